@@ -0,0 +1,134 @@
+#ifndef CHESS_BITBOARD_HPP
+#define CHESS_BITBOARD_HPP
+#include <stdint.h>
+
+#include "chess.h"
+
+/// @brief Piece placement as bitboards, one bit per square index, with a
+/// legal move generator. Squares use the same indices as chess.h.
+class chess_bitboard {
+   public:
+    /// @brief The number of piece types
+    static constexpr const int type_count = 6;
+    /// @brief Piece type indices into pieces[], in value order
+    enum type_index : uint8_t {
+        pawn = 0,
+        knight = 1,
+        bishop = 2,
+        rook = 3,
+        queen = 4,
+        king = 5
+    };
+    /// @brief The corner squares the rooks start on. Castling rights use one bit per corner, in this order.
+    static constexpr const int castling_corners[4] = {0, 7, 56, 63};
+    /// @brief The pieces of each team by type, indexed by [CHESS_TEAM(id) & 1][type_index]
+    uint64_t pieces[2][type_count];
+    /// @brief All the pieces of each team
+    uint64_t teams[2];
+    /// @brief Every occupied square
+    uint64_t occupied;
+    /// @brief The chess.h piece id on each square, or -1
+    chess_value_t squares[64];
+
+    /// @brief Builds the attack tables. Called once before any other use.
+    static void initialize();
+    /// @brief Converts a chess.h piece type to a type index
+    /// @param type The CHESS_TYPE() value
+    /// @return The index
+    static type_index index_of(int type);
+    /// @brief Converts a type index to a chess.h piece type
+    /// @param index The index
+    /// @return The CHESS_TYPE() value
+    static int type_of(type_index index);
+    /// @brief Indicates the squares a knight attacks
+    static uint64_t knight_attacks(int square);
+    /// @brief Indicates the squares a king attacks
+    static uint64_t king_attacks(int square);
+    /// @brief Indicates the squares a pawn of the given team attacks
+    static uint64_t pawn_attacks(int team, int square);
+    /// @brief Indicates the squares a bishop attacks given the occupancy
+    static uint64_t bishop_attacks(int square, uint64_t occupancy);
+    /// @brief Indicates the squares a rook attacks given the occupancy
+    static uint64_t rook_attacks(int square, uint64_t occupancy);
+    /// @brief Indicates the square offset of a single pawn push for a team
+    static int pawn_push(int team);
+    /// @brief Indicates the chess.h id of a piece
+    /// @param team The team
+    /// @param type The type index
+    /// @return The id
+    static chess_value_t piece_id(int team, type_index type);
+    /// @brief Indicates the castling rights of the initial position
+    /// @return The rights, one bit per corner
+    static uint8_t initial_castling();
+    /// @brief Indicates the castling rights that survive a move from or to a square
+    /// @param square The square
+    /// @return The rights to keep, one bit per corner
+    static uint8_t castling_keep(int square);
+
+    /// @brief Empties the board
+    void clear();
+    /// @brief Places a piece on an empty square
+    /// @param id The chess.h piece id
+    /// @param square The square
+    void put(chess_value_t id, int square);
+    /// @brief Removes the piece on a square, if any
+    /// @param square The square
+    void remove(int square);
+    /// @brief Loads the placement from a game
+    /// @param game The game
+    void load(const chess_game_t& game);
+    /// @brief Indicates where a team's king is
+    /// @param team The team
+    /// @return The square, or -1 if there is no king
+    int king_square(int team) const;
+    /// @brief Indicates whether a square is attacked
+    /// @param square The square
+    /// @param by_team The attacking team
+    /// @return True if attacked, otherwise false
+    bool attacked(int square, int by_team) const;
+    /// @brief Finds a team's pieces that attack a square, as though some pieces had moved away
+    /// @param square The square
+    /// @param by_team The attacking team
+    /// @param occupancy The occupied squares sliders are blocked by
+    /// @param removed Squares whose pawns and knights no longer attack
+    /// @return The mask of attacking pieces
+    uint64_t attackers(int square, int by_team, uint64_t occupancy, uint64_t removed) const;
+    /// @brief Indicates whether a team's king is attacked
+    /// @param team The team
+    /// @return True if in check, otherwise false
+    bool in_check(int team) const;
+    /// @brief Computes the legal moves for every piece of a team
+    /// @param team The team to move
+    /// @param castling The castling rights, one bit per corner as in chess_position
+    /// @param en_passant The en passant target square, or -1
+    /// @param out_destinations Receives the destination mask for each origin square. Only entries for returned origins are written.
+    /// @return The mask of origin squares with at least one legal move
+    uint64_t generate(int team, uint8_t castling, chess_value_t en_passant, uint64_t* out_destinations) const;
+    /// @brief Computes the legal moves for a single piece
+    /// @param square The origin square
+    /// @param castling The castling rights, one bit per corner as in chess_position
+    /// @param en_passant The en passant target square, or -1
+    /// @return The mask of destination squares
+    uint64_t destinations(int square, uint8_t castling, chess_value_t en_passant) const;
+    /// @brief Makes a legal move on the bitboards alone, for positions chess_game_t can't be set up in
+    /// @param from The origin square
+    /// @param to The destination square
+    /// @param promotion The id a pawn promotes to, or -1 for a queen
+    /// @param castling The castling rights, updated
+    /// @param en_passant The en passant target square, updated
+    void play(int from, int to, chess_value_t promotion, uint8_t* castling, chess_value_t* en_passant);
+
+   private:
+    uint64_t pseudo_destinations(int square, uint8_t castling, chess_value_t en_passant) const;
+    uint64_t legal_filter(int square, uint64_t targets, chess_value_t en_passant) const;
+};
+
+/// @brief Iterates the set bits of a mask, lowest first
+/// @param mask The mask. The lowest set bit is cleared.
+/// @return The index of the bit that was cleared
+static inline int chess_pop_square(uint64_t* mask) {
+    const int result = __builtin_ctzll(*mask);
+    *mask &= *mask - 1;
+    return result;
+}
+#endif // CHESS_BITBOARD_HPP
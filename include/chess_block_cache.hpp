@@ -0,0 +1,130 @@
+#ifndef CHESS_BLOCK_CACHE_HPP
+#define CHESS_BLOCK_CACHE_HPP
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#else
+#include <mutex>
+#endif
+
+/// @brief A least recently used cache of fixed size file blocks, for random
+/// reads from slow storage such as an SD card. The blocks live in PSRAM when
+/// there is some. Files are identified by number and opened on demand through
+/// a callback, with only a few kept open at once. Safe to use from several tasks.
+class chess_block_cache {
+   public:
+    /// @brief The most files kept open at once
+    static constexpr const size_t max_open = 4;
+    /// @brief Opens a file for reading
+    typedef FILE* (*open_callback)(uint32_t file, void* state);
+    /// @brief Called before each read from storage, with the cache locked.
+    /// It may block, to let other users of the bus go first.
+    typedef void (*gate_callback)(void* state);
+
+   private:
+    struct open_file {
+        uint32_t file;
+        FILE* handle;
+        uint32_t last_use;
+    };
+    uint8_t* blocks;
+    // per block: the file and block number it holds, its hash chain and its
+    // place in the recency list
+    uint32_t* block_files;
+    uint32_t* block_numbers;
+    int32_t* chains;
+    int32_t* newer;
+    int32_t* older;
+    int32_t* buckets;
+    size_t bucket_mask;
+    int32_t newest;
+    int32_t oldest;
+    size_t block_size;
+    size_t block_count;
+    open_file files[max_open];
+    uint32_t use_counter;
+    open_callback opener;
+    void* opener_state;
+    gate_callback gate;
+    void* gate_state;
+    uint32_t hit_count;
+    uint32_t miss_count;
+    uint64_t read_us;
+#ifdef ESP_PLATFORM
+    SemaphoreHandle_t lock;
+#else
+    std::mutex lock;
+#endif
+    void acquire();
+    void release();
+    size_t bucket_of(uint32_t file, uint32_t block) const;
+    void touch(int32_t slot);
+    void reset_blocks();
+    FILE* handle(uint32_t file);
+    const uint8_t* fetch(uint32_t file, uint32_t block);
+    chess_block_cache(const chess_block_cache& rhs) = delete;
+    chess_block_cache& operator=(const chess_block_cache& rhs) = delete;
+
+   public:
+    chess_block_cache();
+    ~chess_block_cache();
+    /// @brief Allocates the blocks, dropping any cached data
+    /// @param block_size The block size in bytes, a multiple of the storage sector size
+    /// @param block_count The number of blocks
+    /// @return True if successful, otherwise false
+    bool allocate(size_t block_size, size_t block_count);
+    /// @brief Frees the blocks and closes the files
+    void deallocate();
+    /// @brief Sets how files are opened. Call before reading.
+    /// @param callback The function
+    /// @param state User defined state passed to the callback
+    void on_open_callback(open_callback callback, void* state = nullptr) {
+        opener = callback;
+        opener_state = state;
+    }
+    /// @brief Sets a function to call before each read from storage
+    /// @param callback The function, or nullptr for none
+    /// @param state User defined state passed to the callback
+    void on_gate_callback(gate_callback callback, void* state = nullptr) {
+        gate = callback;
+        gate_state = state;
+    }
+    /// @brief Reads bytes from a file through the cache
+    /// @param file The file number
+    /// @param offset The offset in bytes
+    /// @param out_data Receives the bytes. Any past the end of the file are zero.
+    /// @param size The number of bytes
+    /// @return True if successful, false if the file can't be read
+    bool read(uint32_t file, uint64_t offset, void* out_data, size_t size);
+    /// @brief Closes the open files. Cached blocks are kept.
+    void close_files();
+    /// @brief Forgets the cached blocks and closes the files, for when the
+    /// file numbers are about to mean different files
+    void clear();
+    /// @brief Indicates whether blocks are allocated
+    /// @return True if allocated, otherwise false
+    bool allocated() const {
+        return blocks != nullptr;
+    }
+    /// @brief Indicates the number of reads served from memory
+    /// @return The count
+    uint32_t hits() const {
+        return hit_count;
+    }
+    /// @brief Indicates the number of blocks read from storage
+    /// @return The count
+    uint32_t misses() const {
+        return miss_count;
+    }
+    /// @brief Indicates the total time spent reading from storage, including the gate
+    /// @return The time in microseconds
+    uint64_t storage_us() const {
+        return read_us;
+    }
+    /// @brief Zeroes the statistics
+    void reset_statistics();
+};
+#endif // CHESS_BLOCK_CACHE_HPP
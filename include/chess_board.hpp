@@ -0,0 +1,687 @@
+#ifndef CHESS_BOARD_HPP
+#define CHESS_BOARD_HPP
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gfx.hpp>  // graphics library
+#include <uix.hpp>  // user interface library
+
+#include "assets/cb24.hpp"
+#include "chess.h"
+#include "chess_position.hpp"
+#include "timing.hpp"
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#endif
+
+/// @brief A touch driven chess board control
+/// @tparam ControlSurfaceType The control surface type, usually the screen's control_surface_type
+/// @tparam Extent The board's side in pixels, fixing the square geometry at compile time.
+/// The control's bounds must be at least this big. 0 measures the control instead, on each use.
+template <typename ControlSurfaceType, int16_t Extent = 0>
+class chess_board : public uix::control<ControlSurfaceType> {
+    static_assert(Extent == 0 || Extent >= 8, "Extent must be 0 or at least 8 pixels");
+    using base_type = uix::control<ControlSurfaceType>;
+    using color_t = gfx::color<typename ControlSurfaceType::pixel_type>;
+   public:
+    /// @brief The most earlier positions remembered for repetition detection
+    static constexpr const size_t max_history = chess_history::capacity;
+
+   private:
+    chess_position position;
+    // the keys of the positions since the last capture or pawn move
+    chess_history history;
+    // the moves made, for taking back and replaying
+    chess_line line;
+    // the history before the first move in line
+    chess_history base;
+    // what the position allows, computed once per move rather than per paint or touch
+    uint64_t legal[64];
+    uint64_t legal_origins;
+    chess_status_t game_status;
+    // the king in check, or -1
+    chess_value_t checked_king;
+    // the piece sliding to its square after a move, or -1
+    chess_value_t anim_id;
+    // the piece it captured, shown on the destination until it lands, or -1
+    chess_value_t anim_captured;
+    chess_value_t anim_from;
+    chess_value_t anim_to;
+    uint32_t anim_start_ms;
+    uint32_t anim_ms;
+    // where the sliding piece was last drawn
+    gfx::srect16 anim_rect;
+    // the square size the geometry below was built for
+    int16_t square_extent;
+    // a coordinate times this, shifted down 16, is its rank or file. runtime sizes only:
+    // with a fixed size the compiler turns the divide by a constant into the same thing
+    uint32_t square_reciprocal;
+    // each square's rectangle, by index
+    gfx::srect16 square_rects[64];
+    void (*move_callback)(chess_value_t from, chess_value_t to, void* state);
+    void* move_callback_state;
+    // the legal destinations of the touched piece, one bit per square
+    uint64_t move_mask;
+    chess_value_t touched;
+    gfx::spoint16 last_touch;
+    chess_value_t computer;
+    bool use_sprites;
+
+    int move_count;
+    void init_board() {
+        position.init();
+        history.clear();
+        line.clear();
+        base.clear();
+        update_status();
+        move_callback = nullptr;
+        move_callback_state = nullptr;
+        move_mask = 0;
+        touched = -1;
+        computer = -1;
+        use_sprites = true;
+        anim_id = -1;
+        anim_ms = 0;
+        square_extent = 0;
+        geometry();
+    }
+    // the pieces pre-rendered over each square background, so repaints
+    // copy pixels instead of alpha blending them. shared by every board
+    using sprite_type = gfx::bitmap<typename ControlSurfaceType::pixel_type>;
+    // dark square, light square, highlighted square
+    static constexpr const int sprite_backgrounds = 3;
+    struct sprite_cache {
+        uint8_t* buffer;
+        gfx::size16 dimensions;
+        size_t sprite_size;
+        bool attempted;
+    };
+    static sprite_cache& sprites() {
+        static sprite_cache result = {nullptr, gfx::size16(0, 0), 0, false};
+        return result;
+    }
+    static typename ControlSurfaceType::pixel_type square_background(int background) {
+        switch (background) {
+            case 0:
+                return color_t::dark_khaki;
+            case 1:
+                return color_t::brown;
+            default:
+                return color_t::light_blue;
+        }
+    }
+    static sprite_type sprite_at(chess_value_t id, int background) {
+        sprite_cache& cache = sprites();
+        const size_t index = (background * 2 + (CHESS_TEAM(id) & 1)) * chess_bitboard::type_count + chess_bitboard::index_of(CHESS_TYPE(id));
+        return sprite_type(cache.dimensions, cache.buffer + index * cache.sprite_size);
+    }
+    static bool build_sprites() {
+        sprite_cache& cache = sprites();
+        if (cache.attempted) {
+            return cache.buffer != nullptr;
+        }
+        cache.attempted = true;
+        uint16_t width = 0, height = 0;
+        for (int type = 0; type < chess_bitboard::type_count; ++type) {
+            const auto& ico = chess_icon(chess_bitboard::piece_id(0, (chess_bitboard::type_index)type));
+            if (ico.dimensions().width > width) width = ico.dimensions().width;
+            if (ico.dimensions().height > height) height = ico.dimensions().height;
+        }
+        cache.dimensions = gfx::size16(width, height);
+        cache.sprite_size = sprite_type::sizeof_buffer(cache.dimensions);
+        const size_t size = cache.sprite_size * sprite_backgrounds * 2 * chess_bitboard::type_count;
+#ifdef ESP_PLATFORM
+        // the sprites are copied by the CPU, not by DMA, so PSRAM will do
+        cache.buffer = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+        if (cache.buffer == nullptr) {
+            cache.buffer = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_8BIT);
+        }
+#else
+        cache.buffer = (uint8_t*)malloc(size);
+#endif
+        if (cache.buffer == nullptr) {
+            // fall back to blending on every paint
+            return false;
+        }
+        for (int background = 0; background < sprite_backgrounds; ++background) {
+            for (int team = 0; team < 2; ++team) {
+                for (int type = 0; type < chess_bitboard::type_count; ++type) {
+                    const chess_value_t id = chess_bitboard::piece_id(team, (chess_bitboard::type_index)type);
+                    sprite_type sprite = sprite_at(id, background);
+                    gfx::draw::filled_rectangle(sprite, sprite.bounds(), square_background(background));
+                    const auto& ico = chess_icon(id);
+                    const gfx::srect16 bounds = ((gfx::srect16)ico.bounds()).center((gfx::srect16)sprite.bounds());
+                    gfx::draw::icon(sprite, bounds.location(), ico, piece_color(id));
+                }
+            }
+        }
+        return true;
+    }
+    static typename ControlSurfaceType::pixel_type piece_color(chess_value_t id) {
+        return CHESS_TEAM(id) ? color_t::white : color_t::black;
+    }
+
+    static constexpr const int16_t fixed_square = Extent / 8;
+    // the square size, building the square table if it changed
+    int16_t geometry() {
+        int16_t square = fixed_square;
+        if (square == 0) {
+            const int16_t extent = this->dimensions().aspect_ratio() >= 1 ? this->dimensions().height : this->dimensions().width;
+            square = extent / 8;
+        }
+        if (square != square_extent) {
+            square_extent = square;
+            // matches the division for every non-negative coordinate up to 103 pixel
+            // squares (checked exhaustively), and 104 is the first it misses. bigger ones divide
+            square_reciprocal = square > 0 && square <= 103 ? (65536 + square - 1) / square : 0;
+            for (int i = 0; i < 64; ++i) {
+                square_rects[i] = gfx::srect16(gfx::spoint16((i & 7) * square, (i >> 3) * square), gfx::ssize16(square, square));
+            }
+        }
+        return square;
+    }
+    // the rank or file a coordinate falls in, or -1 if off the board
+    int square_span(int coordinate, int16_t square) const {
+        int result;
+        if (fixed_square > 0) {
+            result = coordinate / fixed_square;
+        } else if (square_reciprocal == 0) {
+            result = square > 0 ? coordinate / square : -1;
+        } else {
+            result = (int)(((uint32_t)coordinate * square_reciprocal) >> 16);
+        }
+        return coordinate >= 0 && result < 8 ? result : -1;
+    }
+    int point_to_square(gfx::spoint16 point) {
+        const int16_t square = geometry();
+        const int x = square_span(point.x, square), y = square_span(point.y, square);
+        return x < 0 || y < 0 ? -1 : y * 8 + x;
+    }
+    void invalidate_square(int index) {
+        gfx::srect16 bounds;
+        square_coords(index, &bounds);
+        this->invalidate(bounds);
+    }
+    // the squares a move changes, made or taken back
+    void invalidate_move(const chess_undo& undo) {
+        invalidate_square(undo.from);
+        invalidate_square(undo.to);
+        const chess_value_t id = position.bitboards().squares[position.bitboards().squares[(int)undo.to] > -1 ? undo.to : undo.from];
+        if (id < 0) {
+            return;
+        }
+        const int type = CHESS_TYPE(id);
+        if (type == CHESS_PAWN && undo.captured > -1 && undo.to == undo.en_passant) {
+            invalidate_square(undo.to - chess_bitboard::pawn_push(CHESS_TEAM(id) & 1));
+        } else if (type == CHESS_KING && (undo.to - undo.from == 2 || undo.from - undo.to == 2)) {
+            // the rook's corner and the square it jumps to
+            invalidate_square(undo.to > undo.from ? (undo.from & 56) + 7 : (undo.from & 56));
+            invalidate_square((undo.from + undo.to) / 2);
+        }
+    }
+    // where the sliding piece is drawn, a fraction of 256 of the way
+    gfx::srect16 anim_bounds(int progress) {
+        gfx::srect16 from, to;
+        square_coords(anim_from, &from);
+        square_coords(anim_to, &to);
+        const int x = from.x1 + (to.x1 - from.x1) * progress / 256;
+        const int y = from.y1 + (to.y1 - from.y1) * progress / 256;
+        return ((gfx::srect16)chess_icon(anim_id).bounds()).center(from).offset(x - from.x1, y - from.y1);
+    }
+    void start_animation(const chess_undo& undo) {
+        stop_animation();
+        if (anim_ms == 0) {
+            return;
+        }
+        anim_id = position.bitboards().squares[(int)undo.to];
+        // an en passant capture leaves the destination empty already
+        anim_captured = CHESS_TYPE(anim_id) == CHESS_PAWN && undo.to == undo.en_passant ? -1 : undo.captured;
+        anim_from = undo.from;
+        anim_to = undo.to;
+        anim_start_ms = timing_ms();
+        anim_rect = anim_bounds(0);
+    }
+    void stop_animation() {
+        if (anim_id > -1) {
+            this->invalidate(anim_rect);
+            invalidate_square(anim_to);
+            anim_id = -1;
+        }
+    }
+    // the king squares outlined for check, before and after a move
+    void invalidate_kings(chess_value_t old_king) {
+        if (old_king > -1) {
+            invalidate_square(old_king);
+        }
+        if (checked_king > -1 && checked_king != old_king) {
+            invalidate_square(checked_king);
+        }
+    }
+    // caches the legal moves and the status of the side to move
+    void update_status() {
+        legal_origins = position.legal_moves(legal);
+        const bool check = position.in_check();
+        checked_king = check ? (chess_value_t)position.bitboards().king_square(position.turn() & 1) : -1;
+        if (legal_origins) {
+            game_status = check ? CHESS_CHECK : CHESS_NORMAL;
+        } else {
+            game_status = check ? CHESS_CHECKMATE : CHESS_STALEMATE;
+        }
+    }
+    // the destinations a piece may move to. zero unless it belongs to the side to move
+    uint64_t legal_destinations(int square) const {
+        return ((legal_origins >> square) & 1) ? legal[square] : 0;
+    }
+    // forgets the touched piece and its highlighted destinations
+    void drop_touch() {
+        if (touched > -1) {
+            invalidate_square(touched);
+        }
+        while (move_mask) {
+            invalidate_square(chess_pop_square(&move_mask));
+        }
+        touched = -1;
+    }
+    // the keys since the last capture or pawn move, after moving through the line
+    void rebuild_history() {
+        const size_t reversible = position.halfmove_clock();
+        const size_t from_line = reversible < line.ply ? reversible : line.ply;
+        history.clear();
+        if (reversible > line.ply) {
+            const size_t from_base = reversible - line.ply < base.size ? reversible - line.ply : base.size;
+            for (size_t i = base.size - from_base; i < base.size; ++i) {
+                history.append(base.keys[i]);
+            }
+        }
+        for (size_t i = line.ply - from_line; i < line.ply; ++i) {
+            history.append(line.keys[i]);
+        }
+    }
+    void square_coords(int index, gfx::srect16* out_rect) {
+        if (fixed_square == 0) {
+            geometry();
+        }
+        *out_rect = square_rects[index];
+    }
+    static const gfx::const_bitmap<gfx::alpha_pixel<4>>& chess_icon(int id) {
+        const int type = CHESS_TYPE(id);
+        switch (type) {
+            case CHESS_PAWN:
+                return cb24_chess_pawn;
+            case CHESS_KNIGHT:
+                return cb24_chess_knight;
+            case CHESS_BISHOP:
+                return cb24_chess_bishop;
+            case CHESS_ROOK:
+                return cb24_chess_rook;
+            case CHESS_QUEEN:
+                return cb24_chess_queen;
+            case CHESS_KING:
+                return cb24_chess_king;
+        }
+        assert(false);  // invalid piece
+        return cb24_chess_pawn;
+    }
+
+   public:
+    using control_surface_type = ControlSurfaceType;
+    using pixel_type = typename ControlSurfaceType::pixel_type;
+    using palette_type = typename ControlSurfaceType::palette_type;
+    /// @brief Moves a chess_board control
+    /// @param rhs The control to move
+    chess_board(chess_board&& rhs) {
+        do_move_control(rhs);
+    }
+    /// @brief Moves a chess_board control
+    /// @param rhs The control to move
+    /// @return this
+    chess_board& operator=(chess_board&& rhs) {
+        do_move_control(rhs);
+        return *this;
+    }
+    /// @brief Copies a chess_board control
+    /// @param rhs The control to copy
+    chess_board(const chess_board& rhs) {
+        do_copy_control(rhs);
+    }
+    /// @brief Copies a chess_board control
+    /// @param rhs The control to copy
+    /// @return this
+    chess_board& operator=(const chess_board& rhs) {
+        do_copy_control(rhs);
+        return *this;
+    }
+    /// @brief Constructs a chess_board from a given parent with an optional palette
+    /// @param parent The parent the control is bound to - usually the screen
+    /// @param palette The palette associated with the control. This is usually the screen's palette.
+    chess_board(uix::invalidation_tracker& parent, const palette_type* palette = nullptr) : base_type(parent, palette) {
+        init_board();
+    }
+    /// @brief Constructs a chess_board from a given parent with an optional palette
+    chess_board() : base_type() {
+        init_board();
+    }
+    /// @brief Indicates the hashed position
+    /// @return The current position
+    const chess_position& current_position() const {
+        return position;
+    }
+    /// @brief Indicates whether the side to move is in check, checkmated or stalemated
+    /// @return The status, cached when the position changes
+    chess_status_t status() const {
+        return game_status;
+    }
+    /// @brief Indicates whether the game is over
+    /// @return True after checkmate or stalemate, otherwise false
+    bool game_over() const {
+        return legal_origins == 0;
+    }
+    /// @brief Indicates the keys of the earlier positions that can still repeat, oldest first
+    /// @return The keys
+    const uint64_t* position_history() const {
+        return history.keys;
+    }
+    /// @brief Indicates the number of keys in position_history()
+    /// @return The count
+    size_t position_history_size() const {
+        return history.size;
+    }
+    /// @brief Indicates the earlier positions that can still repeat
+    /// @return The history
+    const chess_history& game_history() const {
+        return history;
+    }
+    /// @brief Replaces the game, as when resuming a saved one
+    /// @param position The position to continue from
+    /// @param history The earlier positions that can still repeat
+    void restore(const chess_position& position, const chess_history& history) {
+        this->position = position;
+        this->history = history;
+        base = history;
+        line.clear();
+        anim_id = -1;
+        update_status();
+        move_mask = 0;
+        touched = -1;
+        this->invalidate();
+    }
+    /// @brief Sets a function to call after each move, from touch or make_move()
+    /// @param callback The function, or nullptr for none
+    /// @param state User defined state passed to the callback
+    void on_move_callback(void (*callback)(chess_value_t from, chess_value_t to, void* state), void* state = nullptr) {
+        move_callback = callback;
+        move_callback_state = state;
+    }
+    /// @brief Indicates which team the computer plays
+    /// @return The team, or -1 if both teams are played from the touch screen
+    chess_value_t computer_team() const {
+        return computer;
+    }
+    /// @brief Sets which team the computer plays. Touches are ignored on its turn.
+    /// @param value The team, or -1 if both teams are played from the touch screen
+    void computer_team(chess_value_t value) {
+        computer = value;
+    }
+    /// @brief Indicates whether pieces are drawn from pre-rendered sprites
+    /// @return True if sprites are used, false if the icons are blended on every paint
+    bool sprites_enabled() const {
+        return use_sprites;
+    }
+    /// @brief Sets whether pieces are drawn from pre-rendered sprites
+    /// @param value True to use sprites, false to blend the icons on every paint
+    void sprites_enabled(bool value) {
+        use_sprites = value;
+        this->invalidate();
+    }
+    /// @brief Makes a move on the board as though it were dragged
+    /// @param from The origin square
+    /// @param to The destination square
+    /// @return True if the move was legal, otherwise false
+    bool make_move(chess_value_t from, chess_value_t to) {
+        if (from < 0 || from > 63 || to < 0 || to > 63 || !((legal_destinations(from) >> to) & 1)) {
+            return false;
+        }
+        const uint64_t key = position.key();
+        if (line.ply == chess_line::capacity) {
+            // the oldest move is about to be dropped, so its position joins the base history
+            base.push(line.keys[0], line.moves[1].halfmove);
+        }
+        chess_undo undo;
+        const chess_value_t old_king = checked_king;
+        position.make(from, to, &undo);
+        update_status();
+        line.push(undo, key);
+        history.push(key, position.halfmove_clock());
+        start_animation(undo);
+        char buf[3];
+        chess_index_name(from,buf);
+        fputs("move: ",stdout);
+        fputs(buf,stdout);
+        fputs(" to ",stdout);
+        chess_index_name(to,buf);
+        puts(buf);
+        invalidate_move(undo);
+        invalidate_kings(old_king);
+        if (move_callback != nullptr) {
+            move_callback(from, to, move_callback_state);
+        }
+        return true;
+    }
+    /// @brief Indicates the number of moves made since the game started or was restored
+    /// @return The count
+    size_t ply() const {
+        return line.ply;
+    }
+    /// @brief Indicates the number of moves that can be replayed with redo()
+    /// @return The count
+    size_t redo_count() const {
+        return line.size - line.ply;
+    }
+    /// @brief Takes back the last move. The move callback is not called.
+    /// @return True if a move was taken back, false if there are none
+    bool undo() {
+        if (line.ply == 0) {
+            return false;
+        }
+        const chess_undo& last = line.moves[--line.ply];
+        drop_touch();
+        stop_animation();
+        const chess_value_t old_king = checked_king;
+        position.unmake(last);
+        update_status();
+        rebuild_history();
+        invalidate_move(last);
+        invalidate_kings(old_king);
+        return true;
+    }
+    /// @brief Replays the last move taken back. The move callback is not called.
+    /// @return True if a move was replayed, false if there are none
+    bool redo() {
+        if (line.ply == line.size) {
+            return false;
+        }
+        chess_undo& next = line.moves[line.ply++];
+        drop_touch();
+        stop_animation();
+        const chess_value_t old_king = checked_king;
+        position.make(next.from, next.to, &next);
+        update_status();
+        history.push(line.keys[line.ply - 1], position.halfmove_clock());
+        invalidate_move(next);
+        invalidate_kings(old_king);
+        return true;
+    }
+    /// @brief Sets how long a moved piece takes to slide to its square
+    /// @param value The duration in milliseconds, or 0 to move pieces instantly
+    void animation_ms(uint32_t value) {
+        anim_ms = value;
+    }
+    /// @brief Indicates how long a moved piece takes to slide to its square
+    /// @return The duration in milliseconds, or 0 if pieces move instantly
+    uint32_t animation_ms() const {
+        return anim_ms;
+    }
+    /// @brief Indicates whether a piece is sliding to its square
+    /// @return True if animate() has more frames to draw, otherwise false
+    bool animating() const {
+        return anim_id > -1;
+    }
+    /// @brief Advances the moving piece to where it should be by now, invalidating only
+    /// the rectangles it leaves and enters. Call once per frame while animating() is true.
+    /// @return True if the piece is still moving, false once it has landed
+    bool animate() {
+        if (anim_id < 0) {
+            return false;
+        }
+        const uint32_t elapsed = timing_ms() - anim_start_ms;
+        if (elapsed >= anim_ms) {
+            stop_animation();
+            return false;
+        }
+        // eases out: fast off the square, slowing as it lands
+        const int remaining = 256 - (int)(elapsed * 256 / anim_ms);
+        const gfx::srect16 bounds = anim_bounds(256 - remaining * remaining / 256);
+        if (bounds.x1 != anim_rect.x1 || bounds.y1 != anim_rect.y1) {
+            this->invalidate(anim_rect);
+            this->invalidate(bounds);
+            anim_rect = bounds;
+        }
+        return true;
+    }
+
+   protected:
+    void do_move_control(chess_board& rhs) {
+        do_copy_control(rhs);
+    }
+    void do_copy_control(chess_board& rhs) {
+        position = rhs.position;
+        history = rhs.history;
+        line = rhs.line;
+        base = rhs.base;
+        memcpy(legal, rhs.legal, sizeof(legal));
+        legal_origins = rhs.legal_origins;
+        game_status = rhs.game_status;
+        checked_king = rhs.checked_king;
+        anim_id = rhs.anim_id;
+        anim_captured = rhs.anim_captured;
+        anim_from = rhs.anim_from;
+        anim_to = rhs.anim_to;
+        anim_start_ms = rhs.anim_start_ms;
+        anim_ms = rhs.anim_ms;
+        anim_rect = rhs.anim_rect;
+        square_extent = rhs.square_extent;
+        square_reciprocal = rhs.square_reciprocal;
+        memcpy(square_rects, rhs.square_rects, sizeof(square_rects));
+        move_callback = rhs.move_callback;
+        move_callback_state = rhs.move_callback_state;
+        move_mask = rhs.move_mask;
+        touched = rhs.touched;
+        move_count = rhs.move_count;
+        last_touch = rhs.last_touch;
+        computer = rhs.computer;
+        use_sprites = rhs.use_sprites;
+    }
+    void on_paint(control_surface_type& destination, const gfx::srect16& clip) override {
+        const int16_t square = geometry();
+        if (square == 0) {
+            return;
+        }
+        // only the squares the clip covers
+        const int last = square * 8 - 1;
+        const int x1 = square_span(clip.x1 < 0 ? 0 : clip.x1, square), y1 = square_span(clip.y1 < 0 ? 0 : clip.y1, square);
+        const int x2 = square_span(clip.x2 > last ? last : clip.x2, square), y2 = square_span(clip.y2 > last ? last : clip.y2, square);
+        for (int y = y1; y > -1 && y <= y2; ++y) {
+            for (int x = x1; x > -1 && x <= x2; ++x) {
+                const int idx = y * 8 + x;
+                const gfx::srect16& rect = square_rects[idx];
+                // the moving piece isn't on its square until it lands
+                const chess_value_t id = anim_id > -1 && idx == anim_to ? anim_captured : position.bitboards().squares[idx];
+                int background = (x + y) & 1;
+                pixel_type px_bd = background ? color_t::gold : color_t::black;
+                if (idx == checked_king) {
+                    px_bd = color_t::red;
+                }
+                if (touched == idx || ((move_mask >> idx) & 1)) {
+                    background = 2;
+                    px_bd = color_t::cornflower_blue;
+                }
+                gfx::draw::filled_rectangle(destination, rect, square_background(background));
+                gfx::draw::rectangle(destination, rect.inflate(-2, -2), px_bd);
+                if (CHESS_NONE != id) {
+                    if (use_sprites && build_sprites()) {
+                        // a plain copy: the piece was blended over this background up front
+                        sprite_type sprite = sprite_at(id, background);
+                        const gfx::srect16 bounds = ((gfx::srect16)sprite.bounds()).center(rect);
+                        gfx::draw::bitmap(destination, bounds, sprite, sprite.bounds());
+                    } else {
+                        auto ico = chess_icon(id);
+                        const gfx::srect16 bounds = ((gfx::srect16)ico.bounds()).center(rect);
+                        gfx::draw::icon(destination, bounds.location(), ico, piece_color(id));
+                    }
+                }
+            }
+        }
+        if (anim_id > -1 && anim_rect.intersects(clip)) {
+            // blended, since it straddles squares of either color
+            gfx::draw::icon(destination, anim_rect.location(), chess_icon(anim_id), piece_color(anim_id));
+        }
+    }
+    bool on_touch(size_t locations_size, const gfx::spoint16* locations) {
+        if (touched > -1) {
+            if (locations_size) last_touch = locations[0];
+            return true;
+        }
+        if (position.turn() == computer) {
+            // wait for the computer to move
+            return false;
+        }
+        if (locations_size) {
+            int sq = point_to_square(*locations);
+            if (sq > -1) {
+                const chess_value_t id = position.bitboards().squares[sq];
+                if (id > -1) {
+                    const chess_value_t team = CHESS_TEAM(id);
+                    if (position.turn() == team) {
+                        touched = sq;
+                        move_mask = legal_destinations(sq);
+                        gfx::srect16 sq_bnds;
+                        square_coords(sq, &sq_bnds);
+                        this->invalidate(sq_bnds);
+                    }
+                }
+                if (move_mask) {
+                    uint64_t mask = move_mask;
+                    while (mask) {
+                        gfx::srect16 sq_bnds;
+                        square_coords(chess_pop_square(&mask), &sq_bnds);
+                        this->invalidate(sq_bnds);
+                    }
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+    void on_release() override {
+        if (touched > -1) {
+            invalidate_square(touched);
+            if (move_mask) {
+                uint64_t mask = move_mask;
+                while (mask) {
+                    gfx::srect16 sq_bnds;
+                    square_coords(chess_pop_square(&mask), &sq_bnds);
+                    this->invalidate(sq_bnds);
+                }
+                const int release_idx = point_to_square(last_touch);
+                if (release_idx != -1 && ((move_mask >> release_idx) & 1)) {
+                    make_move(touched, release_idx);
+                }
+                move_mask = 0;
+            }
+        }
+        touched = -1;
+    }
+};
+#endif // CHESS_BOARD_HPP
@@ -0,0 +1,85 @@
+#ifndef CHESS_BOOK_HPP
+#define CHESS_BOOK_HPP
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chess.h"
+#include "chess_position.hpp"
+#ifdef ESP_PLATFORM
+#include "esp_partition.h"
+#endif
+
+/// @brief A book move and how often it should be played
+struct chess_book_move {
+    chess_value_t from;
+    chess_value_t to;
+    uint16_t weight;
+};
+
+/// @brief An opening book in the Polyglot format: 16 byte big endian entries
+/// of key, move, weight and learn data, sorted by key. Lookups binary search
+/// the entries where they lie, which on the ESP32 is the flash partition
+/// mapped into the address space, so nothing is copied into RAM.
+class chess_book {
+    const uint8_t* entries;
+    size_t count;
+#ifdef ESP_PLATFORM
+    esp_partition_mmap_handle_t map;
+    bool mapped;
+#else
+    void* file_data;
+    size_t file_size;
+#endif
+    size_t lower_bound(uint64_t key) const;
+    chess_book(const chess_book& rhs) = delete;
+    chess_book& operator=(const chess_book& rhs) = delete;
+
+   public:
+    /// @brief The size of an entry in bytes
+    static constexpr const size_t entry_size = 16;
+    /// @brief The most moves a position can have in the book
+    static constexpr const size_t max_moves = 32;
+    chess_book();
+    ~chess_book();
+    /// @brief Computes a position's book key: Polyglot's layout of piece,
+    /// castling, en passant and side to move keys
+    /// @param position The position
+    /// @return The key
+    static uint64_t key(const chess_position& position);
+    /// @brief Encodes a move the way the book stores it
+    /// @param position The position before the move
+    /// @param from The origin square
+    /// @param to The destination square
+    /// @return The encoded move
+    static uint16_t encode_move(const chess_position& position, chess_value_t from, chess_value_t to);
+    /// @brief Uses entries already in memory. The data must outlive the book.
+    /// @param data The entries
+    /// @param size The size in bytes. Trailing erased flash (all 0xFF) is ignored.
+    /// @return True if successful, otherwise false
+    bool attach(const void* data, size_t size);
+    /// @brief Maps a book into memory
+    /// @param name On the ESP32, the data partition label. Otherwise, the file path.
+    /// @return True if successful, otherwise false
+    bool open(const char* name);
+    /// @brief Unmaps the book
+    void close();
+    /// @brief Indicates the number of entries
+    /// @return The count
+    size_t size() const {
+        return count;
+    }
+    /// @brief Finds the book moves for a position
+    /// @param position The position
+    /// @param out_moves Receives the moves, highest weight first
+    /// @param max The size of out_moves
+    /// @return The number of moves found
+    size_t probe(const chess_position& position, chess_book_move* out_moves, size_t max) const;
+    /// @brief Chooses a book move at random, in proportion to the weights
+    /// @param position The position
+    /// @param random A random number
+    /// @param out_from Receives the origin square
+    /// @param out_to Receives the destination square
+    /// @return True if the position is in the book, otherwise false
+    bool pick(const chess_position& position, uint32_t random, chess_value_t* out_from, chess_value_t* out_to) const;
+};
+#endif // CHESS_BOOK_HPP
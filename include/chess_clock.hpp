@@ -0,0 +1,88 @@
+#ifndef CHESS_CLOCK_HPP
+#define CHESS_CLOCK_HPP
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief A chess clock for two teams. The time is worked out from timestamps
+/// rather than counted in ticks, so however irregularly it's read it never drifts.
+class chess_clock {
+   public:
+    /// @brief What the bonus time does
+    enum bonus_type : uint8_t {
+        /// @brief Added to the mover's time after each move (Fischer)
+        bonus_increment = 0,
+        /// @brief Spent before the mover's time starts counting down each move (delay)
+        bonus_delay = 1
+    };
+
+   private:
+    uint64_t remaining_us[2];
+    uint64_t bonus_us;
+    bonus_type bonus_mode;
+    // when the running team's turn started
+    uint64_t turn_start_us;
+    int running_team;
+    bool flags[2];
+    // the running team's time, and how much of the delay is left, at a moment
+    uint64_t running_remaining_us(uint64_t now_us, uint64_t* out_delay_left_us) const;
+
+   public:
+    /// @brief Constructs a stopped clock with no time
+    chess_clock();
+    /// @brief Sets both teams' time and stops the clock
+    /// @param initial_ms The time each team starts with
+    /// @param bonus_ms The bonus time per move
+    /// @param mode What the bonus does
+    void reset(uint32_t initial_ms, uint32_t bonus_ms, bonus_type mode);
+    /// @brief Starts or switches the clock to a team, ending the running team's turn
+    /// @param team The team to run the clock for
+    /// @param now_us The time now, in microseconds
+    /// @param moved True if the running team made a move, earning any increment,
+    /// false if its turn ended otherwise, such as by a move taken back
+    void press(int team, uint64_t now_us, bool moved = true);
+    /// @brief Stops the clock, charging the running team for its turn so far
+    /// @param now_us The time now, in microseconds
+    void stop(uint64_t now_us);
+    /// @brief Indicates the team the clock is running for
+    /// @return The team, or -1 if stopped
+    int running() const {
+        return running_team;
+    }
+    /// @brief Indicates a team's time left
+    /// @param team The team
+    /// @param now_us The time now, in microseconds
+    /// @return The time left in milliseconds
+    uint32_t remaining_ms(int team, uint64_t now_us) const;
+    /// @brief Indicates a team's time left as a clock shows it: whole seconds, rounded up,
+    /// so it reads 0 only once the time is gone
+    /// @param team The team
+    /// @param now_us The time now, in microseconds
+    /// @return The time left in seconds
+    uint32_t display_seconds(int team, uint64_t now_us) const;
+    /// @brief Indicates whether a team has run out of time. The clock stops when one does.
+    /// @param team The team
+    /// @return True if flagged, otherwise false
+    bool flagged(int team) const {
+        return flags[team & 1];
+    }
+    /// @brief Checks the running team's time, flagging it and stopping the clock if it's gone
+    /// @param now_us The time now, in microseconds
+    /// @return True if a team flagged, otherwise false
+    bool check_flag(uint64_t now_us);
+    /// @brief Indicates how long until what the clock shows next changes
+    /// @param now_us The time now, in microseconds
+    /// @return The time in microseconds, or 0 if the clock is stopped
+    uint64_t next_change_us(uint64_t now_us) const;
+    /// @brief Works out how long a team should spend on its move
+    /// @param team The team
+    /// @param now_us The time now, in microseconds
+    /// @return The budget in milliseconds, or 0 if the clock isn't set
+    uint32_t budget_ms(int team, uint64_t now_us) const;
+    /// @brief Works out how long to spend on a move from the time left
+    /// @param remaining_ms The time left
+    /// @param increment_ms The time gained after the move
+    /// @param moves_to_go The moves until the next time control, or 0 if none
+    /// @return The budget in milliseconds, at least 1
+    static uint32_t move_budget(uint32_t remaining_ms, uint32_t increment_ms, uint32_t moves_to_go = 0);
+};
+#endif // CHESS_CLOCK_HPP
@@ -0,0 +1,136 @@
+#ifndef CHESS_CLOCK_FACE_HPP
+#define CHESS_CLOCK_FACE_HPP
+#include <gfx.hpp>  // graphics library
+#include <uix.hpp>  // user interface library
+
+/// @brief Shows one team's clock as seven segment digits, the minutes over
+/// the seconds, so it fits a 40 pixel strip. Each second only invalidates the
+/// digits that changed; starting, stopping or flagging repaints it all.
+/// @tparam ControlSurfaceType The control surface type, usually the screen's control_surface_type
+template <typename ControlSurfaceType>
+class chess_clock_face : public uix::control<ControlSurfaceType> {
+    using base_type = uix::control<ControlSurfaceType>;
+    using color_t = gfx::color<typename ControlSurfaceType::pixel_type>;
+    static constexpr const int16_t digit_width = 14;
+    static constexpr const int16_t digit_height = 22;
+    static constexpr const int16_t segment = 3;
+    static constexpr const int16_t row_gap = 6;
+    // minutes tens, minutes ones, seconds tens, seconds ones
+    uint8_t digits[4];
+    bool is_running;
+    bool is_flagged;
+    void do_copy_control(const chess_clock_face& rhs) {
+        for (int i = 0; i < 4; ++i) {
+            digits[i] = rhs.digits[i];
+        }
+        is_running = rhs.is_running;
+        is_flagged = rhs.is_flagged;
+    }
+    // where each digit goes, centered in the control
+    gfx::srect16 digit_bounds(int index) const {
+        const gfx::ssize16 size = (gfx::ssize16)this->dimensions();
+        const int16_t left = (size.width - digit_width * 2 - 4) / 2;
+        const int16_t top = (size.height - digit_height * 2 - row_gap) / 2;
+        const int16_t x = left + (index & 1) * (digit_width + 4);
+        const int16_t y = top + (index >> 1) * (digit_height + row_gap);
+        return gfx::srect16(x, y, x + digit_width - 1, y + digit_height - 1);
+    }
+    static void draw_digit(ControlSurfaceType& destination, const gfx::srect16& bounds, uint8_t digit, typename ControlSurfaceType::pixel_type color) {
+        // segments a through g, clockwise from the top then the middle
+        static const uint8_t masks[] = {0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F};
+        const uint8_t mask = masks[digit % 10];
+        const int16_t x1 = bounds.x1, y1 = bounds.y1, x2 = bounds.x2, y2 = bounds.y2;
+        const int16_t middle = y1 + digit_height / 2;
+        const gfx::srect16 segments[] = {
+            gfx::srect16(x1, y1, x2, y1 + segment - 1),
+            gfx::srect16(x2 - segment + 1, y1, x2, middle),
+            gfx::srect16(x2 - segment + 1, middle, x2, y2),
+            gfx::srect16(x1, y2 - segment + 1, x2, y2),
+            gfx::srect16(x1, middle, x1 + segment - 1, y2),
+            gfx::srect16(x1, y1, x1 + segment - 1, middle),
+            gfx::srect16(x1, middle - segment / 2, x2, middle + segment / 2)};
+        for (int i = 0; i < 7; ++i) {
+            if (mask & (1 << i)) {
+                gfx::draw::filled_rectangle(destination, segments[i], color);
+            }
+        }
+    }
+
+   public:
+    using control_surface_type = ControlSurfaceType;
+    using pixel_type = typename ControlSurfaceType::pixel_type;
+    using palette_type = typename ControlSurfaceType::palette_type;
+    /// @brief Moves a chess_clock_face control
+    /// @param rhs The control to move
+    chess_clock_face(chess_clock_face&& rhs) {
+        do_copy_control(rhs);
+    }
+    /// @brief Moves a chess_clock_face control
+    /// @param rhs The control to move
+    /// @return this
+    chess_clock_face& operator=(chess_clock_face&& rhs) {
+        do_copy_control(rhs);
+        return *this;
+    }
+    /// @brief Copies a chess_clock_face control
+    /// @param rhs The control to copy
+    chess_clock_face(const chess_clock_face& rhs) {
+        do_copy_control(rhs);
+    }
+    /// @brief Copies a chess_clock_face control
+    /// @param rhs The control to copy
+    /// @return this
+    chess_clock_face& operator=(const chess_clock_face& rhs) {
+        do_copy_control(rhs);
+        return *this;
+    }
+    /// @brief Constructs a chess_clock_face from a given parent with an optional palette
+    /// @param parent The parent the control is bound to - usually the screen
+    /// @param palette The palette associated with the control. This is usually the screen's palette.
+    chess_clock_face(uix::invalidation_tracker& parent, const palette_type* palette = nullptr) : base_type(parent, palette), digits{0, 0, 0, 0}, is_running(false), is_flagged(false) {
+    }
+    /// @brief Constructs a chess_clock_face
+    chess_clock_face() : base_type(), digits{0, 0, 0, 0}, is_running(false), is_flagged(false) {
+    }
+    /// @brief Sets what to show, invalidating only what changed
+    /// @param seconds The time left in seconds. Above 99 minutes it shows 99.
+    /// @param running True if the clock is running for this team
+    /// @param flagged True if the team ran out of time
+    void show(uint32_t seconds, bool running, bool flagged) {
+        uint32_t minutes = seconds / 60;
+        if (minutes > 99) {
+            minutes = 99;
+        }
+        const uint8_t next[4] = {(uint8_t)(minutes / 10), (uint8_t)(minutes % 10), (uint8_t)((seconds % 60) / 10), (uint8_t)(seconds % 10)};
+        if (running != is_running || flagged != is_flagged) {
+            // the background changes
+            is_running = running;
+            is_flagged = flagged;
+            for (int i = 0; i < 4; ++i) {
+                digits[i] = next[i];
+            }
+            this->invalidate();
+            return;
+        }
+        for (int i = 0; i < 4; ++i) {
+            if (next[i] != digits[i]) {
+                digits[i] = next[i];
+                this->invalidate(digit_bounds(i));
+            }
+        }
+    }
+
+   protected:
+    void on_paint(control_surface_type& destination, const gfx::srect16& clip) override {
+        const pixel_type background = is_flagged ? color_t::red : is_running ? color_t::dark_green : color_t::black;
+        const pixel_type foreground = is_running || is_flagged ? color_t::white : color_t::gray;
+        gfx::draw::filled_rectangle(destination, destination.bounds(), background);
+        for (int i = 0; i < 4; ++i) {
+            const gfx::srect16 bounds = digit_bounds(i);
+            if (bounds.intersects(clip)) {
+                draw_digit(destination, bounds, digits[i], foreground);
+            }
+        }
+    }
+};
+#endif // CHESS_CLOCK_FACE_HPP
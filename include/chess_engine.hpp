@@ -0,0 +1,148 @@
+#ifndef CHESS_ENGINE_HPP
+#define CHESS_ENGINE_HPP
+#include <atomic>
+
+#include "chess.h"
+#include "chess_position.hpp"
+#include "chess_search.hpp"
+#include "chess_tt.hpp"
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#else
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+/// @brief Runs chess_search in a dedicated task (FreeRTOS) or thread (host)
+/// so the UI never stalls while the computer thinks
+class chess_engine {
+   public:
+    /// @brief The most game history keys passed to the search for repetition detection
+    static constexpr const size_t max_history = 100;
+
+   private:
+    struct request {
+        chess_position position;
+        chess_search_limits limits;
+        uint64_t history[max_history];
+        size_t history_size;
+        bool ponder;
+    };
+    enum ponder_status : uint8_t {
+        ponder_none = 0,
+        ponder_active,
+        // cancelled before the expected move was played: the result is dropped
+        ponder_missed
+    };
+    chess_search searcher;
+    std::atomic<bool> busy;
+    std::atomic<uint8_t> ponder_state;
+    void (*result_callback)(void* state);
+    void* result_callback_state;
+    static void fill_request(request* out_request, const chess_position& position, const chess_search_limits& limits, const uint64_t* history, size_t history_size, bool ponder);
+    bool submit(const chess_position& position, const chess_search_limits& limits, const uint64_t* history, size_t history_size, bool ponder);
+    bool finish_ponder();
+#ifdef ESP_PLATFORM
+    TaskHandle_t task;
+    QueueHandle_t requests;
+    QueueHandle_t results;
+    static void task_proc(void* state);
+#else
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable signal;
+    request pending;
+    bool has_request;
+    chess_search_result result;
+    bool has_result;
+    bool quit;
+    void thread_proc();
+#endif
+    chess_engine(const chess_engine& rhs) = delete;
+    chess_engine& operator=(const chess_engine& rhs) = delete;
+
+   public:
+    chess_engine();
+    ~chess_engine();
+    /// @brief Starts the engine task
+    /// @param core The core to pin the task to, or -1 for any (ignored on the host)
+    /// @param priority The task priority (ignored on the host)
+    /// @return True if the task was started, otherwise false
+    bool start(int core = -1, int priority = 5);
+    /// @brief Stops the engine task, cancelling any search in progress
+    void stop();
+    /// @brief Sets the transposition table the search uses. Call before start().
+    /// @param value The table, or nullptr for none
+    void table(chess_tt* value) {
+        searcher.table(value);
+    }
+    /// @brief Sets the endgame tablebases the search uses. Call before start().
+    /// @param value The tablebases, or nullptr for none
+    void tablebase(chess_tablebase* value) {
+        searcher.tablebase(value);
+    }
+    /// @brief Sets the number of threads searching. Call before start().
+    /// @param count The number of threads including the engine task, up to chess_search::max_threads
+    /// @param core The core to pin the helper tasks to, or -1 for any (ignored on the host)
+    /// @param priority The helper task priority (ignored on the host)
+    /// @return True if the helpers were allocated, otherwise false
+    bool threads(size_t count, int core = -1, int priority = 5) {
+        return searcher.threads(count, core, priority);
+    }
+    /// @brief Sets a function to call from the engine task when a result is ready to poll(),
+    /// or when a cancelled ponder search leaves the engine idle. Call before start().
+    /// @param callback The function, or nullptr for none
+    /// @param state User defined state passed to the callback
+    void on_result_callback(void (*callback)(void* state), void* state = nullptr) {
+        result_callback = callback;
+        result_callback_state = state;
+    }
+    /// @brief Sets a function to call from the engine task each time the search completes a depth. Call before start().
+    /// @param callback The function, or nullptr for none
+    /// @param state User defined state passed to the callback
+    void on_iteration_callback(void (*callback)(const chess_search_result& result, void* state), void* state = nullptr) {
+        searcher.on_iteration_callback(callback, state);
+    }
+    /// @brief Begins searching a position in the background
+    /// @param position The position to search. It is copied.
+    /// @param limits The budget for the search
+    /// @param history The keys of the earlier positions in the game, oldest first. Only the most recent max_history are used.
+    /// @param history_size The number of keys in history
+    /// @return True if the search was started, false if the engine is not started or already busy
+    bool think(const chess_position& position, const chess_search_limits& limits, const uint64_t* history = nullptr, size_t history_size = 0) {
+        return submit(position, limits, history, history_size, false);
+    }
+    /// @brief Begins searching the position the opponent's expected reply leads to, while they think.
+    /// The search ignores its budget until ponder_hit() or cancel().
+    /// @param position The position after the expected reply. It is copied.
+    /// @param limits The budget for the search once the reply is played
+    /// @param history The keys of the earlier positions in the game, oldest first. Only the most recent max_history are used.
+    /// @param history_size The number of keys in history
+    /// @return True if the search was started, false if the engine is not started or already busy
+    bool ponder(const chess_position& position, const chess_search_limits& limits, const uint64_t* history = nullptr, size_t history_size = 0);
+    /// @brief Reports that the expected reply was played, so the ponder search carries on
+    /// as a normal search, its budget starting now
+    /// @return True if the engine was pondering, otherwise false
+    bool ponder_hit();
+    /// @brief Indicates whether the engine is pondering, waiting for ponder_hit() or cancel()
+    /// @return True if pondering, otherwise false
+    bool pondering() const {
+        return ponder_state == ponder_active;
+    }
+    /// @brief Asks the current search to stop early. Its best move so far is still reported,
+    /// unless it was pondering, in which case there is no result and thinking() soon becomes false.
+    void cancel();
+    /// @brief Indicates whether a search is in progress or its result has not been collected
+    /// @return True if busy, otherwise false
+    bool thinking() const {
+        return busy;
+    }
+    /// @brief Retrieves the result of a finished search without blocking
+    /// @param out_result The result
+    /// @return True if a result was retrieved, otherwise false
+    bool poll(chess_search_result* out_result);
+};
+#endif // CHESS_ENGINE_HPP
@@ -0,0 +1,106 @@
+#ifndef CHESS_EVAL_BAR_HPP
+#define CHESS_EVAL_BAR_HPP
+#include <gfx.hpp>  // graphics library
+#include <uix.hpp>  // user interface library
+
+/// @brief Shows the evaluation as a vertical bar: the white team's share
+/// fills it from the bottom and the black team's from the top, meeting in
+/// the middle when level. A new score only invalidates the rows between the
+/// old and new split.
+/// @tparam ControlSurfaceType The control surface type, usually the screen's control_surface_type
+template <typename ControlSurfaceType>
+class chess_eval_bar : public uix::control<ControlSurfaceType> {
+    using base_type = uix::control<ControlSurfaceType>;
+    using color_t = gfx::color<typename ControlSurfaceType::pixel_type>;
+    int centipawns;
+    // the first row of the white part, or -1 before the first paint
+    int16_t split;
+    void do_copy_control(const chess_eval_bar& rhs) {
+        centipawns = rhs.centipawns;
+        split = -1;
+    }
+    // saturates smoothly, so small advantages stay visible and big ones never overflow
+    int16_t split_for(int score) const {
+        const int16_t height = this->dimensions().height;
+        const int16_t half = height / 2;
+        const int magnitude = score < 0 ? -score : score;
+        const int offset = (int)((int64_t)score * half / (magnitude + 400));
+        return (int16_t)(half - offset);
+    }
+
+   public:
+    using control_surface_type = ControlSurfaceType;
+    using pixel_type = typename ControlSurfaceType::pixel_type;
+    using palette_type = typename ControlSurfaceType::palette_type;
+    /// @brief Moves a chess_eval_bar control
+    /// @param rhs The control to move
+    chess_eval_bar(chess_eval_bar&& rhs) {
+        do_copy_control(rhs);
+    }
+    /// @brief Moves a chess_eval_bar control
+    /// @param rhs The control to move
+    /// @return this
+    chess_eval_bar& operator=(chess_eval_bar&& rhs) {
+        do_copy_control(rhs);
+        return *this;
+    }
+    /// @brief Copies a chess_eval_bar control
+    /// @param rhs The control to copy
+    chess_eval_bar(const chess_eval_bar& rhs) {
+        do_copy_control(rhs);
+    }
+    /// @brief Copies a chess_eval_bar control
+    /// @param rhs The control to copy
+    /// @return this
+    chess_eval_bar& operator=(const chess_eval_bar& rhs) {
+        do_copy_control(rhs);
+        return *this;
+    }
+    /// @brief Constructs a chess_eval_bar from a given parent with an optional palette
+    /// @param parent The parent the control is bound to - usually the screen
+    /// @param palette The palette associated with the control. This is usually the screen's palette.
+    chess_eval_bar(uix::invalidation_tracker& parent, const palette_type* palette = nullptr) : base_type(parent, palette), centipawns(0), split(-1) {
+    }
+    /// @brief Constructs a chess_eval_bar
+    chess_eval_bar() : base_type(), centipawns(0), split(-1) {
+    }
+    /// @brief Sets the score to show, invalidating only the rows that change
+    /// @param value The score in centipawns, from the white team's point of view
+    void score(int value) {
+        if (value == centipawns) {
+            return;
+        }
+        centipawns = value;
+        if (split < 0) {
+            // not painted yet, so the whole bar is already pending
+            return;
+        }
+        const int16_t next = split_for(value);
+        if (next != split) {
+            const int16_t width = this->dimensions().width;
+            this->invalidate(gfx::srect16(0, next < split ? next : split, width - 1, (next < split ? split : next) - 1));
+        }
+    }
+    /// @brief Indicates the score shown
+    /// @return The score in centipawns
+    int score() const {
+        return centipawns;
+    }
+
+   protected:
+    void on_paint(control_surface_type& destination, const gfx::srect16& clip) override {
+        const gfx::srect16 bounds = (gfx::srect16)destination.bounds();
+        split = split_for(centipawns);
+        if (split > bounds.y1) {
+            gfx::draw::filled_rectangle(destination, gfx::srect16(bounds.x1, bounds.y1, bounds.x2, split - 1), color_t::black);
+        }
+        if (split <= bounds.y2) {
+            gfx::draw::filled_rectangle(destination, gfx::srect16(bounds.x1, split, bounds.x2, bounds.y2), color_t::white);
+        }
+        // mark level, and outline the black part against the screen
+        const int16_t middle = bounds.y1 + this->dimensions().height / 2;
+        gfx::draw::filled_rectangle(destination, gfx::srect16(bounds.x1, middle, bounds.x2, middle), color_t::gray);
+        gfx::draw::rectangle(destination, bounds, color_t::gray);
+    }
+};
+#endif // CHESS_EVAL_BAR_HPP
@@ -0,0 +1,118 @@
+#ifndef CHESS_JOURNAL_HPP
+#define CHESS_JOURNAL_HPP
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chess.h"
+#include "chess_position.hpp"
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#else
+#include <mutex>
+#endif
+
+/// @brief Keeps the current game on flash so it survives a reset.
+/// Moves are appended to a journal as 16-bit records and the whole position
+/// is snapshotted every few moves, so resuming replays at most that many.
+/// Writes are batched and done by a background task, never by the caller.
+class chess_journal {
+   public:
+    /// @brief The most records buffered between writes
+    static constexpr const size_t max_pending = 64;
+    /// @brief The result of resume()
+    struct resume_result {
+        /// @brief The game number
+        uint32_t game;
+        /// @brief The number of moves in the game
+        uint32_t plies;
+        /// @brief The number of moves replayed after the snapshot
+        uint32_t replayed;
+        /// @brief True if a snapshot was used
+        bool from_snapshot;
+    };
+
+   private:
+    struct snapshot {
+        uint32_t magic;
+        uint32_t size;
+        uint32_t game;
+        // the number of journal records the position includes
+        uint32_t plies;
+        chess_position position;
+        chess_history history;
+        uint32_t checksum;
+    };
+    char journal_path[64];
+    char snapshot_path[64];
+    char temp_path[64];
+    uint32_t game;
+    uint32_t plies;
+    uint32_t snapshot_interval;
+    // filled by the caller, drained by the writer
+    uint16_t pending[max_pending];
+    size_t pending_size;
+    bool pending_new_game;
+    bool pending_snapshot;
+    snapshot pending_snap;
+    // the writer's copies, outside the lock
+    uint16_t writing[max_pending];
+    snapshot writing_snap;
+    bool failed;
+#ifdef ESP_PLATFORM
+    SemaphoreHandle_t lock;
+    TaskHandle_t task;
+    uint32_t sync_ms;
+    static void task_proc(void* state);
+#else
+    std::mutex lock;
+#endif
+    void acquire();
+    void release();
+    void signal();
+    static uint32_t checksum(const snapshot& snap);
+    chess_journal(const chess_journal& rhs) = delete;
+    chess_journal& operator=(const chess_journal& rhs) = delete;
+
+   public:
+    chess_journal();
+    ~chess_journal();
+    /// @brief Sets where the journal lives. Call before anything else.
+    /// @param directory The directory, such as "/spiffs"
+    /// @param snapshot_interval The number of moves between snapshots
+    void open(const char* directory, uint32_t snapshot_interval = 16);
+    /// @brief Restores the last game from its snapshot and the journal records after it
+    /// @param out_position The position
+    /// @param out_history The earlier positions that can still repeat
+    /// @param out_result Statistics about the resume
+    /// @return True if a game was restored, false if there was none
+    bool resume(chess_position* out_position, chess_history* out_history, resume_result* out_result);
+    /// @brief Starts a new, empty game, discarding the old one
+    void new_game();
+    /// @brief Records a move. Doesn't block on flash.
+    /// @param from The origin square
+    /// @param to The destination square
+    /// @param after The position after the move, snapshotted if one is due
+    /// @param history The game history after the move, snapshotted if one is due
+    void append(chess_value_t from, chess_value_t to, const chess_position& after, const chess_history& history);
+    /// @brief Replaces the recorded game with a position, as after moves are taken back. Doesn't block on flash.
+    /// @param position The position
+    /// @param history The game history leading to the position
+    /// @param plies The number of moves in the game up to the position
+    void rewrite(const chess_position& position, const chess_history& history, uint32_t plies);
+    /// @brief Writes and syncs everything recorded so far. Called by the background task if started.
+    /// @return True if successful, otherwise false
+    bool flush();
+    /// @brief Starts the background writer (FreeRTOS only). On the host, call flush() instead.
+    /// @param sync_ms How long to batch moves before writing them
+    /// @param priority The task priority
+    /// @return True if started, otherwise false
+    bool start(uint32_t sync_ms = 1000, int priority = 2);
+    /// @brief Indicates the number of moves in the current game
+    /// @return The count
+    uint32_t game_plies() const {
+        return plies;
+    }
+};
+#endif // CHESS_JOURNAL_HPP
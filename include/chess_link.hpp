@@ -0,0 +1,202 @@
+#ifndef CHESS_LINK_HPP
+#define CHESS_LINK_HPP
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chess.h"
+#include "chess_position.hpp"
+#include "config.h"
+
+/// @brief Plays a game against another board over any byte stream, using the
+/// LINK_ commands in config.h. Each side keeps its own copy of the game. A move
+/// goes as one small CRC checked frame carrying the key of the position it
+/// leads to, and is resent until the peer acknowledges it with the key it
+/// reached, so a lost frame costs a retransmit and a desynchronized game is
+/// caught at the next move. Keepalives compare the keys too. Only a mismatch
+/// sends the whole position, from the side that made the last change.
+/// Nothing blocks: feed it input as it arrives and call update() regularly.
+class chess_link {
+   public:
+    /// @brief The byte that starts each frame
+    static constexpr const uint8_t sync = 0xA5;
+    /// @brief The bytes around a payload
+    static constexpr const size_t frame_overhead = 6;
+    /// @brief The largest payload, a LINK_SYNC with a full history
+    static constexpr const size_t max_payload = 1024;
+    /// @brief How long an unacknowledged move waits to be resent
+    static constexpr const uint32_t retransmit_us = 300 * 1000;
+    /// @brief How often to say hello while unconnected, and half as often once connected
+    static constexpr const uint32_t hello_us = 1000 * 1000;
+    /// @brief How long the peer can be silent before it's considered gone
+    static constexpr const uint32_t timeout_us = 6000 * 1000;
+    /// @brief What poll() reports
+    enum event_type : uint8_t {
+        /// @brief A peer answered. local_team() is now the team this side plays.
+        event_connected = 0,
+        /// @brief The peer went silent
+        event_disconnected,
+        /// @brief The peer moved. Make it on the board, then call painted() once it shows.
+        event_move,
+        /// @brief The game was replaced by the peer's. Restore it from current_position() and game_history().
+        event_synced,
+        /// @brief The peer acknowledged a move, with how long it took to show
+        event_latency
+    };
+    /// @brief An event from poll()
+    struct event {
+        /// @brief What happened
+        event_type type;
+        /// @brief The move's origin square, for event_move
+        chess_value_t from;
+        /// @brief The move's destination square, for event_move
+        chess_value_t to;
+        /// @brief The ply the game reached, for event_move, event_synced and event_latency
+        uint16_t ply;
+        /// @brief From the move here to it showing on the peer's screen, for event_latency
+        uint32_t total_us;
+        /// @brief The estimated time on the wire each way, for event_latency
+        uint32_t wire_us;
+        /// @brief From the peer receiving the move to it showing, for event_latency
+        uint32_t paint_us;
+    };
+    /// @brief Traffic counters
+    struct statistics {
+        /// @brief The frames received intact
+        uint32_t frames_in;
+        /// @brief The frames sent
+        uint32_t frames_out;
+        /// @brief The bytes received
+        uint32_t bytes_in;
+        /// @brief The bytes sent
+        uint32_t bytes_out;
+        /// @brief The frames dropped for a bad CRC or size
+        uint32_t crc_errors;
+        /// @brief The moves sent again
+        uint32_t retransmits;
+        /// @brief The games replaced by the peer's
+        uint32_t resyncs;
+    };
+
+   private:
+    static constexpr const size_t max_events = 8;
+    uint32_t id;
+    uint32_t peer_id;
+    bool is_connected;
+    chess_value_t team;
+    chess_value_t first_team;
+    chess_position position;
+    chess_history history;
+    uint16_t plies;
+    // the move waiting for an ack, and the key before it
+    bool outstanding;
+    uint8_t tx_seq;
+    uint8_t move_payload[15];
+    uint64_t key_before;
+    uint64_t move_sent_us;
+    // the last move received, and its ack once it's painted
+    int rx_seq;
+    bool ack_pending;
+    bool ack_sent;
+    uint8_t ack_payload[17];
+    uint64_t received_us;
+    uint64_t last_rx_us;
+    uint64_t last_hello_us;
+    uint8_t rx[(max_payload + frame_overhead) * 2];
+    size_t rx_size;
+    uint8_t tx[max_payload + frame_overhead];
+    event events[max_events];
+    size_t event_count;
+    statistics stats;
+    void (*write_callback)(const uint8_t* data, size_t size, void* state);
+    void* write_callback_state;
+    void send(COMMAND_ID command, const uint8_t* payload, size_t size);
+    void send_hello(bool reply, uint64_t now_us);
+    void send_sync();
+    void push(const event& value);
+    void connect(uint32_t peer, uint64_t now_us);
+    void handle(COMMAND_ID command, const uint8_t* payload, size_t size, uint64_t now_us);
+    void handle_move(const uint8_t* payload, uint64_t now_us);
+    void handle_ack(const uint8_t* payload, uint64_t now_us);
+    bool handle_sync(const uint8_t* payload, size_t size);
+    chess_link(const chess_link& rhs) = delete;
+    chess_link& operator=(const chess_link& rhs) = delete;
+
+   public:
+    chess_link();
+    /// @brief Sets up the link. Call before anything else.
+    /// @param id A number unique to this board, such as from its MAC address. The higher of the two plays the team that moves first.
+    /// @param position The game's position
+    /// @param history The earlier positions that can still repeat
+    /// @param ply The number of moves in the game, which decides whose game wins when the two differ on connecting
+    void begin(uint32_t id, const chess_position& position, const chess_history& history, uint16_t ply);
+    /// @brief Sets the function that sends the frames
+    /// @param callback The function. Each call is one whole frame.
+    /// @param state User defined state passed to the callback
+    void on_write_callback(void (*callback)(const uint8_t* data, size_t size, void* state), void* state = nullptr) {
+        write_callback = callback;
+        write_callback_state = state;
+    }
+    /// @brief Replaces the game, as after moves are taken back
+    /// @param position The position
+    /// @param history The earlier positions that can still repeat
+    /// @param ply The number of moves in the game
+    /// @param announce True to send it to the peer, which takes it over. Otherwise the keys will differ and the longer game wins.
+    void reset(const chess_position& position, const chess_history& history, uint16_t ply, bool announce = true);
+    /// @brief Records a move made on this board, sending it if it was this side's
+    /// @param from The origin square
+    /// @param to The destination square
+    /// @param now_us The time now, in microseconds
+    /// @return True if the move was legal in the link's game, otherwise false, and the game should be reset()
+    bool move(chess_value_t from, chess_value_t to, uint64_t now_us);
+    /// @brief Acknowledges the peer's last move, once it shows on the screen
+    /// @param now_us The time now, in microseconds
+    void painted(uint64_t now_us);
+    /// @brief Handles input as it arrives. Doesn't block.
+    /// @param data The bytes received
+    /// @param size The number of bytes
+    /// @param now_us The time now, in microseconds
+    void feed(const uint8_t* data, size_t size, uint64_t now_us);
+    /// @brief Resends, says hello and notices a silent peer as they fall due
+    /// @param now_us The time now, in microseconds
+    void update(uint64_t now_us);
+    /// @brief Takes the next event
+    /// @param out_event Receives the event
+    /// @return True if there was one, otherwise false
+    bool poll(event* out_event);
+    /// @brief Indicates whether a peer is answering
+    /// @return True if connected, otherwise false
+    bool connected() const {
+        return is_connected;
+    }
+    /// @brief Indicates whether nothing is waiting on the peer or the screen
+    /// @return True if idle, otherwise false
+    bool idle() const {
+        return !outstanding && !ack_pending;
+    }
+    /// @brief Indicates the team this side plays while connected
+    /// @return The team
+    chess_value_t local_team() const {
+        return team;
+    }
+    /// @brief Indicates the link's copy of the game
+    /// @return The position
+    const chess_position& current_position() const {
+        return position;
+    }
+    /// @brief Indicates the earlier positions in the link's copy of the game that can still repeat
+    /// @return The history
+    const chess_history& game_history() const {
+        return history;
+    }
+    /// @brief Indicates the number of moves in the game
+    /// @return The count
+    uint16_t ply() const {
+        return plies;
+    }
+    /// @brief Indicates the traffic so far
+    /// @return The counters
+    statistics traffic() const {
+        return stats;
+    }
+};
+#endif // CHESS_LINK_HPP
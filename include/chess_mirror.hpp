@@ -0,0 +1,151 @@
+#ifndef CHESS_MIRROR_HPP
+#define CHESS_MIRROR_HPP
+#include <stddef.h>
+#include <stdint.h>
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#else
+#include <mutex>
+#endif
+
+/// @brief Mirrors the screen over a byte stream for remote monitoring.
+/// Each flush is copied into a shadow of the screen and its rectangle queued;
+/// a background task encodes what changed against what it last sent and
+/// writes it out. The flush path never waits on the encoding or the link:
+/// under load the queued rectangles merge, so the mirror skips intermediate
+/// frames rather than falling behind.
+///
+/// The stream is a series of frames:
+///   sync (2 bytes), type (1), payload size (2, little endian), payload,
+///   CRC-16/CCITT of the type, size and payload (2, little endian)
+/// so a viewer can pick it out of other output on the same port.
+/// A rectangle's payload is its x1, y1, x2, y2 (inclusive, 2 bytes each)
+/// followed by tokens covering its pixels in rows:
+///   0x00-0x7F n: skip n + 1 pixels that haven't changed
+///   0x80-0xBF n: the following pixel, n - 0x80 + 1 times
+///   0xC0-0xFF n: the n - 0xC0 + 1 pixels that follow
+/// Pixels are 16 bits, in the order they were flushed.
+class chess_mirror {
+   public:
+    /// @brief The frame types
+    enum frame_type : uint8_t {
+        /// @brief The screen's width and height (2 bytes each) and bits per pixel (1). The rectangles that follow repaint it all.
+        frame_screen = 1,
+        /// @brief Some of the screen, as above
+        frame_rect = 2,
+        /// @brief A move was made. The ply the game reached (2 bytes) and the bytes flushed to the screen since the last move (4).
+        frame_move = 3
+    };
+    /// @brief The bytes that start each frame
+    static constexpr const uint8_t sync[2] = {0xC2, 0x4D};
+    /// @brief The bytes around a payload
+    static constexpr const size_t frame_overhead = 7;
+    /// @brief The largest payload sent
+    static constexpr const size_t max_payload = 4096;
+    /// @brief The rectangles queued before they merge
+    static constexpr const size_t max_dirty = 8;
+    /// @brief Traffic counters
+    struct statistics {
+        /// @brief The flushes captured
+        uint32_t flushes;
+        /// @brief The bytes the flushes sent to the screen
+        uint32_t flush_bytes;
+        /// @brief The rectangles merged into others
+        uint32_t merges;
+        /// @brief The frames written
+        uint32_t frames;
+        /// @brief The bytes written
+        uint32_t bytes;
+    };
+
+   private:
+    struct rect {
+        uint16_t x1, y1, x2, y2;
+    };
+    uint16_t width;
+    uint16_t height;
+    // the screen as flushed, and as last sent
+    uint16_t* screen;
+    uint16_t* sent;
+    // the encoder's copy of a row, and the frame being built
+    uint16_t* row;
+    uint8_t* frame;
+    size_t frame_size;
+    // filled by the flush path, taken by drain()
+    rect dirty[max_dirty];
+    size_t dirty_size;
+    bool refresh_pending;
+    int move_pending;
+    // the flushed bytes at the last move frame
+    uint32_t move_flush_bytes;
+    statistics stats;
+    void (*write_callback)(const uint8_t* data, size_t size, void* state);
+    void* write_callback_state;
+#ifdef ESP_PLATFORM
+    portMUX_TYPE lock;
+    TaskHandle_t task;
+    uint32_t refresh_ms;
+    static void task_proc(void* state);
+#else
+    std::mutex lock;
+#endif
+    void acquire();
+    void release();
+    void signal();
+    void begin_frame(frame_type type);
+    void end_frame();
+    void encode(const rect& bounds, bool keyframe);
+    chess_mirror(const chess_mirror& rhs) = delete;
+    chess_mirror& operator=(const chess_mirror& rhs) = delete;
+
+   public:
+    chess_mirror();
+    ~chess_mirror();
+    /// @brief Allocates the two copies of the screen, in PSRAM if available
+    /// @param width The screen width
+    /// @param height The screen height
+    /// @return True if successful, otherwise false
+    bool allocate(uint16_t width, uint16_t height);
+    /// @brief Frees the memory
+    void deallocate();
+    /// @brief Sets the function that sends the stream. It's called from drain(), one frame per call.
+    /// @param callback The function
+    /// @param state A user defined value passed to the callback
+    void on_write_callback(void (*callback)(const uint8_t* data, size_t size, void* state), void* state = nullptr) {
+        write_callback = callback;
+        write_callback_state = state;
+    }
+    /// @brief Records a flush. Copies the pixels and queues the rectangle; never waits on the link.
+    /// @param x1 The left edge
+    /// @param y1 The top edge
+    /// @param x2 The right edge, inclusive
+    /// @param y2 The bottom edge, inclusive
+    /// @param bitmap The 16-bit pixels, in rows
+    void capture(int x1, int y1, int x2, int y2, const void* bitmap);
+    /// @brief Marks a move in the stream, after the drawing queued so far
+    /// @param ply The ply the game reached
+    void move(uint32_t ply);
+    /// @brief Sends the whole screen next, for a viewer that joined late
+    void refresh();
+    /// @brief Encodes and writes everything queued. Called by the background task if started.
+    /// @return The bytes written
+    size_t drain();
+    /// @brief Starts the background task (FreeRTOS only). On the host, call drain() instead.
+    /// @param priority The task priority
+    /// @param refresh_ms How often to send the whole screen, or 0 for only at the start
+    /// @return True if started, otherwise false
+    bool start(int priority = 1, uint32_t refresh_ms = 0);
+    /// @brief Indicates the traffic so far
+    /// @return The counters
+    statistics traffic() const {
+        return stats;
+    }
+    /// @brief Computes the CRC-16/CCITT the frames end with
+    /// @param data The data
+    /// @param size The size of data
+    /// @param crc The CRC so far, to continue from
+    /// @return The CRC
+    static uint16_t crc16(const uint8_t* data, size_t size, uint16_t crc = 0xFFFF);
+};
+#endif // CHESS_MIRROR_HPP
@@ -0,0 +1,87 @@
+#ifndef CHESS_PERFT_HPP
+#define CHESS_PERFT_HPP
+#include <stdint.h>
+
+#include "chess.h"
+#include "chess_bitboard.hpp"
+#include "chess_position.hpp"
+
+/// @brief A well known position and its move path enumeration counts
+struct chess_perft_reference {
+    /// @brief The most depths a reference lists
+    static constexpr const int max_depth = 6;
+    /// @brief A short name for reports
+    const char* name;
+    /// @brief The position, in Forsyth-Edwards Notation
+    const char* fen;
+    /// @brief The leaf count at depth 1, 2, ... or 0 past the last known depth
+    uint64_t nodes[max_depth];
+};
+
+/// @brief Counts the leaves of the legal move tree (perft) to validate and
+/// time the move generators. Positions are played on bitboards alone, so any
+/// position can be loaded from FEN, including underpromotions.
+class chess_perft {
+    chess_bitboard boards;
+    chess_value_t turn;
+    uint8_t castling;
+    chess_value_t en_passant;
+    uint64_t count(int depth) const;
+    static uint64_t library_walk(const chess_game_t& game, chess_position& position, int depth, uint32_t* out_mismatches);
+
+   public:
+    /// @brief The standard reference positions: the initial position, Kiwipete
+    /// and the en passant, castling and promotion edge cases
+    static const chess_perft_reference references[];
+    /// @brief The number of entries in references
+    static const int references_size;
+    /// @brief Loads a position from Forsyth-Edwards Notation
+    /// @param fen The position. The move counters are optional and ignored.
+    /// @return True if the position was loaded, otherwise false
+    bool load(const char* fen);
+    /// @brief Loads a game position
+    /// @param position The position
+    void load(const chess_position& position);
+    /// @brief Indicates the piece placement
+    /// @return The bitboards
+    const chess_bitboard& bitboards() const {
+        return boards;
+    }
+    /// @brief Indicates the team to move
+    /// @return The team
+    chess_value_t team_to_move() const {
+        return turn;
+    }
+    /// @brief Indicates the castling rights, one bit per board corner
+    /// @return The rights
+    uint8_t castling_rights() const {
+        return castling;
+    }
+    /// @brief Indicates the en passant target square
+    /// @return The square, or -1 if none
+    chess_value_t en_passant_square() const {
+        return en_passant;
+    }
+    /// @brief Counts the leaves of the legal move tree, with each promotion counted once per piece it may promote to
+    /// @param depth The depth in plies
+    /// @return The count
+    uint64_t nodes(int depth) const;
+    /// @brief Counts the leaves below each root move
+    /// @param depth The depth in plies, at least 1
+    /// @param callback Called for each root move. promotion is the id promoted to, or -1.
+    /// @param state User defined state passed to the callback
+    /// @return The total count
+    uint64_t divide(int depth, void (*callback)(chess_value_t from, chess_value_t to, chess_value_t promotion, uint64_t nodes, void* state), void* state) const;
+    /// @brief Counts the leaves of the legal move tree from the initial position using chess_compute_moves()
+    /// and chess_move(), checking each position's destinations, bitboards and make()/unmake() against the library along the way
+    /// @param depth The depth in plies
+    /// @param out_mismatches Incremented for every disagreement between the library and the bitboards
+    /// @return The count. The library only promotes to queens.
+    static uint64_t library_nodes(int depth, uint32_t* out_mismatches);
+    /// @brief Runs every reference position up to a depth, printing the counts, timings and nodes/s
+    /// @param max_depth The deepest depth to run
+    /// @param library_depth The depth to cross check the library to from the initial position, or 0 to skip it
+    /// @return The number of counts that did not match
+    static int run_suite(int max_depth, int library_depth);
+};
+#endif // CHESS_PERFT_HPP
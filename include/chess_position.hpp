@@ -0,0 +1,217 @@
+#ifndef CHESS_POSITION_HPP
+#define CHESS_POSITION_HPP
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "chess.h"
+#include "chess_bitboard.hpp"
+
+/// @brief What make() records to take a move back with unmake(): only what
+/// the move itself can't tell
+struct chess_undo {
+    /// @brief The origin square
+    chess_value_t from;
+    /// @brief The destination square
+    chess_value_t to;
+    /// @brief The captured piece, or -1
+    chess_value_t captured;
+    /// @brief Nonzero if a pawn promoted
+    uint8_t promoted;
+    /// @brief The castling rights before the move
+    uint8_t castling;
+    /// @brief The en passant target square before the move
+    chess_value_t en_passant;
+    /// @brief The halfmove clock before the move
+    uint8_t halfmove;
+};
+
+/// @brief A position as bitboards with an incrementally maintained Zobrist
+/// hash and evaluation, plus the castling, en passant and fifty move state
+/// they depend on. Moves are made and taken back in place, so copies are never needed.
+/// Pawns promote to queens, as with chess_move().
+class chess_position {
+    chess_bitboard boards;
+    uint64_t hash;
+    chess_value_t side;
+    uint8_t castling;
+    chess_value_t en_passant;
+    uint8_t halfmove;
+    // the middlegame and endgame material and piece-square sums, from the
+    // point of view of team 0, and how much material is left to blend them by
+    int16_t middle_score;
+    int16_t end_score;
+    uint8_t material_phase;
+    static uint64_t castling_key(uint8_t rights);
+    void compute_score(int16_t* out_middle, int16_t* out_end, uint8_t* out_phase) const;
+    void put_piece(chess_value_t id, int square);
+    void remove_piece(int square);
+    void toggle_en_passant();
+
+   public:
+    /// @brief The material phase of the initial position, where score() uses the middlegame weights alone
+    static constexpr const int max_phase = 24;
+    /// @brief Sets up the initial position
+    void init();
+    /// @brief Sets up any position, such as one chess_perft loaded from FEN
+    /// @param boards The piece placement
+    /// @param turn The team to move
+    /// @param castling The castling rights, one bit per board corner
+    /// @param en_passant The en passant target square, or -1
+    /// @param halfmove The number of plies since the last capture or pawn move
+    void setup(const chess_bitboard& boards, chess_value_t turn, uint8_t castling, chess_value_t en_passant, uint8_t halfmove);
+    /// @brief Moves a piece if the move is legal, updating the hash
+    /// @param from The origin square
+    /// @param to The destination square
+    /// @return The same as chess_move(): -2 if illegal, -1 on success, or the square of a pawn captured en passant
+    chess_value_t move(chess_value_t from, chess_value_t to);
+    /// @brief Makes a legal move without checking it
+    /// @param from The origin square
+    /// @param to The destination square
+    /// @param out_undo Receives what unmake() needs to take it back
+    /// @return -1, or the square of a pawn captured en passant
+    chess_value_t make(chess_value_t from, chess_value_t to, chess_undo* out_undo);
+    /// @brief Takes back the last move made
+    /// @param undo What make() recorded for it
+    void unmake(const chess_undo& undo);
+    /// @brief Indicates the piece placement
+    /// @return The bitboards
+    const chess_bitboard& bitboards() const {
+        return boards;
+    }
+    /// @brief Indicates the team to move
+    /// @return The team
+    chess_value_t turn() const {
+        return side;
+    }
+    /// @brief Computes the legal destinations for a piece, as a mask
+    /// @param index The origin square
+    /// @return The mask, or 0 if the square is empty or not the side to move's
+    uint64_t destinations(chess_value_t index) const;
+    /// @brief Computes the legal moves for a piece. A drop-in for chess_compute_moves().
+    /// @param index The origin square
+    /// @param out_moves Receives up to 64 destination squares
+    /// @return The number of destinations
+    chess_value_t compute_moves(chess_value_t index, chess_value_t* out_moves) const;
+    /// @brief Computes the legal moves for the side to move
+    /// @param out_destinations Receives the destination mask for each returned origin square (64 entries)
+    /// @return The mask of origin squares with at least one legal move
+    uint64_t legal_moves(uint64_t* out_destinations) const {
+        return boards.generate(side & 1, castling, en_passant, out_destinations);
+    }
+    /// @brief Indicates whether the side to move is in check
+    /// @return True if in check, otherwise false
+    bool in_check() const {
+        return boards.in_check(side & 1);
+    }
+    /// @brief Indicates the Zobrist key of the position
+    /// @return The key
+    uint64_t key() const {
+        return hash;
+    }
+    /// @brief Computes the Zobrist key from scratch, to verify the incremental one
+    /// @return The key
+    uint64_t compute_key() const;
+    /// @brief Evaluates the position by material and piece placement, tapered
+    /// from middlegame to endgame weights as material comes off. Kept up to date
+    /// by every move, so reading it costs nothing.
+    /// @param team The team whose point of view to score from
+    /// @return The score in centipawns
+    int score(int team) const;
+    /// @brief Indicates how much material is left, for tapering the evaluation
+    /// @return The phase, from 0 with only kings and pawns to max_phase at the start
+    int phase() const {
+        // promotions can push it past the start
+        return material_phase < max_phase ? material_phase : max_phase;
+    }
+    /// @brief Verifies the incremental key and evaluation against ones computed
+    /// from scratch, and the bitboards against the squares
+    /// @return True if they match, otherwise false
+    bool consistent() const;
+    /// @brief Indicates the remaining castling rights, one bit per board corner
+    /// @return The rights
+    uint8_t castling_rights() const {
+        return castling;
+    }
+    /// @brief Indicates the square a pawn may be captured en passant on
+    /// @return The square, or -1 if none
+    chess_value_t en_passant_square() const {
+        return en_passant;
+    }
+    /// @brief Indicates whether the side to move has a pawn beside the one that
+    /// can be captured en passant. Only then is the square part of the key.
+    /// @return True if so, otherwise false
+    bool en_passant_capturable() const;
+    /// @brief Indicates the number of plies since the last capture or pawn move
+    /// @return The count
+    uint8_t halfmove_clock() const {
+        return halfmove;
+    }
+};
+
+/// @brief The keys of the earlier positions in a game that can still repeat, oldest first
+struct chess_history {
+    /// @brief The most keys kept. Older ones are dropped.
+    static constexpr const size_t capacity = 100;
+    /// @brief The keys
+    uint64_t keys[capacity];
+    /// @brief The number of keys
+    size_t size;
+    /// @brief Forgets every key
+    void clear() {
+        size = 0;
+    }
+    /// @brief Records a move
+    /// @param key The key of the position the move was made from
+    /// @param halfmove_clock The halfmove clock after the move
+    void push(uint64_t key, uint8_t halfmove_clock) {
+        if (halfmove_clock == 0) {
+            // captures and pawn moves can't be undone, so nothing before them repeats
+            size = 0;
+            return;
+        }
+        append(key);
+    }
+    /// @brief Adds a key, dropping the oldest if full
+    /// @param key The key
+    void append(uint64_t key) {
+        if (size == capacity) {
+            memmove(keys, keys + 1, (capacity - 1) * sizeof(uint64_t));
+            --size;
+        }
+        keys[size++] = key;
+    }
+};
+
+/// @brief The moves of a game as a fixed size undo stack. Moves taken back
+/// stay above the current ply until a different move is made, so they can be redone.
+struct chess_line {
+    /// @brief The most moves kept. The oldest are dropped and can no longer be taken back.
+    static constexpr const size_t capacity = 256;
+    /// @brief What make() recorded for each move
+    chess_undo moves[capacity];
+    /// @brief The key of the position each move was made from
+    uint64_t keys[capacity];
+    /// @brief The number of moves made
+    size_t ply;
+    /// @brief The number of moves recorded, including those taken back
+    size_t size;
+    /// @brief Forgets every move
+    void clear() {
+        ply = size = 0;
+    }
+    /// @brief Records a move made at the current ply, forgetting any taken back
+    /// @param undo What make() recorded
+    /// @param key The key of the position the move was made from
+    void push(const chess_undo& undo, uint64_t key) {
+        if (ply == capacity) {
+            memmove(moves, moves + 1, (capacity - 1) * sizeof(chess_undo));
+            memmove(keys, keys + 1, (capacity - 1) * sizeof(uint64_t));
+            --ply;
+        }
+        moves[ply] = undo;
+        keys[ply] = key;
+        size = ++ply;
+    }
+};
+#endif // CHESS_POSITION_HPP
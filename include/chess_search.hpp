@@ -0,0 +1,248 @@
+#ifndef CHESS_SEARCH_HPP
+#define CHESS_SEARCH_HPP
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "chess.h"
+#include "chess_position.hpp"
+#include "chess_tablebase.hpp"
+#include "chess_tt.hpp"
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#else
+#include <thread>
+#endif
+
+/// @brief The budget for a single search. Zero means unbounded.
+struct chess_search_limits {
+    /// @brief The maximum iteration depth
+    int depth;
+    /// @brief The wall time budget in milliseconds
+    uint32_t time_ms;
+    /// @brief The node budget
+    uint32_t nodes;
+};
+
+/// @brief The outcome of a search
+struct chess_search_result {
+    /// @brief The origin square of the best move, or -1 if there are no legal moves
+    chess_value_t from;
+    /// @brief The destination square of the best move
+    chess_value_t to;
+    /// @brief The score in centipawns from the side to move's perspective
+    int score;
+    /// @brief The last fully completed iteration depth
+    int depth;
+    /// @brief The origin square of the reply the search expects, or -1 if it has none
+    chess_value_t ponder_from;
+    /// @brief The destination square of the expected reply
+    chess_value_t ponder_to;
+    /// @brief The number of nodes visited
+    uint32_t nodes;
+    /// @brief The number of positions scored from the endgame tablebases
+    uint32_t tablebase_hits;
+    /// @brief The time spent searching in milliseconds
+    uint32_t elapsed_ms;
+    /// @brief The beta cutoffs in the main search
+    uint32_t cutoffs;
+    /// @brief The beta cutoffs made by the first move searched, the measure of move ordering
+    uint32_t first_move_cutoffs;
+    /// @brief The captures quiescence skipped because they lose material
+    uint32_t see_pruned;
+    /// @brief The effective branching factor times 100: the last completed iteration's
+    /// nodes over the one before's, or 0 before the second iteration
+    uint32_t branching_x100;
+    /// @brief Indicates the search speed
+    /// @return The number of nodes visited per second
+    uint32_t nps() const {
+        return elapsed_ms ? (uint32_t)((uint64_t)nodes * 1000 / elapsed_ms) : nodes;
+    }
+    /// @brief Indicates how often the first move searched was good enough to cut off
+    /// @return The share of cutoffs in permille
+    uint32_t first_move_cutoff_permille() const {
+        return cutoffs ? (uint32_t)((uint64_t)first_move_cutoffs * 1000 / cutoffs) : 0;
+    }
+};
+
+/// @brief Iterative deepening alpha-beta search over chess_position positions.
+/// With more than one thread it is a Lazy SMP search: helpers search the same
+/// root in their own tasks, skipping depths in a staggered pattern, and only
+/// share what they find through the transposition table. The result is always
+/// the main search's, so one thread searches exactly as before.
+class chess_search {
+   public:
+    /// @brief The most threads a search can use, including the caller's
+    static constexpr const size_t max_threads = 64;
+    /// @brief The deepest ply the search will reach, including quiescence
+    static constexpr const int max_ply = 64;
+    /// @brief The score of delivering mate at the root
+    static constexpr const int mate_score = 30000;
+    /// @brief The score of a position the tablebases say is won, below any mate the search finds
+    static constexpr const int tablebase_win = mate_score - 2 * max_ply;
+    /// @brief A move paired with its ordering score
+    struct move_entry {
+        chess_value_t from;
+        chess_value_t to;
+        int16_t order;
+    };
+
+   private:
+    // all plies share one move stack, each ply working above its parent's
+    static constexpr const size_t move_stack_size = 4096;
+    move_entry move_stack[move_stack_size];
+    size_t move_top;
+    // two quiet moves per ply that last caused a cutoff there, most recent first
+    uint16_t killers[max_ply + 1][2];
+    // how often each quiet move caused a cutoff, weighted by depth, by [team][from][to]
+    int16_t butterfly[2][64][64];
+    uint32_t cutoffs;
+    uint32_t first_move_cutoffs;
+    uint32_t see_pruned;
+    // the keys of the positions on the current line, for repetition detection
+    uint64_t path[max_ply + 1];
+    const uint64_t* history;
+    size_t history_size;
+    chess_tt* transpositions;
+    chess_tt::statistics table_stats;
+    chess_tablebase* tablebases;
+    uint32_t tablebase_hits;
+    std::atomic<bool> cancel_requested;
+    std::atomic<bool> ponder_requested;
+    bool stopped;
+    bool pondering;
+    uint32_t nodes;
+    uint32_t start_ms;
+    // where the time and node budgets start: after pondering ends
+    uint32_t budget_ms;
+    uint32_t budget_nodes;
+    uint32_t last_yield_ms;
+    chess_search_limits limits;
+    // 0 for the main search, otherwise the helper's number
+    size_t helper_index;
+    chess_search* helpers[max_threads - 1];
+    size_t helper_count;
+    int helper_core;
+    int helper_priority;
+    // the root a helper searches. the history is the main search's.
+    chess_position helper_root;
+    bool helper_running;
+    void (*iteration_callback)(const chess_search_result& result, void* state);
+    void* iteration_callback_state;
+#ifdef ESP_PLATFORM
+    SemaphoreHandle_t helper_done;
+    static void helper_proc(void* state);
+#else
+    std::thread helper_thread;
+#endif
+
+    size_t generate(const chess_position& position, bool captures_only);
+    void sort(size_t begin, size_t end);
+    void order_quiets(size_t begin, size_t end, int ply);
+    void record_cutoff(const chess_position& position, const move_entry& move, int depth, int ply);
+    void reset_ordering();
+    bool check_stop();
+    bool is_repetition(const chess_position& position, int ply) const;
+    int evaluate(const chess_position& position) const;
+    int quiesce(chess_position& position, int alpha, int beta, int ply);
+    int negamax(chess_position& position, int depth, int alpha, int beta, int ply);
+    void iterate(chess_position& position, size_t count, chess_search_result* out_result);
+    void help();
+    void start_helpers(const chess_position& position);
+    void stop_helpers(uint32_t* in_out_nodes, uint32_t* in_out_tablebase_hits);
+    void free_helpers();
+    chess_search(const chess_search& rhs) = delete;
+    chess_search& operator=(const chess_search& rhs) = delete;
+
+   public:
+    chess_search();
+    ~chess_search();
+    /// @brief Packs a move into 16 bits
+    /// @param from The origin square
+    /// @param to The destination square
+    /// @return The packed move. Zero is never a legal move.
+    static uint16_t pack_move(chess_value_t from, chess_value_t to) {
+        return (uint16_t)(from | (to << 6));
+    }
+    /// @brief Sets the transposition table to use
+    /// @param value The table, or nullptr for none
+    void table(chess_tt* value) {
+        transpositions = value;
+    }
+    /// @brief Indicates the transposition table in use
+    /// @return The table, or nullptr for none
+    chess_tt* table() const {
+        return transpositions;
+    }
+    /// @brief Sets the endgame tablebases to use
+    /// @param value The tablebases, or nullptr for none
+    void tablebase(chess_tablebase* value) {
+        tablebases = value;
+    }
+    /// @brief Sets the number of threads searching. Don't call during a search.
+    /// @param count The number of threads including the caller's, up to max_threads
+    /// @param core The core to pin the helper tasks to, or -1 for any (ignored on the host)
+    /// @param priority The helper task priority (ignored on the host)
+    /// @return True if the helpers were allocated, otherwise false, leaving as many as could be
+    bool threads(size_t count, int core = -1, int priority = 5);
+    /// @brief Indicates the number of threads searching
+    /// @return The count, including the caller's
+    size_t threads() const {
+        return helper_count + 1;
+    }
+    /// @brief Sets a function to call from the searching task each time the main search completes a depth
+    /// @param callback The function, or nullptr for none. The result has the best move, score and depth so far,
+    /// and the main search's nodes and time. The expected reply isn't known until the search ends.
+    /// @param state User defined state passed to the callback
+    void on_iteration_callback(void (*callback)(const chess_search_result& result, void* state), void* state = nullptr) {
+        iteration_callback = callback;
+        iteration_callback_state = state;
+    }
+    /// @brief Searches a position for the best move
+    /// @param position The position to search
+    /// @param limits The budget for the search
+    /// @param out_result The best move and search statistics
+    /// @param history The keys of the earlier positions in the game, oldest first, for repetition detection
+    /// @param history_size The number of keys in history
+    /// @return True if a move was found, false if the side to move has no legal moves
+    bool search(const chess_position& position, const chess_search_limits& limits, chess_search_result* out_result, const uint64_t* history = nullptr, size_t history_size = 0);
+    /// @brief Asks a running search to stop. Safe to call from another task.
+    void cancel();
+    /// @brief Forgets an earlier cancel(). search() doesn't, so call this before queuing
+    /// a search on another task; a cancel made in between then stops the search it was meant for.
+    void clear_cancel() {
+        cancel_requested = false;
+    }
+    /// @brief Sets whether searches ponder: search the opponent's expected reply on their time,
+    /// ignoring the time and node budget. Clearing it during a search starts the budget from then,
+    /// so the search carries on as though it had just started. Safe to call from another task.
+    /// @param value True to ponder, otherwise false
+    void ponder(bool value) {
+        ponder_requested = value;
+    }
+    /// @brief Statically evaluates a position
+    /// @param position The position
+    /// @return The score in centipawns from the side to move's perspective
+    int static_evaluation(const chess_position& position) const {
+        return evaluate(position);
+    }
+    /// @brief Works out what a capture wins or loses once every piece that
+    /// can recapture on the square has, least valuable first
+    /// @param position The position
+    /// @param from The origin square of the capture
+    /// @param to The destination square
+    /// @return The material gained in centipawns, negative if the capture loses material
+    static int exchange_value(const chess_position& position, int from, int to);
+    /// @brief Searches positions with 1, 2, 4 ... threads, printing the nodes/s
+    /// and the time to finish for each count relative to one thread. With a depth limit
+    /// and no other, the time is the time to depth.
+    /// @param searcher The search to use. Its table is cleared before each position and its threads are restored after.
+    /// @param positions The positions
+    /// @param count The number of positions
+    /// @param limits The budget for each search
+    /// @param max_threads The most threads to try
+    static void run_scaling(chess_search& searcher, const chess_position* positions, size_t count, const chess_search_limits& limits, size_t max_threads);
+};
+#endif // CHESS_SEARCH_HPP
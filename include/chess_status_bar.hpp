@@ -0,0 +1,100 @@
+#ifndef CHESS_STATUS_BAR_HPP
+#define CHESS_STATUS_BAR_HPP
+#include <gfx.hpp>  // graphics library
+#include <uix.hpp>  // user interface library
+
+#include "assets/cb24.hpp"
+#include "chess.h"
+
+/// @brief Shows the side to move as its king, over a background that marks
+/// check, checkmate and stalemate. Only repaints when either changes.
+/// @tparam ControlSurfaceType The control surface type, usually the screen's control_surface_type
+template <typename ControlSurfaceType>
+class chess_status_bar : public uix::control<ControlSurfaceType> {
+    using base_type = uix::control<ControlSurfaceType>;
+    using color_t = gfx::color<typename ControlSurfaceType::pixel_type>;
+    chess_status_t game_status;
+    chess_value_t turn;
+    void do_copy_control(const chess_status_bar& rhs) {
+        game_status = rhs.game_status;
+        turn = rhs.turn;
+    }
+
+   public:
+    using control_surface_type = ControlSurfaceType;
+    using pixel_type = typename ControlSurfaceType::pixel_type;
+    using palette_type = typename ControlSurfaceType::palette_type;
+    /// @brief Moves a chess_status_bar control
+    /// @param rhs The control to move
+    chess_status_bar(chess_status_bar&& rhs) {
+        do_copy_control(rhs);
+    }
+    /// @brief Moves a chess_status_bar control
+    /// @param rhs The control to move
+    /// @return this
+    chess_status_bar& operator=(chess_status_bar&& rhs) {
+        do_copy_control(rhs);
+        return *this;
+    }
+    /// @brief Copies a chess_status_bar control
+    /// @param rhs The control to copy
+    chess_status_bar(const chess_status_bar& rhs) {
+        do_copy_control(rhs);
+    }
+    /// @brief Copies a chess_status_bar control
+    /// @param rhs The control to copy
+    /// @return this
+    chess_status_bar& operator=(const chess_status_bar& rhs) {
+        do_copy_control(rhs);
+        return *this;
+    }
+    /// @brief Constructs a chess_status_bar from a given parent with an optional palette
+    /// @param parent The parent the control is bound to - usually the screen
+    /// @param palette The palette associated with the control. This is usually the screen's palette.
+    chess_status_bar(uix::invalidation_tracker& parent, const palette_type* palette = nullptr) : base_type(parent, palette), game_status(CHESS_NORMAL), turn(-1) {
+    }
+    /// @brief Constructs a chess_status_bar
+    chess_status_bar() : base_type(), game_status(CHESS_NORMAL), turn(-1) {
+    }
+    /// @brief Sets what to show, repainting only if it changed
+    /// @param status The status of the side to move
+    /// @param team The side to move
+    void status(chess_status_t status, chess_value_t team) {
+        if (status != game_status || team != turn) {
+            game_status = status;
+            turn = team;
+            this->invalidate();
+        }
+    }
+    /// @brief Indicates the status shown
+    /// @return The status
+    chess_status_t status() const {
+        return game_status;
+    }
+
+   protected:
+    void on_paint(control_surface_type& destination, const gfx::srect16& clip) override {
+        pixel_type background;
+        switch (game_status) {
+            case CHESS_CHECK:
+                background = color_t::orange;
+                break;
+            case CHESS_CHECKMATE:
+                background = color_t::red;
+                break;
+            case CHESS_STALEMATE:
+                background = color_t::gray;
+                break;
+            default:
+                background = color_t::dark_khaki;
+                break;
+        }
+        gfx::draw::filled_rectangle(destination, destination.bounds(), background);
+        if (turn > -1) {
+            const auto& ico = cb24_chess_king;
+            const gfx::srect16 bounds = ((gfx::srect16)ico.bounds()).center((gfx::srect16)destination.bounds());
+            gfx::draw::icon(destination, bounds.location(), ico, turn ? color_t::white : color_t::black);
+        }
+    }
+};
+#endif // CHESS_STATUS_BAR_HPP
@@ -0,0 +1,135 @@
+#ifndef CHESS_TABLEBASE_HPP
+#define CHESS_TABLEBASE_HPP
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "chess.h"
+#include "chess_bitboard.hpp"
+#include "chess_block_cache.hpp"
+#include "chess_position.hpp"
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#else
+#include <mutex>
+#endif
+
+/// @brief A position as the tablebases see it. Moves are played on the
+/// bitboards alone, so any position can be probed, including ones chess_game_t
+/// can't be set up in.
+struct chess_tb_position {
+    /// @brief The piece placement
+    chess_bitboard boards;
+    /// @brief The team to move
+    chess_value_t turn;
+    /// @brief The castling rights, one bit per corner as in chess_position
+    uint8_t castling;
+    /// @brief The en passant target square, or -1
+    chess_value_t en_passant;
+    /// @brief The number of plies since the last capture or pawn move
+    uint8_t halfmove;
+    /// @brief Copies a game position
+    /// @param position The position
+    void load(const chess_position& position);
+};
+
+/// @brief Probes Syzygy endgame tablebases: win/draw/loss (.rtbw) and
+/// distance to zeroing (.rtbz) files of up to 7 pieces. The files are read
+/// through a chess_block_cache, so only the blocks a probe touches are loaded.
+class chess_tablebase {
+   public:
+    /// @brief Win/draw/loss scores. A cursed win or blessed loss is a
+    /// win or loss the fifty move rule turns into a draw.
+    enum wdl_score : int {
+        loss = -2,
+        blessed_loss = -1,
+        draw = 0,
+        cursed_win = 1,
+        win = 2
+    };
+    // the decoding state of one compressed table, and a file pair's tables
+    struct pairs;
+    struct table;
+
+   private:
+    chess_block_cache* cache;
+    char directory[64];
+    table* tables;
+    size_t tables_size;
+    // material signatures to tables, sorted by signature
+    struct lookup {
+        uint64_t signature;
+        uint32_t table;
+    };
+    lookup* index;
+    size_t index_size;
+    int largest;
+    std::atomic<uint32_t> probe_count;
+#ifdef ESP_PLATFORM
+    SemaphoreHandle_t lock;
+#else
+    std::mutex lock;
+#endif
+    void acquire();
+    void release();
+    static FILE* open_file(uint32_t file, void* state);
+    table* find(uint64_t signature) const;
+    bool load(table& entry, bool dtz);
+    bool ready(table& entry, bool dtz);
+    void free_items(table& entry, bool dtz);
+    int decompress(const pairs& d, uint32_t file, uint64_t idx, bool* out_ok);
+    int probe_table(const chess_tb_position& position, bool dtz, int wdl, int* state);
+    int search(const chess_tb_position& position, bool check_zeroing, int* state);
+    int probe_dtz_internal(const chess_tb_position& position, int* state);
+    bool probeable(const chess_tb_position& position) const;
+    chess_tablebase(const chess_tablebase& rhs) = delete;
+    chess_tablebase& operator=(const chess_tablebase& rhs) = delete;
+
+   public:
+    chess_tablebase();
+    ~chess_tablebase();
+    /// @brief Finds the tables in a directory
+    /// @param directory The directory, such as "/sdcard/syzygy"
+    /// @param cache The cache to read them through. Must be allocated and outlive the tablebase.
+    /// @return True if any tables were found, otherwise false
+    bool open(const char* directory, chess_block_cache* cache);
+    /// @brief Forgets the tables
+    void close();
+    /// @brief Indicates the number of tables found
+    /// @return The count of .rtbw files
+    size_t size() const {
+        return tables_size;
+    }
+    /// @brief Indicates the most pieces a position can have to be probed
+    /// @return The count, or 0 if there are no tables
+    int max_pieces() const {
+        return largest;
+    }
+    /// @brief Indicates the number of successful probes
+    /// @return The count
+    uint32_t probes() const {
+        return probe_count;
+    }
+    /// @brief Finds whether a position is won, drawn or lost for the side to move
+    /// @param position The position. Castling rights can't be probed.
+    /// @param out_wdl Receives the wdl_score
+    /// @return True if successful, false if the position isn't in the tables
+    bool probe_wdl(const chess_tb_position& position, int* out_wdl);
+    /// @brief Finds the distance to the next capture or pawn move with best play
+    /// @param position The position
+    /// @param out_dtz Receives the distance in plies: positive if winning,
+    /// negative if losing, 0 if drawn. Over 100 in magnitude for cursed wins and blessed losses.
+    /// @return True if successful, false if the position isn't in the tables
+    bool probe_dtz(const chess_tb_position& position, int* out_dtz);
+    /// @brief Chooses the move that keeps the best result the quickest,
+    /// minding the fifty move rule. Pawns only promote to queens, as in chess.h.
+    /// @param position The position
+    /// @param out_from Receives the origin square
+    /// @param out_to Receives the destination square
+    /// @param out_wdl Receives the position's wdl_score, taking the fifty move rule into account
+    /// @return True if successful, false if the position isn't in the tables or has no moves
+    bool probe_root(const chess_tb_position& position, chess_value_t* out_from, chess_value_t* out_to, int* out_wdl);
+};
+#endif // CHESS_TABLEBASE_HPP
@@ -0,0 +1,147 @@
+#ifndef CHESS_TT_HPP
+#define CHESS_TT_HPP
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+/// @brief A bucketed transposition table keyed by Zobrist hash.
+/// On the ESP32 it lives in PSRAM, which is read through the cache 32 bytes
+/// at a time, so each bucket is exactly one cache line of four 8 byte entries:
+/// a probe costs a single external RAM line fill.
+/// Any number of searches may share it without locking. Each entry is two
+/// 32 bit words written separately, and the check bits are stored XORed with
+/// the rest of the entry, so a torn read fails verification like any other miss.
+class chess_tt {
+   public:
+    /// @brief How a stored score relates to the true score
+    enum bound_type : uint8_t {
+        bound_none = 0,
+        /// @brief The true score is at most the stored score
+        bound_upper = 1,
+        /// @brief The true score is at least the stored score
+        bound_lower = 2,
+        /// @brief The stored score is exact
+        bound_exact = 3
+    };
+    /// @brief A stored search result
+    struct entry {
+        // the upper 16 bits of the key. the lower bits select the bucket
+        uint16_t check;
+        uint16_t move;
+        int16_t score;
+        int8_t depth;
+        // the search generation in the upper 6 bits, the bound in the lower 2
+        uint8_t generation_bound;
+        bound_type bound() const {
+            return (bound_type)(generation_bound & 3);
+        }
+        uint8_t generation() const {
+            return generation_bound >> 2;
+        }
+    };
+    /// @brief Counts kept by one search while it uses the table, so searches
+    /// running side by side don't contend for shared counters
+    struct statistics {
+        uint32_t probes;
+        uint32_t hits;
+        uint32_t stores;
+        uint32_t overwrites;
+        uint32_t collisions;
+    };
+    // an entry as stored: the move and score in one word, the depth,
+    // generation, bound and verification bits in the other
+    struct slot {
+        std::atomic<uint32_t> data;
+        std::atomic<uint32_t> meta;
+    };
+    static constexpr const size_t bucket_entries = 4;
+    struct alignas(32) bucket {
+        slot slots[bucket_entries];
+    };
+
+   private:
+    bucket* buckets;
+    size_t bucket_mask;
+    bool external;
+    uint8_t current_generation;
+    std::atomic<uint32_t> probes;
+    std::atomic<uint32_t> hits;
+    std::atomic<uint32_t> stores;
+    std::atomic<uint32_t> overwrites;
+    std::atomic<uint32_t> collisions;
+    static bool load(const slot& s, entry* out_entry);
+    chess_tt(const chess_tt& rhs) = delete;
+    chess_tt& operator=(const chess_tt& rhs) = delete;
+
+   public:
+    chess_tt();
+    ~chess_tt();
+    /// @brief Allocates the table, preferring PSRAM on the ESP32
+    /// @param size The size in bytes. It is rounded down to a power of two buckets.
+    /// @return True if a table of some size was allocated, otherwise false
+    bool allocate(size_t size);
+    /// @brief Frees the table
+    void deallocate();
+    /// @brief Indicates the table size
+    /// @return The size in bytes
+    size_t size() const {
+        return buckets == nullptr ? 0 : (bucket_mask + 1) * sizeof(bucket);
+    }
+    /// @brief Indicates whether the table was allocated in external RAM
+    /// @return True if it is in PSRAM, otherwise false
+    bool in_psram() const {
+        return external;
+    }
+    /// @brief Empties the table
+    void clear();
+    /// @brief Starts a new search generation. Entries from older searches are replaced first.
+    /// Call before the searches sharing the table start.
+    void new_search();
+    /// @brief Looks up a position
+    /// @param key The Zobrist key
+    /// @param out_entry The stored entry, if found
+    /// @param stats The counters to update
+    /// @return True if found, otherwise false
+    bool probe(uint64_t key, entry* out_entry, statistics* stats);
+    /// @brief Stores a search result
+    /// @param key The Zobrist key
+    /// @param move The best move, packed, or 0 for none
+    /// @param score The score
+    /// @param depth The remaining depth the score was searched to
+    /// @param bound How the score relates to the true score
+    /// @param stats The counters to update
+    void store(uint64_t key, uint16_t move, int score, int depth, bound_type bound, statistics* stats);
+    /// @brief Adds a search's counters to the totals. Hits whose move turned
+    /// out to be illegal, meaning two positions shared a check value, are counted by the search as collisions.
+    /// @param stats The counters
+    void add_statistics(const statistics& stats);
+    /// @brief Resets the counters
+    void reset_statistics();
+    /// @brief Indicates the number of lookups
+    uint32_t probe_count() const {
+        return probes;
+    }
+    /// @brief Indicates the number of lookups that found an entry
+    uint32_t hit_count() const {
+        return hits;
+    }
+    /// @brief Indicates the hit rate
+    /// @return The rate in tenths of a percent
+    uint32_t hit_rate_permille() const {
+        return probes ? (uint32_t)((uint64_t)hits * 1000 / probes) : 0;
+    }
+    /// @brief Indicates the number of stores
+    uint32_t store_count() const {
+        return stores;
+    }
+    /// @brief Indicates the number of stores that evicted a different position
+    uint32_t overwrite_count() const {
+        return overwrites;
+    }
+    /// @brief Indicates the number of detected key collisions
+    uint32_t collision_count() const {
+        return collisions;
+    }
+};
+#endif // CHESS_TT_HPP
@@ -0,0 +1,116 @@
+#ifndef CHESS_UCI_HPP
+#define CHESS_UCI_HPP
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "chess.h"
+#include "chess_engine.hpp"
+#include "chess_position.hpp"
+#include "chess_tt.hpp"
+
+/// @brief Speaks the Universal Chess Interface over any byte stream, so
+/// desktop GUIs and match runners can drive the engine. Input is fed in as it
+/// arrives, in pieces of any size, and assembled into lines without blocking.
+/// Searches run on the engine task: call update() regularly to collect them.
+/// feed() and update() must be called from the same task.
+class chess_uci {
+   public:
+    /// @brief The longest command accepted. Longer lines are dropped.
+    static constexpr const size_t max_line = 4096;
+    /// @brief Traffic counters, for throughput tests
+    struct statistics {
+        /// @brief The bytes fed in
+        uint32_t bytes_in;
+        /// @brief The bytes written out
+        uint32_t bytes_out;
+        /// @brief The commands handled
+        uint32_t commands;
+        /// @brief The searches finished
+        uint32_t searches;
+    };
+
+   private:
+    chess_engine& engine;
+    chess_tt* transpositions;
+    void (*write_callback)(const char* data, size_t size, void* state);
+    void* write_callback_state;
+    char line[max_line];
+    size_t line_size;
+    bool line_overflow;
+    chess_position position;
+    chess_history history;
+    // the team that moves first, for picking wtime or btime
+    chess_value_t white;
+    chess_search_limits limits;
+    // a go that is waiting for the engine to finish something else
+    bool go_pending;
+    bool go_ponder;
+    // holds the best move until stop, as UCI requires for go infinite and go ponder
+    bool go_infinite;
+    bool searching;
+    bool stop_requested;
+    bool has_result;
+    chess_search_result result;
+    std::atomic<bool> session;
+    bool quit;
+    statistics stats;
+    // written from the engine task too
+    std::atomic<uint32_t> bytes_out;
+    void write(const char* text);
+    void writef(const char* format, ...);
+    void command(char* text);
+    void handle_position(char* args);
+    void handle_go(char* args);
+    void start_search();
+    void report_best();
+    static void on_iteration(const chess_search_result& result, void* state);
+    static size_t move_name(const chess_position& position, chess_value_t from, chess_value_t to, char* out_name);
+    static bool parse_move(const chess_position& position, const char* text, chess_value_t* out_from, chess_value_t* out_to);
+    chess_uci(const chess_uci& rhs) = delete;
+    chess_uci& operator=(const chess_uci& rhs) = delete;
+
+   public:
+    /// @brief Constructs a UCI endpoint
+    /// @param engine The engine to search with. It must be started. Its iteration callback is taken over.
+    /// @param table The engine's transposition table, cleared on ucinewgame, or nullptr
+    chess_uci(chess_engine& engine, chess_tt* table = nullptr);
+    /// @brief Sets the function that sends output. It may be called from the engine task.
+    /// @param callback The function. Each call is one or more whole lines.
+    /// @param state User defined state passed to the callback
+    void on_write_callback(void (*callback)(const char* data, size_t size, void* state), void* state = nullptr) {
+        write_callback = callback;
+        write_callback_state = state;
+    }
+    /// @brief Handles input as it arrives. Doesn't block.
+    /// @param data The bytes received
+    /// @param size The number of bytes
+    void feed(const char* data, size_t size);
+    /// @brief Collects a finished search and reports its best move, and starts a search that was waiting
+    void update();
+    /// @brief Indicates whether a GUI has started a session with "uci" and not yet quit.
+    /// The engine belongs to the session meanwhile. Safe to call from another task.
+    /// @return True if in a session, otherwise false
+    bool active() const {
+        return session;
+    }
+    /// @brief Indicates whether "quit" was received
+    /// @return True if the GUI is done, otherwise false
+    bool quit_requested() const {
+        return quit;
+    }
+    /// @brief Indicates whether a search is running or waiting to
+    /// @return True if busy, otherwise false
+    bool busy() const {
+        return searching || go_pending;
+    }
+    /// @brief Indicates the traffic so far
+    /// @return The counters
+    statistics traffic() const {
+        statistics result = stats;
+        result.bytes_out = bytes_out;
+        return result;
+    }
+};
+#endif // CHESS_UCI_HPP
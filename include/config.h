@@ -9,7 +9,16 @@ static constexpr const size_t alarm_count = 5;
 enum COMMAND_ID : uint8_t {
     SET_ALARM = 1, // followed by 1 byte, alarm id
     CLEAR_ALARM = 2, // followed by 1 byte, alarm id
-    ALARM_THROWN = 3 // followed by 1 byte, alarm id
+    ALARM_THROWN = 3, // followed by 1 byte, alarm id
+    // two board play (see chess_link.hpp). each command goes in a frame:
+    // 0xA5, the command, 2 bytes payload size, the payload, 2 bytes CRC-16.
+    // values are little endian
+    LINK_HELLO = 16, // followed by 4 bytes board id, 2 bytes ply, 8 bytes position key, 1 byte flags (1: reply)
+    LINK_MOVE = 17, // followed by 1 byte sequence, 1 byte from, 1 byte to, 8 bytes key after, 4 bytes timestamp
+    LINK_ACK = 18, // followed by 1 byte sequence, 8 bytes key after, 4 bytes timestamp echoed, 4 bytes receipt to paint in us
+    LINK_SYNC_REQUEST = 19, // no payload
+    LINK_SYNC = 20 // followed by 2 bytes ply, 1 byte each turn, castling, en passant and halfmove clock,
+                   // 64 bytes squares, 1 byte history size, 8 bytes per history key
 };
 
 // The fire alarm switches - must have <alarm_count> entries
@@ -31,10 +40,10 @@ static constexpr struct {
 
 #ifdef ESP_PLATFORM
 // the pins used for serial transmission from the slave
-// only for ESP32
+// only for ESP32. Port C on the Core2: 16 and 17 drive its PSRAM
 constexpr struct {
     uint8_t rx;
     uint8_t tx;
-} slave_serial_pins = {16,17};
+} slave_serial_pins = {13,14};
 #endif
 #endif
\ No newline at end of file
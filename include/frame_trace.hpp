@@ -0,0 +1,45 @@
+#ifndef FRAME_TRACE_HPP
+#define FRAME_TRACE_HPP
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief The points in the frame pipeline that are timestamped
+enum struct frame_trace_event : uint8_t {
+    /// @brief lcd.update() was entered
+    update_begin = 0,
+    /// @brief lcd.update() returned
+    update_end,
+    /// @brief A control's on_paint() was entered
+    paint_begin,
+    /// @brief A control's on_paint() returned
+    paint_end,
+    /// @brief A transfer buffer was handed to the LCD. The value is the byte count.
+    flush,
+    /// @brief The LCD finished sending a transfer buffer
+    transfer_done
+};
+
+/// @brief Timestamps frame pipeline events into a lock-free ring buffer and
+/// summarizes them as histograms. Safe to record from interrupts and from
+/// either core. When the buffer wraps, the oldest events are dropped.
+class frame_trace {
+   public:
+    /// @brief The number of histogram buckets. Bucket n counts values from 2^(n-1) up to 2^n - 1.
+    static constexpr const int buckets = 16;
+    /// @brief Allocates the ring buffer and starts recording
+    /// @param capacity The number of events to hold. Rounded up to a power of 2.
+    /// @return True if recording started, otherwise false
+    static bool begin(size_t capacity = 1024);
+    /// @brief Stops recording and frees the ring buffer
+    static void end();
+    /// @brief Records an event with the current time. Does nothing if not started.
+    /// @param event The event
+    /// @param value The event's value, if any
+    static void record(frame_trace_event event, uint32_t value = 0);
+    /// @brief Consumes the recorded events and prints the histograms to stdout:
+    /// paint, update and SPI transfer times, flushes per frame, bytes per flush,
+    /// how long rendering waited for a free buffer and how long the LCD sat idle
+    /// waiting for the next one
+    static void report();
+};
+#endif // FRAME_TRACE_HPP
@@ -0,0 +1,25 @@
+#ifndef TIMING_HPP
+#define TIMING_HPP
+#include <stdint.h>
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
+#else
+#include <chrono>
+#endif
+
+/// @brief Retrieves a monotonic timestamp
+/// @return The number of microseconds since an arbitrary point in time
+static inline uint64_t timing_us() {
+#ifdef ESP_PLATFORM
+    return (uint64_t)esp_timer_get_time();
+#else
+    using namespace std::chrono;
+    return (uint64_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+}
+/// @brief Retrieves a monotonic timestamp
+/// @return The number of milliseconds since an arbitrary point in time
+static inline uint32_t timing_ms() {
+    return (uint32_t)(timing_us() / 1000);
+}
+#endif // TIMING_HPP
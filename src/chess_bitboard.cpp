@@ -0,0 +1,368 @@
+#include "chess_bitboard.hpp"
+
+#include <string.h>
+
+// ray directions. the first four are positive (toward higher square indices)
+enum {
+    dir_east = 0,   // +1
+    dir_south_west, // +7
+    dir_south,      // +8
+    dir_south_east, // +9
+    dir_west,       // -1
+    dir_north_east, // -7
+    dir_north,      // -8
+    dir_north_west  // -9
+};
+static constexpr const int dir_dx[8] = {1, -1, 0, 1, -1, 1, 0, -1};
+static constexpr const int dir_dy[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+
+static struct {
+    uint64_t knight[64];
+    uint64_t king[64];
+    uint64_t pawn[2][64];
+    uint64_t rays[8][64];
+    // squares strictly between a king square and a corner, by corner bit
+    uint64_t castling_path[4];
+    int8_t castling_king[4];
+    int8_t castling_step[4];
+    // the rights that survive a move from or to each square
+    uint8_t castling_keep[64];
+    uint8_t initial_castling;
+    // the chess.h id of each piece, by [team][type_index]
+    chess_value_t ids[2][chess_bitboard::type_count];
+    int8_t push[2];
+    uint64_t double_push_rank[2];
+    bool initialized;
+} tables;
+
+static uint64_t bit(int square) {
+    return 1ull << square;
+}
+static uint64_t offset_mask(int square, int dx, int dy) {
+    const int x = (square & 7) + dx, y = (square >> 3) + dy;
+    return (x < 0 || x > 7 || y < 0 || y > 7) ? 0 : bit(y * 8 + x);
+}
+static uint64_t slide(int dir, int square, uint64_t occupancy) {
+    uint64_t attacks = tables.rays[dir][square];
+    const uint64_t blockers = attacks & occupancy;
+    if (blockers) {
+        // the nearest blocker is the lowest bit on positive rays, the highest on negative ones
+        const int b = dir < dir_west ? __builtin_ctzll(blockers) : 63 - __builtin_clzll(blockers);
+        attacks ^= tables.rays[dir][b];
+    }
+    return attacks;
+}
+
+void chess_bitboard::initialize() {
+    if (tables.initialized) {
+        return;
+    }
+    static const int knight_d[8][2] = {{1, 2}, {2, 1}, {-1, 2}, {-2, 1}, {1, -2}, {2, -1}, {-1, -2}, {-2, -1}};
+    for (int sq = 0; sq < 64; ++sq) {
+        uint64_t n = 0, k = 0;
+        for (const auto& d : knight_d) {
+            n |= offset_mask(sq, d[0], d[1]);
+        }
+        for (int dir = 0; dir < 8; ++dir) {
+            k |= offset_mask(sq, dir_dx[dir], dir_dy[dir]);
+            uint64_t ray = 0;
+            for (int i = 1; i < 8; ++i) {
+                const uint64_t m = offset_mask(sq, dir_dx[dir] * i, dir_dy[dir] * i);
+                if (!m) break;
+                ray |= m;
+            }
+            tables.rays[dir][sq] = ray;
+        }
+        tables.knight[sq] = n;
+        tables.king[sq] = k;
+    }
+    // the pawn direction and castling geometry come from the initial position
+    chess_game_t game;
+    chess_init(&game);
+    tables.push[0] = tables.push[1] = 0;
+    memset(tables.ids, -1, sizeof(tables.ids));
+    for (int sq = 0; sq < 64; ++sq) {
+        const chess_value_t id = chess_index_to_id(&game, sq);
+        if (id < 0) {
+            continue;
+        }
+        tables.ids[CHESS_TEAM(id) & 1][index_of(CHESS_TYPE(id))] = id;
+        if (CHESS_TYPE(id) == CHESS_PAWN) {
+            // pawns advance away from the edge they start nearest to
+            tables.push[CHESS_TEAM(id) & 1] = sq < 32 ? 8 : -8;
+        }
+    }
+    for (int team = 0; team < 2; ++team) {
+        const int dy = tables.push[team] / 8;
+        for (int sq = 0; sq < 64; ++sq) {
+            tables.pawn[team][sq] = offset_mask(sq, -1, dy) | offset_mask(sq, 1, dy);
+        }
+        // pawns start on the second rank from their edge
+        tables.double_push_rank[team] = 0xFFull << (dy > 0 ? 8 : 48);
+    }
+    memset(tables.castling_keep, 0xFF, sizeof(tables.castling_keep));
+    tables.initial_castling = 0;
+    for (int i = 0; i < 4; ++i) {
+        const int corner = castling_corners[i];
+        const int rank = corner & 56;
+        tables.castling_king[i] = -1;
+        tables.castling_path[i] = 0;
+        tables.castling_step[i] = 0;
+        const chess_value_t rook = chess_index_to_id(&game, corner);
+        if (rook < 0 || CHESS_TYPE(rook) != CHESS_ROOK) {
+            continue;
+        }
+        // find the king on the rook's rank
+        for (int sq = rank; sq < rank + 8; ++sq) {
+            const chess_value_t id = chess_index_to_id(&game, sq);
+            if (id > -1 && CHESS_TYPE(id) == CHESS_KING && CHESS_TEAM(id) == CHESS_TEAM(rook)) {
+                tables.initial_castling |= (1 << i);
+                tables.castling_keep[corner] &= ~(1 << i);
+                tables.castling_keep[sq] &= ~(1 << i);
+                tables.castling_king[i] = sq;
+                tables.castling_step[i] = corner > sq ? 1 : -1;
+                for (int s = sq + tables.castling_step[i]; s != corner; s += tables.castling_step[i]) {
+                    tables.castling_path[i] |= bit(s);
+                }
+            }
+        }
+    }
+    tables.initialized = true;
+}
+chess_bitboard::type_index chess_bitboard::index_of(int type) {
+    switch (type) {
+        case CHESS_KNIGHT:
+            return knight;
+        case CHESS_BISHOP:
+            return bishop;
+        case CHESS_ROOK:
+            return rook;
+        case CHESS_QUEEN:
+            return queen;
+        case CHESS_KING:
+            return king;
+        default:
+            return pawn;
+    }
+}
+int chess_bitboard::type_of(type_index index) {
+    static const int types[type_count] = {CHESS_PAWN, CHESS_KNIGHT, CHESS_BISHOP, CHESS_ROOK, CHESS_QUEEN, CHESS_KING};
+    return types[index];
+}
+uint64_t chess_bitboard::knight_attacks(int square) {
+    return tables.knight[square];
+}
+uint64_t chess_bitboard::king_attacks(int square) {
+    return tables.king[square];
+}
+uint64_t chess_bitboard::pawn_attacks(int team, int square) {
+    return tables.pawn[team & 1][square];
+}
+uint64_t chess_bitboard::bishop_attacks(int square, uint64_t occupancy) {
+    return slide(dir_south_west, square, occupancy) | slide(dir_south_east, square, occupancy) |
+           slide(dir_north_east, square, occupancy) | slide(dir_north_west, square, occupancy);
+}
+uint64_t chess_bitboard::rook_attacks(int square, uint64_t occupancy) {
+    return slide(dir_east, square, occupancy) | slide(dir_south, square, occupancy) |
+           slide(dir_west, square, occupancy) | slide(dir_north, square, occupancy);
+}
+int chess_bitboard::pawn_push(int team) {
+    return tables.push[team & 1];
+}
+chess_value_t chess_bitboard::piece_id(int team, type_index type) {
+    return tables.ids[team & 1][type];
+}
+uint8_t chess_bitboard::initial_castling() {
+    return tables.initial_castling;
+}
+uint8_t chess_bitboard::castling_keep(int square) {
+    return tables.castling_keep[square];
+}
+void chess_bitboard::clear() {
+    memset(pieces, 0, sizeof(pieces));
+    teams[0] = teams[1] = 0;
+    occupied = 0;
+    memset(squares, -1, sizeof(squares));
+}
+void chess_bitboard::put(chess_value_t id, int square) {
+    const uint64_t b = bit(square);
+    const int team = CHESS_TEAM(id) & 1;
+    pieces[team][index_of(CHESS_TYPE(id))] |= b;
+    teams[team] |= b;
+    occupied |= b;
+    squares[square] = id;
+}
+void chess_bitboard::remove(int square) {
+    const chess_value_t id = squares[square];
+    if (id < 0) {
+        return;
+    }
+    const uint64_t b = ~bit(square);
+    const int team = CHESS_TEAM(id) & 1;
+    pieces[team][index_of(CHESS_TYPE(id))] &= b;
+    teams[team] &= b;
+    occupied &= b;
+    squares[square] = -1;
+}
+void chess_bitboard::load(const chess_game_t& game) {
+    clear();
+    for (int sq = 0; sq < 64; ++sq) {
+        const chess_value_t id = chess_index_to_id(&game, sq);
+        if (id > -1) {
+            put(id, sq);
+        }
+    }
+}
+int chess_bitboard::king_square(int team) const {
+    const uint64_t k = pieces[team & 1][king];
+    return k ? __builtin_ctzll(k) : -1;
+}
+uint64_t chess_bitboard::attackers(int square, int by_team, uint64_t occupancy, uint64_t removed) const {
+    const uint64_t* p = pieces[by_team & 1];
+    const uint64_t keep = ~removed;
+    return (tables.pawn[!(by_team & 1)][square] & p[pawn] & keep) |
+           (tables.knight[square] & p[knight] & keep) |
+           (tables.king[square] & p[king]) |
+           (bishop_attacks(square, occupancy) & (p[bishop] | p[queen]) & keep) |
+           (rook_attacks(square, occupancy) & (p[rook] | p[queen]) & keep);
+}
+bool chess_bitboard::attacked(int square, int by_team) const {
+    return 0 != attackers(square, by_team, occupied, 0);
+}
+bool chess_bitboard::in_check(int team) const {
+    const int k = king_square(team);
+    return k > -1 && attacked(k, !(team & 1));
+}
+uint64_t chess_bitboard::pseudo_destinations(int square, uint8_t castling, chess_value_t en_passant) const {
+    const chess_value_t id = squares[square];
+    const int team = CHESS_TEAM(id) & 1;
+    const uint64_t own = teams[team];
+    switch (index_of(CHESS_TYPE(id))) {
+        case pawn: {
+            const int push = tables.push[team];
+            uint64_t result = 0;
+            const int one = square + push;
+            if (one >= 0 && one < 64 && !(occupied & bit(one))) {
+                result |= bit(one);
+                const int two = one + push;
+                if ((tables.double_push_rank[team] & bit(square)) && !(occupied & bit(two))) {
+                    result |= bit(two);
+                }
+            }
+            uint64_t enemies = teams[!team];
+            if (en_passant > -1) {
+                enemies |= bit(en_passant);
+            }
+            return result | (tables.pawn[team][square] & enemies);
+        }
+        case knight:
+            return tables.knight[square] & ~own;
+        case bishop:
+            return bishop_attacks(square, occupied) & ~own;
+        case rook:
+            return rook_attacks(square, occupied) & ~own;
+        case queen:
+            return (bishop_attacks(square, occupied) | rook_attacks(square, occupied)) & ~own;
+        case king: {
+            uint64_t result = tables.king[square] & ~own;
+            for (int i = 0; i < 4; ++i) {
+                if (!(castling & (1 << i)) || tables.castling_king[i] != square) {
+                    continue;
+                }
+                const chess_value_t rook_id = squares[castling_corners[i]];
+                if (rook_id < 0 || CHESS_TYPE(rook_id) != CHESS_ROOK || (CHESS_TEAM(rook_id) & 1) != team ||
+                    (occupied & tables.castling_path[i])) {
+                    continue;
+                }
+                // the king may not castle out of, through or into check
+                const int step = tables.castling_step[i];
+                if (attacked(square, !team) || attacked(square + step, !team)) {
+                    continue;
+                }
+                // legal_filter checks the destination
+                result |= bit(square + step * 2);
+            }
+            return result;
+        }
+    }
+    return 0;
+}
+uint64_t chess_bitboard::legal_filter(int square, uint64_t targets, chess_value_t en_passant) const {
+    const chess_value_t id = squares[square];
+    const int team = CHESS_TEAM(id) & 1;
+    const bool is_king = CHESS_TYPE(id) == CHESS_KING;
+    const bool is_pawn = CHESS_TYPE(id) == CHESS_PAWN;
+    const int k = is_king ? -1 : king_square(team);
+    if (!is_king && k < 0) {
+        // no king to protect
+        return targets;
+    }
+    uint64_t result = 0;
+    uint64_t remaining = targets;
+    while (remaining) {
+        const int to = chess_pop_square(&remaining);
+        uint64_t removed = bit(to);
+        uint64_t occupancy = (occupied & ~bit(square)) | bit(to);
+        if (is_pawn && to == en_passant) {
+            // the captured pawn is behind the target square
+            const int captured = to - tables.push[team];
+            removed |= bit(captured);
+            occupancy &= ~bit(captured);
+        }
+        if (0 == attackers(is_king ? to : k, !team, occupancy, removed)) {
+            result |= bit(to);
+        }
+    }
+    return result;
+}
+uint64_t chess_bitboard::destinations(int square, uint8_t castling, chess_value_t en_passant) const {
+    if (squares[square] < 0) {
+        return 0;
+    }
+    return legal_filter(square, pseudo_destinations(square, castling, en_passant), en_passant);
+}
+uint64_t chess_bitboard::generate(int team, uint8_t castling, chess_value_t en_passant, uint64_t* out_destinations) const {
+    uint64_t origins = 0;
+    uint64_t remaining = teams[team & 1];
+    while (remaining) {
+        const int sq = chess_pop_square(&remaining);
+        const uint64_t d = legal_filter(sq, pseudo_destinations(sq, castling, en_passant), en_passant);
+        if (d) {
+            out_destinations[sq] = d;
+            origins |= bit(sq);
+        }
+    }
+    return origins;
+}
+void chess_bitboard::play(int from, int to, chess_value_t promotion, uint8_t* castling, chess_value_t* en_passant) {
+    const chess_value_t id = squares[from];
+    const int team = CHESS_TEAM(id) & 1;
+    const int type = CHESS_TYPE(id);
+    const int push = tables.push[team];
+    remove(to);
+    remove(from);
+    chess_value_t arrived = id;
+    if (type == CHESS_PAWN) {
+        if (to == *en_passant) {
+            // the captured pawn is behind the target square
+            remove(to - push);
+        }
+        if (to + push < 0 || to + push > 63) {
+            arrived = promotion > -1 ? promotion : tables.ids[team][queen];
+        }
+    } else if (type == CHESS_KING) {
+        for (int i = 0; i < 4; ++i) {
+            const int step = tables.castling_step[i];
+            if (tables.castling_king[i] == from && from + step * 2 == to) {
+                // the rook jumps to the square the king crossed
+                const chess_value_t rook = squares[castling_corners[i]];
+                remove(castling_corners[i]);
+                put(rook, from + step);
+                break;
+            }
+        }
+    }
+    put(arrived, to);
+    *castling &= tables.castling_keep[from] & tables.castling_keep[to];
+    *en_passant = (type == CHESS_PAWN && (to - from == 16 || from - to == 16)) ? (chess_value_t)((from + to) / 2) : -1;
+}
@@ -0,0 +1,251 @@
+#include "chess_block_cache.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "timing.hpp"
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#endif
+
+static void* cache_alloc(size_t size) {
+#ifdef ESP_PLATFORM
+    void* result = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (result == nullptr) {
+        result = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    return result;
+#else
+    return malloc(size);
+#endif
+}
+static void cache_free(void* ptr) {
+#ifdef ESP_PLATFORM
+    heap_caps_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+chess_block_cache::chess_block_cache() : blocks(nullptr), block_files(nullptr), block_numbers(nullptr), chains(nullptr), newer(nullptr), older(nullptr), buckets(nullptr), bucket_mask(0), newest(-1), oldest(-1), block_size(0), block_count(0), use_counter(0), opener(nullptr), opener_state(nullptr), gate(nullptr), gate_state(nullptr), hit_count(0), miss_count(0), read_us(0) {
+    memset(files, 0, sizeof(files));
+#ifdef ESP_PLATFORM
+    lock = xSemaphoreCreateMutex();
+#endif
+}
+chess_block_cache::~chess_block_cache() {
+    deallocate();
+#ifdef ESP_PLATFORM
+    vSemaphoreDelete(lock);
+#endif
+}
+void chess_block_cache::acquire() {
+#ifdef ESP_PLATFORM
+    xSemaphoreTake(lock, portMAX_DELAY);
+#else
+    lock.lock();
+#endif
+}
+void chess_block_cache::release() {
+#ifdef ESP_PLATFORM
+    xSemaphoreGive(lock);
+#else
+    lock.unlock();
+#endif
+}
+bool chess_block_cache::allocate(size_t block_size, size_t block_count) {
+    deallocate();
+    if (block_size == 0 || block_count == 0) {
+        return false;
+    }
+    size_t bucket_count = 1;
+    while (bucket_count < block_count) bucket_count *= 2;
+    blocks = (uint8_t*)cache_alloc(block_size * block_count);
+    // the bookkeeping is small, so it stays in internal RAM
+    block_files = (uint32_t*)malloc(block_count * sizeof(uint32_t));
+    block_numbers = (uint32_t*)malloc(block_count * sizeof(uint32_t));
+    chains = (int32_t*)malloc(block_count * sizeof(int32_t));
+    newer = (int32_t*)malloc(block_count * sizeof(int32_t));
+    older = (int32_t*)malloc(block_count * sizeof(int32_t));
+    buckets = (int32_t*)malloc(bucket_count * sizeof(int32_t));
+    if (blocks == nullptr || block_files == nullptr || block_numbers == nullptr || chains == nullptr ||
+        newer == nullptr || older == nullptr || buckets == nullptr) {
+        deallocate();
+        return false;
+    }
+    this->block_size = block_size;
+    this->block_count = block_count;
+    bucket_mask = bucket_count - 1;
+    reset_blocks();
+    return true;
+}
+void chess_block_cache::reset_blocks() {
+    for (size_t i = 0; i <= bucket_mask; ++i) {
+        buckets[i] = -1;
+    }
+    // every block starts out empty, chained oldest to newest in order
+    for (size_t i = 0; i < block_count; ++i) {
+        block_files[i] = UINT32_MAX;
+        block_numbers[i] = 0;
+        chains[i] = -1;
+        older[i] = (int32_t)i - 1;
+        newer[i] = i + 1 < block_count ? (int32_t)i + 1 : -1;
+    }
+    oldest = 0;
+    newest = (int32_t)block_count - 1;
+}
+void chess_block_cache::deallocate() {
+    close_files();
+    cache_free(blocks);
+    free(block_files);
+    free(block_numbers);
+    free(chains);
+    free(newer);
+    free(older);
+    free(buckets);
+    blocks = nullptr;
+    block_files = block_numbers = nullptr;
+    chains = newer = older = buckets = nullptr;
+    block_size = block_count = 0;
+    newest = oldest = -1;
+}
+void chess_block_cache::close_files() {
+    acquire();
+    for (open_file& f : files) {
+        if (f.handle != nullptr) {
+            fclose(f.handle);
+            f.handle = nullptr;
+        }
+    }
+    release();
+}
+void chess_block_cache::clear() {
+    close_files();
+    if (blocks == nullptr) {
+        return;
+    }
+    acquire();
+    reset_blocks();
+    release();
+}
+void chess_block_cache::reset_statistics() {
+    hit_count = miss_count = 0;
+    read_us = 0;
+}
+size_t chess_block_cache::bucket_of(uint32_t file, uint32_t block) const {
+    return (size_t)((file * 0x9E3779B1u) ^ (block * 0x85EBCA77u)) & bucket_mask;
+}
+void chess_block_cache::touch(int32_t slot) {
+    if (slot == newest) {
+        return;
+    }
+    // unlink. there's a newer block since this isn't the newest
+    const int32_t previous = older[slot], next = newer[slot];
+    if (previous > -1) {
+        newer[previous] = next;
+    } else {
+        oldest = next;
+    }
+    older[next] = previous;
+    // relink as the newest
+    older[slot] = newest;
+    newer[slot] = -1;
+    newer[newest] = slot;
+    newest = slot;
+}
+FILE* chess_block_cache::handle(uint32_t file) {
+    open_file* victim = &files[0];
+    for (open_file& f : files) {
+        if (f.handle != nullptr && f.file == file) {
+            f.last_use = ++use_counter;
+            return f.handle;
+        }
+        if (f.handle == nullptr || (victim->handle != nullptr && f.last_use < victim->last_use)) {
+            victim = &f;
+        }
+    }
+    if (opener == nullptr) {
+        return nullptr;
+    }
+    if (victim->handle != nullptr) {
+        fclose(victim->handle);
+        victim->handle = nullptr;
+    }
+    FILE* result = opener(file, opener_state);
+    if (result != nullptr) {
+        victim->file = file;
+        victim->handle = result;
+        victim->last_use = ++use_counter;
+    }
+    return result;
+}
+const uint8_t* chess_block_cache::fetch(uint32_t file, uint32_t block) {
+    const size_t bucket = bucket_of(file, block);
+    for (int32_t slot = buckets[bucket]; slot > -1; slot = chains[slot]) {
+        if (block_files[slot] == file && block_numbers[slot] == block) {
+            ++hit_count;
+            touch(slot);
+            return blocks + (size_t)slot * block_size;
+        }
+    }
+    FILE* f = handle(file);
+    if (f == nullptr) {
+        return nullptr;
+    }
+    // reuse the least recently used block
+    const int32_t slot = oldest;
+    if (block_files[slot] != UINT32_MAX) {
+        int32_t* link = &buckets[bucket_of(block_files[slot], block_numbers[slot])];
+        while (*link != slot) {
+            link = &chains[*link];
+        }
+        *link = chains[slot];
+    }
+    block_files[slot] = UINT32_MAX;
+    uint8_t* data = blocks + (size_t)slot * block_size;
+    const uint64_t start = timing_us();
+    if (gate != nullptr) {
+        gate(gate_state);
+    }
+    size_t read = 0;
+    if (0 == fseek(f, (long)((uint64_t)block * block_size), SEEK_SET)) {
+        read = fread(data, 1, block_size, f);
+    }
+    read_us += timing_us() - start;
+    ++miss_count;
+    if (read == 0 && ferror(f)) {
+        clearerr(f);
+        touch(slot);
+        return nullptr;
+    }
+    memset(data + read, 0, block_size - read);
+    block_files[slot] = file;
+    block_numbers[slot] = block;
+    chains[slot] = buckets[bucket];
+    buckets[bucket] = slot;
+    touch(slot);
+    return data;
+}
+bool chess_block_cache::read(uint32_t file, uint64_t offset, void* out_data, size_t size) {
+    if (blocks == nullptr) {
+        return false;
+    }
+    uint8_t* out = (uint8_t*)out_data;
+    acquire();
+    while (size) {
+        const uint32_t block = (uint32_t)(offset / block_size);
+        const size_t start = (size_t)(offset % block_size);
+        const size_t length = size < block_size - start ? size : block_size - start;
+        const uint8_t* data = fetch(file, block);
+        if (data == nullptr) {
+            release();
+            return false;
+        }
+        memcpy(out, data + start, length);
+        out += length;
+        offset += length;
+        size -= length;
+    }
+    release();
+    return true;
+}
@@ -0,0 +1,110 @@
+#include "chess_clock.hpp"
+
+chess_clock::chess_clock() {
+    reset(0, 0, bonus_increment);
+}
+void chess_clock::reset(uint32_t initial_ms, uint32_t bonus_ms, bonus_type mode) {
+    remaining_us[0] = remaining_us[1] = (uint64_t)initial_ms * 1000;
+    bonus_us = (uint64_t)bonus_ms * 1000;
+    bonus_mode = mode;
+    turn_start_us = 0;
+    running_team = -1;
+    flags[0] = flags[1] = false;
+}
+uint64_t chess_clock::running_remaining_us(uint64_t now_us, uint64_t* out_delay_left_us) const {
+    uint64_t elapsed = now_us > turn_start_us ? now_us - turn_start_us : 0;
+    *out_delay_left_us = 0;
+    if (bonus_mode == bonus_delay) {
+        if (elapsed < bonus_us) {
+            *out_delay_left_us = bonus_us - elapsed;
+            elapsed = 0;
+        } else {
+            elapsed -= bonus_us;
+        }
+    }
+    const uint64_t remaining = remaining_us[running_team];
+    return elapsed < remaining ? remaining - elapsed : 0;
+}
+void chess_clock::press(int team, uint64_t now_us, bool moved) {
+    if (running_team > -1) {
+        uint64_t delay_left;
+        remaining_us[running_team] = running_remaining_us(now_us, &delay_left);
+        if (remaining_us[running_team] == 0) {
+            flags[running_team] = true;
+            running_team = -1;
+            return;
+        }
+        if (moved && bonus_mode == bonus_increment) {
+            remaining_us[running_team] += bonus_us;
+        }
+    }
+    if (flags[0] || flags[1]) {
+        return;
+    }
+    running_team = team & 1;
+    turn_start_us = now_us;
+}
+void chess_clock::stop(uint64_t now_us) {
+    if (running_team > -1) {
+        uint64_t delay_left;
+        remaining_us[running_team] = running_remaining_us(now_us, &delay_left);
+        flags[running_team] = remaining_us[running_team] == 0;
+        running_team = -1;
+    }
+}
+uint32_t chess_clock::remaining_ms(int team, uint64_t now_us) const {
+    if ((team & 1) != running_team) {
+        return (uint32_t)(remaining_us[team & 1] / 1000);
+    }
+    uint64_t delay_left;
+    return (uint32_t)(running_remaining_us(now_us, &delay_left) / 1000);
+}
+uint32_t chess_clock::display_seconds(int team, uint64_t now_us) const {
+    uint64_t remaining = remaining_us[team & 1];
+    if ((team & 1) == running_team) {
+        uint64_t delay_left;
+        remaining = running_remaining_us(now_us, &delay_left);
+    }
+    return (uint32_t)((remaining + 999999) / 1000000);
+}
+bool chess_clock::check_flag(uint64_t now_us) {
+    if (running_team < 0) {
+        return false;
+    }
+    uint64_t delay_left;
+    if (running_remaining_us(now_us, &delay_left) != 0) {
+        return false;
+    }
+    stop(now_us);
+    return true;
+}
+uint64_t chess_clock::next_change_us(uint64_t now_us) const {
+    if (running_team < 0) {
+        return 0;
+    }
+    uint64_t delay_left;
+    const uint64_t remaining = running_remaining_us(now_us, &delay_left);
+    // the display rounds up, so it changes as the time crosses a whole second
+    const uint64_t to_second = remaining % 1000000;
+    return delay_left + (to_second ? to_second : remaining ? 1000000 : 1);
+}
+uint32_t chess_clock::budget_ms(int team, uint64_t now_us) const {
+    const uint32_t remaining = remaining_ms(team, now_us);
+    if (remaining == 0 && bonus_us == 0) {
+        return 0;
+    }
+    const uint32_t bonus = (uint32_t)(bonus_us / 1000);
+    if (bonus_mode == bonus_delay) {
+        // the delay is free, and spending it all costs nothing
+        return move_budget(remaining, 0) + bonus;
+    }
+    return move_budget(remaining, bonus);
+}
+uint32_t chess_clock::move_budget(uint32_t remaining_ms, uint32_t increment_ms, uint32_t moves_to_go) {
+    // an even share of what's left, plus most of the increment,
+    // never cutting into the last 50ms
+    const uint32_t budget = remaining_ms / (moves_to_go ? moves_to_go + 1 : 30) + increment_ms * 3 / 4;
+    const uint32_t most = remaining_ms > 100 ? remaining_ms - 50 : remaining_ms / 2;
+    const uint32_t result = budget < most ? budget : most;
+    return result ? result : 1;
+}
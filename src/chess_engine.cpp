@@ -0,0 +1,238 @@
+#include "chess_engine.hpp"
+
+#include <string.h>
+#ifndef ESP_PLATFORM
+#include <chrono>
+#endif
+
+// how often a finished ponder search checks for the expected move
+static constexpr const uint32_t ponder_wait_ms = 10;
+
+void chess_engine::fill_request(request* out_request, const chess_position& position, const chess_search_limits& limits, const uint64_t* history, size_t history_size, bool ponder) {
+    out_request->position = position;
+    out_request->limits = limits;
+    out_request->ponder = ponder;
+    if (history == nullptr) {
+        history_size = 0;
+    }
+    // keep the most recent keys
+    const size_t skip = history_size > max_history ? history_size - max_history : 0;
+    out_request->history_size = history_size - skip;
+    if (out_request->history_size) {
+        memcpy(out_request->history, history + skip, out_request->history_size * sizeof(uint64_t));
+    }
+}
+bool chess_engine::ponder(const chess_position& position, const chess_search_limits& limits, const uint64_t* history, size_t history_size) {
+    if (busy) {
+        return false;
+    }
+    searcher.ponder(true);
+    ponder_state = ponder_active;
+    if (!submit(position, limits, history, history_size, true)) {
+        searcher.ponder(false);
+        ponder_state = ponder_none;
+        return false;
+    }
+    return true;
+}
+bool chess_engine::ponder_hit() {
+    uint8_t expected = ponder_active;
+    if (!ponder_state.compare_exchange_strong(expected, ponder_none)) {
+        return false;
+    }
+    searcher.ponder(false);
+    return true;
+}
+// called from the engine task once a ponder search returns. it may have
+// finished before the opponent moved, so wait for the verdict.
+// returns true if the result should be reported
+bool chess_engine::finish_ponder() {
+    while (ponder_state == ponder_active) {
+#ifdef ESP_PLATFORM
+        vTaskDelay(pdMS_TO_TICKS(ponder_wait_ms));
+#else
+        std::this_thread::sleep_for(std::chrono::milliseconds(ponder_wait_ms));
+#endif
+    }
+    const bool hit = ponder_state != ponder_missed;
+    ponder_state = ponder_none;
+    searcher.ponder(false);
+    return hit;
+}
+#ifdef ESP_PLATFORM
+// the search recurses once per ply
+static constexpr const uint32_t engine_stack_size = 16 * 1024;
+
+chess_engine::chess_engine() : busy(false), ponder_state(ponder_none), result_callback(nullptr), result_callback_state(nullptr), task(nullptr), requests(nullptr), results(nullptr) {
+}
+chess_engine::~chess_engine() {
+    stop();
+}
+void chess_engine::task_proc(void* state) {
+    chess_engine* engine = (chess_engine*)state;
+    static request req;
+    chess_search_result result;
+    while (1) {
+        if (pdTRUE == xQueueReceive(engine->requests, &req, portMAX_DELAY)) {
+            engine->searcher.search(req.position, req.limits, &result, req.history, req.history_size);
+            if (req.ponder && !engine->finish_ponder()) {
+                // the opponent played something else
+                engine->busy = false;
+            } else {
+                xQueueOverwrite(engine->results, &result);
+            }
+            if (engine->result_callback != nullptr) {
+                engine->result_callback(engine->result_callback_state);
+            }
+        }
+    }
+}
+bool chess_engine::start(int core, int priority) {
+    if (task != nullptr) {
+        return true;
+    }
+    requests = xQueueCreate(1, sizeof(request));
+    results = xQueueCreate(1, sizeof(chess_search_result));
+    if (requests == nullptr || results == nullptr) {
+        stop();
+        return false;
+    }
+    if (pdPASS != xTaskCreatePinnedToCore(task_proc, "chess_engine", engine_stack_size, this, priority, &task, core < 0 ? tskNO_AFFINITY : core)) {
+        task = nullptr;
+        stop();
+        return false;
+    }
+    return true;
+}
+void chess_engine::stop() {
+    if (task != nullptr) {
+        cancel();
+        vTaskDelete(task);
+        task = nullptr;
+    }
+    if (requests != nullptr) {
+        vQueueDelete(requests);
+        requests = nullptr;
+    }
+    if (results != nullptr) {
+        vQueueDelete(results);
+        results = nullptr;
+    }
+    busy = false;
+    ponder_state = ponder_none;
+    searcher.ponder(false);
+}
+bool chess_engine::submit(const chess_position& position, const chess_search_limits& limits, const uint64_t* history, size_t history_size, bool ponder) {
+    if (task == nullptr || busy) {
+        return false;
+    }
+    // too big for the stack of the UI task
+    static request req;
+    fill_request(&req, position, limits, history, history_size, ponder);
+    busy = true;
+    // before it's queued, so a cancel() from now on reaches this search
+    searcher.clear_cancel();
+    if (pdTRUE != xQueueSend(requests, &req, 0)) {
+        busy = false;
+        return false;
+    }
+    return true;
+}
+bool chess_engine::poll(chess_search_result* out_result) {
+    if (results == nullptr || pdTRUE != xQueueReceive(results, out_result, 0)) {
+        return false;
+    }
+    busy = false;
+    return true;
+}
+#else
+chess_engine::chess_engine() : busy(false), ponder_state(ponder_none), result_callback(nullptr), result_callback_state(nullptr), has_request(false), has_result(false), quit(false) {
+}
+chess_engine::~chess_engine() {
+    stop();
+}
+void chess_engine::thread_proc() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (1) {
+        signal.wait(guard, [this] { return has_request || quit; });
+        if (quit) {
+            return;
+        }
+        request req = pending;
+        has_request = false;
+        guard.unlock();
+        chess_search_result res;
+        searcher.search(req.position, req.limits, &res, req.history, req.history_size);
+        const bool report = !req.ponder || finish_ponder();
+        guard.lock();
+        if (report) {
+            result = res;
+            has_result = true;
+        } else {
+            // the opponent played something else
+            busy = false;
+        }
+        if (result_callback != nullptr) {
+            guard.unlock();
+            result_callback(result_callback_state);
+            guard.lock();
+        }
+    }
+}
+bool chess_engine::start(int core, int priority) {
+    (void)core;
+    (void)priority;
+    if (thread.joinable()) {
+        return true;
+    }
+    quit = false;
+    thread = std::thread(&chess_engine::thread_proc, this);
+    return true;
+}
+void chess_engine::stop() {
+    if (thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            quit = true;
+        }
+        cancel();
+        signal.notify_all();
+        thread.join();
+    }
+    has_request = false;
+    has_result = false;
+    busy = false;
+    ponder_state = ponder_none;
+    searcher.ponder(false);
+}
+bool chess_engine::submit(const chess_position& position, const chess_search_limits& limits, const uint64_t* history, size_t history_size, bool ponder) {
+    if (!thread.joinable() || busy) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        fill_request(&pending, position, limits, history, history_size, ponder);
+        // before it's queued, so a cancel() from now on reaches this search
+        searcher.clear_cancel();
+        has_request = true;
+        busy = true;
+    }
+    signal.notify_all();
+    return true;
+}
+bool chess_engine::poll(chess_search_result* out_result) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!has_result) {
+        return false;
+    }
+    *out_result = result;
+    has_result = false;
+    busy = false;
+    return true;
+}
+#endif
+void chess_engine::cancel() {
+    uint8_t expected = ponder_active;
+    ponder_state.compare_exchange_strong(expected, ponder_missed);
+    searcher.cancel();
+}
@@ -0,0 +1,309 @@
+#include "chess_journal.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <type_traits>
+
+// the journal starts with a header, followed by 16-bit move records:
+// from in bits 0-5, to in bits 6-11, bits 12-15 reserved (zero).
+// record i is the move that reaches ply base + i + 1
+static constexpr const uint32_t journal_magic = 0x314E4A43;   // CJN1
+static constexpr const uint32_t snapshot_magic = 0x31504E53;  // SNP1
+struct journal_header {
+    uint32_t magic;
+    uint32_t game;
+    // the ply the first record starts from
+    uint32_t base;
+};
+static_assert(std::is_trivially_copyable<chess_position>::value, "chess_position is snapshotted as bytes");
+
+static uint16_t pack_record(chess_value_t from, chess_value_t to) {
+    return (uint16_t)((from & 63) | ((to & 63) << 6));
+}
+// writes a file next to the target and swaps it in, so a reset leaves
+// either the old contents or the new ones
+static bool replace_file(const char* path, const char* temp_path, const void* data1, size_t size1, const void* data2, size_t size2) {
+    FILE* file = fopen(temp_path, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool result = size1 == fwrite(data1, 1, size1, file);
+    if (result && size2) {
+        result = size2 == fwrite(data2, 1, size2, file);
+    }
+    result = result && 0 == fflush(file) && 0 == fsync(fileno(file));
+    fclose(file);
+    if (!result) {
+        remove(temp_path);
+        return false;
+    }
+    // SPIFFS won't rename over an existing file
+    remove(path);
+    return 0 == rename(temp_path, path);
+}
+
+chess_journal::chess_journal() : game(0), plies(0), snapshot_interval(16), pending_size(0), pending_new_game(false), pending_snapshot(false), failed(false) {
+    journal_path[0] = snapshot_path[0] = temp_path[0] = '\0';
+#ifdef ESP_PLATFORM
+    lock = xSemaphoreCreateMutex();
+    task = nullptr;
+    sync_ms = 1000;
+#endif
+}
+chess_journal::~chess_journal() {
+#ifdef ESP_PLATFORM
+    if (task != nullptr) {
+        vTaskDelete(task);
+    }
+    vSemaphoreDelete(lock);
+#endif
+}
+void chess_journal::acquire() {
+#ifdef ESP_PLATFORM
+    xSemaphoreTake(lock, portMAX_DELAY);
+#else
+    lock.lock();
+#endif
+}
+void chess_journal::release() {
+#ifdef ESP_PLATFORM
+    xSemaphoreGive(lock);
+#else
+    lock.unlock();
+#endif
+}
+void chess_journal::signal() {
+#ifdef ESP_PLATFORM
+    if (task != nullptr) {
+        xTaskNotifyGive(task);
+    }
+#endif
+}
+uint32_t chess_journal::checksum(const snapshot& snap) {
+    // FNV-1a over everything but the checksum
+    uint32_t result = 2166136261u;
+    const uint8_t* p = (const uint8_t*)&snap;
+    for (size_t i = 0; i < offsetof(snapshot, checksum); ++i) {
+        result = (result ^ p[i]) * 16777619u;
+    }
+    return result;
+}
+void chess_journal::open(const char* directory, uint32_t snapshot_interval) {
+    snprintf(journal_path, sizeof(journal_path), "%s/game.jnl", directory);
+    snprintf(snapshot_path, sizeof(snapshot_path), "%s/game.snp", directory);
+    snprintf(temp_path, sizeof(temp_path), "%s/game.tmp", directory);
+    this->snapshot_interval = snapshot_interval ? snapshot_interval : 1;
+    // a reset between the remove and the rename in replace_file()
+    // leaves only the new contents, under the temporary name
+    FILE* file = fopen(temp_path, "rb");
+    if (file != nullptr) {
+        uint32_t magic = 0;
+        const bool read = 1 == fread(&magic, sizeof(magic), 1, file);
+        fclose(file);
+        if (read && magic == journal_magic && access(journal_path, F_OK) != 0) {
+            rename(temp_path, journal_path);
+        } else if (read && magic == snapshot_magic && access(snapshot_path, F_OK) != 0) {
+            rename(temp_path, snapshot_path);
+        } else {
+            remove(temp_path);
+        }
+    }
+}
+bool chess_journal::resume(chess_position* out_position, chess_history* out_history, resume_result* out_result) {
+    FILE* file = fopen(journal_path, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    journal_header header;
+    if (1 != fread(&header, sizeof(header), 1, file) || header.magic != journal_magic) {
+        fclose(file);
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    const long bytes = ftell(file) - (long)sizeof(header);
+    const uint32_t records = bytes > 0 ? (uint32_t)(bytes / 2) : 0;
+    bool damaged = bytes > 0 && (bytes & 1);
+    uint32_t start = header.base;
+    bool from_snapshot = false;
+    // the writer's snapshot isn't in use until start() or flush()
+    snapshot& snap = writing_snap;
+    FILE* snap_file = fopen(snapshot_path, "rb");
+    if (snap_file != nullptr) {
+        if (1 == fread(&snap, sizeof(snap), 1, snap_file) && snap.magic == snapshot_magic &&
+            snap.size == sizeof(snap) && snap.checksum == checksum(snap) && snap.game == header.game &&
+            snap.plies >= header.base && snap.position.consistent()) {
+            *out_position = snap.position;
+            *out_history = snap.history;
+            start = snap.plies;
+            from_snapshot = true;
+        }
+        fclose(snap_file);
+    }
+    if (!from_snapshot) {
+        if (header.base != 0) {
+            // the moves before the journal starts are gone
+            fclose(file);
+            return false;
+        }
+        out_position->init();
+        out_history->clear();
+    }
+    uint32_t replayed = 0;
+    if (start - header.base < records) {
+        fseek(file, (long)(sizeof(header) + (start - header.base) * 2), SEEK_SET);
+        uint16_t buffer[32];
+        size_t read;
+        bool stop = false;
+        while (!stop && 0 != (read = fread(buffer, sizeof(uint16_t), 32, file))) {
+            for (size_t i = 0; i < read; ++i) {
+                const chess_value_t from = buffer[i] & 63, to = (buffer[i] >> 6) & 63;
+                const uint64_t key = out_position->key();
+                if ((buffer[i] >> 12) != 0 || -2 == out_position->move(from, to)) {
+                    // a torn or corrupt record. the game ends before it
+                    damaged = true;
+                    stop = true;
+                    break;
+                }
+                out_history->push(key, out_position->halfmove_clock());
+                ++replayed;
+            }
+        }
+    }
+    fclose(file);
+    acquire();
+    game = header.game;
+    plies = start + replayed;
+    pending_size = 0;
+    if (damaged) {
+        // rewrite the journal without the bad tail
+        pending_snap.position = *out_position;
+        pending_snap.history = *out_history;
+        pending_snap.plies = plies;
+        pending_snapshot = true;
+    }
+    release();
+    if (damaged) {
+        signal();
+    }
+    if (out_result != nullptr) {
+        out_result->game = game;
+        out_result->plies = plies;
+        out_result->replayed = replayed;
+        out_result->from_snapshot = from_snapshot;
+    }
+    return true;
+}
+void chess_journal::new_game() {
+    acquire();
+    ++game;
+    plies = 0;
+    pending_size = 0;
+    pending_snapshot = false;
+    pending_new_game = true;
+    release();
+    signal();
+}
+void chess_journal::append(chess_value_t from, chess_value_t to, const chess_position& after, const chess_history& history) {
+    acquire();
+    ++plies;
+    if (plies % snapshot_interval == 0 || pending_size == max_pending) {
+        // the snapshot covers every move before it, so
+        // the journal restarts after it
+        pending_snap.position = after;
+        pending_snap.history = history;
+        pending_snap.plies = plies;
+        pending_snapshot = true;
+        pending_size = 0;
+    } else {
+        pending[pending_size++] = pack_record(from, to);
+    }
+    release();
+    signal();
+}
+void chess_journal::rewrite(const chess_position& position, const chess_history& history, uint32_t plies) {
+    acquire();
+    this->plies = plies;
+    // moves after the position are gone, so the snapshot replaces them all
+    pending_snap.position = position;
+    pending_snap.history = history;
+    pending_snap.plies = plies;
+    pending_snapshot = true;
+    pending_size = 0;
+    release();
+    signal();
+}
+bool chess_journal::flush() {
+    acquire();
+    const bool new_game = pending_new_game;
+    const bool take_snapshot = pending_snapshot;
+    const size_t size = pending_size;
+    const uint32_t current_game = game;
+    if (take_snapshot) {
+        writing_snap = pending_snap;
+    }
+    memcpy(writing, pending, size * sizeof(uint16_t));
+    pending_new_game = false;
+    pending_snapshot = false;
+    pending_size = 0;
+    release();
+    bool result = true;
+    if (new_game && !take_snapshot) {
+        journal_header header = {journal_magic, current_game, 0};
+        remove(snapshot_path);
+        result = replace_file(journal_path, temp_path, &header, sizeof(header), writing, size * sizeof(uint16_t));
+    } else if (take_snapshot) {
+        writing_snap.magic = snapshot_magic;
+        writing_snap.size = sizeof(writing_snap);
+        writing_snap.game = current_game;
+        writing_snap.checksum = checksum(writing_snap);
+        // the snapshot first: until the journal is rewritten, the old one still
+        // leads up to it, and resume() replays only what follows it
+        journal_header header = {journal_magic, current_game, writing_snap.plies};
+        result = replace_file(snapshot_path, temp_path, &writing_snap, sizeof(writing_snap), nullptr, 0) &&
+                 replace_file(journal_path, temp_path, &header, sizeof(header), writing, size * sizeof(uint16_t));
+    } else if (size) {
+        FILE* file = fopen(journal_path, "ab");
+        result = file != nullptr;
+        if (result) {
+            result = size == fwrite(writing, sizeof(uint16_t), size, file) && 0 == fflush(file) && 0 == fsync(fileno(file));
+            fclose(file);
+        }
+    }
+    if (!result && !failed) {
+        puts("journal: unable to write");
+    }
+    failed = !result;
+    return result;
+}
+#ifdef ESP_PLATFORM
+void chess_journal::task_proc(void* state) {
+    chess_journal* journal = (chess_journal*)state;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // let more moves pile up so they share one write
+        vTaskDelay(pdMS_TO_TICKS(journal->sync_ms));
+        journal->flush();
+    }
+}
+bool chess_journal::start(uint32_t sync_ms, int priority) {
+    if (task != nullptr) {
+        return true;
+    }
+    this->sync_ms = sync_ms;
+    if (pdPASS != xTaskCreate(task_proc, "chess_journal", 4096, this, priority, &task)) {
+        task = nullptr;
+        return false;
+    }
+    // anything recorded before the task started
+    xTaskNotifyGive(task);
+    return true;
+}
+#else
+bool chess_journal::start(uint32_t sync_ms, int priority) {
+    (void)sync_ms;
+    (void)priority;
+    return false;
+}
+#endif
@@ -0,0 +1,363 @@
+#include "chess_link.hpp"
+
+#include <string.h>
+
+#include "chess_mirror.hpp"
+
+static_assert(6 + 64 + 1 + chess_history::capacity * 8 <= chess_link::max_payload, "a LINK_SYNC must fit in a frame");
+
+static uint16_t read16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+static uint32_t read32(const uint8_t* p) {
+    return read16(p) | ((uint32_t)read16(p + 2) << 16);
+}
+static uint64_t read64(const uint8_t* p) {
+    return read32(p) | ((uint64_t)read32(p + 4) << 32);
+}
+static uint8_t* write16(uint8_t* p, uint16_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    return p + 2;
+}
+static uint8_t* write32(uint8_t* p, uint32_t value) {
+    return write16(write16(p, (uint16_t)value), (uint16_t)(value >> 16));
+}
+static uint8_t* write64(uint8_t* p, uint64_t value) {
+    return write32(write32(p, (uint32_t)value), (uint32_t)(value >> 32));
+}
+
+chess_link::chess_link() : id(0), peer_id(0), is_connected(false), team(0), first_team(0), plies(0), outstanding(false), tx_seq(0), key_before(0), move_sent_us(0), rx_seq(-1), ack_pending(false), ack_sent(false), received_us(0), last_rx_us(0), last_hello_us(0), rx_size(0), event_count(0), write_callback(nullptr), write_callback_state(nullptr) {
+    memset(&stats, 0, sizeof(stats));
+    position.init();
+    history.clear();
+    first_team = team = position.turn() & 1;
+}
+void chess_link::begin(uint32_t id, const chess_position& position, const chess_history& history, uint16_t ply) {
+    this->id = id;
+    is_connected = false;
+    outstanding = ack_pending = ack_sent = false;
+    rx_seq = -1;
+    rx_size = 0;
+    event_count = 0;
+    last_hello_us = 0;
+    reset(position, history, ply, false);
+}
+void chess_link::send(COMMAND_ID command, const uint8_t* payload, size_t size) {
+    tx[0] = sync;
+    tx[1] = command;
+    write16(tx + 2, (uint16_t)size);
+    if (size) {
+        memcpy(tx + 4, payload, size);
+    }
+    // the same CRC as the mirror's frames
+    write16(tx + 4 + size, chess_mirror::crc16(tx + 1, size + 3));
+    ++stats.frames_out;
+    stats.bytes_out += (uint32_t)(size + frame_overhead);
+    if (write_callback != nullptr) {
+        write_callback(tx, size + frame_overhead, write_callback_state);
+    }
+}
+void chess_link::send_hello(bool reply, uint64_t now_us) {
+    uint8_t payload[15];
+    uint8_t* p = write32(payload, id);
+    p = write16(p, plies);
+    p = write64(p, position.key());
+    *p = reply ? 1 : 0;
+    send(LINK_HELLO, payload, sizeof(payload));
+    last_hello_us = now_us;
+}
+void chess_link::send_sync() {
+    uint8_t payload[max_payload];
+    uint8_t* p = write16(payload, plies);
+    *p++ = (uint8_t)position.turn();
+    *p++ = position.castling_rights();
+    *p++ = (uint8_t)position.en_passant_square();
+    *p++ = position.halfmove_clock();
+    memcpy(p, position.bitboards().squares, 64);
+    p += 64;
+    *p++ = (uint8_t)history.size;
+    for (size_t i = 0; i < history.size; ++i) {
+        p = write64(p, history.keys[i]);
+    }
+    // whatever was in flight is part of it
+    outstanding = false;
+    send(LINK_SYNC, payload, (size_t)(p - payload));
+}
+void chess_link::push(const event& value) {
+    if (event_count < max_events) {
+        events[event_count++] = value;
+    }
+}
+void chess_link::connect(uint32_t peer, uint64_t now_us) {
+    last_rx_us = now_us;
+    if (is_connected && peer == peer_id) {
+        return;
+    }
+    is_connected = true;
+    peer_id = peer;
+    team = id > peer ? first_team : (chess_value_t)(first_team ^ 1);
+    rx_seq = -1;
+    event connected;
+    memset(&connected, 0, sizeof(connected));
+    connected.type = event_connected;
+    connected.ply = plies;
+    push(connected);
+}
+void chess_link::reset(const chess_position& position, const chess_history& history, uint16_t ply, bool announce) {
+    this->position = position;
+    this->history = history;
+    plies = ply;
+    outstanding = ack_pending = false;
+    if (announce && is_connected) {
+        send_sync();
+    }
+}
+bool chess_link::move(chess_value_t from, chess_value_t to, uint64_t now_us) {
+    const uint64_t before = position.key();
+    if (-2 == position.move(from, to)) {
+        return false;
+    }
+    history.push(before, position.halfmove_clock());
+    ++plies;
+    if (!is_connected) {
+        // kept up to date for when a peer answers
+        return true;
+    }
+    if ((position.turn() & 1) == team) {
+        // this board moved for the peer, so its game wins
+        send_sync();
+        return true;
+    }
+    uint8_t* p = move_payload;
+    *p++ = ++tx_seq;
+    *p++ = (uint8_t)from;
+    *p++ = (uint8_t)to;
+    p = write64(p, position.key());
+    write32(p, (uint32_t)now_us);
+    key_before = before;
+    outstanding = true;
+    move_sent_us = now_us;
+    send(LINK_MOVE, move_payload, sizeof(move_payload));
+    return true;
+}
+void chess_link::painted(uint64_t now_us) {
+    if (!ack_pending) {
+        return;
+    }
+    write32(ack_payload + 13, (uint32_t)(now_us - received_us));
+    ack_pending = false;
+    ack_sent = true;
+    send(LINK_ACK, ack_payload, sizeof(ack_payload));
+}
+void chess_link::handle_move(const uint8_t* payload, uint64_t now_us) {
+    const uint8_t seq = payload[0];
+    if (seq == rx_seq) {
+        // sent again, so the ack was lost or is still waiting on the screen
+        if (ack_sent) {
+            send(LINK_ACK, ack_payload, sizeof(ack_payload));
+        }
+        return;
+    }
+    rx_seq = seq;
+    ack_pending = ack_sent = false;
+    const chess_value_t from = (chess_value_t)payload[1], to = (chess_value_t)payload[2];
+    const uint64_t before = position.key();
+    chess_position next = position;
+    if ((position.turn() & 1) == team || from < 0 || from > 63 || to < 0 || to > 63 ||
+        -2 == next.move(from, to) || next.key() != read64(payload + 3)) {
+        // the games differ, and the side that moved has the one that counts
+        send(LINK_SYNC_REQUEST, nullptr, 0);
+        return;
+    }
+    position = next;
+    history.push(before, position.halfmove_clock());
+    ++plies;
+    // the peer answered our move, so it had it even if the ack was lost
+    outstanding = false;
+    uint8_t* p = ack_payload;
+    *p++ = seq;
+    p = write64(p, position.key());
+    // the timestamp goes back as it came, so the sender needs no shared clock
+    memcpy(p, payload + 11, 4);
+    ack_pending = true;
+    received_us = now_us;
+    event moved;
+    memset(&moved, 0, sizeof(moved));
+    moved.type = event_move;
+    moved.from = from;
+    moved.to = to;
+    moved.ply = plies;
+    push(moved);
+}
+void chess_link::handle_ack(const uint8_t* payload, uint64_t now_us) {
+    if (!outstanding || payload[0] != tx_seq) {
+        return;
+    }
+    outstanding = false;
+    if (read64(payload + 1) != read64(move_payload + 3)) {
+        send_sync();
+        return;
+    }
+    const uint32_t round_trip = (uint32_t)now_us - read32(payload + 9);
+    const uint32_t paint = read32(payload + 13);
+    event latency;
+    memset(&latency, 0, sizeof(latency));
+    latency.type = event_latency;
+    latency.ply = plies;
+    latency.paint_us = paint;
+    // the painting happened between the two trips
+    latency.wire_us = round_trip > paint ? (round_trip - paint) / 2 : 0;
+    latency.total_us = latency.wire_us + paint;
+    push(latency);
+}
+bool chess_link::handle_sync(const uint8_t* payload, size_t size) {
+    if (size < 71 || size < 71 + (size_t)payload[70] * 8 || payload[70] > chess_history::capacity) {
+        return false;
+    }
+    chess_bitboard boards;
+    boards.clear();
+    for (int sq = 0; sq < 64; ++sq) {
+        const chess_value_t id = (chess_value_t)payload[6 + sq];
+        if (id > -1) {
+            boards.put(id, sq);
+        }
+    }
+    position.setup(boards, (chess_value_t)payload[2], payload[3], (chess_value_t)payload[4], payload[5]);
+    history.clear();
+    for (size_t i = 0; i < payload[70]; ++i) {
+        history.append(read64(payload + 71 + i * 8));
+    }
+    plies = read16(payload);
+    outstanding = ack_pending = false;
+    ++stats.resyncs;
+    event synced;
+    memset(&synced, 0, sizeof(synced));
+    synced.type = event_synced;
+    synced.ply = plies;
+    push(synced);
+    return true;
+}
+void chess_link::handle(COMMAND_ID command, const uint8_t* payload, size_t size, uint64_t now_us) {
+    if (command == LINK_HELLO) {
+        if (size < 15) {
+            return;
+        }
+        const uint32_t peer = read32(payload);
+        const uint16_t peer_ply = read16(payload + 4);
+        const uint64_t key = read64(payload + 6);
+        connect(peer, now_us);
+        if (payload[14] & 1) {
+            send_hello(false, now_us);
+        }
+        if (key == position.key() || (outstanding && key == key_before)) {
+            // the same game, or the peer hasn't had our move yet
+            return;
+        }
+        // the longer game wins, or on a tie the higher id's. only the
+        // winner sends, so each difference costs one sync
+        if (plies > peer_ply || (plies == peer_ply && id > peer)) {
+            send_sync();
+        }
+        return;
+    }
+    if (!is_connected) {
+        // nothing counts until the peer says hello
+        return;
+    }
+    last_rx_us = now_us;
+    switch (command) {
+        case LINK_MOVE:
+            if (size >= 15) {
+                handle_move(payload, now_us);
+            }
+            break;
+        case LINK_ACK:
+            if (size >= 17) {
+                handle_ack(payload, now_us);
+            }
+            break;
+        case LINK_SYNC_REQUEST:
+            send_sync();
+            break;
+        case LINK_SYNC:
+            if (handle_sync(payload, size)) {
+                // so the peer can see the keys agree
+                send_hello(false, now_us);
+            }
+            break;
+        default:
+            break;
+    }
+}
+void chess_link::feed(const uint8_t* data, size_t size, uint64_t now_us) {
+    stats.bytes_in += (uint32_t)size;
+    while (size) {
+        const size_t take = size < sizeof(rx) - rx_size ? size : sizeof(rx) - rx_size;
+        memcpy(rx + rx_size, data, take);
+        rx_size += take;
+        data += take;
+        size -= take;
+        size_t at = 0;
+        while (at < rx_size) {
+            if (rx[at] != sync) {
+                ++at;
+                continue;
+            }
+            if (rx_size - at < frame_overhead) {
+                break;
+            }
+            const size_t payload_size = read16(rx + at + 2);
+            if (payload_size > max_payload) {
+                ++stats.crc_errors;
+                ++at;
+                continue;
+            }
+            if (rx_size - at < payload_size + frame_overhead) {
+                break;
+            }
+            if (read16(rx + at + 4 + payload_size) != chess_mirror::crc16(rx + at + 1, payload_size + 3)) {
+                // look for the next frame from the byte after
+                ++stats.crc_errors;
+                ++at;
+                continue;
+            }
+            ++stats.frames_in;
+            handle((COMMAND_ID)rx[at + 1], rx + at + 4, payload_size, now_us);
+            at += payload_size + frame_overhead;
+        }
+        // what's left is less than a frame, so there's always room for more
+        memmove(rx, rx + at, rx_size - at);
+        rx_size -= at;
+    }
+}
+void chess_link::update(uint64_t now_us) {
+    if (is_connected && now_us - last_rx_us > timeout_us) {
+        is_connected = false;
+        outstanding = ack_pending = false;
+        event lost;
+        memset(&lost, 0, sizeof(lost));
+        lost.type = event_disconnected;
+        lost.ply = plies;
+        push(lost);
+    }
+    if (outstanding && now_us - move_sent_us >= retransmit_us) {
+        ++stats.retransmits;
+        move_sent_us = now_us;
+        send(LINK_MOVE, move_payload, sizeof(move_payload));
+    }
+    // connected, the hellos are keepalives that also compare the keys
+    const uint64_t interval = is_connected ? hello_us * 2 : hello_us;
+    if (last_hello_us == 0 || now_us - last_hello_us >= interval) {
+        send_hello(!is_connected, now_us);
+    }
+}
+bool chess_link::poll(event* out_event) {
+    if (event_count == 0) {
+        return false;
+    }
+    *out_event = events[0];
+    --event_count;
+    memmove(events, events + 1, event_count * sizeof(event));
+    return true;
+}
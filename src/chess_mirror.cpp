@@ -0,0 +1,347 @@
+#include "chess_mirror.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#endif
+
+constexpr const uint8_t chess_mirror::sync[2];
+
+static void* mirror_alloc(size_t size) {
+#ifdef ESP_PLATFORM
+    void* result = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (result == nullptr) {
+        result = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    return result;
+#else
+    return malloc(size);
+#endif
+}
+static void mirror_free(void* ptr) {
+#ifdef ESP_PLATFORM
+    heap_caps_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+static uint32_t rect_area(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2) {
+    return (x2 - x1 + 1) * (y2 - y1 + 1);
+}
+
+chess_mirror::chess_mirror() : width(0), height(0), screen(nullptr), sent(nullptr), row(nullptr), frame(nullptr), frame_size(0), dirty_size(0), refresh_pending(false), move_pending(-1), move_flush_bytes(0), write_callback(nullptr), write_callback_state(nullptr) {
+    memset(&stats, 0, sizeof(stats));
+#ifdef ESP_PLATFORM
+    portMUX_INITIALIZE(&lock);
+    task = nullptr;
+    refresh_ms = 0;
+#endif
+}
+chess_mirror::~chess_mirror() {
+#ifdef ESP_PLATFORM
+    if (task != nullptr) {
+        vTaskDelete(task);
+    }
+#endif
+    deallocate();
+}
+void chess_mirror::acquire() {
+#ifdef ESP_PLATFORM
+    // held for a few dozen instructions, so spinning beats sleeping
+    portENTER_CRITICAL(&lock);
+#else
+    lock.lock();
+#endif
+}
+void chess_mirror::release() {
+#ifdef ESP_PLATFORM
+    portEXIT_CRITICAL(&lock);
+#else
+    lock.unlock();
+#endif
+}
+void chess_mirror::signal() {
+#ifdef ESP_PLATFORM
+    if (task != nullptr) {
+        xTaskNotifyGive(task);
+    }
+#endif
+}
+bool chess_mirror::allocate(uint16_t width, uint16_t height) {
+    deallocate();
+    const size_t size = (size_t)width * height * sizeof(uint16_t);
+    screen = (uint16_t*)mirror_alloc(size);
+    sent = (uint16_t*)mirror_alloc(size);
+    row = (uint16_t*)mirror_alloc(width * sizeof(uint16_t));
+    frame = (uint8_t*)mirror_alloc(max_payload + frame_overhead);
+    if (screen == nullptr || sent == nullptr || row == nullptr || frame == nullptr) {
+        deallocate();
+        return false;
+    }
+    memset(screen, 0, size);
+    memset(sent, 0, size);
+    this->width = width;
+    this->height = height;
+    dirty_size = 0;
+    // a viewer starts from nothing
+    refresh_pending = true;
+    return true;
+}
+void chess_mirror::deallocate() {
+    mirror_free(screen);
+    mirror_free(sent);
+    mirror_free(row);
+    mirror_free(frame);
+    screen = sent = row = nullptr;
+    frame = nullptr;
+    width = height = 0;
+}
+void chess_mirror::capture(int x1, int y1, int x2, int y2, const void* bitmap) {
+    if (screen == nullptr || x1 < 0 || y1 < 0 || x2 >= width || y2 >= height || x2 < x1 || y2 < y1) {
+        return;
+    }
+    const size_t row_size = (size_t)(x2 - x1 + 1) * sizeof(uint16_t);
+    const uint8_t* src = (const uint8_t*)bitmap;
+    for (int y = y1; y <= y2; ++y) {
+        memcpy(&screen[y * width + x1], src, row_size);
+        src += row_size;
+    }
+    // queued after the copy, so a drain that read the pixels mid copy sends them again
+    const rect bounds = {(uint16_t)x1, (uint16_t)y1, (uint16_t)x2, (uint16_t)y2};
+    acquire();
+    ++stats.flushes;
+    stats.flush_bytes += (uint32_t)(row_size * (y2 - y1 + 1));
+    size_t merge = dirty_size;
+    for (size_t i = 0; i < dirty_size; ++i) {
+        // overlapping or touching
+        const rect& r = dirty[i];
+        if (bounds.x1 <= r.x2 + 1 && r.x1 <= bounds.x2 + 1 && bounds.y1 <= r.y2 + 1 && r.y1 <= bounds.y2 + 1) {
+            merge = i;
+            break;
+        }
+    }
+    if (merge == dirty_size && dirty_size == max_dirty) {
+        // full: grow whichever grows least
+        uint32_t best = UINT32_MAX;
+        for (size_t i = 0; i < dirty_size; ++i) {
+            const rect& r = dirty[i];
+            const uint32_t growth = rect_area(r.x1 < bounds.x1 ? r.x1 : bounds.x1, r.y1 < bounds.y1 ? r.y1 : bounds.y1,
+                                              r.x2 > bounds.x2 ? r.x2 : bounds.x2, r.y2 > bounds.y2 ? r.y2 : bounds.y2) -
+                                    rect_area(r.x1, r.y1, r.x2, r.y2);
+            if (growth < best) {
+                best = growth;
+                merge = i;
+            }
+        }
+    }
+    if (merge < dirty_size) {
+        rect& r = dirty[merge];
+        if (bounds.x1 < r.x1) r.x1 = bounds.x1;
+        if (bounds.y1 < r.y1) r.y1 = bounds.y1;
+        if (bounds.x2 > r.x2) r.x2 = bounds.x2;
+        if (bounds.y2 > r.y2) r.y2 = bounds.y2;
+        ++stats.merges;
+    } else {
+        dirty[dirty_size++] = bounds;
+    }
+    release();
+    signal();
+}
+void chess_mirror::move(uint32_t ply) {
+    acquire();
+    move_pending = (int)(ply & 0xFFFF);
+    release();
+    signal();
+}
+void chess_mirror::refresh() {
+    acquire();
+    refresh_pending = true;
+    release();
+    signal();
+}
+void chess_mirror::begin_frame(frame_type type) {
+    frame[0] = sync[0];
+    frame[1] = sync[1];
+    frame[2] = type;
+    frame_size = 5;
+}
+void chess_mirror::end_frame() {
+    const size_t payload = frame_size - 5;
+    frame[3] = (uint8_t)payload;
+    frame[4] = (uint8_t)(payload >> 8);
+    const uint16_t crc = crc16(frame + 2, frame_size - 2);
+    frame[frame_size++] = (uint8_t)crc;
+    frame[frame_size++] = (uint8_t)(crc >> 8);
+    if (write_callback != nullptr) {
+        write_callback(frame, frame_size, write_callback_state);
+    }
+    ++stats.frames;
+    stats.bytes += (uint32_t)frame_size;
+}
+void chess_mirror::encode(const rect& bounds, bool keyframe) {
+    const size_t w = bounds.x2 - bounds.x1 + 1;
+    // a row can't take more than a token and a pixel per pixel
+    const size_t row_worst = w * 3 + 2;
+    const size_t header = 5 + 8;
+    int band_y1 = -1, last_y = 0;
+    size_t skip = 0, literal_at = 0, literal_count = 0;
+    for (int y = bounds.y1; y <= bounds.y2; ++y) {
+        if (band_y1 < 0) {
+            begin_frame(frame_rect);
+            frame_size = header;
+            band_y1 = y;
+            skip = literal_count = 0;
+        }
+        // a flush may be writing the row, so encode a copy and remember exactly what was sent
+        uint16_t* old = &sent[y * width + bounds.x1];
+        memcpy(row, &screen[y * width + bounds.x1], w * sizeof(uint16_t));
+        bool changed = false;
+        for (size_t x = 0; x < w;) {
+            const uint16_t pixel = row[x];
+            if (!keyframe && pixel == old[x]) {
+                literal_count = 0;
+                ++skip;
+                ++x;
+                continue;
+            }
+            changed = true;
+            while (skip) {
+                const size_t n = skip < 128 ? skip : 128;
+                frame[frame_size++] = (uint8_t)(n - 1);
+                skip -= n;
+            }
+            size_t run = 1;
+            while (x + run < w && run < 64 && row[x + run] == pixel) {
+                ++run;
+            }
+            if (run >= 3) {
+                literal_count = 0;
+                frame[frame_size++] = (uint8_t)(0x80 + run - 1);
+                memcpy(&frame[frame_size], &pixel, 2);
+                frame_size += 2;
+                x += run;
+                continue;
+            }
+            if (literal_count == 0 || literal_count == 64) {
+                literal_at = frame_size++;
+                literal_count = 0;
+            }
+            frame[literal_at] = (uint8_t)(0xC0 + literal_count);
+            ++literal_count;
+            memcpy(&frame[frame_size], &pixel, 2);
+            frame_size += 2;
+            ++x;
+        }
+        memcpy(old, row, w * sizeof(uint16_t));
+        if (changed) {
+            last_y = y;
+        } else if (frame_size == header) {
+            // nothing sent yet, so start the band below
+            band_y1 = y + 1;
+            skip = 0;
+        }
+        // the pending skip costs a byte per 128 pixels when it's flushed
+        if (y == bounds.y2 || frame_size + skip / 128 + 1 + row_worst > 5 + max_payload) {
+            if (frame_size > header) {
+                // a trailing skip needn't be sent
+                const uint16_t coords[4] = {bounds.x1, (uint16_t)band_y1, bounds.x2, (uint16_t)last_y};
+                for (int i = 0; i < 4; ++i) {
+                    frame[5 + i * 2] = (uint8_t)coords[i];
+                    frame[6 + i * 2] = (uint8_t)(coords[i] >> 8);
+                }
+                end_frame();
+            }
+            band_y1 = -1;
+        }
+    }
+}
+size_t chess_mirror::drain() {
+    if (screen == nullptr) {
+        return 0;
+    }
+    rect pending[max_dirty];
+    acquire();
+    const size_t pending_size = dirty_size;
+    memcpy(pending, dirty, sizeof(rect) * dirty_size);
+    dirty_size = 0;
+    const bool keyframe = refresh_pending;
+    refresh_pending = false;
+    const int ply = move_pending;
+    move_pending = -1;
+    const uint32_t flush_bytes = stats.flush_bytes;
+    release();
+    const uint32_t bytes = stats.bytes;
+    if (keyframe) {
+        begin_frame(frame_screen);
+        frame[frame_size++] = (uint8_t)width;
+        frame[frame_size++] = (uint8_t)(width >> 8);
+        frame[frame_size++] = (uint8_t)height;
+        frame[frame_size++] = (uint8_t)(height >> 8);
+        frame[frame_size++] = 16;
+        end_frame();
+        // everything, whatever the viewer had
+        encode(rect{0, 0, (uint16_t)(width - 1), (uint16_t)(height - 1)}, true);
+    } else {
+        for (size_t i = 0; i < pending_size; ++i) {
+            encode(pending[i], false);
+        }
+    }
+    if (ply > -1) {
+        begin_frame(frame_move);
+        frame[frame_size++] = (uint8_t)ply;
+        frame[frame_size++] = (uint8_t)(ply >> 8);
+        const uint32_t flushed = flush_bytes - move_flush_bytes;
+        move_flush_bytes = flush_bytes;
+        for (int i = 0; i < 4; ++i) {
+            frame[frame_size++] = (uint8_t)(flushed >> (i * 8));
+        }
+        end_frame();
+    }
+    return stats.bytes - bytes;
+}
+#ifdef ESP_PLATFORM
+void chess_mirror::task_proc(void* state) {
+    chess_mirror* mirror = (chess_mirror*)state;
+    const TickType_t period = mirror->refresh_ms ? pdMS_TO_TICKS(mirror->refresh_ms) : portMAX_DELAY;
+    TickType_t refreshed = xTaskGetTickCount();
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, period);
+        if (mirror->refresh_ms && xTaskGetTickCount() - refreshed >= period) {
+            refreshed = xTaskGetTickCount();
+            mirror->refresh();
+        }
+        // blocks on the link, but only this task waits
+        mirror->drain();
+    }
+}
+bool chess_mirror::start(int priority, uint32_t refresh_ms) {
+    if (task != nullptr) {
+        return true;
+    }
+    this->refresh_ms = refresh_ms;
+    if (pdPASS != xTaskCreate(task_proc, "chess_mirror", 4096, this, priority, &task)) {
+        task = nullptr;
+        return false;
+    }
+    // the first whole screen
+    xTaskNotifyGive(task);
+    return true;
+}
+#else
+bool chess_mirror::start(int priority, uint32_t refresh_ms) {
+    (void)priority;
+    (void)refresh_ms;
+    return false;
+}
+#endif
+uint16_t chess_mirror::crc16(const uint8_t* data, size_t size, uint16_t crc) {
+    // CCITT polynomial 0x1021, a nibble at a time
+    static const uint16_t table[16] = {0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+                                       0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF};
+    for (size_t i = 0; i < size; ++i) {
+        crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (data[i] >> 4)]);
+        crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (data[i] & 15)]);
+    }
+    return crc;
+}
@@ -0,0 +1,325 @@
+#include "chess_perft.hpp"
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "timing.hpp"
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#endif
+
+// counts from https://www.chessprogramming.org/Perft_Results
+const chess_perft_reference chess_perft::references[] = {
+    {"initial", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+     {20, 400, 8902, 197281, 4865609, 119060324}},
+    {"kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+     {48, 2039, 97862, 4085603, 193690690, 0}},
+    // en passant discovered checks and pins along the rank
+    {"endgame", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+     {14, 191, 2812, 43238, 674624, 11030083}},
+    // promotions and underpromotions, castling out of check
+    {"promotion", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+     {6, 264, 9467, 422333, 15833292, 0}},
+    // promotion with capture, castling rights lost by a captured rook
+    {"castling", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+     {44, 1486, 62379, 2103487, 89941194, 0}},
+    {"middlegame", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+     {46, 2079, 89890, 3894594, 164075551, 0}},
+};
+const int chess_perft::references_size = (int)(sizeof(references) / sizeof(references[0]));
+
+// FEN names squares by file and rank. chess.h names them too, so the
+// mapping is taken from chess_index_name() rather than assumed
+static struct {
+    int8_t squares[8][8];  // [rank][file]
+    chess_value_t white;
+    bool initialized;
+} notation;
+
+static void notation_init() {
+    chess_bitboard::initialize();
+    for (int i = 0; i < 64; ++i) {
+        char name[3];
+        chess_index_name(i, name);
+        notation.squares[name[1] - '1'][name[0] - 'a'] = i;
+    }
+    chess_game_t game;
+    chess_init(&game);
+    notation.white = CHESS_TEAM(chess_index_to_id(&game, notation.squares[0][4]));
+    notation.initialized = true;
+}
+static int notation_square(const char* name) {
+    if (name[0] < 'a' || name[0] > 'h' || name[1] < '1' || name[1] > '8') {
+        return -1;
+    }
+    return notation.squares[name[1] - '1'][name[0] - 'a'];
+}
+static uint64_t promotion_rank(int team) {
+    return chess_bitboard::pawn_push(team) > 0 ? 0xFF00000000000000ull : 0xFFull;
+}
+static const chess_bitboard::type_index promotion_types[] = {chess_bitboard::queen, chess_bitboard::rook, chess_bitboard::bishop, chess_bitboard::knight};
+
+#ifdef ESP_PLATFORM
+static uint32_t yield_counter;
+static uint32_t last_yield_ms;
+// keep the idle task (and its watchdog) on this core fed
+static void keep_alive() {
+    if ((++yield_counter & 4095) == 0) {
+        if (timing_ms() - last_yield_ms >= 50) {
+            vTaskDelay(1);
+            last_yield_ms = timing_ms();
+        }
+    }
+}
+#else
+static void keep_alive() {
+}
+#endif
+
+bool chess_perft::load(const char* fen) {
+    if (!notation.initialized) {
+        notation_init();
+    }
+    boards.clear();
+    int rank = 7, file = 0;
+    static const char piece_chars[] = "pnbrqk";
+    for (; *fen && *fen != ' '; ++fen) {
+        const char ch = *fen;
+        if (ch == '/') {
+            if (file != 8 || rank == 0) {
+                return false;
+            }
+            --rank;
+            file = 0;
+        } else if (ch >= '1' && ch <= '8') {
+            file += ch - '0';
+            if (file > 8) {
+                return false;
+            }
+        } else {
+            const char* type = strchr(piece_chars, tolower((unsigned char)ch));
+            if (type == nullptr || file > 7) {
+                return false;
+            }
+            const int team = isupper((unsigned char)ch) ? notation.white : !notation.white;
+            boards.put(chess_bitboard::piece_id(team, (chess_bitboard::type_index)(type - piece_chars)), notation.squares[rank][file++]);
+        }
+    }
+    if (rank != 0 || file != 8) {
+        return false;
+    }
+    while (*fen == ' ') ++fen;
+    if (*fen != 'w' && *fen != 'b') {
+        return false;
+    }
+    turn = *fen++ == 'w' ? notation.white : !notation.white;
+    while (*fen == ' ') ++fen;
+    castling = 0;
+    for (; *fen && *fen != ' '; ++fen) {
+        if (*fen == '-') {
+            continue;
+        }
+        int square;
+        switch (*fen) {
+            case 'K': square = notation.squares[0][7]; break;
+            case 'Q': square = notation.squares[0][0]; break;
+            case 'k': square = notation.squares[7][7]; break;
+            case 'q': square = notation.squares[7][0]; break;
+            default: return false;
+        }
+        for (int i = 0; i < 4; ++i) {
+            if (chess_bitboard::castling_corners[i] == square) {
+                castling |= (1 << i);
+            }
+        }
+    }
+    while (*fen == ' ') ++fen;
+    en_passant = -1;
+    if (*fen && *fen != '-') {
+        en_passant = notation_square(fen);
+        if (en_passant < 0) {
+            return false;
+        }
+    }
+    return boards.king_square(0) > -1 && boards.king_square(1) > -1;
+}
+void chess_perft::load(const chess_position& position) {
+    boards = position.bitboards();
+    turn = position.turn();
+    castling = position.castling_rights();
+    en_passant = position.en_passant_square();
+}
+uint64_t chess_perft::count(int depth) const {
+    keep_alive();
+    uint64_t destinations[64];
+    uint64_t origins = boards.generate(turn & 1, castling, en_passant, destinations);
+    const uint64_t last_rank = promotion_rank(turn);
+    uint64_t result = 0;
+    while (origins) {
+        const int from = chess_pop_square(&origins);
+        const bool pawn = CHESS_TYPE(boards.squares[from]) == CHESS_PAWN;
+        uint64_t targets = destinations[from];
+        if (depth == 1) {
+            // bulk count the leaves
+            result += __builtin_popcountll(targets);
+            if (pawn) {
+                result += 3 * __builtin_popcountll(targets & last_rank);
+            }
+            continue;
+        }
+        while (targets) {
+            const int to = chess_pop_square(&targets);
+            const bool promotes = pawn && ((last_rank >> to) & 1);
+            for (int i = 0; i < (promotes ? 4 : 1); ++i) {
+                chess_perft child = *this;
+                child.boards.play(from, to, promotes ? chess_bitboard::piece_id(turn, promotion_types[i]) : -1, &child.castling, &child.en_passant);
+                child.turn = !turn;
+                result += child.count(depth - 1);
+            }
+        }
+    }
+    return result;
+}
+uint64_t chess_perft::nodes(int depth) const {
+    return depth < 1 ? 1 : count(depth);
+}
+uint64_t chess_perft::divide(int depth, void (*callback)(chess_value_t from, chess_value_t to, chess_value_t promotion, uint64_t nodes, void* state), void* state) const {
+    uint64_t destinations[64];
+    uint64_t origins = boards.generate(turn & 1, castling, en_passant, destinations);
+    const uint64_t last_rank = promotion_rank(turn);
+    uint64_t result = 0;
+    while (origins) {
+        const int from = chess_pop_square(&origins);
+        const bool pawn = CHESS_TYPE(boards.squares[from]) == CHESS_PAWN;
+        uint64_t targets = destinations[from];
+        while (targets) {
+            const int to = chess_pop_square(&targets);
+            const bool promotes = pawn && ((last_rank >> to) & 1);
+            for (int i = 0; i < (promotes ? 4 : 1); ++i) {
+                const chess_value_t promotion = promotes ? chess_bitboard::piece_id(turn, promotion_types[i]) : -1;
+                chess_perft child = *this;
+                child.boards.play(from, to, promotion, &child.castling, &child.en_passant);
+                child.turn = !turn;
+                const uint64_t n = child.nodes(depth - 1);
+                result += n;
+                callback(from, to, promotion, n, state);
+            }
+        }
+    }
+    return result;
+}
+uint64_t chess_perft::library_walk(const chess_game_t& game, chess_position& position, int depth, uint32_t* out_mismatches) {
+    keep_alive();
+    if (depth < 1) {
+        return 1;
+    }
+    const chess_value_t turn = chess_turn(&game);
+    if (turn != position.turn()) {
+        ++*out_mismatches;
+    }
+    uint64_t result = 0;
+    for (int sq = 0; sq < 64; ++sq) {
+        const chess_value_t id = chess_index_to_id(&game, sq);
+        if (id != position.bitboards().squares[sq]) {
+            ++*out_mismatches;
+        }
+        if (id < 0 || CHESS_TEAM(id) != turn) {
+            continue;
+        }
+        chess_value_t targets[64];
+        const int count = chess_compute_moves(&game, sq, targets);
+        uint64_t mask = 0;
+        for (int i = 0; i < count; ++i) {
+            mask |= 1ull << targets[i];
+        }
+        if (mask != position.destinations(sq)) {
+            ++*out_mismatches;
+        }
+        if (depth == 1) {
+            result += count;
+            continue;
+        }
+        const uint64_t key = position.key();
+        for (int i = 0; i < count; ++i) {
+            chess_game_t child = game;
+            const chess_value_t library = chess_move(&child, sq, targets[i]);
+            chess_undo undo;
+            const chess_value_t captured = position.make(sq, targets[i], &undo);
+            // the library reports the en passant square too
+            if (library == -2 || (library > -1 && library != targets[i] && library != captured) || !position.consistent()) {
+                ++*out_mismatches;
+            } else {
+                result += library_walk(child, position, depth - 1, out_mismatches);
+            }
+            position.unmake(undo);
+            if (position.key() != key) {
+                ++*out_mismatches;
+            }
+        }
+    }
+    return result;
+}
+uint64_t chess_perft::library_nodes(int depth, uint32_t* out_mismatches) {
+    chess_game_t game;
+    chess_init(&game);
+    chess_position position;
+    position.init();
+    return library_walk(game, position, depth, out_mismatches);
+}
+static void print_row(const char* name, int depth, uint64_t nodes, uint64_t expected, uint64_t elapsed_us) {
+    const uint64_t nps = elapsed_us ? nodes * 1000000 / elapsed_us : 0;
+    printf("%-10s %d %12" PRIu64 " %9" PRIu64 "us %10" PRIu64 " nps  ", name, depth, nodes, elapsed_us, nps);
+    if (expected == 0) {
+        puts("-");
+    } else if (expected == nodes) {
+        puts("ok");
+    } else {
+        printf("FAIL, expected %" PRIu64 "\n", expected);
+    }
+}
+int chess_perft::run_suite(int max_depth, int library_depth) {
+#ifdef ESP_PLATFORM
+    last_yield_ms = timing_ms();
+#endif
+    int failures = 0;
+    uint64_t total_nodes = 0, total_us = 0;
+    puts("position   d        nodes       time          speed");
+    for (int r = 0; r < references_size; ++r) {
+        const chess_perft_reference& ref = references[r];
+        chess_perft perft;
+        if (!perft.load(ref.fen)) {
+            printf("%-10s invalid FEN\n", ref.name);
+            ++failures;
+            continue;
+        }
+        for (int depth = 1; depth <= max_depth && depth <= chess_perft_reference::max_depth && ref.nodes[depth - 1]; ++depth) {
+            const uint64_t start = timing_us();
+            const uint64_t n = perft.nodes(depth);
+            const uint64_t elapsed = timing_us() - start;
+            print_row(ref.name, depth, n, ref.nodes[depth - 1], elapsed);
+            failures += n != ref.nodes[depth - 1];
+            total_nodes += n;
+            total_us += elapsed;
+        }
+    }
+    if (library_depth > 0) {
+        // the library has no FEN support, so it is checked from the initial position
+        for (int depth = 1; depth <= library_depth && depth <= chess_perft_reference::max_depth; ++depth) {
+            uint32_t mismatches = 0;
+            const uint64_t start = timing_us();
+            const uint64_t n = library_nodes(depth, &mismatches);
+            const uint64_t elapsed = timing_us() - start;
+            print_row("chess.h", depth, n, references[0].nodes[depth - 1], elapsed);
+            failures += n != references[0].nodes[depth - 1];
+            if (mismatches) {
+                printf("chess.h    %d %" PRIu32 " positions disagree with the bitboards\n", depth, mismatches);
+                ++failures;
+            }
+        }
+    }
+    printf("bitboards: %" PRIu64 " nodes in %" PRIu64 "ms, %" PRIu64 " nps, %d failures\n", total_nodes, total_us / 1000, total_us ? total_nodes * 1000000 / total_us : 0, failures);
+    return failures;
+}
@@ -0,0 +1,413 @@
+#include "chess_position.hpp"
+
+// random keys, built once
+static struct {
+    // [team][type][square]
+    uint64_t pieces[2][8][64];
+    uint64_t side;
+    uint64_t castling[4];
+    uint64_t en_passant[8];
+    bool initialized;
+} zobrist;
+
+// the evaluation weights, material included, built once.
+// [team][type_index][square], for the middlegame and the endgame
+static struct {
+    int16_t middle[2][chess_bitboard::type_count][64];
+    int16_t end[2][chess_bitboard::type_count][64];
+} weights;
+
+// by type_index
+static const int16_t middle_values[] = {100, 320, 330, 500, 900, 0};
+static const int16_t end_values[] = {120, 300, 320, 530, 950, 0};
+// how much each type counts towards the middlegame, by type_index
+static const uint8_t phase_weights[] = {0, 1, 1, 2, 4, 0};
+// piece-square tables as seen from the team's own side: the first row is
+// the far rank and the last is the team's back rank. They're symmetric
+// left to right, so which way the files run doesn't matter.
+static const int8_t pawn_middle[64] = {
+    0, 0, 0, 0, 0, 0, 0, 0,
+    50, 50, 50, 50, 50, 50, 50, 50,
+    10, 10, 20, 30, 30, 20, 10, 10,
+    5, 5, 10, 25, 25, 10, 5, 5,
+    0, 0, 0, 20, 20, 0, 0, 0,
+    5, -5, -10, 0, 0, -10, -5, 5,
+    5, 10, 10, -20, -20, 10, 10, 5,
+    0, 0, 0, 0, 0, 0, 0, 0};
+static const int8_t pawn_end[64] = {
+    0, 0, 0, 0, 0, 0, 0, 0,
+    80, 80, 80, 80, 80, 80, 80, 80,
+    50, 50, 50, 50, 50, 50, 50, 50,
+    30, 30, 30, 30, 30, 30, 30, 30,
+    20, 20, 20, 20, 20, 20, 20, 20,
+    10, 10, 10, 10, 10, 10, 10, 10,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0};
+static const int8_t knight_table[64] = {
+    -50, -40, -30, -30, -30, -30, -40, -50,
+    -40, -20, 0, 0, 0, 0, -20, -40,
+    -30, 0, 10, 15, 15, 10, 0, -30,
+    -30, 5, 15, 20, 20, 15, 5, -30,
+    -30, 0, 15, 20, 20, 15, 0, -30,
+    -30, 5, 10, 15, 15, 10, 5, -30,
+    -40, -20, 0, 5, 5, 0, -20, -40,
+    -50, -40, -30, -30, -30, -30, -40, -50};
+static const int8_t bishop_table[64] = {
+    -20, -10, -10, -10, -10, -10, -10, -20,
+    -10, 0, 0, 0, 0, 0, 0, -10,
+    -10, 0, 5, 10, 10, 5, 0, -10,
+    -10, 5, 5, 10, 10, 5, 5, -10,
+    -10, 0, 10, 10, 10, 10, 0, -10,
+    -10, 10, 10, 10, 10, 10, 10, -10,
+    -10, 5, 0, 0, 0, 0, 5, -10,
+    -20, -10, -10, -10, -10, -10, -10, -20};
+static const int8_t rook_table[64] = {
+    0, 0, 0, 0, 0, 0, 0, 0,
+    5, 10, 10, 10, 10, 10, 10, 5,
+    -5, 0, 0, 0, 0, 0, 0, -5,
+    -5, 0, 0, 0, 0, 0, 0, -5,
+    -5, 0, 0, 0, 0, 0, 0, -5,
+    -5, 0, 0, 0, 0, 0, 0, -5,
+    -5, 0, 0, 0, 0, 0, 0, -5,
+    0, 0, 0, 5, 5, 0, 0, 0};
+static const int8_t queen_table[64] = {
+    -20, -10, -10, -5, -5, -10, -10, -20,
+    -10, 0, 0, 0, 0, 0, 0, -10,
+    -10, 0, 5, 5, 5, 5, 0, -10,
+    -5, 0, 5, 5, 5, 5, 0, -5,
+    -5, 0, 5, 5, 5, 5, 0, -5,
+    -10, 0, 5, 5, 5, 5, 0, -10,
+    -10, 0, 0, 0, 0, 0, 0, -10,
+    -20, -10, -10, -5, -5, -10, -10, -20};
+static const int8_t king_middle[64] = {
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -20, -30, -30, -40, -40, -30, -30, -20,
+    -10, -20, -20, -20, -20, -20, -20, -10,
+    20, 20, 0, 0, 0, 0, 20, 20,
+    20, 30, 10, 0, 0, 10, 30, 20};
+static const int8_t king_end[64] = {
+    -50, -40, -30, -20, -20, -30, -40, -50,
+    -30, -20, -10, 0, 0, -10, -20, -30,
+    -30, -10, 20, 30, 30, 20, -10, -30,
+    -30, -10, 30, 40, 40, 30, -10, -30,
+    -30, -10, 30, 40, 40, 30, -10, -30,
+    -30, -10, 20, 30, 30, 20, -10, -30,
+    -30, -30, 0, 0, 0, 0, -30, -30,
+    -50, -30, -30, -30, -30, -30, -30, -50};
+
+static void weights_init() {
+    static const int8_t* const middle_tables[] = {pawn_middle, knight_table, bishop_table, rook_table, queen_table, king_middle};
+    static const int8_t* const end_tables[] = {pawn_end, knight_table, bishop_table, rook_table, queen_table, king_end};
+    for (int team = 0; team < 2; ++team) {
+        // a team whose pawns advance up the indices has its back rank at index 0,
+        // the last row of the tables
+        const int flip = chess_bitboard::pawn_push(team) > 0 ? 56 : 0;
+        for (int type = 0; type < chess_bitboard::type_count; ++type) {
+            for (int sq = 0; sq < 64; ++sq) {
+                weights.middle[team][type][sq] = middle_values[type] + middle_tables[type][sq ^ flip];
+                weights.end[team][type][sq] = end_values[type] + end_tables[type][sq ^ flip];
+            }
+        }
+    }
+}
+static uint64_t splitmix64(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+static uint64_t piece_key(chess_value_t id, int index) {
+    return zobrist.pieces[CHESS_TEAM(id) & 1][CHESS_TYPE(id) & 7][index];
+}
+static void zobrist_init() {
+    chess_bitboard::initialize();
+    // a fixed seed keeps keys stable across runs and between host and device
+    uint64_t seed = 0x636F726532636873ull;
+    for (auto& team : zobrist.pieces) {
+        for (auto& type : team) {
+            for (auto& key : type) {
+                key = splitmix64(&seed);
+            }
+        }
+    }
+    zobrist.side = splitmix64(&seed);
+    for (auto& key : zobrist.castling) {
+        key = splitmix64(&seed);
+    }
+    for (auto& key : zobrist.en_passant) {
+        key = splitmix64(&seed);
+    }
+    weights_init();
+    zobrist.initialized = true;
+}
+
+uint64_t chess_position::castling_key(uint8_t rights) {
+    uint64_t result = 0;
+    for (int i = 0; i < 4; ++i) {
+        if (rights & (1 << i)) {
+            result ^= zobrist.castling[i];
+        }
+    }
+    return result;
+}
+bool chess_position::en_passant_capturable() const {
+    // only hash the square when an enemy pawn could actually take,
+    // so transpositions that differ in name only still match
+    if (en_passant < 0) {
+        return false;
+    }
+    // the pawn that just moved sits one rank past the target square
+    const int pawn = en_passant < 32 ? en_passant + 8 : en_passant - 8;
+    const int file = pawn & 7;
+    for (int offset = -1; offset <= 1; offset += 2) {
+        if (file + offset < 0 || file + offset > 7) {
+            continue;
+        }
+        const chess_value_t id = boards.squares[pawn + offset];
+        if (id > -1 && CHESS_TYPE(id) == CHESS_PAWN && CHESS_TEAM(id) == side) {
+            return true;
+        }
+    }
+    return false;
+}
+void chess_position::toggle_en_passant() {
+    if (en_passant_capturable()) {
+        hash ^= zobrist.en_passant[en_passant & 7];
+    }
+}
+void chess_position::init() {
+    if (!zobrist.initialized) {
+        zobrist_init();
+    }
+    // the library only sets up the initial position
+    chess_game_t game;
+    chess_init(&game);
+    boards.load(game);
+    side = chess_turn(&game);
+    castling = chess_bitboard::initial_castling();
+    en_passant = -1;
+    halfmove = 0;
+    hash = compute_key();
+    compute_score(&middle_score, &end_score, &material_phase);
+}
+void chess_position::setup(const chess_bitboard& boards, chess_value_t turn, uint8_t castling, chess_value_t en_passant, uint8_t halfmove) {
+    if (!zobrist.initialized) {
+        zobrist_init();
+    }
+    this->boards = boards;
+    side = turn;
+    this->castling = castling;
+    this->en_passant = en_passant;
+    this->halfmove = halfmove;
+    hash = compute_key();
+    compute_score(&middle_score, &end_score, &material_phase);
+}
+uint64_t chess_position::compute_key() const {
+    uint64_t result = 0;
+    for (int sq = 0; sq < 64; ++sq) {
+        const chess_value_t id = boards.squares[sq];
+        if (id > -1) {
+            result ^= piece_key(id, sq);
+        }
+    }
+    if (side) {
+        result ^= zobrist.side;
+    }
+    result ^= castling_key(castling);
+    if (en_passant_capturable()) {
+        result ^= zobrist.en_passant[en_passant & 7];
+    }
+    return result;
+}
+bool chess_position::consistent() const {
+    uint64_t pieces[2][chess_bitboard::type_count] = {};
+    for (int sq = 0; sq < 64; ++sq) {
+        const chess_value_t id = boards.squares[sq];
+        if (id > -1) {
+            pieces[CHESS_TEAM(id) & 1][chess_bitboard::index_of(CHESS_TYPE(id))] |= 1ull << sq;
+        }
+    }
+    uint64_t occupied = 0;
+    for (int team = 0; team < 2; ++team) {
+        uint64_t all = 0;
+        for (int type = 0; type < chess_bitboard::type_count; ++type) {
+            if (pieces[team][type] != boards.pieces[team][type]) {
+                return false;
+            }
+            all |= pieces[team][type];
+        }
+        if (all != boards.teams[team]) {
+            return false;
+        }
+        occupied |= all;
+    }
+    int16_t middle, end;
+    uint8_t phase;
+    compute_score(&middle, &end, &phase);
+    return occupied == boards.occupied && hash == compute_key() &&
+           middle == middle_score && end == end_score && phase == material_phase;
+}
+void chess_position::compute_score(int16_t* out_middle, int16_t* out_end, uint8_t* out_phase) const {
+    int middle = 0, end = 0, phase = 0;
+    for (int sq = 0; sq < 64; ++sq) {
+        const chess_value_t id = boards.squares[sq];
+        if (id > -1) {
+            const int team = CHESS_TEAM(id) & 1;
+            const int type = chess_bitboard::index_of(CHESS_TYPE(id));
+            const int sign = team ? -1 : 1;
+            middle += sign * weights.middle[team][type][sq];
+            end += sign * weights.end[team][type][sq];
+            phase += phase_weights[type];
+        }
+    }
+    *out_middle = (int16_t)middle;
+    *out_end = (int16_t)end;
+    *out_phase = (uint8_t)phase;
+}
+int chess_position::score(int team) const {
+    // blend from the middlegame weights at full material to the endgame weights with none
+    const int phase = this->phase();
+    const int blended = (middle_score * phase + end_score * (max_phase - phase)) / max_phase;
+    return (team & 1) ? -blended : blended;
+}
+void chess_position::put_piece(chess_value_t id, int square) {
+    boards.put(id, square);
+    hash ^= piece_key(id, square);
+    const int team = CHESS_TEAM(id) & 1;
+    const int type = chess_bitboard::index_of(CHESS_TYPE(id));
+    if (team) {
+        middle_score -= weights.middle[1][type][square];
+        end_score -= weights.end[1][type][square];
+    } else {
+        middle_score += weights.middle[0][type][square];
+        end_score += weights.end[0][type][square];
+    }
+    material_phase += phase_weights[type];
+}
+void chess_position::remove_piece(int square) {
+    const chess_value_t id = boards.squares[square];
+    if (id > -1) {
+        boards.remove(square);
+        hash ^= piece_key(id, square);
+        const int team = CHESS_TEAM(id) & 1;
+        const int type = chess_bitboard::index_of(CHESS_TYPE(id));
+        if (team) {
+            middle_score += weights.middle[1][type][square];
+            end_score += weights.end[1][type][square];
+        } else {
+            middle_score -= weights.middle[0][type][square];
+            end_score -= weights.end[0][type][square];
+        }
+        material_phase -= phase_weights[type];
+    }
+}
+uint64_t chess_position::destinations(chess_value_t index) const {
+    const chess_value_t id = boards.squares[(int)index];
+    if (id < 0 || CHESS_TEAM(id) != side) {
+        return 0;
+    }
+    return boards.destinations(index, castling, en_passant);
+}
+chess_value_t chess_position::compute_moves(chess_value_t index, chess_value_t* out_moves) const {
+    uint64_t mask = destinations(index);
+    chess_value_t result = 0;
+    while (mask) {
+        out_moves[result++] = (chess_value_t)chess_pop_square(&mask);
+    }
+    return result;
+}
+chess_value_t chess_position::move(chess_value_t from, chess_value_t to) {
+    if (from < 0 || from > 63 || to < 0 || to > 63 || !((destinations(from) >> to) & 1)) {
+        return -2;
+    }
+    chess_undo undo;
+    return make(from, to, &undo);
+}
+chess_value_t chess_position::make(chess_value_t from, chess_value_t to, chess_undo* out_undo) {
+    const chess_value_t id = boards.squares[(int)from];
+    const int team = CHESS_TEAM(id) & 1;
+    const int type = CHESS_TYPE(id);
+    out_undo->from = from;
+    out_undo->to = to;
+    out_undo->castling = castling;
+    out_undo->en_passant = en_passant;
+    out_undo->halfmove = halfmove;
+    out_undo->promoted = 0;
+    // the en passant key depends on the position before the move
+    toggle_en_passant();
+    hash ^= zobrist.side;
+    chess_value_t result = -1;
+    int captured_square = to;
+    if (type == CHESS_PAWN && to == en_passant) {
+        // the captured pawn is behind the target square
+        captured_square = to - chess_bitboard::pawn_push(team);
+        result = (chess_value_t)captured_square;
+    }
+    out_undo->captured = boards.squares[captured_square];
+    remove_piece(captured_square);
+    remove_piece(from);
+    chess_value_t arrived = id;
+    if (type == CHESS_PAWN && (to < 8 || to > 55)) {
+        arrived = chess_bitboard::piece_id(team, chess_bitboard::queen);
+        out_undo->promoted = 1;
+    }
+    put_piece(arrived, to);
+    if (type == CHESS_KING && (to - from == 2 || from - to == 2)) {
+        // castling: the rook jumps from its corner to the square the king crossed
+        const int rook_from = to > from ? (from & 56) + 7 : (from & 56);
+        const int rook_to = (from + to) / 2;
+        const chess_value_t rook = boards.squares[rook_from];
+        if (rook > -1) {
+            remove_piece(rook_from);
+            put_piece(rook, rook_to);
+        }
+    }
+    hash ^= castling_key(castling);
+    castling &= chess_bitboard::castling_keep(from) & chess_bitboard::castling_keep(to);
+    hash ^= castling_key(castling);
+    en_passant = -1;
+    if (type == CHESS_PAWN && (to - from == 16 || from - to == 16)) {
+        en_passant = (from + to) / 2;
+    }
+    if (type == CHESS_PAWN || out_undo->captured > -1) {
+        halfmove = 0;
+    } else if (halfmove < 255) {
+        ++halfmove;
+    }
+    side = !side;
+    toggle_en_passant();
+    return result;
+}
+void chess_position::unmake(const chess_undo& undo) {
+    const int from = undo.from, to = undo.to;
+    toggle_en_passant();
+    hash ^= zobrist.side;
+    side = !side;
+    hash ^= castling_key(castling);
+    castling = undo.castling;
+    hash ^= castling_key(castling);
+    const chess_value_t id = boards.squares[to];
+    const int team = CHESS_TEAM(id) & 1;
+    const int type = CHESS_TYPE(id);
+    if (type == CHESS_KING && (to - from == 2 || from - to == 2)) {
+        const int rook_from = to > from ? (from & 56) + 7 : (from & 56);
+        const int rook_to = (from + to) / 2;
+        const chess_value_t rook = boards.squares[rook_to];
+        if (rook > -1) {
+            remove_piece(rook_to);
+            put_piece(rook, rook_from);
+        }
+    }
+    remove_piece(to);
+    put_piece(undo.promoted ? chess_bitboard::piece_id(team, chess_bitboard::pawn) : id, from);
+    if (undo.captured > -1) {
+        const bool en_passant_capture = type == CHESS_PAWN && !undo.promoted && to == undo.en_passant;
+        put_piece(undo.captured, en_passant_capture ? to - chess_bitboard::pawn_push(team) : to);
+    }
+    en_passant = undo.en_passant;
+    halfmove = undo.halfmove;
+    toggle_en_passant();
+}
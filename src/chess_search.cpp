@@ -0,0 +1,707 @@
+#include "chess_search.hpp"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <new>
+
+#include "timing.hpp"
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#endif
+
+// for ordering captures, by type_index
+static const int16_t piece_values[] = {100, 320, 330, 500, 900, 0};
+// for static exchange evaluation, by type_index. a king can only capture last
+static const int16_t exchange_values[] = {100, 320, 330, 500, 900, 20000};
+// move ordering, best first: the table's move, captures that don't lose
+// material, promotions, the killers, the quiet moves by their history, and
+// last the captures that lose material
+static constexpr const int16_t order_capture = 16000;
+static constexpr const int16_t order_promotion = 15000;
+static constexpr const int16_t order_killer = 14000;
+// the history scores are halved once one passes this, staying below the killers
+static constexpr const int16_t history_max = 12000;
+static constexpr const int16_t order_losing_capture = -8000;
+// how often the clock and budget are checked, in nodes (power of 2)
+static constexpr const uint32_t check_interval = 1024;
+// how long the search may run before yielding to the idle task
+static constexpr const uint32_t yield_interval_ms = 50;
+static constexpr const int infinity = 32000;
+// which iteration depths a helper skips: helper n searches depth d unless
+// ((d + phase) / size) is odd, so helpers spread over neighboring depths
+static const uint8_t skip_size[] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+static const uint8_t skip_phase[] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+#ifdef ESP_PLATFORM
+// as much as the engine task has
+static constexpr const uint32_t helper_stack_size = 16 * 1024;
+#endif
+
+chess_search::chess_search() : move_top(0), cutoffs(0), first_move_cutoffs(0), see_pruned(0), history(nullptr), history_size(0), transpositions(nullptr), table_stats(), tablebases(nullptr), tablebase_hits(0), cancel_requested(false), ponder_requested(false), stopped(false), pondering(false), nodes(0), helper_index(0), helper_count(0), helper_core(-1), helper_priority(5), helper_running(false), iteration_callback(nullptr), iteration_callback_state(nullptr) {
+    memset(killers, 0, sizeof(killers));
+    memset(butterfly, 0, sizeof(butterfly));
+#ifdef ESP_PLATFORM
+    helper_done = nullptr;
+#endif
+}
+chess_search::~chess_search() {
+    free_helpers();
+#ifdef ESP_PLATFORM
+    if (helper_done != nullptr) {
+        vSemaphoreDelete(helper_done);
+    }
+#endif
+}
+void chess_search::free_helpers() {
+    for (size_t i = 0; i < helper_count; ++i) {
+        delete helpers[i];
+    }
+    helper_count = 0;
+}
+bool chess_search::threads(size_t count, int core, int priority) {
+    free_helpers();
+    helper_core = core;
+    helper_priority = priority;
+    if (count > max_threads) {
+        count = max_threads;
+    }
+    while (helper_count + 1 < count) {
+        // too big for most stacks
+        chess_search* helper = new (std::nothrow) chess_search();
+        if (helper == nullptr) {
+            return false;
+        }
+#ifdef ESP_PLATFORM
+        helper->helper_done = xSemaphoreCreateBinary();
+        if (helper->helper_done == nullptr) {
+            delete helper;
+            return false;
+        }
+#endif
+        helper->helper_index = helper_count + 1;
+        helpers[helper_count++] = helper;
+    }
+    return true;
+}
+void chess_search::cancel() {
+    cancel_requested = true;
+    // the helpers end on their own even if the main search never gets to stop them
+    for (size_t i = 0; i < helper_count; ++i) {
+        helpers[i]->cancel();
+    }
+}
+size_t chess_search::generate(const chess_position& position, bool captures_only) {
+    const size_t begin = move_top;
+    const chess_bitboard& boards = position.bitboards();
+    const int team = position.turn() & 1;
+    const int enemy = !team;
+    uint64_t destinations[64];
+    uint64_t origins = position.legal_moves(destinations);
+    while (origins) {
+        const int sq = chess_pop_square(&origins);
+        const int attacker = piece_values[chess_bitboard::index_of(CHESS_TYPE(boards.squares[sq]))];
+        uint64_t targets = destinations[sq];
+        if (captures_only) {
+            // en passant is left to the main search
+            targets &= boards.teams[enemy];
+        }
+        while (targets) {
+            const int to = chess_pop_square(&targets);
+            if (move_top == move_stack_size) {
+                return move_top - begin;
+            }
+            const chess_value_t victim = boards.squares[to];
+            move_entry& entry = move_stack[move_top++];
+            entry.from = sq;
+            entry.to = to;
+            if (victim > -1) {
+                // most valuable victim, least valuable attacker
+                const int victim_value = piece_values[chess_bitboard::index_of(CHESS_TYPE(victim))];
+                const int16_t mvv_lva = (int16_t)(victim_value * 8 - attacker / 8);
+                // taking with a cheaper piece can't lose material, so only the rest need the exchange worked out
+                const bool losing = victim_value < attacker && exchange_value(position, sq, to) < 0;
+                entry.order = (losing ? order_losing_capture : order_capture) + mvv_lva;
+            } else if (CHESS_TYPE(boards.squares[sq]) == CHESS_PAWN && (to < 8 || to > 55)) {
+                entry.order = order_promotion;
+            } else {
+                entry.order = butterfly[team][sq][to];
+            }
+        }
+    }
+    return move_top - begin;
+}
+int chess_search::exchange_value(const chess_position& position, int from, int to) {
+    const chess_bitboard& boards = position.bitboards();
+    // gain[d] is what the side making the d-th capture has won if the exchange stops there
+    int gain[32];
+    int depth = 0;
+    uint64_t occupancy = boards.occupied, removed = 0;
+    uint64_t attacker = 1ull << from;
+    int team = CHESS_TEAM(boards.squares[from]) & 1;
+    const chess_value_t victim = boards.squares[to];
+    gain[0] = victim < 0 ? 0 : exchange_values[chess_bitboard::index_of(CHESS_TYPE(victim))];
+    int attacker_value = exchange_values[chess_bitboard::index_of(CHESS_TYPE(boards.squares[from]))];
+    do {
+        ++depth;
+        // if the piece that just captured is taken in turn
+        gain[depth] = attacker_value - gain[depth - 1];
+        if ((-gain[depth - 1] > gain[depth] ? -gain[depth - 1] : gain[depth]) < 0) {
+            // neither side can come out ahead by going on
+            break;
+        }
+        // sliders behind the piece that moved join in
+        occupancy &= ~attacker;
+        removed |= attacker;
+        team = !team;
+        const uint64_t attackers = boards.attackers(to, team, occupancy, removed) & occupancy;
+        attacker = 0;
+        for (int type = 0; type < chess_bitboard::type_count; ++type) {
+            const uint64_t candidates = attackers & boards.pieces[team][type];
+            if (candidates) {
+                attacker = candidates & (0 - candidates);
+                attacker_value = exchange_values[type];
+                break;
+            }
+        }
+    } while (attacker && depth < 31);
+    while (--depth) {
+        // either side may decline to recapture
+        gain[depth - 1] = -(-gain[depth - 1] > gain[depth] ? -gain[depth - 1] : gain[depth]);
+    }
+    return gain[0];
+}
+void chess_search::order_quiets(size_t begin, size_t end, int ply) {
+    const uint16_t first = killers[ply][0], second = killers[ply][1];
+    if (first == 0) {
+        return;
+    }
+    for (size_t i = begin; i < end; ++i) {
+        move_entry& entry = move_stack[i];
+        if (entry.order < 0 || entry.order > history_max) {
+            // captures and promotions already come first
+            continue;
+        }
+        const uint16_t move = pack_move(entry.from, entry.to);
+        if (move == first) {
+            entry.order = order_killer;
+        } else if (move == second) {
+            entry.order = order_killer - 1;
+        }
+    }
+}
+void chess_search::record_cutoff(const chess_position& position, const move_entry& move, int depth, int ply) {
+    const chess_bitboard& boards = position.bitboards();
+    const chess_value_t id = boards.squares[(int)move.from];
+    if (boards.squares[(int)move.to] > -1 || (CHESS_TYPE(id) == CHESS_PAWN && (move.to < 8 || move.to > 55))) {
+        // captures and promotions are ordered well enough already
+        return;
+    }
+    const uint16_t packed = pack_move(move.from, move.to);
+    if (killers[ply][0] != packed) {
+        killers[ply][1] = killers[ply][0];
+        killers[ply][0] = packed;
+    }
+    const int team = CHESS_TEAM(id) & 1;
+    const int score = butterfly[team][(int)move.from][(int)move.to] + depth * depth;
+    butterfly[team][(int)move.from][(int)move.to] = (int16_t)score;
+    if (score > history_max) {
+        // keep every move's standing, but make room
+        for (auto& side : butterfly) {
+            for (auto& origin : side) {
+                for (int16_t& entry : origin) {
+                    entry /= 2;
+                }
+            }
+        }
+    }
+}
+void chess_search::reset_ordering() {
+    memset(killers, 0, sizeof(killers));
+    // what was learned on the last move mostly still applies, but less
+    for (auto& side : butterfly) {
+        for (auto& origin : side) {
+            for (int16_t& entry : origin) {
+                entry /= 4;
+            }
+        }
+    }
+    cutoffs = 0;
+    first_move_cutoffs = 0;
+    see_pruned = 0;
+}
+void chess_search::sort(size_t begin, size_t end) {
+    // insertion sort: the lists are short and often nearly sorted
+    for (size_t i = begin + 1; i < end; ++i) {
+        const move_entry entry = move_stack[i];
+        size_t j = i;
+        while (j > begin && move_stack[j - 1].order < entry.order) {
+            move_stack[j] = move_stack[j - 1];
+            --j;
+        }
+        move_stack[j] = entry;
+    }
+}
+bool chess_search::check_stop() {
+    if (stopped) {
+        return true;
+    }
+    if ((nodes & (check_interval - 1)) != 0) {
+        return false;
+    }
+    if (cancel_requested) {
+        stopped = true;
+        return true;
+    }
+    const uint32_t ms = timing_ms();
+    if (pondering && !ponder_requested) {
+        // the expected move was played: the budget starts now
+        pondering = false;
+        budget_ms = ms;
+        budget_nodes = nodes;
+    }
+    if (!pondering && limits.nodes && nodes - budget_nodes >= limits.nodes) {
+        stopped = true;
+        return true;
+    }
+    if (!pondering && limits.time_ms && ms - budget_ms >= limits.time_ms) {
+        stopped = true;
+        return true;
+    }
+#ifdef ESP_PLATFORM
+    // keep the idle task (and its watchdog) on this core fed
+    if (ms - last_yield_ms >= yield_interval_ms) {
+        vTaskDelay(1);
+        last_yield_ms = timing_ms();
+    }
+#endif
+    return false;
+}
+int chess_search::evaluate(const chess_position& position) const {
+    // updated as moves are made, rather than counted at every node
+    return position.score(position.turn());
+}
+// mate scores are stored relative to the node, not the root
+static int score_to_table(int score, int ply) {
+    if (score >= chess_search::mate_score - chess_search::max_ply) return score + ply;
+    if (score <= -chess_search::mate_score + chess_search::max_ply) return score - ply;
+    return score;
+}
+static int score_from_table(int score, int ply) {
+    if (score >= chess_search::mate_score - chess_search::max_ply) return score - ply;
+    if (score <= -chess_search::mate_score + chess_search::max_ply) return score + ply;
+    return score;
+}
+bool chess_search::is_repetition(const chess_position& position, int ply) const {
+    // only positions since the last capture or pawn move can repeat,
+    // and only with the same side to move
+    const uint64_t key = position.key();
+    int remaining = position.halfmove_clock();
+    int i = ply - 2;
+    for (; i >= 0 && remaining >= 2; i -= 2, remaining -= 2) {
+        if (path[i] == key) {
+            return true;
+        }
+    }
+    // continue into the game history where the line left off
+    for (int j = (int)history_size + i; j >= 0 && remaining >= 2; j -= 2, remaining -= 2) {
+        if (history[j] == key) {
+            return true;
+        }
+    }
+    return false;
+}
+int chess_search::quiesce(chess_position& position, int alpha, int beta, int ply) {
+    ++nodes;
+    if (check_stop()) {
+        return 0;
+    }
+    const int stand_pat = evaluate(position);
+    if (stand_pat >= beta || ply >= max_ply) {
+        return stand_pat;
+    }
+    if (stand_pat > alpha) {
+        alpha = stand_pat;
+    }
+    const size_t begin = move_top;
+    const size_t count = generate(position, true);
+    sort(begin, begin + count);
+    for (size_t i = begin; i < begin + count; ++i) {
+        if (move_stack[i].order < 0) {
+            // this and everything after it loses material
+            see_pruned += (uint32_t)(begin + count - i);
+            break;
+        }
+        chess_undo undo;
+        position.make(move_stack[i].from, move_stack[i].to, &undo);
+        const int score = -quiesce(position, -beta, -alpha, ply + 1);
+        position.unmake(undo);
+        if (stopped) {
+            break;
+        }
+        if (score > alpha) {
+            alpha = score;
+            if (alpha >= beta) {
+                break;
+            }
+        }
+    }
+    move_top = begin;
+    return alpha;
+}
+int chess_search::negamax(chess_position& position, int depth, int alpha, int beta, int ply) {
+    path[ply] = position.key();
+    if (is_repetition(position, ply) || position.halfmove_clock() >= 100) {
+        return 0;
+    }
+    if (depth <= 0) {
+        return quiesce(position, alpha, beta, ply);
+    }
+    ++nodes;
+    if (check_stop()) {
+        return 0;
+    }
+    if (ply >= max_ply) {
+        return evaluate(position);
+    }
+    // right after a capture or pawn move the result is exact, with no
+    // repetitions or fifty move count to account for
+    if (tablebases != nullptr && position.halfmove_clock() == 0 && position.castling_rights() == 0 &&
+        __builtin_popcountll(position.bitboards().occupied) <= tablebases->max_pieces()) {
+        chess_tb_position probe;
+        probe.load(position);
+        int wdl;
+        if (tablebases->probe_wdl(probe, &wdl)) {
+            ++tablebase_hits;
+            // cursed wins and blessed losses are draws under the fifty move rule
+            return wdl > chess_tablebase::cursed_win ? tablebase_win - ply : wdl < chess_tablebase::blessed_loss ? -tablebase_win + ply : 0;
+        }
+    }
+    uint16_t table_move = 0;
+    chess_tt::entry entry;
+    if (transpositions != nullptr && transpositions->probe(position.key(), &entry, &table_stats)) {
+        table_move = entry.move;
+        if (entry.depth >= depth) {
+            const int score = score_from_table(entry.score, ply);
+            const chess_tt::bound_type bound = entry.bound();
+            if (bound == chess_tt::bound_exact ||
+                (bound == chess_tt::bound_lower && score >= beta) ||
+                (bound == chess_tt::bound_upper && score <= alpha)) {
+                return score;
+            }
+        }
+    }
+    const size_t begin = move_top;
+    const size_t count = generate(position, false);
+    if (count == 0) {
+        // prefer the quickest mate
+        return position.in_check() ? -mate_score + ply : 0;
+    }
+    order_quiets(begin, begin + count, ply);
+    if (table_move != 0) {
+        bool found = false;
+        for (size_t i = begin; i < begin + count; ++i) {
+            if (pack_move(move_stack[i].from, move_stack[i].to) == table_move) {
+                move_stack[i].order = INT16_MAX;
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            // another position with the same check bits
+            ++table_stats.collisions;
+        }
+    }
+    sort(begin, begin + count);
+    const int original_alpha = alpha;
+    int best = -infinity;
+    uint16_t best_move = 0;
+    for (size_t i = begin; i < begin + count; ++i) {
+        chess_undo undo;
+        position.make(move_stack[i].from, move_stack[i].to, &undo);
+        const int score = -negamax(position, depth - 1, -beta, -alpha, ply + 1);
+        position.unmake(undo);
+        if (stopped) {
+            break;
+        }
+        if (score > best) {
+            best = score;
+            best_move = pack_move(move_stack[i].from, move_stack[i].to);
+            if (score > alpha) {
+                alpha = score;
+                if (alpha >= beta) {
+                    ++cutoffs;
+                    if (i == begin) {
+                        ++first_move_cutoffs;
+                    }
+                    record_cutoff(position, move_stack[i], depth, ply);
+                    break;
+                }
+            }
+        }
+    }
+    move_top = begin;
+    if (!stopped && transpositions != nullptr) {
+        const chess_tt::bound_type bound = best >= beta ? chess_tt::bound_lower : best > original_alpha ? chess_tt::bound_exact : chess_tt::bound_upper;
+        transpositions->store(position.key(), best_move, score_to_table(best, ply), depth, bound, &table_stats);
+    }
+    return best;
+}
+bool chess_search::search(const chess_position& position, const chess_search_limits& limits, chess_search_result* out_result, const uint64_t* history, size_t history_size) {
+    this->limits = limits;
+    this->history = history;
+    this->history_size = history != nullptr ? history_size : 0;
+    // cancel_requested is left alone: a cancel made after the search was
+    // queued but before it started must still stop it. see clear_cancel()
+    stopped = false;
+    nodes = 0;
+    tablebase_hits = 0;
+    table_stats = chess_tt::statistics();
+    move_top = 0;
+    reset_ordering();
+    start_ms = last_yield_ms = budget_ms = timing_ms();
+    budget_nodes = 0;
+    pondering = ponder_requested;
+    if (transpositions != nullptr) {
+        transpositions->new_search();
+    }
+    out_result->from = -1;
+    out_result->to = -1;
+    out_result->ponder_from = -1;
+    out_result->ponder_to = -1;
+    out_result->score = 0;
+    out_result->depth = 0;
+    out_result->tablebase_hits = 0;
+    out_result->cutoffs = 0;
+    out_result->first_move_cutoffs = 0;
+    out_result->see_pruned = 0;
+    out_result->branching_x100 = 0;
+    const size_t count = generate(position, false);
+    if (count == 0) {
+        out_result->nodes = 0;
+        out_result->elapsed_ms = 0;
+        return false;
+    }
+    if (tablebases != nullptr && position.castling_rights() == 0 &&
+        __builtin_popcountll(position.bitboards().occupied) <= tablebases->max_pieces()) {
+        // the tables know the best move outright
+        chess_tb_position probe;
+        probe.load(position);
+        int wdl;
+        if (tablebases->probe_root(probe, &out_result->from, &out_result->to, &wdl)) {
+            out_result->score = wdl > chess_tablebase::cursed_win ? tablebase_win : wdl < chess_tablebase::blessed_loss ? -tablebase_win : 0;
+            out_result->nodes = 0;
+            out_result->tablebase_hits = 1;
+            out_result->elapsed_ms = timing_ms() - start_ms;
+            return true;
+        }
+    }
+    sort(0, count);
+    path[0] = position.key();
+    // always have a legal move to play, even if the first iteration is cut short
+    out_result->from = move_stack[0].from;
+    out_result->to = move_stack[0].to;
+    start_helpers(position);
+    // searched in place, made and unmade move by move
+    chess_position root = position;
+    iterate(root, count, out_result);
+    uint32_t total_nodes = nodes, total_tablebase_hits = tablebase_hits;
+    stop_helpers(&total_nodes, &total_tablebase_hits);
+    if (transpositions != nullptr) {
+        // the reply the search expects is the table's best move after ours
+        chess_position child = position;
+        child.move(out_result->from, out_result->to);
+        chess_tt::entry entry;
+        if (transpositions->probe(child.key(), &entry, &table_stats) && entry.move != 0) {
+            const chess_value_t from = entry.move & 63, to = (entry.move >> 6) & 63;
+            if (((child.bitboards().teams[child.turn() & 1] >> from) & 1) && ((child.destinations(from) >> to) & 1)) {
+                out_result->ponder_from = from;
+                out_result->ponder_to = to;
+            } else {
+                ++table_stats.collisions;
+            }
+        }
+        transpositions->add_statistics(table_stats);
+    }
+    out_result->nodes = total_nodes;
+    out_result->tablebase_hits = total_tablebase_hits;
+    out_result->cutoffs = cutoffs;
+    out_result->first_move_cutoffs = first_move_cutoffs;
+    out_result->see_pruned = see_pruned;
+    out_result->elapsed_ms = timing_ms() - start_ms;
+    return true;
+}
+void chess_search::iterate(chess_position& position, size_t count, chess_search_result* out_result) {
+    const int max_depth = (limits.depth > 0 && limits.depth < max_ply) ? limits.depth : max_ply - 1;
+    uint32_t previous_nodes = 0;
+    for (int depth = 1; depth <= max_depth; ++depth) {
+        if (helper_index != 0) {
+            const size_t i = (helper_index - 1) % sizeof(skip_size);
+            if (((depth + skip_phase[i]) / skip_size[i]) & 1) {
+                continue;
+            }
+        }
+        int alpha = -infinity;
+        size_t best_index = 0;
+        const uint32_t start_nodes = nodes;
+        for (size_t i = 0; i < count; ++i) {
+            chess_undo undo;
+            position.make(move_stack[i].from, move_stack[i].to, &undo);
+            const int score = -negamax(position, depth - 1, -infinity, -alpha, 1);
+            position.unmake(undo);
+            if (stopped) {
+                break;
+            }
+            if (score > alpha) {
+                alpha = score;
+                best_index = i;
+            }
+        }
+        if (stopped) {
+            // a partial iteration still searched the previous best move first,
+            // so any move that beat it is an improvement
+            if (best_index != 0) {
+                out_result->from = move_stack[best_index].from;
+                out_result->to = move_stack[best_index].to;
+                out_result->score = alpha;
+            }
+            break;
+        }
+        // search the best move first on the next iteration
+        const move_entry best = move_stack[best_index];
+        memmove(&move_stack[1], &move_stack[0], best_index * sizeof(move_entry));
+        move_stack[0] = best;
+        out_result->from = best.from;
+        out_result->to = best.to;
+        out_result->score = alpha;
+        out_result->depth = depth;
+        const uint32_t iteration_nodes = nodes - start_nodes;
+        out_result->branching_x100 = previous_nodes ? (uint32_t)((uint64_t)iteration_nodes * 100 / previous_nodes) : 0;
+        previous_nodes = iteration_nodes;
+        if (transpositions != nullptr) {
+            transpositions->store(position.key(), pack_move(best.from, best.to), score_to_table(alpha, 0), depth, chess_tt::bound_exact, &table_stats);
+        }
+        if (helper_index == 0 && iteration_callback != nullptr) {
+            out_result->nodes = nodes;
+            out_result->elapsed_ms = timing_ms() - start_ms;
+            out_result->cutoffs = cutoffs;
+            out_result->first_move_cutoffs = first_move_cutoffs;
+            out_result->see_pruned = see_pruned;
+            iteration_callback(*out_result, iteration_callback_state);
+        }
+        // no point looking deeper once a forced mate is found
+        if (alpha >= mate_score - max_ply || alpha <= -mate_score + max_ply) {
+            break;
+        }
+    }
+}
+void chess_search::help() {
+    stopped = false;
+    nodes = 0;
+    tablebase_hits = 0;
+    table_stats = chess_tt::statistics();
+    move_top = 0;
+    reset_ordering();
+    start_ms = last_yield_ms = budget_ms = timing_ms();
+    budget_nodes = 0;
+    pondering = false;
+    const size_t count = generate(helper_root, false);
+    sort(0, count);
+    path[0] = helper_root.key();
+    // only the table keeps what a helper finds
+    chess_search_result result;
+    iterate(helper_root, count, &result);
+}
+#ifdef ESP_PLATFORM
+void chess_search::helper_proc(void* state) {
+    chess_search* helper = (chess_search*)state;
+    helper->help();
+    xSemaphoreGive(helper->helper_done);
+    vTaskDelete(nullptr);
+}
+#endif
+void chess_search::start_helpers(const chess_position& position) {
+    for (size_t i = 0; i < helper_count; ++i) {
+        chess_search* helper = helpers[i];
+        helper->helper_root = position;
+        helper->history = history;
+        helper->history_size = history_size;
+        helper->transpositions = transpositions;
+        helper->tablebases = tablebases;
+        // helpers run until the main search is done with them
+        helper->limits.depth = 0;
+        helper->limits.time_ms = 0;
+        helper->limits.nodes = 0;
+        // set here so a cancel can't be lost before the helper starts
+        helper->cancel_requested = false;
+#ifdef ESP_PLATFORM
+        helper->helper_running = pdPASS == xTaskCreatePinnedToCore(helper_proc, "chess_helper", helper_stack_size, helper, helper_priority, nullptr, helper_core < 0 ? tskNO_AFFINITY : helper_core);
+#else
+        helper->helper_thread = std::thread(&chess_search::help, helper);
+        helper->helper_running = true;
+#endif
+    }
+}
+void chess_search::stop_helpers(uint32_t* in_out_nodes, uint32_t* in_out_tablebase_hits) {
+    for (size_t i = 0; i < helper_count; ++i) {
+        helpers[i]->cancel();
+    }
+    for (size_t i = 0; i < helper_count; ++i) {
+        chess_search* helper = helpers[i];
+        if (!helper->helper_running) {
+            continue;
+        }
+#ifdef ESP_PLATFORM
+        xSemaphoreTake(helper->helper_done, portMAX_DELAY);
+#else
+        helper->helper_thread.join();
+#endif
+        helper->helper_running = false;
+        *in_out_nodes += helper->nodes;
+        *in_out_tablebase_hits += helper->tablebase_hits;
+        if (transpositions != nullptr) {
+            transpositions->add_statistics(helper->table_stats);
+        }
+    }
+}
+void chess_search::run_scaling(chess_search& searcher, const chess_position* positions, size_t count, const chess_search_limits& limits, size_t max_threads) {
+    const size_t restore = searcher.threads();
+    chess_tt* table = searcher.table();
+    uint64_t base_nodes = 0, base_ms = 0;
+    puts("threads        nodes       time          speed  nps x  time x  depth");
+    for (size_t threads = 1; threads <= max_threads && threads <= chess_search::max_threads; threads *= 2) {
+        if (!searcher.threads(threads, searcher.helper_core, searcher.helper_priority)) {
+            printf("%7u unable to allocate the helpers\n", (unsigned)threads);
+            break;
+        }
+        uint64_t total_nodes = 0, total_ms = 0;
+        int total_depth = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (table != nullptr) {
+                // each count starts from the same empty table
+                table->clear();
+            }
+            chess_search_result result;
+            if (searcher.search(positions[i], limits, &result)) {
+                total_nodes += result.nodes;
+                total_ms += result.elapsed_ms;
+                total_depth += result.depth;
+            }
+        }
+        const uint64_t nps = total_ms ? total_nodes * 1000 / total_ms : total_nodes;
+        if (threads == 1) {
+            base_nodes = nps;
+            base_ms = total_ms;
+        }
+        // hundredths, relative to one thread
+        const uint64_t nps_x = base_nodes ? nps * 100 / base_nodes : 0;
+        const uint64_t time_x = total_ms ? base_ms * 100 / total_ms : 0;
+        printf("%7u %12" PRIu64 " %8" PRIu64 "ms %10" PRIu64 "nps %3u.%02u %4u.%02u %6.1f\n",
+               (unsigned)threads, total_nodes, total_ms, nps,
+               (unsigned)(nps_x / 100), (unsigned)(nps_x % 100),
+               (unsigned)(time_x / 100), (unsigned)(time_x % 100),
+               count ? (double)total_depth / count : 0.0);
+    }
+    searcher.threads(restore, searcher.helper_core, searcher.helper_priority);
+}
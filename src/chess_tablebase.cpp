@@ -0,0 +1,1221 @@
+#include "chess_tablebase.hpp"
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <new>
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#endif
+
+// This follows the Syzygy probing code in Stockfish (tbprobe.cpp), except
+// that the files are read through the block cache instead of being mapped
+// whole. Internally squares run from a1 = 0 to h8 = 63 and pieces are coded
+// pawn = 1 to king = 6, plus 8 for black, as in the files.
+
+namespace {
+constexpr const uint32_t wdl_magic = 0x5D23E871;
+constexpr const uint32_t dtz_magic = 0xA50C66D7;
+constexpr const int max_table_pieces = 7;
+// per table flags
+enum : uint8_t {
+    flag_stm = 1,
+    flag_mapped = 2,
+    flag_win_plies = 4,
+    flag_loss_plies = 8,
+    flag_wide = 16,
+    flag_single_value = 128
+};
+// how a probe went
+enum : int {
+    state_change_stm = -1,
+    state_fail = 0,
+    state_ok = 1,
+    // the best move captures or moves a pawn, so DTZ can't be read for the position
+    state_zeroing_best_move = 2
+};
+
+struct tb_maps {
+    // chess.h squares to table squares and back
+    uint8_t to_tb[64];
+    chess_value_t from_tb[64];
+    // the team the tables call white, which moves first
+    int white;
+    // the squares below the a1-h8 diagonal, 0 to 27
+    uint8_t map_b1h1h7[64];
+    // the a1-d1-d4 triangle, 0 to 9, with the diagonal last
+    uint8_t map_a1d1d4[64];
+    // the 462 placements of two kings with the first in the triangle
+    int16_t map_kk[10][64];
+    uint32_t binomial[6][64];
+    // a2-h7 to 0-47, highest for the leading pawn
+    uint8_t map_pawns[64];
+    uint32_t lead_pawn_idx[6][64];
+    uint32_t lead_pawns_size[6][4];
+    tb_maps();
+};
+int off_a1h8(int square) {
+    return (square >> 3) - (square & 7);
+}
+bool kings_touch(int a, int b) {
+    const int dx = (a & 7) - (b & 7), dy = (a >> 3) - (b >> 3);
+    return dx >= -1 && dx <= 1 && dy >= -1 && dy <= 1;
+}
+tb_maps::tb_maps() {
+    memset(this, 0, sizeof(*this));
+    chess_bitboard::initialize();
+    for (int i = 0; i < 64; ++i) {
+        char name[3];
+        chess_index_name(i, name);
+        const int square = (name[1] - '1') * 8 + (name[0] - 'a');
+        to_tb[i] = (uint8_t)square;
+        from_tb[square] = (chess_value_t)i;
+    }
+    chess_game_t game;
+    chess_init(&game);
+    white = chess_turn(&game) & 1;
+    int code = 0;
+    for (int s = 0; s < 64; ++s) {
+        if (off_a1h8(s) < 0) {
+            map_b1h1h7[s] = (uint8_t)code++;
+        }
+    }
+    int diagonal[4];
+    int diagonal_size = 0;
+    code = 0;
+    for (int s = 0; s <= 27; ++s) {
+        if (off_a1h8(s) < 0 && (s & 7) <= 3) {
+            map_a1d1d4[s] = (uint8_t)code++;
+        } else if (!off_a1h8(s) && (s & 7) <= 3) {
+            diagonal[diagonal_size++] = s;
+        }
+    }
+    for (int i = 0; i < diagonal_size; ++i) {
+        map_a1d1d4[diagonal[i]] = (uint8_t)code++;
+    }
+    // both kings on the diagonal are encoded last
+    struct {
+        int idx;
+        int square;
+    } both[64];
+    int both_size = 0;
+    code = 0;
+    for (int idx = 0; idx < 10; ++idx) {
+        for (int s1 = 0; s1 <= 27; ++s1) {
+            // b1 is the only square in the triangle mapped to 0
+            if (map_a1d1d4[s1] != idx || (idx == 0 && s1 != 1)) {
+                continue;
+            }
+            for (int s2 = 0; s2 < 64; ++s2) {
+                if (kings_touch(s1, s2) || (!off_a1h8(s1) && off_a1h8(s2) > 0)) {
+                    continue;
+                }
+                if (!off_a1h8(s1) && !off_a1h8(s2)) {
+                    both[both_size++] = {idx, s2};
+                } else {
+                    map_kk[idx][s2] = (int16_t)code++;
+                }
+            }
+        }
+    }
+    for (int i = 0; i < both_size; ++i) {
+        map_kk[both[i].idx][both[i].square] = (int16_t)code++;
+    }
+    binomial[0][0] = 1;
+    for (int n = 1; n < 64; ++n) {
+        for (int k = 0; k < 6 && k <= n; ++k) {
+            binomial[k][n] = (k > 0 ? binomial[k - 1][n - 1] : 0) + (k < n ? binomial[k][n - 1] : 0);
+        }
+    }
+    int available = 47;
+    for (int lead = 1; lead <= 5; ++lead) {
+        for (int file = 0; file < 4; ++file) {
+            uint32_t idx = 0;
+            for (int rank = 1; rank <= 6; ++rank) {
+                const int sq = rank * 8 + file;
+                if (lead == 1) {
+                    map_pawns[sq] = (uint8_t)available--;
+                    map_pawns[sq ^ 7] = (uint8_t)available--;
+                }
+                lead_pawn_idx[lead][sq] = idx;
+                idx += binomial[lead - 1][map_pawns[sq]];
+            }
+            lead_pawns_size[lead][file] = idx;
+        }
+    }
+}
+const tb_maps& tb_tables() {
+    static const tb_maps result;
+    return result;
+}
+
+// reads little endian values through the cache, zero once anything fails
+struct tb_reader {
+    chess_block_cache* cache;
+    uint32_t file;
+    uint64_t offset;
+    bool ok;
+    void bytes(void* out, size_t size) {
+        if (!ok || !cache->read(file, offset, out, size)) {
+            memset(out, 0, size);
+            ok = false;
+        }
+        offset += size;
+    }
+    uint8_t u8() {
+        uint8_t result;
+        bytes(&result, 1);
+        return result;
+    }
+    uint16_t u16() {
+        uint8_t b[2];
+        bytes(b, 2);
+        return (uint16_t)(b[0] | (b[1] << 8));
+    }
+    uint32_t u32() {
+        uint8_t b[4];
+        bytes(b, 4);
+        return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+    }
+};
+// reads a compressed block as big endian words, a buffer at a time
+struct tb_stream {
+    tb_reader in;
+    uint8_t buffer[32];
+    size_t position;
+    uint32_t be32() {
+        if (position + 4 > sizeof(buffer)) {
+            in.bytes(buffer, sizeof(buffer));
+            position = 0;
+        }
+        const uint8_t* p = buffer + position;
+        position += 4;
+        return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+};
+
+void* tb_alloc(size_t size) {
+    void* result;
+#ifdef ESP_PLATFORM
+    result = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (result == nullptr) {
+        result = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+#else
+    result = malloc(size);
+#endif
+    if (result != nullptr) {
+        memset(result, 0, size);
+    }
+    return result;
+}
+void tb_free(void* ptr) {
+#ifdef ESP_PLATFORM
+    heap_caps_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+// counts of each piece kind, 4 bits apiece: white pawns first, black kings last
+uint64_t tb_signature(const chess_bitboard& boards, int white) {
+    uint64_t result = 0;
+    for (int color = 0; color < 2; ++color) {
+        const int team = color ? !white : white;
+        for (int type = 0; type < chess_bitboard::type_count; ++type) {
+            result |= (uint64_t)__builtin_popcountll(boards.pieces[team][type]) << ((color * 6 + type) * 4);
+        }
+    }
+    return result;
+}
+int tb_code(chess_value_t id, int white) {
+    return chess_bitboard::index_of(CHESS_TYPE(id)) + 1 + ((CHESS_TEAM(id) & 1) == white ? 0 : 8);
+}
+uint64_t promotion_rank(int team) {
+    return chess_bitboard::pawn_push(team) > 0 ? 0xFF00000000000000ull : 0xFFull;
+}
+const chess_bitboard::type_index promotion_types[] = {chess_bitboard::queen, chess_bitboard::rook, chess_bitboard::bishop, chess_bitboard::knight};
+
+bool tb_is_capture(const chess_tb_position& position, int from, int to) {
+    return position.boards.squares[to] > -1 ||
+           (to == position.en_passant && CHESS_TYPE(position.boards.squares[from]) == CHESS_PAWN);
+}
+bool tb_is_zeroing(const chess_tb_position& position, int from, int to) {
+    return CHESS_TYPE(position.boards.squares[from]) == CHESS_PAWN || position.boards.squares[to] > -1;
+}
+void tb_play(const chess_tb_position& position, int from, int to, chess_value_t promotion, chess_tb_position* out_child) {
+    *out_child = position;
+    out_child->halfmove = tb_is_zeroing(position, from, to) ? 0 : (uint8_t)std::min(255, position.halfmove + 1);
+    out_child->boards.play(from, to, promotion, &out_child->castling, &out_child->en_passant);
+    out_child->turn = !position.turn;
+}
+// calls visit(from, to, promotion) for each legal move until it returns false.
+// promotion is the id a pawn promotes to, or -1
+template <typename F>
+bool tb_for_each_move(const chess_tb_position& position, bool queens_only, F visit) {
+    const int team = position.turn & 1;
+    const uint64_t last_rank = promotion_rank(team);
+    uint64_t origins = position.boards.teams[team];
+    while (origins) {
+        const int from = chess_pop_square(&origins);
+        const bool pawn = CHESS_TYPE(position.boards.squares[from]) == CHESS_PAWN;
+        uint64_t targets = position.boards.destinations(from, position.castling, position.en_passant);
+        while (targets) {
+            const int to = chess_pop_square(&targets);
+            const int promotions = (pawn && ((last_rank >> to) & 1)) ? (queens_only ? 1 : 4) : 0;
+            if (promotions == 0) {
+                if (!visit(from, to, (chess_value_t)-1)) {
+                    return false;
+                }
+            }
+            for (int i = 0; i < promotions; ++i) {
+                if (!visit(from, to, chess_bitboard::piece_id(team, promotion_types[i]))) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+bool tb_has_move(const chess_tb_position& position) {
+    uint64_t origins = position.boards.teams[position.turn & 1];
+    while (origins) {
+        if (position.boards.destinations(chess_pop_square(&origins), position.castling, position.en_passant)) {
+            return true;
+        }
+    }
+    return false;
+}
+bool tb_is_mate(const chess_tb_position& position) {
+    return position.boards.in_check(position.turn & 1) && !tb_has_move(position);
+}
+int sign_of(int value) {
+    return (value > 0) - (value < 0);
+}
+int dtz_before_zeroing(int wdl) {
+    switch (wdl) {
+        case chess_tablebase::win:
+            return 1;
+        case chess_tablebase::cursed_win:
+            return 101;
+        case chess_tablebase::blessed_loss:
+            return -101;
+        case chess_tablebase::loss:
+            return -1;
+        default:
+            return 0;
+    }
+}
+// sorts squares in place, by map when given. stable, and without the heap
+void tb_sort(int* begin, int* end, const uint8_t* map) {
+    for (int* i = begin + 1; i < end; ++i) {
+        const int value = *i;
+        const int key = map ? map[value] : value;
+        int* j = i;
+        while (j > begin && (map ? map[j[-1]] : j[-1]) > key) {
+            *j = j[-1];
+            --j;
+        }
+        *j = value;
+    }
+}
+}  // namespace
+
+struct chess_tablebase::pairs {
+    uint8_t flags;
+    // the value of a single value table
+    uint8_t min_sym_len;
+    uint8_t max_sym_len;
+    uint8_t pieces[max_table_pieces];
+    uint8_t group_len[max_table_pieces + 1];
+    uint64_t group_idx[max_table_pieces + 1];
+    uint16_t map_idx[4];
+    uint64_t block_size;
+    uint64_t span;
+    uint32_t blocks;
+    uint32_t block_length_size;
+    uint64_t sparse_index_size;
+    // where each part starts in the file
+    uint64_t sparse_index;
+    uint64_t block_length;
+    uint64_t data;
+    // the Huffman and pairing tables, kept in memory
+    uint16_t symbols;
+    uint64_t* base64;
+    uint16_t* lowest_sym;
+    uint8_t* btree;
+    uint8_t* symlen;
+    uint16_t left(int sym) const {
+        const uint8_t* p = btree + sym * 3;
+        return (uint16_t)(((p[1] & 0xF) << 8) | p[0]);
+    }
+    uint16_t right(int sym) const {
+        const uint8_t* p = btree + sym * 3;
+        return (uint16_t)((p[2] << 4) | (p[1] >> 4));
+    }
+};
+
+struct chess_tablebase::table {
+    char name[16];
+    // the signature with white as named, and with the colors swapped
+    uint64_t key;
+    uint64_t key2;
+    uint8_t piece_count;
+    // the leading side's pawns, then the other side's
+    uint8_t pawn_count[2];
+    bool has_pawns;
+    bool has_unique;
+    bool has_dtz;
+    std::atomic<bool> ready[2];
+    bool failed[2];
+    // by [wdl, dtz], then file and side
+    pairs* items[2];
+    uint64_t dtz_map;
+};
+
+static void tb_set_groups(const chess_tablebase::table& entry, chess_tablebase::pairs* d, const int order[2], int file) {
+    const tb_maps& maps = tb_tables();
+    int n = 0, first_len = entry.has_pawns ? 0 : entry.has_unique ? 3 : 2;
+    d->group_len[n] = 1;
+    // the pieces in each group are the same kind, except that the leading group
+    // holds the first two or three unique pieces
+    for (int i = 1; i < entry.piece_count; ++i) {
+        if (--first_len > 0 || d->pieces[i] == d->pieces[i - 1]) {
+            ++d->group_len[n];
+        } else {
+            d->group_len[++n] = 1;
+        }
+    }
+    d->group_len[++n] = 0;
+    // the groups are encoded in the order the file gives, each scaling the
+    // ones before it by its number of placements
+    const bool pp = entry.has_pawns && entry.pawn_count[1];
+    int next = pp ? 2 : 1;
+    int free_squares = 64 - d->group_len[0] - (pp ? d->group_len[1] : 0);
+    uint64_t idx = 1;
+    for (int k = 0; next < n || k == order[0] || k == order[1]; ++k) {
+        if (k == order[0]) {
+            d->group_idx[0] = idx;
+            idx *= entry.has_pawns ? maps.lead_pawns_size[d->group_len[0]][file] : entry.has_unique ? 31332 : 462;
+        } else if (k == order[1]) {
+            d->group_idx[1] = idx;
+            idx *= maps.binomial[d->group_len[1]][48 - d->group_len[0]];
+        } else {
+            d->group_idx[next] = idx;
+            idx *= maps.binomial[d->group_len[next]][free_squares];
+            free_squares -= d->group_len[next++];
+        }
+    }
+    d->group_idx[n] = idx;
+}
+static bool tb_read_sizes(tb_reader& in, chess_tablebase::pairs* d) {
+    d->flags = in.u8();
+    if (d->flags & flag_single_value) {
+        d->min_sym_len = in.u8();
+        return in.ok;
+    }
+    int last = 0;
+    while (last < max_table_pieces && d->group_len[last]) ++last;
+    const uint64_t size = d->group_idx[last];
+    const uint8_t block_shift = in.u8(), span_shift = in.u8();
+    if (block_shift > 30 || span_shift > 30) {
+        return false;
+    }
+    d->block_size = 1ull << block_shift;
+    d->span = 1ull << span_shift;
+    d->sparse_index_size = (size + d->span - 1) / d->span;
+    const uint8_t padding = in.u8();
+    d->blocks = in.u32();
+    d->block_length_size = d->blocks + padding;
+    d->max_sym_len = in.u8();
+    d->min_sym_len = in.u8();
+    if (d->min_sym_len < 1 || d->max_sym_len < d->min_sym_len || d->max_sym_len > 32) {
+        return false;
+    }
+    const int lengths = d->max_sym_len - d->min_sym_len + 1;
+    uint16_t lowest[32];
+    for (int i = 0; i < lengths; ++i) {
+        lowest[i] = in.u16();
+    }
+    d->symbols = in.u16();
+    if (!in.ok || d->symbols == 0 || d->symbols > 4096) {
+        return false;
+    }
+    // one block for all four tables
+    uint8_t* storage = (uint8_t*)tb_alloc(lengths * (sizeof(uint64_t) + sizeof(uint16_t)) + d->symbols * 4);
+    if (storage == nullptr) {
+        return false;
+    }
+    d->base64 = (uint64_t*)storage;
+    d->lowest_sym = (uint16_t*)(storage + lengths * sizeof(uint64_t));
+    d->btree = (uint8_t*)(d->lowest_sym + lengths);
+    d->symlen = d->btree + d->symbols * 3;
+    memcpy(d->lowest_sym, lowest, lengths * sizeof(uint16_t));
+    in.bytes(d->btree, d->symbols * 3);
+    in.offset += d->symbols & 1;
+    // canonical Huffman: longer codes have lower values, so base64[i] is the
+    // lowest code of length i + min_sym_len, left aligned in 64 bits
+    d->base64[lengths - 1] = 0;
+    for (int i = lengths - 2; i >= 0; --i) {
+        d->base64[i] = (d->base64[i + 1] + d->lowest_sym[i] - d->lowest_sym[i + 1]) / 2;
+    }
+    for (int i = 0; i < lengths; ++i) {
+        d->base64[i] <<= 64 - i - d->min_sym_len;
+    }
+    // each symbol stands for a pair of earlier ones, down to the values at the
+    // leaves. symlen is the number of values a symbol expands to, less one.
+    // worked out depth first, without recursion
+    uint16_t* stack = (uint16_t*)malloc(d->symbols * sizeof(uint16_t) + d->symbols);
+    if (stack == nullptr) {
+        return false;
+    }
+    uint8_t* visited = (uint8_t*)(stack + d->symbols);
+    memset(visited, 0, d->symbols);
+    bool result = in.ok;
+    for (int sym = 0; sym < d->symbols && result; ++sym) {
+        int top = 0;
+        if (!visited[sym]) stack[top++] = (uint16_t)sym;
+        while (top > 0 && result) {
+            const int s = stack[top - 1];
+            const int l = d->left(s), r = d->right(s);
+            if (r == 0xFFF) {
+                d->symlen[s] = 0;
+            } else if (l >= d->symbols || r >= d->symbols) {
+                result = false;
+                break;
+            } else if (!visited[l] || !visited[r]) {
+                if (top == d->symbols) {
+                    // a cycle
+                    result = false;
+                    break;
+                }
+                stack[top++] = (uint16_t)(!visited[l] ? l : r);
+                continue;
+            } else {
+                d->symlen[s] = (uint8_t)(d->symlen[l] + d->symlen[r] + 1);
+            }
+            visited[s] = 1;
+            --top;
+        }
+    }
+    free(stack);
+    return result;
+}
+void chess_tb_position::load(const chess_position& position) {
+    boards = position.bitboards();
+    turn = position.turn();
+    castling = position.castling_rights();
+    en_passant = position.en_passant_square();
+    halfmove = position.halfmove_clock();
+}
+
+chess_tablebase::chess_tablebase() : cache(nullptr), tables(nullptr), tables_size(0), index(nullptr), index_size(0), largest(0), probe_count(0) {
+    directory[0] = '\0';
+#ifdef ESP_PLATFORM
+    lock = xSemaphoreCreateMutex();
+#endif
+}
+chess_tablebase::~chess_tablebase() {
+    close();
+#ifdef ESP_PLATFORM
+    vSemaphoreDelete(lock);
+#endif
+}
+void chess_tablebase::acquire() {
+#ifdef ESP_PLATFORM
+    xSemaphoreTake(lock, portMAX_DELAY);
+#else
+    lock.lock();
+#endif
+}
+void chess_tablebase::release() {
+#ifdef ESP_PLATFORM
+    xSemaphoreGive(lock);
+#else
+    lock.unlock();
+#endif
+}
+FILE* chess_tablebase::open_file(uint32_t file, void* state) {
+    const chess_tablebase* self = (const chess_tablebase*)state;
+    if (file / 2 >= self->tables_size) {
+        return nullptr;
+    }
+    char path[96];
+    snprintf(path, sizeof(path), "%s/%s.%s", self->directory, self->tables[file / 2].name, (file & 1) ? "rtbz" : "rtbw");
+    return fopen(path, "rb");
+}
+// parses a name such as "KRPvKR" into piece counts by [side][type_index]
+static bool tb_parse_name(const char* name, size_t length, int counts[2][chess_bitboard::type_count]) {
+    static const char letters[] = "PNBRQK";
+    memset(counts, 0, sizeof(int) * 2 * chess_bitboard::type_count);
+    int side = 0, total = 0;
+    for (size_t i = 0; i < length; ++i) {
+        if (name[i] == 'v' && side == 0) {
+            side = 1;
+            continue;
+        }
+        const char* letter = strchr(letters, name[i]);
+        if (letter == nullptr || name[i] == '\0') {
+            return false;
+        }
+        ++counts[side][letter - letters];
+        ++total;
+    }
+    return side == 1 && counts[0][chess_bitboard::king] == 1 && counts[1][chess_bitboard::king] == 1 && total <= max_table_pieces;
+}
+bool chess_tablebase::open(const char* directory, chess_block_cache* cache) {
+    close();
+    tb_tables();
+    if (cache == nullptr || !cache->allocated() || strlen(directory) >= sizeof(this->directory)) {
+        return false;
+    }
+    DIR* dir = opendir(directory);
+    if (dir == nullptr) {
+        return false;
+    }
+    strcpy(this->directory, directory);
+    this->cache = cache;
+    size_t capacity = 0;
+    struct dirent* item;
+    while (nullptr != (item = readdir(dir))) {
+        const char* name = item->d_name;
+        const size_t length = strlen(name);
+        int counts[2][chess_bitboard::type_count];
+        if (length < 6 || length - 5 >= sizeof(table::name) || 0 != strcasecmp(name + length - 5, ".rtbw") ||
+            !tb_parse_name(name, length - 5, counts)) {
+            continue;
+        }
+        if (tables_size == capacity) {
+            capacity = capacity ? capacity * 2 : 32;
+            table* grown = (table*)tb_alloc(capacity * sizeof(table));
+            if (grown == nullptr) {
+                break;
+            }
+            if (tables != nullptr) {
+                memcpy((void*)grown, (void*)tables, tables_size * sizeof(table));
+                tb_free(tables);
+            }
+            tables = grown;
+        }
+        table& entry = tables[tables_size];
+        memcpy(entry.name, name, length - 5);
+        entry.name[length - 5] = '\0';
+        entry.key = entry.key2 = 0;
+        entry.piece_count = 0;
+        entry.has_unique = false;
+        for (int side = 0; side < 2; ++side) {
+            for (int type = 0; type < chess_bitboard::type_count; ++type) {
+                entry.key |= (uint64_t)counts[side][type] << ((side * 6 + type) * 4);
+                entry.key2 |= (uint64_t)counts[side][type] << (((1 - side) * 6 + type) * 4);
+                entry.piece_count += counts[side][type];
+                if (type != chess_bitboard::king && counts[side][type] == 1) {
+                    entry.has_unique = true;
+                }
+            }
+        }
+        const int white_pawns = counts[0][chess_bitboard::pawn], black_pawns = counts[1][chess_bitboard::pawn];
+        entry.has_pawns = white_pawns + black_pawns > 0;
+        // the side with fewer pawns leads, as that compresses better
+        const bool white_leads = !black_pawns || (white_pawns && black_pawns >= white_pawns);
+        entry.pawn_count[0] = (uint8_t)(white_leads ? white_pawns : black_pawns);
+        entry.pawn_count[1] = (uint8_t)(white_leads ? black_pawns : white_pawns);
+        char path[96];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s.rtbz", directory, entry.name);
+        entry.has_dtz = 0 == stat(path, &st);
+        new (&entry.ready[0]) std::atomic<bool>(false);
+        new (&entry.ready[1]) std::atomic<bool>(false);
+        entry.failed[0] = entry.failed[1] = false;
+        entry.items[0] = entry.items[1] = nullptr;
+        entry.dtz_map = 0;
+        if (entry.piece_count > largest) {
+            largest = entry.piece_count;
+        }
+        ++tables_size;
+    }
+    closedir(dir);
+    index = (lookup*)tb_alloc(tables_size * 2 * sizeof(lookup) + 1);
+    if (index == nullptr) {
+        close();
+        return false;
+    }
+    for (size_t i = 0; i < tables_size; ++i) {
+        index[index_size++] = {tables[i].key, (uint32_t)i};
+        if (tables[i].key2 != tables[i].key) {
+            index[index_size++] = {tables[i].key2, (uint32_t)i};
+        }
+    }
+    std::sort(index, index + index_size, [](const lookup& lhs, const lookup& rhs) {
+        return lhs.signature < rhs.signature;
+    });
+    // the cache may hold blocks from other tables under the same file numbers
+    cache->clear();
+    cache->on_open_callback(open_file, this);
+    if (tables_size == 0) {
+        close();
+        return false;
+    }
+    return true;
+}
+void chess_tablebase::close() {
+    for (size_t i = 0; i < tables_size; ++i) {
+        free_items(tables[i], false);
+        free_items(tables[i], true);
+    }
+    if (cache != nullptr) {
+        cache->on_open_callback(nullptr);
+        cache->clear();
+    }
+    tb_free(tables);
+    tb_free(index);
+    tables = nullptr;
+    index = nullptr;
+    tables_size = index_size = 0;
+    largest = 0;
+    cache = nullptr;
+}
+void chess_tablebase::free_items(table& entry, bool dtz) {
+    pairs* items = entry.items[dtz];
+    if (items == nullptr) {
+        return;
+    }
+    const int count = (entry.has_pawns ? 4 : 1) * ((!dtz && entry.key != entry.key2) ? 2 : 1);
+    for (int i = 0; i < count; ++i) {
+        tb_free(items[i].base64);
+    }
+    tb_free(items);
+    entry.items[dtz] = nullptr;
+}
+chess_tablebase::table* chess_tablebase::find(uint64_t signature) const {
+    size_t low = 0, high = index_size;
+    while (low < high) {
+        const size_t mid = low + (high - low) / 2;
+        if (index[mid].signature < signature) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return (low < index_size && index[low].signature == signature) ? &tables[index[low].table] : nullptr;
+}
+bool chess_tablebase::load(table& entry, bool dtz) {
+    tb_reader in = {cache, (uint32_t)(&entry - tables) * 2 + (dtz ? 1 : 0), 0, true};
+    const uint32_t magic = in.u32();
+    const uint8_t header = in.u8();
+    if (!in.ok || magic != (dtz ? dtz_magic : wdl_magic) || ((header & 2) != 0) != entry.has_pawns ||
+        ((header & 1) != 0) != (entry.key != entry.key2)) {
+        return false;
+    }
+    const int sides = (!dtz && entry.key != entry.key2) ? 2 : 1;
+    const int files = entry.has_pawns ? 4 : 1;
+    const bool pp = entry.has_pawns && entry.pawn_count[1];
+    pairs* items = (pairs*)tb_alloc(sizeof(pairs) * sides * files);
+    if (items == nullptr) {
+        return false;
+    }
+    entry.items[dtz] = items;
+    for (int f = 0; f < files; ++f) {
+        const uint8_t b0 = in.u8(), b1 = pp ? in.u8() : 0;
+        const int order[2][2] = {{b0 & 0xF, pp ? (b1 & 0xF) : 0xF}, {b0 >> 4, pp ? (b1 >> 4) : 0xF}};
+        for (int k = 0; k < entry.piece_count; ++k) {
+            const uint8_t b = in.u8();
+            for (int i = 0; i < sides; ++i) {
+                items[f * sides + i].pieces[k] = i ? (b >> 4) : (b & 0xF);
+            }
+        }
+        for (int i = 0; i < sides; ++i) {
+            tb_set_groups(entry, &items[f * sides + i], order[i], f);
+        }
+    }
+    in.offset += in.offset & 1;
+    for (int i = 0; i < files * sides; ++i) {
+        if (!tb_read_sizes(in, &items[i])) {
+            return false;
+        }
+    }
+    if (dtz) {
+        entry.dtz_map = in.offset;
+        for (int f = 0; f < files; ++f) {
+            pairs& d = items[f];
+            if (!(d.flags & flag_mapped)) {
+                continue;
+            }
+            // four maps, one per result, each prefixed by its length
+            if (d.flags & flag_wide) {
+                in.offset += in.offset & 1;
+                for (int i = 0; i < 4; ++i) {
+                    d.map_idx[i] = (uint16_t)((in.offset - entry.dtz_map) / 2 + 1);
+                    in.offset += 2 * (uint64_t)in.u16();
+                }
+            } else {
+                for (int i = 0; i < 4; ++i) {
+                    d.map_idx[i] = (uint16_t)(in.offset - entry.dtz_map + 1);
+                    in.offset += in.u8();
+                }
+            }
+        }
+        in.offset += in.offset & 1;
+    }
+    for (int i = 0; i < files * sides; ++i) {
+        items[i].sparse_index = in.offset;
+        in.offset += items[i].sparse_index_size * 6;
+    }
+    for (int i = 0; i < files * sides; ++i) {
+        items[i].block_length = in.offset;
+        in.offset += (uint64_t)items[i].block_length_size * 2;
+    }
+    for (int i = 0; i < files * sides; ++i) {
+        in.offset = (in.offset + 63) & ~(uint64_t)63;
+        items[i].data = in.offset;
+        in.offset += (uint64_t)items[i].blocks * items[i].block_size;
+    }
+    return in.ok;
+}
+bool chess_tablebase::ready(table& entry, bool dtz) {
+    if (entry.ready[dtz].load(std::memory_order_acquire)) {
+        return true;
+    }
+    // the header is read on first use, once
+    acquire();
+    if (!entry.ready[dtz] && !entry.failed[dtz]) {
+        if (load(entry, dtz)) {
+            entry.ready[dtz].store(true, std::memory_order_release);
+        } else {
+            free_items(entry, dtz);
+            entry.failed[dtz] = true;
+        }
+    }
+    const bool result = entry.ready[dtz];
+    release();
+    return result;
+}
+int chess_tablebase::decompress(const pairs& d, uint32_t file, uint64_t idx, bool* out_ok) {
+    if (d.flags & flag_single_value) {
+        return d.min_sym_len;
+    }
+    tb_reader in = {cache, file, d.sparse_index + idx / d.span * 6, true};
+    uint32_t block = in.u32();
+    int offset = in.u16() + (int)(idx % d.span) - (int)(d.span / 2);
+    // the sparse index points near the value. walk the block lengths to it
+    while (offset < 0 && in.ok) {
+        if (block == 0) {
+            in.ok = false;
+            break;
+        }
+        in.offset = d.block_length + (uint64_t)--block * 2;
+        offset += in.u16() + 1;
+    }
+    while (in.ok) {
+        if (block >= d.block_length_size) {
+            in.ok = false;
+            break;
+        }
+        in.offset = d.block_length + (uint64_t)block * 2;
+        const int length = in.u16();
+        if (offset <= length) {
+            break;
+        }
+        offset -= length + 1;
+        ++block;
+    }
+    if (!in.ok) {
+        *out_ok = false;
+        return 0;
+    }
+    tb_stream stream = {{cache, file, d.data + (uint64_t)block * d.block_size, true}, {0}, sizeof(tb_stream::buffer)};
+    uint64_t buf64 = (uint64_t)stream.be32() << 32;
+    buf64 |= stream.be32();
+    int buf64_size = 64;
+    int sym;
+    // skip whole symbols until the one holding the value
+    while (true) {
+        int len = 0;
+        while (buf64 < d.base64[len]) ++len;
+        sym = (int)((buf64 - d.base64[len]) >> (64 - len - d.min_sym_len)) + d.lowest_sym[len];
+        if (sym >= d.symbols) {
+            *out_ok = false;
+            return 0;
+        }
+        if (offset < d.symlen[sym] + 1) {
+            break;
+        }
+        offset -= d.symlen[sym] + 1;
+        len += d.min_sym_len;
+        buf64 <<= len;
+        buf64_size -= len;
+        if (buf64_size <= 32) {
+            buf64_size += 32;
+            buf64 |= (uint64_t)stream.be32() << (64 - buf64_size);
+        }
+    }
+    // then descend its pairs to the value
+    while (d.symlen[sym]) {
+        const int left = d.left(sym);
+        if (offset < d.symlen[left] + 1) {
+            sym = left;
+        } else {
+            offset -= d.symlen[left] + 1;
+            sym = d.right(sym);
+        }
+    }
+    *out_ok = stream.in.ok;
+    return d.left(sym);
+}
+int chess_tablebase::probe_table(const chess_tb_position& position, bool dtz, int wdl, int* state) {
+    const tb_maps& maps = tb_tables();
+    if (__builtin_popcountll(position.boards.occupied) == 2) {
+        // king against king
+        return draw;
+    }
+    const uint64_t signature = tb_signature(position.boards, maps.white);
+    table* entry = find(signature);
+    if (entry == nullptr || (dtz && !entry->has_dtz) || !ready(*entry, dtz)) {
+        *state = state_fail;
+        return 0;
+    }
+    // the tables hold the side with more material as white, and only white
+    // to move when both sides have the same. otherwise flip the board
+    const int side_to_move = (position.turn & 1) == maps.white ? 0 : 1;
+    const bool flip = (entry->key == entry->key2 && side_to_move) || signature != entry->key;
+    const int flip_color = flip ? 8 : 0, flip_squares = flip ? 56 : 0;
+    const int stm = flip ^ side_to_move;
+    const int sides = (!dtz && entry->key != entry->key2) ? 2 : 1;
+    const pairs* items = entry->items[dtz];
+    int squares[max_table_pieces];
+    uint8_t pieces[max_table_pieces];
+    int size = 0, lead_count = 0, file = 0;
+    uint64_t lead = 0;
+    if (entry->has_pawns) {
+        // the leading pawns come first in every file's piece list. the table
+        // to use depends on the file of the one nearest the edge
+        const int color = (items[0].pieces[0] ^ flip_color) >> 3;
+        lead = position.boards.pieces[color ? !maps.white : maps.white][chess_bitboard::pawn];
+        uint64_t remaining = lead;
+        while (remaining && size < max_table_pieces) {
+            squares[size++] = maps.to_tb[chess_pop_square(&remaining)] ^ flip_squares;
+        }
+        lead_count = size;
+        if (lead_count == 0) {
+            *state = state_fail;
+            return 0;
+        }
+        int best = 0;
+        for (int i = 1; i < lead_count; ++i) {
+            if (maps.map_pawns[squares[i]] > maps.map_pawns[squares[best]]) {
+                best = i;
+            }
+        }
+        std::swap(squares[0], squares[best]);
+        file = std::min(squares[0] & 7, 7 - (squares[0] & 7));
+    }
+    const pairs* d = &items[file * sides + stm % sides];
+    if (dtz && (d->flags & flag_stm) != stm && !(entry->key == entry->key2 && !entry->has_pawns)) {
+        // only the other side to move is stored
+        *state = state_change_stm;
+        return 0;
+    }
+    uint64_t remaining = position.boards.occupied & ~lead;
+    while (remaining && size < max_table_pieces) {
+        const int square = chess_pop_square(&remaining);
+        squares[size] = maps.to_tb[square] ^ flip_squares;
+        pieces[size++] = (uint8_t)(tb_code(position.boards.squares[square], maps.white) ^ flip_color);
+    }
+    if (size != entry->piece_count) {
+        *state = state_fail;
+        return 0;
+    }
+    // put the pieces in the order the file lists them
+    for (int i = lead_count; i < size - 1; ++i) {
+        for (int j = i + 1; j < size; ++j) {
+            if (d->pieces[i] == pieces[j]) {
+                std::swap(pieces[i], pieces[j]);
+                std::swap(squares[i], squares[j]);
+                break;
+            }
+        }
+    }
+    // mirror so the leading piece is on files a to d
+    if ((squares[0] & 7) > 3) {
+        for (int i = 0; i < size; ++i) {
+            squares[i] ^= 7;
+        }
+    }
+    uint64_t idx;
+    if (entry->has_pawns) {
+        idx = maps.lead_pawn_idx[lead_count][squares[0]];
+        tb_sort(squares + 1, squares + lead_count, maps.map_pawns);
+        for (int i = 1; i < lead_count; ++i) {
+            idx += maps.binomial[i][maps.map_pawns[squares[i]]];
+        }
+    } else {
+        // without pawns, also mirror it onto ranks 1 to 4, then below the a1-h8 diagonal
+        if ((squares[0] >> 3) > 3) {
+            for (int i = 0; i < size; ++i) {
+                squares[i] ^= 56;
+            }
+        }
+        for (int i = 0; i < d->group_len[0]; ++i) {
+            if (!off_a1h8(squares[i])) {
+                continue;
+            }
+            if (off_a1h8(squares[i]) > 0) {
+                for (int j = i; j < size; ++j) {
+                    squares[j] = ((squares[j] >> 3) | (squares[j] << 3)) & 63;
+                }
+            }
+            break;
+        }
+        if (entry->has_unique) {
+            const int adjust1 = squares[1] > squares[0];
+            const int adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+            if (off_a1h8(squares[0])) {
+                idx = ((uint64_t)maps.map_a1d1d4[squares[0]] * 63 + (squares[1] - adjust1)) * 62 + squares[2] - adjust2;
+            } else if (off_a1h8(squares[1])) {
+                idx = ((uint64_t)6 * 63 + (squares[0] >> 3) * 28 + maps.map_b1h1h7[squares[1]]) * 62 + squares[2] - adjust2;
+            } else if (off_a1h8(squares[2])) {
+                idx = 6 * 63 * 62 + 4 * 28 * 62 + (squares[0] >> 3) * 7 * 28 + ((squares[1] >> 3) - adjust1) * 28 +
+                      maps.map_b1h1h7[squares[2]];
+            } else {
+                idx = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 + (squares[0] >> 3) * 7 * 6 +
+                      ((squares[1] >> 3) - adjust1) * 6 + ((squares[2] >> 3) - adjust2);
+            }
+        } else {
+            idx = maps.map_kk[maps.map_a1d1d4[squares[0]]][squares[1]];
+        }
+    }
+    idx *= d->group_idx[0];
+    // the remaining groups, each as a combination of the squares left over
+    int* group = squares + d->group_len[0];
+    bool remaining_pawns = entry->has_pawns && entry->pawn_count[1];
+    int next = 0;
+    while (d->group_len[++next]) {
+        tb_sort(group, group + d->group_len[next], nullptr);
+        uint64_t n = 0;
+        for (int i = 0; i < d->group_len[next]; ++i) {
+            int adjust = 0;
+            for (const int* s = squares; s < group; ++s) {
+                adjust += group[i] > *s;
+            }
+            n += maps.binomial[i + 1][group[i] - adjust - 8 * remaining_pawns];
+        }
+        remaining_pawns = false;
+        idx += n * d->group_idx[next];
+        group += d->group_len[next];
+    }
+    const uint32_t file_number = (uint32_t)(entry - tables) * 2 + (dtz ? 1 : 0);
+    bool ok = true;
+    int value = decompress(*d, file_number, idx, &ok);
+    if (!ok) {
+        *state = state_fail;
+        return 0;
+    }
+    if (!dtz) {
+        return value - 2;
+    }
+    // DTZ values are remapped per result, and stored in moves rather than plies when that's exact
+    static const int wdl_map[] = {1, 3, 0, 2, 0};
+    if (d->flags & flag_mapped) {
+        tb_reader in = {cache, file_number, 0, true};
+        const uint64_t at = d->map_idx[wdl_map[wdl + 2]] + (uint64_t)value;
+        if (d->flags & flag_wide) {
+            in.offset = entry->dtz_map + at * 2;
+            value = in.u16();
+        } else {
+            in.offset = entry->dtz_map + at;
+            value = in.u8();
+        }
+        if (!in.ok) {
+            *state = state_fail;
+            return 0;
+        }
+    }
+    if ((wdl == win && !(d->flags & flag_win_plies)) || (wdl == loss && !(d->flags & flag_loss_plies)) ||
+        wdl == cursed_win || wdl == blessed_loss) {
+        value *= 2;
+    }
+    return value + 1;
+}
+int chess_tablebase::search(const chess_tb_position& position, bool check_zeroing, int* state) {
+    // the tables don't hold en passant rights and may hold any value where
+    // the best move captures, so captures (and pawn moves, for DTZ) are searched
+    int best = loss;
+    size_t total = 0, count = 0;
+    bool failed = false, won = false;
+    tb_for_each_move(position, false, [&](int from, int to, chess_value_t promotion) {
+        ++total;
+        if (!tb_is_capture(position, from, to) &&
+            (!check_zeroing || CHESS_TYPE(position.boards.squares[from]) != CHESS_PAWN)) {
+            return true;
+        }
+        ++count;
+        chess_tb_position child;
+        tb_play(position, from, to, promotion, &child);
+        const int value = -search(child, false, state);
+        if (*state == state_fail) {
+            failed = true;
+            return false;
+        }
+        if (value > best) {
+            best = value;
+            if (value >= win) {
+                won = true;
+                return false;
+            }
+        }
+        return true;
+    });
+    if (failed) {
+        return draw;
+    }
+    if (won) {
+        *state = state_zeroing_best_move;
+        return best;
+    }
+    // with every move searched, the stored value needn't be trusted
+    const bool no_more_moves = count && count == total;
+    int value;
+    if (no_more_moves) {
+        value = best;
+    } else {
+        value = probe_table(position, false, draw, state);
+        if (*state == state_fail) {
+            return draw;
+        }
+    }
+    if (best >= value) {
+        *state = (best > draw || no_more_moves) ? state_zeroing_best_move : state_ok;
+        return best;
+    }
+    *state = state_ok;
+    return value;
+}
+int chess_tablebase::probe_dtz_internal(const chess_tb_position& position, int* state) {
+    *state = state_ok;
+    const int wdl = search(position, true, state);
+    if (*state == state_fail || wdl == draw) {
+        return 0;
+    }
+    if (*state == state_zeroing_best_move) {
+        return dtz_before_zeroing(wdl);
+    }
+    int dtz = probe_table(position, true, wdl, state);
+    if (*state == state_fail) {
+        return 0;
+    }
+    if (*state != state_change_stm) {
+        return (dtz + 100 * (wdl == blessed_loss || wdl == cursed_win)) * sign_of(wdl);
+    }
+    // the table is for the other side to move, so look one ply ahead for the
+    // move that keeps the result the quickest
+    int min_dtz = 0xFFFF;
+    bool failed = false;
+    tb_for_each_move(position, false, [&](int from, int to, chess_value_t promotion) {
+        const bool zeroing = tb_is_zeroing(position, from, to);
+        chess_tb_position child;
+        tb_play(position, from, to, promotion, &child);
+        // a zeroing move's distance is that of the move itself
+        int value = zeroing ? -dtz_before_zeroing(search(child, false, state)) : -probe_dtz_internal(child, state);
+        if (*state == state_fail) {
+            failed = true;
+            return false;
+        }
+        if (value == 1 && tb_is_mate(child)) {
+            min_dtz = 1;
+        }
+        if (!zeroing) {
+            value += sign_of(value);
+        }
+        if (value < min_dtz && sign_of(value) == sign_of(wdl)) {
+            min_dtz = value;
+        }
+        return true;
+    });
+    if (failed) {
+        *state = state_fail;
+        return 0;
+    }
+    // no legal moves: mated
+    return min_dtz == 0xFFFF ? -1 : min_dtz;
+}
+bool chess_tablebase::probeable(const chess_tb_position& position) const {
+    return tables_size > 0 && position.castling == 0 &&
+           __builtin_popcountll(position.boards.occupied) <= largest;
+}
+bool chess_tablebase::probe_wdl(const chess_tb_position& position, int* out_wdl) {
+    if (!probeable(position)) {
+        return false;
+    }
+    int state = state_ok;
+    const int result = search(position, false, &state);
+    if (state == state_fail) {
+        return false;
+    }
+    ++probe_count;
+    *out_wdl = result;
+    return true;
+}
+bool chess_tablebase::probe_dtz(const chess_tb_position& position, int* out_dtz) {
+    if (!probeable(position)) {
+        return false;
+    }
+    int state = state_ok;
+    const int result = probe_dtz_internal(position, &state);
+    if (state == state_fail) {
+        return false;
+    }
+    ++probe_count;
+    *out_dtz = result;
+    return true;
+}
+bool chess_tablebase::probe_root(const chess_tb_position& position, chess_value_t* out_from, chess_value_t* out_to, int* out_wdl) {
+    if (!probeable(position)) {
+        return false;
+    }
+    int best_rank = 0;
+    bool found = false, failed = false;
+    tb_for_each_move(position, true, [&](int from, int to, chess_value_t promotion) {
+        chess_tb_position child;
+        tb_play(position, from, to, promotion, &child);
+        int state = state_ok;
+        int dtz;
+        if (child.halfmove == 0) {
+            dtz = dtz_before_zeroing(-search(child, false, &state));
+        } else {
+            // the distance from here is one ply more
+            dtz = -probe_dtz_internal(child, &state);
+            dtz += sign_of(dtz);
+        }
+        if (state == state_fail) {
+            failed = true;
+            return false;
+        }
+        if (dtz == 2 && tb_is_mate(child)) {
+            dtz = 1;
+        }
+        // the quickest certain win, then the longest loss. results the fifty
+        // move rule turns into draws rank just above or below a draw
+        int rank = 0;
+        if (dtz > 0) {
+            rank = dtz + position.halfmove <= 100 ? 1000 - dtz : 1;
+        } else if (dtz < 0) {
+            rank = -dtz + position.halfmove <= 100 ? -1000 - dtz : -1;
+        }
+        if (!found || rank > best_rank) {
+            found = true;
+            best_rank = rank;
+            *out_from = (chess_value_t)from;
+            *out_to = (chess_value_t)to;
+        }
+        return true;
+    });
+    if (failed || !found) {
+        return false;
+    }
+    ++probe_count;
+    *out_wdl = best_rank > 1 ? win : best_rank == 1 ? cursed_win : best_rank == 0 ? draw : best_rank == -1 ? blessed_loss : loss;
+    return true;
+}
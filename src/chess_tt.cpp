@@ -0,0 +1,167 @@
+#include "chess_tt.hpp"
+
+#include <stdlib.h>
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#endif
+
+// the smallest table worth having
+static constexpr const size_t min_size = 16 * 1024;
+
+static void* tt_alloc(size_t size, bool* out_external) {
+#ifdef ESP_PLATFORM
+    void* result = heap_caps_aligned_alloc(sizeof(chess_tt::bucket), size, MALLOC_CAP_SPIRAM);
+    *out_external = result != nullptr;
+    if (result == nullptr) {
+        result = heap_caps_aligned_alloc(sizeof(chess_tt::bucket), size, MALLOC_CAP_8BIT);
+    }
+    return result;
+#else
+    *out_external = false;
+    return aligned_alloc(sizeof(chess_tt::bucket), size);
+#endif
+}
+static void tt_free(void* ptr) {
+#ifdef ESP_PLATFORM
+    heap_caps_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+// folds everything but the check bits into 16 bits, to verify them against
+static uint16_t fold(uint32_t data, uint32_t meta) {
+    return (uint16_t)(data ^ (data >> 16) ^ meta);
+}
+
+chess_tt::chess_tt() : buckets(nullptr), bucket_mask(0), external(false), current_generation(0) {
+    reset_statistics();
+}
+chess_tt::~chess_tt() {
+    deallocate();
+}
+bool chess_tt::allocate(size_t size) {
+    deallocate();
+    size_t count = 1;
+    while (count * 2 * sizeof(bucket) <= size) {
+        count *= 2;
+    }
+    // back off until something fits
+    while (count * sizeof(bucket) >= min_size) {
+        buckets = (bucket*)tt_alloc(count * sizeof(bucket), &external);
+        if (buckets != nullptr) {
+            bucket_mask = count - 1;
+            clear();
+            return true;
+        }
+        count /= 2;
+    }
+    return false;
+}
+void chess_tt::deallocate() {
+    if (buckets != nullptr) {
+        tt_free(buckets);
+        buckets = nullptr;
+        bucket_mask = 0;
+    }
+}
+void chess_tt::clear() {
+    if (buckets != nullptr) {
+        for (size_t i = 0; i <= bucket_mask; ++i) {
+            for (slot& s : buckets[i].slots) {
+                s.data.store(0, std::memory_order_relaxed);
+                s.meta.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+    current_generation = 0;
+}
+void chess_tt::new_search() {
+    current_generation = (current_generation + 1) & 63;
+}
+void chess_tt::reset_statistics() {
+    probes = 0;
+    hits = 0;
+    stores = 0;
+    overwrites = 0;
+    collisions = 0;
+}
+void chess_tt::add_statistics(const statistics& stats) {
+    probes.fetch_add(stats.probes, std::memory_order_relaxed);
+    hits.fetch_add(stats.hits, std::memory_order_relaxed);
+    stores.fetch_add(stats.stores, std::memory_order_relaxed);
+    overwrites.fetch_add(stats.overwrites, std::memory_order_relaxed);
+    collisions.fetch_add(stats.collisions, std::memory_order_relaxed);
+}
+bool chess_tt::load(const slot& s, entry* out_entry) {
+    // each word is read whole, but the pair may come from two different stores
+    const uint32_t data = s.data.load(std::memory_order_relaxed);
+    const uint32_t meta = s.meta.load(std::memory_order_relaxed);
+    out_entry->move = (uint16_t)data;
+    out_entry->score = (int16_t)(data >> 16);
+    out_entry->depth = (int8_t)(meta & 0xFF);
+    out_entry->generation_bound = (uint8_t)(meta >> 8);
+    out_entry->check = (uint16_t)(meta >> 16) ^ fold(data, meta & 0xFFFF);
+    return out_entry->bound() != bound_none;
+}
+bool chess_tt::probe(uint64_t key, entry* out_entry, statistics* stats) {
+    if (buckets == nullptr) {
+        return false;
+    }
+    ++stats->probes;
+    // the whole bucket is one cache line
+    const bucket& b = buckets[key & bucket_mask];
+    const uint16_t check = (uint16_t)(key >> 48);
+    for (size_t i = 0; i < bucket_entries; ++i) {
+        entry e;
+        if (load(b.slots[i], &e) && e.check == check) {
+            *out_entry = e;
+            ++stats->hits;
+            return true;
+        }
+    }
+    return false;
+}
+void chess_tt::store(uint64_t key, uint16_t move, int score, int depth, bound_type bound, statistics* stats) {
+    if (buckets == nullptr) {
+        return;
+    }
+    ++stats->stores;
+    bucket& b = buckets[key & bucket_mask];
+    const uint16_t check = (uint16_t)(key >> 48);
+    slot* victim = nullptr;
+    entry victim_entry;
+    int victim_worth = 0x7FFF;
+    for (size_t i = 0; i < bucket_entries; ++i) {
+        entry e;
+        const bool used = load(b.slots[i], &e);
+        if (!used || e.check == check) {
+            victim = &b.slots[i];
+            victim_entry = e;
+            break;
+        }
+        // replace stale generations first, then the shallowest search
+        const int age = (current_generation - e.generation()) & 63;
+        const int worth = e.depth - age * 8;
+        if (worth < victim_worth) {
+            victim_worth = worth;
+            victim = &b.slots[i];
+            victim_entry = e;
+        }
+    }
+    if (victim_entry.check == check && victim_entry.bound() != bound_none) {
+        // same position: keep a deeper result from this search unless this one is exact
+        if (depth < victim_entry.depth && bound != bound_exact && victim_entry.generation() == current_generation) {
+            return;
+        }
+        if (move == 0) {
+            // don't forget a known best move
+            move = victim_entry.move;
+        }
+    } else if (victim_entry.bound() != bound_none) {
+        ++stats->overwrites;
+    }
+    const uint32_t data = (uint32_t)move | ((uint32_t)(uint16_t)score << 16);
+    const uint32_t meta = (uint32_t)(uint8_t)depth | ((uint32_t)((current_generation << 2) | bound) << 8);
+    victim->data.store(data, std::memory_order_relaxed);
+    victim->meta.store(meta | ((uint32_t)(check ^ fold(data, meta)) << 16), std::memory_order_relaxed);
+}
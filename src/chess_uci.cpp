@@ -0,0 +1,338 @@
+#include "chess_uci.hpp"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chess_clock.hpp"
+#include "chess_perft.hpp"
+
+// splits off the next space separated token, or returns nullptr at the end
+static char* next_token(char** cursor) {
+    char* p = *cursor;
+    while (*p == ' ' || *p == '\t') ++p;
+    if (!*p) {
+        *cursor = p;
+        return nullptr;
+    }
+    char* result = p;
+    while (*p && *p != ' ' && *p != '\t') ++p;
+    if (*p) {
+        *p++ = '\0';
+    }
+    *cursor = p;
+    return result;
+}
+static int square_index(const char* name) {
+    for (int i = 0; i < 64; ++i) {
+        char buf[3];
+        chess_index_name(i, buf);
+        if (buf[0] == name[0] && buf[1] == name[1]) {
+            return i;
+        }
+    }
+    return -1;
+}
+// the fifth FEN field
+static uint8_t fen_halfmove(const char* fen) {
+    int field = 0;
+    for (const char* p = fen; *p; ++p) {
+        if (*p == ' ' && p[1] != ' ' && ++field == 4) {
+            return (uint8_t)atoi(p + 1);
+        }
+    }
+    return 0;
+}
+
+chess_uci::chess_uci(chess_engine& engine, chess_tt* table) : engine(engine), transpositions(table), write_callback(nullptr), write_callback_state(nullptr), line_size(0), line_overflow(false), go_pending(false), go_ponder(false), go_infinite(false), searching(false), stop_requested(false), has_result(false), session(false), quit(false), stats(), bytes_out(0) {
+    position.init();
+    history.clear();
+    white = position.turn();
+    limits = chess_search_limits();
+    engine.on_iteration_callback(on_iteration, this);
+}
+void chess_uci::write(const char* text) {
+    const size_t size = strlen(text);
+    bytes_out += (uint32_t)size;
+    if (write_callback != nullptr) {
+        write_callback(text, size, write_callback_state);
+    }
+}
+void chess_uci::writef(const char* format, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    write(buf);
+}
+size_t chess_uci::move_name(const chess_position& position, chess_value_t from, chess_value_t to, char* out_name) {
+    if (from < 0) {
+        strcpy(out_name, "0000");
+        return 4;
+    }
+    chess_index_name(from, out_name);
+    chess_index_name(to, out_name + 2);
+    const chess_value_t id = position.bitboards().squares[(int)from];
+    if (id > -1 && CHESS_TYPE(id) == CHESS_PAWN && (to < 8 || to > 55)) {
+        out_name[4] = 'q';
+        out_name[5] = '\0';
+        return 5;
+    }
+    return 4;
+}
+bool chess_uci::parse_move(const chess_position& position, const char* text, chess_value_t* out_from, chess_value_t* out_to) {
+    const size_t length = strlen(text);
+    if (length < 4 || length > 5) {
+        return false;
+    }
+    const int from = square_index(text), to = square_index(text + 2);
+    if (from < 0 || to < 0 || !((position.destinations(from) >> to) & 1)) {
+        return false;
+    }
+    // pawns only promote to queens
+    if (length == 5 && text[4] != 'q') {
+        return false;
+    }
+    *out_from = from;
+    *out_to = to;
+    return true;
+}
+void chess_uci::feed(const char* data, size_t size) {
+    stats.bytes_in += size;
+    for (size_t i = 0; i < size; ++i) {
+        const char ch = data[i];
+        if (ch == '\n' || ch == '\r') {
+            if (line_overflow) {
+                write("info string line too long\n");
+            } else if (line_size) {
+                line[line_size] = '\0';
+                command(line);
+            }
+            line_size = 0;
+            line_overflow = false;
+        } else if (line_size < max_line - 1) {
+            line[line_size++] = ch;
+        } else {
+            line_overflow = true;
+        }
+    }
+}
+void chess_uci::command(char* text) {
+    ++stats.commands;
+    char* cursor = text;
+    const char* name = next_token(&cursor);
+    if (name == nullptr) {
+        return;
+    }
+    if (0 == strcmp(name, "uci")) {
+        if (!session) {
+            // whatever the engine was doing before is dropped by update()
+            engine.cancel();
+            session = true;
+        }
+        quit = false;
+        write("id name core2_chess\nid author the core2_chess authors\nuciok\n");
+    } else if (0 == strcmp(name, "isready")) {
+        write("readyok\n");
+    } else if (0 == strcmp(name, "ucinewgame")) {
+        if (transpositions != nullptr && !engine.thinking()) {
+            transpositions->clear();
+        }
+        position.init();
+        history.clear();
+    } else if (0 == strcmp(name, "position")) {
+        handle_position(cursor);
+    } else if (0 == strcmp(name, "go")) {
+        handle_go(cursor);
+    } else if (0 == strcmp(name, "stop")) {
+        if (go_pending) {
+            // answer as quickly as possible
+            limits.depth = 1;
+            limits.time_ms = 0;
+            limits.nodes = 0;
+            go_ponder = false;
+        } else if (searching) {
+            // a ponder search's result is dropped on cancel, so turn it into a normal search first
+            engine.ponder_hit();
+            engine.cancel();
+        }
+        go_ponder = false;
+        stop_requested = true;
+    } else if (0 == strcmp(name, "ponderhit")) {
+        if (go_ponder && searching) {
+            engine.ponder_hit();
+        }
+        go_ponder = false;
+    } else if (0 == strcmp(name, "quit")) {
+        if (searching) {
+            engine.cancel();
+        }
+        searching = go_pending = false;
+        has_result = false;
+        session = false;
+        quit = true;
+    } else if (0 == strcmp(name, "debug") || 0 == strcmp(name, "setoption") || 0 == strcmp(name, "register")) {
+        // nothing to configure
+    } else {
+        writef("info string unknown command %s\n", name);
+    }
+}
+void chess_uci::handle_position(char* args) {
+    char* moves = strstr(args, "moves");
+    if (moves != nullptr) {
+        *moves = '\0';
+        moves += 5;
+    }
+    char* cursor = args;
+    const char* kind = next_token(&cursor);
+    if (kind != nullptr && 0 == strcmp(kind, "startpos")) {
+        position.init();
+    } else if (kind != nullptr && 0 == strcmp(kind, "fen")) {
+        while (*cursor == ' ') ++cursor;
+        chess_perft loader;
+        if (!loader.load(cursor)) {
+            writef("info string invalid FEN %s\n", cursor);
+            return;
+        }
+        position.setup(loader.bitboards(), loader.team_to_move(), loader.castling_rights(), loader.en_passant_square(), fen_halfmove(cursor));
+    } else {
+        write("info string expected startpos or fen\n");
+        return;
+    }
+    history.clear();
+    if (moves == nullptr) {
+        return;
+    }
+    cursor = moves;
+    const char* move;
+    while ((move = next_token(&cursor)) != nullptr) {
+        chess_value_t from, to;
+        if (!parse_move(position, move, &from, &to)) {
+            writef("info string illegal move %s\n", move);
+            return;
+        }
+        const uint64_t key = position.key();
+        position.move(from, to);
+        history.push(key, position.halfmove_clock());
+    }
+}
+void chess_uci::handle_go(char* args) {
+    if (searching || go_pending) {
+        write("info string already searching\n");
+        return;
+    }
+    uint32_t white_ms = 0, black_ms = 0, white_inc = 0, black_inc = 0, moves_to_go = 0, move_ms = 0;
+    limits = chess_search_limits();
+    go_ponder = go_infinite = false;
+    stop_requested = false;
+    char* cursor = args;
+    const char* token;
+    while ((token = next_token(&cursor)) != nullptr) {
+        if (0 == strcmp(token, "infinite")) {
+            go_infinite = true;
+            continue;
+        }
+        if (0 == strcmp(token, "ponder")) {
+            go_ponder = true;
+            continue;
+        }
+        const char* value = next_token(&cursor);
+        if (value == nullptr) {
+            break;
+        }
+        const uint32_t number = (uint32_t)strtoul(value, nullptr, 10);
+        if (0 == strcmp(token, "wtime")) {
+            white_ms = number;
+        } else if (0 == strcmp(token, "btime")) {
+            black_ms = number;
+        } else if (0 == strcmp(token, "winc")) {
+            white_inc = number;
+        } else if (0 == strcmp(token, "binc")) {
+            black_inc = number;
+        } else if (0 == strcmp(token, "movestogo")) {
+            moves_to_go = number;
+        } else if (0 == strcmp(token, "movetime")) {
+            move_ms = number;
+        } else if (0 == strcmp(token, "depth")) {
+            limits.depth = (int)number;
+        } else if (0 == strcmp(token, "nodes")) {
+            limits.nodes = number;
+        }
+    }
+    const bool white_to_move = position.turn() == white;
+    const uint32_t remaining = white_to_move ? white_ms : black_ms;
+    const uint32_t increment = white_to_move ? white_inc : black_inc;
+    if (move_ms != 0) {
+        limits.time_ms = move_ms;
+    } else if (remaining != 0) {
+        limits.time_ms = chess_clock::move_budget(remaining, increment, moves_to_go);
+    }
+    go_pending = true;
+    start_search();
+}
+void chess_uci::start_search() {
+    if (engine.thinking()) {
+        // collected by update() first
+        return;
+    }
+    const bool started = go_ponder ? engine.ponder(position, limits, history.keys, history.size)
+                                   : engine.think(position, limits, history.keys, history.size);
+    if (started) {
+        go_pending = false;
+        searching = true;
+    }
+}
+void chess_uci::update() {
+    chess_search_result collected;
+    if (engine.poll(&collected)) {
+        if (searching) {
+            searching = false;
+            result = collected;
+            has_result = true;
+            ++stats.searches;
+        }
+        // otherwise it was searched before the session or cancelled by quit
+    }
+    if (has_result && ((!go_infinite && !go_ponder) || stop_requested)) {
+        report_best();
+    }
+    if (go_pending) {
+        start_search();
+    }
+}
+void chess_uci::report_best() {
+    char best[6], reply[6];
+    move_name(position, result.from, result.to, best);
+    if (result.from > -1 && result.ponder_from > -1) {
+        chess_position after = position;
+        after.move(result.from, result.to);
+        move_name(after, result.ponder_from, result.ponder_to, reply);
+        writef("bestmove %s ponder %s\n", best, reply);
+    } else {
+        writef("bestmove %s\n", best);
+    }
+    has_result = false;
+    stop_requested = false;
+    go_infinite = false;
+}
+void chess_uci::on_iteration(const chess_search_result& result, void* state) {
+    chess_uci* uci = (chess_uci*)state;
+    if (!uci->session) {
+        return;
+    }
+    char score[24];
+    static constexpr const int mate_window = chess_search::mate_score - chess_search::max_ply;
+    if (result.score >= mate_window) {
+        snprintf(score, sizeof(score), "mate %d", (chess_search::mate_score - result.score + 1) / 2);
+    } else if (result.score <= -mate_window) {
+        snprintf(score, sizeof(score), "mate -%d", (chess_search::mate_score + result.score) / 2);
+    } else {
+        snprintf(score, sizeof(score), "cp %d", result.score);
+    }
+    char best[6];
+    move_name(uci->position, result.from, result.to, best);
+    uci->writef("info depth %d score %s nodes %u nps %u time %u pv %s\n", result.depth, score,
+                (unsigned)result.nodes, (unsigned)result.nps(), (unsigned)result.elapsed_ms, best);
+}
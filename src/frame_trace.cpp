@@ -0,0 +1,227 @@
+#include "frame_trace.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+
+#include "timing.hpp"
+
+namespace {
+struct trace_entry {
+    // the event's index + 1 once written, 0 while being written
+    std::atomic<uint32_t> sequence;
+    uint32_t timestamp;
+    uint32_t value;
+    frame_trace_event event;
+};
+
+struct histogram {
+    uint32_t counts[frame_trace::buckets];
+    uint32_t count;
+    uint64_t total;
+    uint32_t min;
+    uint32_t max;
+    void reset() {
+        memset(this, 0, sizeof(*this));
+    }
+    void add(uint32_t value) {
+        int bucket = value ? 32 - __builtin_clz(value) : 0;
+        if (bucket >= frame_trace::buckets) bucket = frame_trace::buckets - 1;
+        ++counts[bucket];
+        if (count == 0 || value < min) min = value;
+        if (value > max) max = value;
+        total += value;
+        ++count;
+    }
+    void print(const char* name) const {
+        if (count == 0) {
+            printf("%-14s -\n", name);
+            return;
+        }
+        printf("%-14s n=%u min=%u avg=%u max=%u\n", name, (unsigned)count,
+               (unsigned)min, (unsigned)(total / count), (unsigned)max);
+        printf("%14s", "");
+        for (int i = 0; i < frame_trace::buckets; ++i) {
+            if (counts[i]) {
+                // labeled by the bucket's bounds
+                if (i < frame_trace::buckets - 1) {
+                    printf(" <%u:%u", (unsigned)(1u << i), (unsigned)counts[i]);
+                } else {
+                    printf(" >=%u:%u", (unsigned)(1u << (i - 1)), (unsigned)counts[i]);
+                }
+            }
+        }
+        putchar('\n');
+    }
+};
+}  // namespace
+
+static trace_entry* ring = nullptr;
+static uint32_t ring_mask = 0;
+static std::atomic<uint32_t> ring_head(0);
+static uint32_t ring_tail = 0;
+
+// the consumer's view of the pipeline, kept across reports so
+// events that straddle two reports still pair up
+static struct {
+    uint32_t update_start;
+    uint32_t paint_start;
+    // start times of the transfers the LCD hasn't finished, oldest first
+    uint32_t pending[4];
+    int pending_size;
+    uint32_t last_done;
+    // when rendering last gave up for want of a free buffer, or 0
+    uint32_t stall_start;
+    bool in_frame;
+    uint32_t frame_flushes;
+    uint32_t update_flushes;
+    uint32_t events;
+    uint32_t dropped;
+    histogram update_us;
+    histogram paint_us;
+    histogram transfer_us;
+    histogram flushes_per_frame;
+    histogram bytes_per_flush;
+    histogram buffer_wait_us;
+    histogram lcd_idle_us;
+} analysis;
+
+static void analyze(frame_trace_event event, uint32_t timestamp, uint32_t value) {
+    ++analysis.events;
+    switch (event) {
+        case frame_trace_event::update_begin:
+            analysis.update_start = timestamp;
+            analysis.update_flushes = 0;
+            break;
+        case frame_trace_event::update_end:
+            analysis.update_us.add(timestamp - analysis.update_start);
+            if (analysis.update_flushes == 0) {
+                if (analysis.pending_size > 0) {
+                    // both buffers are with the LCD
+                    if (analysis.stall_start == 0) analysis.stall_start = timestamp;
+                } else if (analysis.in_frame) {
+                    // nothing left to draw or send
+                    analysis.flushes_per_frame.add(analysis.frame_flushes);
+                    analysis.in_frame = false;
+                }
+            }
+            break;
+        case frame_trace_event::paint_begin:
+            analysis.paint_start = timestamp;
+            break;
+        case frame_trace_event::paint_end:
+            analysis.paint_us.add(timestamp - analysis.paint_start);
+            break;
+        case frame_trace_event::flush:
+            analysis.bytes_per_flush.add(value);
+            if (!analysis.in_frame) {
+                analysis.in_frame = true;
+                analysis.frame_flushes = 0;
+            } else if (analysis.pending_size == 0 && analysis.last_done != 0) {
+                // the LCD had nothing to send while this buffer was drawn
+                analysis.lcd_idle_us.add(timestamp - analysis.last_done);
+            }
+            ++analysis.frame_flushes;
+            ++analysis.update_flushes;
+            if (analysis.pending_size < 4) {
+                analysis.pending[analysis.pending_size++] = timestamp;
+            }
+            break;
+        case frame_trace_event::transfer_done:
+            if (analysis.pending_size > 0) {
+                analysis.transfer_us.add(timestamp - analysis.pending[0]);
+                memmove(analysis.pending, analysis.pending + 1, --analysis.pending_size * sizeof(uint32_t));
+            }
+            analysis.last_done = timestamp;
+            if (analysis.stall_start != 0) {
+                analysis.buffer_wait_us.add(timestamp - analysis.stall_start);
+                analysis.stall_start = 0;
+            }
+            break;
+    }
+}
+
+bool frame_trace::begin(size_t capacity) {
+    end();
+    size_t size = 1;
+    while (size < capacity) size *= 2;
+    ring = (trace_entry*)calloc(size, sizeof(trace_entry));
+    if (ring == nullptr) {
+        return false;
+    }
+    ring_mask = (uint32_t)(size - 1);
+    ring_head = 0;
+    ring_tail = 0;
+    memset(&analysis, 0, sizeof(analysis));
+    return true;
+}
+void frame_trace::end() {
+    if (ring != nullptr) {
+        trace_entry* old = ring;
+        ring = nullptr;
+        free(old);
+    }
+}
+void frame_trace::record(frame_trace_event event, uint32_t value) {
+    trace_entry* entries = ring;
+    if (entries == nullptr) {
+        return;
+    }
+    const uint32_t index = ring_head.fetch_add(1, std::memory_order_relaxed);
+    trace_entry& entry = entries[index & ring_mask];
+    entry.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.timestamp = (uint32_t)timing_us();
+    entry.value = value;
+    entry.event = event;
+    entry.sequence.store(index + 1, std::memory_order_release);
+}
+void frame_trace::report() {
+    if (ring == nullptr) {
+        return;
+    }
+    const uint32_t head = ring_head.load(std::memory_order_acquire);
+    if (head - ring_tail > ring_mask + 1) {
+        // the producers lapped us
+        analysis.dropped += head - ring_tail - (ring_mask + 1);
+        ring_tail = head - (ring_mask + 1);
+    }
+    while (ring_tail != head) {
+        trace_entry& entry = ring[ring_tail & ring_mask];
+        const uint32_t sequence = entry.sequence.load(std::memory_order_acquire);
+        if (sequence == 0 || sequence < ring_tail + 1) {
+            // still being written. pick it up next time
+            break;
+        }
+        const frame_trace_event event = entry.event;
+        const uint32_t timestamp = entry.timestamp;
+        const uint32_t value = entry.value;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence != ring_tail + 1 || entry.sequence.load(std::memory_order_relaxed) != sequence) {
+            // overwritten while we read it
+            ++analysis.dropped;
+        } else {
+            analyze(event, timestamp, value);
+        }
+        ++ring_tail;
+    }
+    printf("frame trace: %u events, %u dropped\n", (unsigned)analysis.events, (unsigned)analysis.dropped);
+    analysis.update_us.print("update us");
+    analysis.paint_us.print("paint us");
+    analysis.transfer_us.print("transfer us");
+    analysis.flushes_per_frame.print("flushes/frame");
+    analysis.bytes_per_flush.print("bytes/flush");
+    analysis.buffer_wait_us.print("buffer wait us");
+    analysis.lcd_idle_us.print("lcd idle us");
+    analysis.events = 0;
+    analysis.dropped = 0;
+    analysis.update_us.reset();
+    analysis.paint_us.reset();
+    analysis.transfer_us.reset();
+    analysis.flushes_per_frame.reset();
+    analysis.bytes_per_flush.reset();
+    analysis.buffer_wait_us.reset();
+    analysis.lcd_idle_us.reset();
+}
@@ -0,0 +1,172 @@
+// Benchmarks chess_search on the host.
+//
+// usage: bench [-d depth] [-t ms] [-n nodes] [-h table_mb] [-j threads] [-s max_threads] [-g games]
+// searches a fixed set of positions and reports nodes/s and transposition
+// table statistics. -h 0 disables the table. -j searches with more threads.
+// With -s, also searches the positions with 1, 2, 4 ... up to max_threads threads
+// and reports how the nodes/s and the time to depth scale. With -g, also plays
+// the given number of games between the configured budget and one ply less,
+// alternating colors, as a rough strength check.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chess_search.hpp"
+#include "host.hpp"
+
+// positions are reached by playing these from the initial position
+static const char* bench_positions[] = {
+    "",
+    "e2e4 e7e5 g1f3 b8c6 f1c4 g8f6",
+    "d2d4 g8f6 c2c4 e7e6 b1c3 f8b4 e2e3 e8g8 f1d3 d7d5",
+    "e2e4 c7c5 g1f3 d7d6 d2d4 c5d4 f3d4 g8f6 b1c3 a7a6 c1e3 e7e5 d4b3 c8e6",
+    "e2e4 e7e5 g1f3 b8c6 f1b5 a7a6 b5a4 g8f6 e1g1 f8e7 f1e1 b7b5 a4b3 d7d6 c2c3 e8g8",
+};
+static constexpr const int max_game_plies = 200;
+
+static chess_search searcher;
+static chess_tt table;
+
+static void print_move(const chess_search_result& result) {
+    char from[3], to[3];
+    chess_index_name(result.from, from);
+    chess_index_name(result.to, to);
+    printf("%s%s", from, to);
+}
+
+// plays one game. returns 1 if the first engine won, -1 if it lost, 0 for a draw
+static int play_game(const chess_search_limits& first, const chess_search_limits& second, bool first_moves_first) {
+    chess_position position;
+    position.init();
+    uint64_t history[max_game_plies];
+    const chess_value_t first_team = first_moves_first ? position.turn() : !position.turn();
+    table.clear();
+    for (int ply = 0; ply < max_game_plies; ++ply) {
+        const bool first_to_move = position.turn() == first_team;
+        chess_search_result result;
+        if (!searcher.search(position, first_to_move ? first : second, &result, history, ply)) {
+            if (!position.in_check()) {
+                // stalemate
+                return 0;
+            }
+            return first_to_move ? -1 : 1;
+        }
+        history[ply] = position.key();
+        position.move(result.from, result.to);
+        // threefold repetition or the fifty move rule
+        int repeats = 0;
+        for (int i = ply - 1; i >= 0 && repeats < 2; i -= 2) {
+            repeats += history[i] == position.key();
+        }
+        if (repeats == 2 || position.halfmove_clock() >= 100) {
+            return 0;
+        }
+    }
+    // adjudicate long games as draws
+    return 0;
+}
+
+int bench_main(int argc, char** argv) {
+    chess_search_limits limits;
+    limits.depth = 4;
+    limits.time_ms = 0;
+    limits.nodes = 0;
+    int games = 0;
+    size_t table_mb = 16;
+    size_t threads = 1, scaling_threads = 0;
+    for (int i = 0; i + 1 < argc; i += 2) {
+        if (0 == strcmp(argv[i], "-d")) {
+            limits.depth = atoi(argv[i + 1]);
+        } else if (0 == strcmp(argv[i], "-t")) {
+            limits.time_ms = (uint32_t)atoi(argv[i + 1]);
+        } else if (0 == strcmp(argv[i], "-n")) {
+            limits.nodes = (uint32_t)atoi(argv[i + 1]);
+        } else if (0 == strcmp(argv[i], "-h")) {
+            table_mb = (size_t)atoi(argv[i + 1]);
+        } else if (0 == strcmp(argv[i], "-j")) {
+            threads = (size_t)atoi(argv[i + 1]);
+        } else if (0 == strcmp(argv[i], "-s")) {
+            scaling_threads = (size_t)atoi(argv[i + 1]);
+        } else if (0 == strcmp(argv[i], "-g")) {
+            games = atoi(argv[i + 1]);
+        } else {
+            fprintf(stderr, "unrecognized option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (table_mb > 0) {
+        if (!table.allocate(table_mb * 1024 * 1024)) {
+            fprintf(stderr, "Unable to allocate the transposition table\n");
+            return 1;
+        }
+        searcher.table(&table);
+    }
+    if (!searcher.threads(threads)) {
+        fprintf(stderr, "Unable to allocate the search threads\n");
+        return 1;
+    }
+    static constexpr const size_t positions_size = sizeof(bench_positions) / sizeof(bench_positions[0]);
+    static chess_position positions[positions_size];
+    for (size_t i = 0; i < positions_size; ++i) {
+        positions[i].init();
+        if (!host_play(&positions[i], bench_positions[i])) {
+            fprintf(stderr, "position %d: illegal move sequence\n", (int)i);
+            return 1;
+        }
+        if (!positions[i].consistent()) {
+            fprintf(stderr, "position %d: incremental hash or bitboards mismatch\n", (int)i);
+            return 1;
+        }
+    }
+    uint64_t total_nodes = 0, total_ms = 0;
+    int index = 0;
+    for (const chess_position& position : positions) {
+        table.clear();
+        table.reset_statistics();
+        chess_search_result result;
+        if (searcher.search(position, limits, &result)) {
+            printf("position %d: best ", index);
+            print_move(result);
+            printf(", score %d, depth %d, %u nodes in %ums (%u nps)\n",
+                   result.score, result.depth, (unsigned)result.nodes,
+                   (unsigned)result.elapsed_ms, (unsigned)result.nps());
+            const uint32_t first = result.first_move_cutoff_permille();
+            printf("  ordering: %u cutoffs, %u.%u%% on the first move, %u losing captures skipped, branching %u.%02u\n",
+                   (unsigned)result.cutoffs, (unsigned)(first / 10), (unsigned)(first % 10),
+                   (unsigned)result.see_pruned, (unsigned)(result.branching_x100 / 100),
+                   (unsigned)(result.branching_x100 % 100));
+            if (table_mb > 0) {
+                const uint32_t hit_rate = table.hit_rate_permille();
+                printf("  tt: %u probes, %u.%u%% hits, %u stores, %u overwrites, %u collisions\n",
+                       (unsigned)table.probe_count(), (unsigned)(hit_rate / 10),
+                       (unsigned)(hit_rate % 10), (unsigned)table.store_count(),
+                       (unsigned)table.overwrite_count(), (unsigned)table.collision_count());
+            }
+            total_nodes += result.nodes;
+            total_ms += result.elapsed_ms;
+        }
+        ++index;
+    }
+    printf("total: %llu nodes in %llums (%llu nps)\n",
+           (unsigned long long)total_nodes, (unsigned long long)total_ms,
+           (unsigned long long)(total_ms ? total_nodes * 1000 / total_ms : total_nodes));
+    if (scaling_threads > 0) {
+        chess_search::run_scaling(searcher, positions, positions_size, limits, scaling_threads);
+    }
+    if (games > 0) {
+        chess_search_limits weaker = limits;
+        if (weaker.depth > 1) --weaker.depth;
+        if (weaker.time_ms) weaker.time_ms /= 2;
+        if (weaker.nodes) weaker.nodes /= 2;
+        int wins = 0, draws = 0, losses = 0;
+        for (int i = 0; i < games; ++i) {
+            const int outcome = play_game(limits, weaker, (i & 1) == 0);
+            wins += outcome > 0;
+            draws += outcome == 0;
+            losses += outcome < 0;
+            printf("game %d: %s\n", i + 1, outcome > 0 ? "win" : outcome < 0 ? "loss" : "draw");
+        }
+        printf("match vs weaker budget: +%d =%d -%d\n", wins, draws, losses);
+    }
+    return 0;
+}
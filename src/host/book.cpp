@@ -0,0 +1,301 @@
+// Builds and queries opening books on the host.
+//
+// usage: book build [-o book.bin] [-p plies] [-m min_games] games.pgn...
+//        book probe [-b book.bin] [moves]
+//        book check
+// build reads the games, keeps the first plies (default 20) of each and
+// weights every move by how it scored for the side that played it: 2 for
+// a win, 1 for a draw, 0 for a loss. Moves seen in fewer than min_games
+// (default 2) games are dropped. The output is written to the book
+// partition, see the README.
+// probe plays the moves (such as "e2e4 e7e5") and lists the book moves
+// for the resulting position along with the lookup time.
+// check compares the keys of positions from the Polyglot book format's
+// documentation against the published ones, exiting with 1 on a mismatch.
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "chess_book.hpp"
+#include "host.hpp"
+#include "timing.hpp"
+
+namespace {
+struct book_record {
+    uint64_t key;
+    uint16_t move;
+    // the side that played it: 0 for the first to move, 1 for the other
+    uint8_t side;
+};
+struct book_total {
+    uint64_t key;
+    uint16_t move;
+    uint32_t score;
+    uint32_t games;
+};
+}  // namespace
+
+static bool token_is(const char* token, size_t length, const char* text) {
+    return length == strlen(text) && 0 == memcmp(token, text, length);
+}
+// parses the games in a PGN file, adding the opening moves of each to totals
+static bool book_read_pgn(const char* path, int plies, std::vector<book_total>* totals, size_t* out_games) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "unable to open %s\n", path);
+        return false;
+    }
+    std::vector<char> text;
+    char buffer[64 * 1024];
+    size_t read;
+    while (0 != (read = fread(buffer, 1, sizeof(buffer), file))) {
+        text.insert(text.end(), buffer, buffer + read);
+    }
+    fclose(file);
+    text.push_back('\0');
+    static chess_position position;
+    std::vector<book_record> game;
+    position.init();
+    bool playing = true;
+    int ply = 0;
+    const char* p = text.data();
+    while (*p) {
+        const char ch = *p;
+        if (isspace((unsigned char)ch)) {
+            ++p;
+        } else if (ch == '[') {
+            // tag pairs. the result token ends the game anyway
+            while (*p && *p != '\n') ++p;
+        } else if (ch == '{') {
+            while (*p && *p != '}') ++p;
+            if (*p) ++p;
+        } else if (ch == ';' || ch == '%') {
+            while (*p && *p != '\n') ++p;
+        } else if (ch == '(') {
+            // variations, which may nest
+            int depth = 0;
+            do {
+                if (*p == '(') ++depth;
+                if (*p == ')') --depth;
+                ++p;
+            } while (*p && depth > 0);
+        } else {
+            const char* token = p;
+            while (*p && !isspace((unsigned char)*p) && !strchr("{(;", *p)) ++p;
+            const size_t length = p - token;
+            int result = -1;
+            if (token_is(token, length, "1-0")) {
+                result = 2;
+            } else if (token_is(token, length, "0-1")) {
+                result = 0;
+            } else if (token_is(token, length, "1/2-1/2") || token_is(token, length, "*")) {
+                result = 1;
+            }
+            if (result > -1) {
+                // score every move from the point of view of the side that made it
+                for (const book_record& record : game) {
+                    const uint32_t score = record.side == 0 ? result : 2 - result;
+                    totals->push_back({record.key, record.move, score, 1});
+                }
+                game.clear();
+                position.init();
+                playing = true;
+                ply = 0;
+                ++*out_games;
+                continue;
+            }
+            // move numbers can be glued to the move, as in 1.e4 or 12...Nf6
+            const size_t number = host_move_number(token, length);
+            if (number == length || token[0] == '$') {
+                // move numbers and annotations
+                continue;
+            }
+            chess_value_t from, to;
+            if (!playing || ply >= plies) {
+                continue;
+            }
+            if (!host_san_move(position, token + number, length - number, &from, &to)) {
+                // an underpromotion or a bad move. keep what came before it
+                playing = false;
+                continue;
+            }
+            game.push_back({chess_book::key(position), chess_book::encode_move(position, from, to), (uint8_t)(ply & 1)});
+            position.move(from, to);
+            ++ply;
+        }
+    }
+    return true;
+}
+
+static int book_build(int argc, char** argv) {
+    const char* output = "book.bin";
+    int plies = 20;
+    uint32_t min_games = 2;
+    std::vector<book_total> totals;
+    size_t games = 0;
+    std::vector<const char*> inputs;
+    for (int i = 0; i < argc; ++i) {
+        if (i + 1 < argc && 0 == strcmp(argv[i], "-o")) {
+            output = argv[++i];
+        } else if (i + 1 < argc && 0 == strcmp(argv[i], "-p")) {
+            plies = atoi(argv[++i]);
+        } else if (i + 1 < argc && 0 == strcmp(argv[i], "-m")) {
+            min_games = (uint32_t)atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "unrecognized option %s\n", argv[i]);
+            return 1;
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+    if (inputs.empty()) {
+        fprintf(stderr, "no input files\n");
+        return 1;
+    }
+    const uint64_t start = timing_us();
+    for (const char* input : inputs) {
+        if (!book_read_pgn(input, plies, &totals, &games)) {
+            return 1;
+        }
+    }
+    // merge the duplicates
+    std::sort(totals.begin(), totals.end(), [](const book_total& lhs, const book_total& rhs) {
+        return lhs.key < rhs.key || (lhs.key == rhs.key && lhs.move < rhs.move);
+    });
+    std::vector<book_total> merged;
+    uint32_t max_score = 0;
+    for (const book_total& total : totals) {
+        if (!merged.empty() && merged.back().key == total.key && merged.back().move == total.move) {
+            merged.back().score += total.score;
+            ++merged.back().games;
+        } else {
+            merged.push_back(total);
+        }
+    }
+    merged.erase(std::remove_if(merged.begin(), merged.end(), [min_games](const book_total& total) {
+                     return total.games < min_games || total.score == 0;
+                 }),
+                 merged.end());
+    for (const book_total& total : merged) {
+        max_score = std::max(max_score, total.score);
+    }
+    FILE* file = fopen(output, "wb");
+    if (file == nullptr) {
+        fprintf(stderr, "unable to create %s\n", output);
+        return 1;
+    }
+    for (const book_total& total : merged) {
+        // scale the weights into 16 bits, keeping every one above zero
+        const uint32_t weight = max_score > 0xFFFF ? std::max<uint32_t>(1, (uint32_t)((uint64_t)total.score * 0xFFFF / max_score)) : total.score;
+        uint8_t entry[chess_book::entry_size] = {0};
+        for (int i = 0; i < 8; ++i) {
+            entry[i] = (uint8_t)(total.key >> (56 - i * 8));
+        }
+        entry[8] = (uint8_t)(total.move >> 8);
+        entry[9] = (uint8_t)total.move;
+        entry[10] = (uint8_t)(weight >> 8);
+        entry[11] = (uint8_t)weight;
+        fwrite(entry, sizeof(entry), 1, file);
+    }
+    fclose(file);
+    printf("%zu games, %zu entries (%zu bytes) in %" PRIu64 "ms\n", games, merged.size(),
+           merged.size() * chess_book::entry_size, (timing_us() - start) / 1000);
+    return 0;
+}
+
+static int book_probe(int argc, char** argv) {
+    const char* path = "book.bin";
+    const char* moves = "";
+    for (int i = 0; i < argc; ++i) {
+        if (i + 1 < argc && 0 == strcmp(argv[i], "-b")) {
+            path = argv[++i];
+        } else {
+            moves = argv[i];
+        }
+    }
+    chess_book book;
+    if (!book.open(path)) {
+        fprintf(stderr, "unable to open %s\n", path);
+        return 1;
+    }
+    static chess_position position;
+    position.init();
+    if (!host_play(&position, moves)) {
+        fprintf(stderr, "illegal move in \"%s\"\n", moves);
+        return 1;
+    }
+    chess_book_move found[chess_book::max_moves];
+    size_t size = 0;
+    static constexpr const int iterations = 100000;
+    const uint64_t start = timing_us();
+    for (int i = 0; i < iterations; ++i) {
+        size = book.probe(position, found, chess_book::max_moves);
+    }
+    const uint64_t elapsed = timing_us() - start;
+    printf("%zu entries, key %016" PRIx64 ", %zu moves, %.3fus per lookup\n", book.size(),
+           chess_book::key(position), size, (double)elapsed / iterations);
+    for (size_t i = 0; i < size; ++i) {
+        char from[3], to[3];
+        chess_index_name(found[i].from, from);
+        chess_index_name(found[i].to, to);
+        printf("%s%s %u\n", from, to, (unsigned)found[i].weight);
+    }
+    return 0;
+}
+
+// the moves from the start position and the keys Polyglot's documentation gives for them
+static const struct {
+    const char* moves;
+    uint64_t key;
+} book_check_keys[] = {
+    {"", 0x463b96181691fc9cull},
+    {"e2e4", 0x823c9b50fd114196ull},
+    {"e2e4 d7d5", 0x0756b94461c50fb0ull},
+    {"e2e4 d7d5 e4e5", 0x662fafb965db29d4ull},
+    // en passant on f6, which the e5 pawn can take
+    {"e2e4 d7d5 e4e5 f7f5", 0x22a48b5a8e47ff78ull},
+    {"e2e4 d7d5 e4e5 f7f5 e1e2", 0x652a607ca3f242c1ull},
+    {"e2e4 d7d5 e4e5 f7f5 e1e2 e8f7", 0x00fdd303c946bdd9ull},
+    // en passant on c3, which the b4 pawn can take
+    {"a2a4 b7b5 h2h4 b5b4 c2c4", 0x3c8123ea7b067637ull},
+    {"a2a4 b7b5 h2h4 b5b4 c2c4 b4c3 a1a3", 0x5c3f9b829b279560ull},
+};
+static int book_check() {
+    int failures = 0;
+    for (const auto& test : book_check_keys) {
+        chess_position position;
+        position.init();
+        if (!host_play(&position, test.moves)) {
+            fprintf(stderr, "illegal moves: %s\n", test.moves);
+            return 1;
+        }
+        const uint64_t key = chess_book::key(position);
+        const bool ok = key == test.key;
+        failures += !ok;
+        printf("%016" PRIx64 " %s %s\n", key, ok ? "ok      " : "MISMATCH", *test.moves ? test.moves : "(start)");
+    }
+    printf("%d of %d keys match Polyglot's\n", (int)(sizeof(book_check_keys) / sizeof(book_check_keys[0])) - failures,
+           (int)(sizeof(book_check_keys) / sizeof(book_check_keys[0])));
+    return failures ? 1 : 0;
+}
+
+int book_main(int argc, char** argv) {
+    if (argc > 0 && 0 == strcmp(argv[0], "build")) {
+        return book_build(argc - 1, argv + 1);
+    }
+    if (argc > 0 && 0 == strcmp(argv[0], "probe")) {
+        return book_probe(argc - 1, argv + 1);
+    }
+    if (argc > 0 && 0 == strcmp(argv[0], "check")) {
+        return book_check();
+    }
+    fprintf(stderr, "usage: book build [-o book.bin] [-p plies] [-m min_games] games.pgn...\n"
+                    "       book probe [-b book.bin] [moves]\n"
+                    "       book check\n");
+    return 1;
+}
@@ -0,0 +1,352 @@
+// Renders chess_board into an in-memory RGB565 framebuffer and replays
+// scripted touch input, reporting the cost of each move.
+//
+// script format, one command per line ('#' starts a comment):
+//   move e2 e4     touch the first square, drag to the second, release
+//   touch 100 50   press at the given screen coordinates
+//   release        lift the finger
+//   idle 3         run the given number of extra update passes
+//
+// usage: harness [script] [-o frame.ppm] [-i] [-t] [-m stream]
+// -i blends the piece icons on every paint instead of copying the
+// pre-rendered sprites, for comparison. -t prints the frame trace
+// histograms at the end. -m writes the screen mirror's stream to a file,
+// for the mirror tool to play back.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gfx.hpp>
+#include <uix.hpp>
+
+#define CB24_IMPLEMENTATION
+#include "assets/cb24.hpp"
+#include "chess_board.hpp"
+#include "chess_mirror.hpp"
+#include "frame_trace.hpp"
+#include "host.hpp"
+#include "timing.hpp"
+
+using namespace gfx;
+using namespace uix;
+
+// screen dimensions (matches the Core2)
+#define LCD_WIDTH 320
+#define LCD_HEIGHT 240
+// indicates how much of the screen gets updated at once
+#define LCD_DIVISOR 10
+// UIX can draw to one buffer while "sending" another
+#define LCD_TWO_BUFFERS
+
+using color_t = color<rgb_pixel<16>>;
+using screen_t = uix::screen<rgb_pixel<16>>;
+using surface_t = screen_t::control_surface_type;
+
+static constexpr const size_t lcd_transfer_buffer_size =
+    LCD_WIDTH * LCD_HEIGHT * 2 / LCD_DIVISOR;
+
+static uix::display lcd;
+static screen_t main_screen;
+static uint16_t frame_buffer[LCD_WIDTH * LCD_HEIGHT];
+static uint8_t lcd_transfer_buffer1[lcd_transfer_buffer_size];
+#ifdef LCD_TWO_BUFFERS
+static uint8_t lcd_transfer_buffer2[lcd_transfer_buffer_size];
+#endif
+
+static const char* default_script =
+    "move e2 e4\n"
+    "move e7 e5\n"
+    "move g1 f3\n"
+    "move b8 c6\n"
+    "move f1 c4\n"
+    "move g8 f6\n"
+    "move d2 d4\n"
+    "move e5 d4\n"
+    "move e1 g1\n";
+
+static uint32_t micros() {
+    return (uint32_t)timing_us();
+}
+
+// counters accumulated by the flush and paint hooks
+static struct {
+    uint32_t paint_us;
+    uint32_t paints;
+    uint32_t squares;
+    uint32_t flushes;
+    uint32_t flush_bytes;
+} counters;
+
+// the touch point the next update will report, if any
+static struct {
+    bool pressed;
+    uint16_t x;
+    uint16_t y;
+} touch_state;
+
+// the board, with its paint routine timed
+class harness_board : public chess_board<surface_t> {
+   public:
+    using chess_board<surface_t>::chess_board;
+
+   protected:
+    void on_paint(surface_t& destination, const srect16& clip) override {
+        const uint32_t start = micros();
+        frame_trace::record(frame_trace_event::paint_begin);
+        chess_board<surface_t>::on_paint(destination, clip);
+        frame_trace::record(frame_trace_event::paint_end);
+        counters.paint_us += micros() - start;
+        ++counters.paints;
+        // the squares the clip touches are the ones that were drawn
+        const int size = (dimensions().width < dimensions().height ? dimensions().width : dimensions().height) / 8;
+        const int x1 = clip.x1 < 0 ? 0 : clip.x1 / size, x2 = clip.x2 / size;
+        const int y1 = clip.y1 < 0 ? 0 : clip.y1 / size, y2 = clip.y2 / size;
+        counters.squares += (uint32_t)(((x2 > 7 ? 7 : x2) - x1 + 1) * ((y2 > 7 ? 7 : y2) - y1 + 1));
+    }
+};
+
+static harness_board board;
+// drained after each update pass, since there's no background task
+static chess_mirror mirror;
+
+static void lcd_init() {
+    lcd.buffer_size(lcd_transfer_buffer_size);
+    lcd.buffer1(lcd_transfer_buffer1);
+#ifdef LCD_TWO_BUFFERS
+    lcd.buffer2(lcd_transfer_buffer2);
+#endif
+    lcd.on_flush_callback(
+        [](const rect16& bounds, const void* bmp, void* state) {
+            const size_t row_size = bounds.width() * 2;
+            const uint8_t* src = (const uint8_t*)bmp;
+            for (int y = bounds.y1; y <= bounds.y2; ++y) {
+                memcpy(&frame_buffer[y * LCD_WIDTH + bounds.x1], src, row_size);
+                src += row_size;
+            }
+            ++counters.flushes;
+            counters.flush_bytes += row_size * bounds.height();
+            frame_trace::record(frame_trace_event::flush, (uint32_t)(row_size * bounds.height()));
+            mirror.capture(bounds.x1, bounds.y1, bounds.x2, bounds.y2, bmp);
+            // the "transfer" is synchronous
+            lcd.flush_complete();
+            frame_trace::record(frame_trace_event::transfer_done);
+        });
+    lcd.on_touch_callback(
+        [](point16* out_locations, size_t* in_out_locations_size, void* state) {
+            *in_out_locations_size = 0;
+            if (touch_state.pressed) {
+                out_locations[0] = point16(touch_state.x, touch_state.y);
+                *in_out_locations_size = 1;
+            }
+        });
+}
+
+// run update passes until the screen has settled
+static void update_pass(int passes = 2) {
+    while (passes--) {
+        frame_trace::record(frame_trace_event::update_begin);
+        lcd.update();
+        frame_trace::record(frame_trace_event::update_end);
+        mirror.drain();
+    }
+}
+
+static void square_center(int index, uint16_t* out_x, uint16_t* out_y) {
+    const srect16& b = board.bounds();
+    const int size = b.width() / 8;
+    *out_x = (uint16_t)(b.x1 + (index % 8) * size + size / 2);
+    *out_y = (uint16_t)(b.y1 + (index / 8) * size + size / 2);
+}
+
+static void touch_at(uint16_t x, uint16_t y) {
+    touch_state.pressed = true;
+    touch_state.x = x;
+    touch_state.y = y;
+    update_pass();
+}
+
+static void release() {
+    touch_state.pressed = false;
+    update_pass();
+}
+
+static uint32_t frame_checksum() {
+    // FNV-1a
+    uint32_t result = 2166136261u;
+    const uint8_t* p = (const uint8_t*)frame_buffer;
+    for (size_t i = 0; i < sizeof(frame_buffer); ++i) {
+        result = (result ^ p[i]) * 16777619u;
+    }
+    return result;
+}
+
+static bool write_ppm(const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", LCD_WIDTH, LCD_HEIGHT);
+    for (size_t i = 0; i < LCD_WIDTH * LCD_HEIGHT; ++i) {
+        // the pixels are stored big endian, as they go over the wire
+        const uint8_t* p = (const uint8_t*)&frame_buffer[i];
+        const uint16_t v = (p[0] << 8) | p[1];
+        const uint8_t rgb[3] = {(uint8_t)(((v >> 11) & 31) * 255 / 31),
+                                (uint8_t)(((v >> 5) & 63) * 255 / 63),
+                                (uint8_t)((v & 31) * 255 / 31)};
+        fwrite(rgb, 1, 3, file);
+    }
+    fclose(file);
+    return true;
+}
+
+static char* read_file(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        return nullptr;
+    }
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* result = (char*)malloc(size + 1);
+    if (result != nullptr) {
+        result[fread(result, 1, size, file)] = '\0';
+    }
+    fclose(file);
+    return result;
+}
+
+int harness_main(int argc, char** argv) {
+    const char* script_path = nullptr;
+    const char* ppm_path = nullptr;
+    const char* mirror_path = nullptr;
+    bool blend = false, trace = false;
+    for (int i = 0; i < argc; ++i) {
+        if (0 == strcmp(argv[i], "-o") && i + 1 < argc) {
+            ppm_path = argv[++i];
+        } else if (0 == strcmp(argv[i], "-i")) {
+            blend = true;
+        } else if (0 == strcmp(argv[i], "-t")) {
+            trace = true;
+        } else if (0 == strcmp(argv[i], "-m") && i + 1 < argc) {
+            mirror_path = argv[++i];
+        } else {
+            script_path = argv[i];
+        }
+    }
+    char* script = script_path ? read_file(script_path) : strdup(default_script);
+    if (script == nullptr) {
+        fprintf(stderr, "Unable to read %s\n", script_path);
+        return 1;
+    }
+    if (trace && !frame_trace::begin(64 * 1024)) {
+        fprintf(stderr, "Unable to start the frame trace\n");
+        return 1;
+    }
+    FILE* mirror_file = nullptr;
+    if (mirror_path != nullptr) {
+        mirror_file = fopen(mirror_path, "wb");
+        if (mirror_file == nullptr || !mirror.allocate(LCD_WIDTH, LCD_HEIGHT)) {
+            fprintf(stderr, "Unable to start the mirror in %s\n", mirror_path);
+            return 1;
+        }
+        mirror.on_write_callback([](const uint8_t* data, size_t size, void* state) {
+            fwrite(data, 1, size, (FILE*)state);
+        }, mirror_file);
+    }
+    lcd_init();
+    main_screen.dimensions({LCD_WIDTH, LCD_HEIGHT});
+    main_screen.background_color(color_t::black);
+    board.bounds(srect16(0, 0, 239, 239).center(main_screen.bounds()));
+    main_screen.register_control(board);
+    board.sprites_enabled(!blend);
+    lcd.active_screen(main_screen);
+
+    uint32_t start = micros();
+    update_pass();
+    printf("initial: paint %uus (%uns/square), update %uus, flushes %u, bytes %u\n",
+           (unsigned)counters.paint_us,
+           (unsigned)(counters.squares ? counters.paint_us * 1000ull / counters.squares : 0),
+           (unsigned)(micros() - start), (unsigned)counters.flushes,
+           (unsigned)counters.flush_bytes);
+
+    uint32_t total_paint_us = 0, total_update_us = 0, total_flushes = 0,
+             total_bytes = 0, total_squares = 0;
+    int move_number = 0, line_number = 0;
+    char* save = nullptr;
+    for (char* line = strtok_r(script, "\n", &save); line != nullptr;
+         line = strtok_r(nullptr, "\n", &save)) {
+        ++line_number;
+        char* comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+        char cmd[16], arg1[16], arg2[16];
+        const int fields = sscanf(line, "%15s %15s %15s", cmd, arg1, arg2);
+        if (fields < 1) {
+            continue;
+        }
+        memset(&counters, 0, sizeof(counters));
+        start = micros();
+        if (0 == strcmp(cmd, "move") && fields == 3) {
+            const int from = host_square_index(arg1), to = host_square_index(arg2);
+            if (from < 0 || to < 0) {
+                fprintf(stderr, "line %d: bad square\n", line_number);
+                continue;
+            }
+            uint16_t x, y;
+            square_center(from, &x, &y);
+            touch_at(x, y);
+            square_center(to, &x, &y);
+            touch_at(x, y);
+            release();
+            ++move_number;
+            mirror.move((uint32_t)move_number);
+            mirror.drain();
+            const uint32_t update_us = micros() - start;
+            printf("move %d %s%s: paint %uus, update %uus, flushes %u, bytes %u\n",
+                   move_number, arg1, arg2, (unsigned)counters.paint_us,
+                   (unsigned)update_us, (unsigned)counters.flushes,
+                   (unsigned)counters.flush_bytes);
+            total_paint_us += counters.paint_us;
+            total_squares += counters.squares;
+            total_update_us += update_us;
+            total_flushes += counters.flushes;
+            total_bytes += counters.flush_bytes;
+        } else if (0 == strcmp(cmd, "touch") && fields == 3) {
+            touch_at((uint16_t)atoi(arg1), (uint16_t)atoi(arg2));
+        } else if (0 == strcmp(cmd, "release")) {
+            release();
+        } else if (0 == strcmp(cmd, "idle")) {
+            update_pass(fields > 1 ? atoi(arg1) : 1);
+        } else {
+            fprintf(stderr, "line %d: unrecognized command\n", line_number);
+        }
+    }
+    free(script);
+    if (move_number) {
+        printf("paint per square: %uns (%s)\n",
+               (unsigned)(total_squares ? total_paint_us * 1000ull / total_squares : 0),
+               blend ? "blended icons" : "sprites");
+        printf("total: %d moves, paint %uus (%uus/move), update %uus, flushes %u (%u/move), bytes %u (%u/move)\n",
+               move_number, (unsigned)total_paint_us,
+               (unsigned)(total_paint_us / move_number),
+               (unsigned)total_update_us, (unsigned)total_flushes,
+               (unsigned)(total_flushes / move_number), (unsigned)total_bytes,
+               (unsigned)(total_bytes / move_number));
+    }
+    printf("frame checksum: %08x\n", (unsigned)frame_checksum());
+    if (mirror_file != nullptr) {
+        const chess_mirror::statistics traffic = mirror.traffic();
+        printf("mirror: %u frames, %u bytes for %u flushed (%u merged rectangles)\n", (unsigned)traffic.frames,
+               (unsigned)traffic.bytes, (unsigned)traffic.flush_bytes, (unsigned)traffic.merges);
+        fclose(mirror_file);
+    }
+    if (trace) {
+        frame_trace::report();
+        frame_trace::end();
+    }
+    if (ppm_path != nullptr && !write_ppm(ppm_path)) {
+        fprintf(stderr, "Unable to write %s\n", ppm_path);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef HOST_HPP
+#define HOST_HPP
+#include "chess.h"
+#include "chess_position.hpp"
+// entry points for the Linux host tools
+// each takes the arguments following the tool name
+
+/// @brief Replays scripted touch input against the chess_board control
+int harness_main(int argc, char** argv);
+/// @brief Benchmarks the search on fixed positions and in self play
+int bench_main(int argc, char** argv);
+/// @brief Validates and times the move generators on reference positions
+int perft_main(int argc, char** argv);
+/// @brief Records random games in a journal and times resuming them
+int journal_main(int argc, char** argv);
+/// @brief Builds opening books from PGN files and looks up positions in them
+int book_main(int argc, char** argv);
+/// @brief Probes Syzygy endgame tablebases
+int tb_main(int argc, char** argv);
+/// @brief Runs the UCI endpoint over stdin and stdout
+int uci_main(int argc, char** argv);
+/// @brief Replays PGN files through the rules on a thread pool
+int pgn_main(int argc, char** argv);
+/// @brief Reconstructs the screen from a mirror stream
+int mirror_main(int argc, char** argv);
+/// @brief Plays games between two link endpoints over a pseudo terminal
+int link_main(int argc, char** argv);
+
+// helpers shared by the tools
+
+/// @brief Finds a square by name
+/// @param name The name, such as "e4"
+/// @return The square index, or -1 if the name is invalid
+int host_square_index(const char* name);
+/// @brief Plays a sequence of moves such as "e2e4 e7e5"
+/// @param position The position to play the moves on
+/// @param moves The moves, separated by whitespace
+/// @return True if every move was legal, otherwise false
+bool host_play(chess_position* position, const char* moves);
+/// @brief Finds the move a SAN string such as "Nbd7" or "O-O" names
+/// @param position The position the move is made from
+/// @param san The move, which needn't be null terminated
+/// @param length The length of san
+/// @param out_from Receives the origin square
+/// @param out_to Receives the destination square
+/// @return True if the string names exactly one legal move, otherwise false
+bool host_san_move(const chess_position& position, const char* san, size_t length, chess_value_t* out_from, chess_value_t* out_to);
+/// @brief Measures the move number at the start of a PGN token, which may be glued to the move as in "1.e4" or "12...Nf6"
+/// @param token The token, which needn't be null terminated
+/// @param length The length of token
+/// @return The length of the move number and its dots, which is all of it for a token such as "12." or "...", otherwise 0 if it doesn't start with one
+size_t host_move_number(const char* token, size_t length);
+
+#endif // HOST_HPP
@@ -0,0 +1,116 @@
+// Exercises chess_journal on the host.
+//
+// usage: journal [-p plies] [-s snapshot_plies] [-g games] [-d directory]
+// plays random games of the given length (default 200), recording them in
+// a journal in the directory (default /tmp), then resumes each one and checks
+// the position matches. Reports the resume time and the size of the files,
+// which should stay flat however long the game gets.
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "chess_journal.hpp"
+#include "host.hpp"
+#include "timing.hpp"
+
+static long file_size(const char* directory, const char* name) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    struct stat st;
+    return 0 == stat(path, &st) ? (long)st.st_size : 0;
+}
+
+// plays a random legal move. false if there is none
+static bool play_random(chess_position* position, chess_history* history, chess_value_t* out_from, chess_value_t* out_to) {
+    uint64_t destinations[64];
+    uint64_t origins = position->legal_moves(destinations);
+    int count = 0;
+    for (uint64_t o = origins; o;) {
+        count += __builtin_popcountll(destinations[chess_pop_square(&o)]);
+    }
+    if (count == 0) {
+        return false;
+    }
+    int pick = rand() % count;
+    while (origins) {
+        const int from = chess_pop_square(&origins);
+        uint64_t dests = destinations[from];
+        while (dests) {
+            const int to = chess_pop_square(&dests);
+            if (pick-- == 0) {
+                const uint64_t key = position->key();
+                position->move(from, to);
+                history->push(key, position->halfmove_clock());
+                *out_from = from;
+                *out_to = to;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+int journal_main(int argc, char** argv) {
+    int plies = 200;
+    int snapshot_plies = 16;
+    int games = 4;
+    const char* directory = "/tmp";
+    for (int i = 0; i + 1 < argc; i += 2) {
+        if (0 == strcmp(argv[i], "-p")) {
+            plies = atoi(argv[i + 1]);
+        } else if (0 == strcmp(argv[i], "-s")) {
+            snapshot_plies = atoi(argv[i + 1]);
+        } else if (0 == strcmp(argv[i], "-g")) {
+            games = atoi(argv[i + 1]);
+        } else if (0 == strcmp(argv[i], "-d")) {
+            directory = argv[i + 1];
+        } else {
+            fprintf(stderr, "unrecognized option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    srand(1);
+    static chess_position position, resumed;
+    static chess_history history, resumed_history;
+    int failures = 0;
+    for (int game = 0; game < games; ++game) {
+        chess_journal journal;
+        journal.open(directory, snapshot_plies);
+        journal.new_game();
+        position.init();
+        history.clear();
+        int played = 0;
+        while (played < plies) {
+            chess_value_t from, to;
+            if (!play_random(&position, &history, &from, &to)) {
+                break;
+            }
+            ++played;
+            journal.append(from, to, position, history);
+            // the device's writer task wakes up about this often
+            if (played % 4 == 0) {
+                journal.flush();
+            }
+        }
+        journal.flush();
+        // as if after a reset
+        chess_journal reopened;
+        reopened.open(directory, snapshot_plies);
+        chess_journal::resume_result result;
+        const uint64_t start = timing_us();
+        const bool ok = reopened.resume(&resumed, &resumed_history, &result);
+        const uint64_t elapsed = timing_us() - start;
+        const bool match = ok && result.plies == (uint32_t)played && resumed.key() == position.key() &&
+                           resumed_history.size == history.size &&
+                           0 == memcmp(resumed_history.keys, history.keys, history.size * sizeof(uint64_t));
+        if (!match) {
+            ++failures;
+        }
+        printf("game %d: %d plies, resumed %s, replayed %u in %" PRIu64 "us, journal %ld bytes, snapshot %ld bytes\n",
+               game + 1, played, match ? "ok" : "FAILED", ok ? (unsigned)result.replayed : 0u, elapsed,
+               file_size(directory, "game.jnl"), file_size(directory, "game.snp"));
+    }
+    return failures ? 1 : 0;
+}
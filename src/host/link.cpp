@@ -0,0 +1,368 @@
+// Plays games between two chess_link endpoints over a pseudo terminal, as two
+// boards play over their UARTs, to exercise the protocol without hardware.
+//
+// usage: link [-g plies] [-e errors] [-x ply] [-b baud] [-s seed] [-P | -t device]
+// each side plays random legal moves for its team until the game reaches the
+// given length (default 200) or ends. The writes are paced to the baud
+// (default 115200), and -e corrupts that many frames in a thousand, to show
+// the retransmits and resynchronization at work. -x makes the side to move
+// at that ply play it without telling the other, so the games differ, and
+// warns if the game never got there.
+// At the end it checks both sides finished with the same game and prints the
+// traffic and the latency from a move to it showing on the other side.
+// The host paints nothing, so the latency is all wire.
+// -P plays one side on a pseudo terminal and prints its path for another
+// instance to open with -t; -t plays one side on a serial port, against a
+// board or another instance. Either waits for the other side to turn up.
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "chess_link.hpp"
+#include "host.hpp"
+#include "timing.hpp"
+
+namespace {
+struct link_side {
+    const char* name = nullptr;
+    int fd = -1;
+    uint32_t id = 0;
+    int baud = 115200;
+    int errors = 0;
+    int plies = 200;
+    // the ply to play without telling the peer, shared by the sides so
+    // whichever is to move then plays it. -1 once played, or for none
+    std::atomic<int>* desync_ply = nullptr;
+    std::mt19937 random;
+    // the board, kept apart from the link's copy as on the device
+    chess_position position;
+    chess_history history;
+    uint16_t ply = 0;
+    bool paint_pending = false;
+    std::atomic<bool> finished{false};
+    uint32_t corrupted = 0;
+    std::vector<chess_link::event> latencies;
+    chess_link link;
+};
+}  // namespace
+
+static speed_t baud_constant(int baud) {
+    switch (baud) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return B115200;
+    }
+}
+static void make_raw(int fd, int baud) {
+    struct termios options;
+    if (0 == tcgetattr(fd, &options)) {
+        cfmakeraw(&options);
+        cfsetispeed(&options, baud_constant(baud));
+        cfsetospeed(&options, baud_constant(baud));
+        options.c_cc[VMIN] = 0;
+        options.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &options);
+    }
+}
+static void write_side(const uint8_t* data, size_t size, void* state) {
+    link_side& side = *(link_side*)state;
+    uint8_t frame[chess_link::max_payload + chess_link::frame_overhead];
+    memcpy(frame, data, size);
+    if (side.errors > 0 && (int)(side.random() % 1000) < side.errors) {
+        frame[side.random() % size] ^= (uint8_t)(1 + side.random() % 255);
+        ++side.corrupted;
+    }
+    // ten bits a byte, so the timing is close to a real port's
+    usleep((useconds_t)((uint64_t)size * 10 * 1000000 / side.baud));
+    size_t written = 0;
+    while (written < size) {
+        const ssize_t result = write(side.fd, frame + written, size - written);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return;
+        }
+        written += (size_t)result;
+    }
+}
+// makes a move on the side's board
+static bool play(link_side* side, chess_value_t from, chess_value_t to) {
+    const uint64_t key = side->position.key();
+    if (-2 == side->position.move(from, to)) {
+        return false;
+    }
+    side->history.push(key, side->position.halfmove_clock());
+    ++side->ply;
+    return true;
+}
+// picks a random legal move. false if there is none
+static bool pick_random(link_side* side, chess_value_t* out_from, chess_value_t* out_to) {
+    uint64_t destinations[64];
+    uint64_t origins = side->position.legal_moves(destinations);
+    int count = 0;
+    for (uint64_t o = origins; o;) {
+        count += __builtin_popcountll(destinations[chess_pop_square(&o)]);
+    }
+    if (count == 0) {
+        return false;
+    }
+    int pick = (int)(side->random() % count);
+    while (origins) {
+        const int from = chess_pop_square(&origins);
+        uint64_t dests = destinations[from];
+        while (dests) {
+            const int to = chess_pop_square(&dests);
+            if (pick-- == 0) {
+                *out_from = from;
+                *out_to = to;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+static void run_side(link_side* side, const std::atomic<bool>* stop) {
+    side->position.init();
+    const chess_value_t first_team = side->position.turn() & 1;
+    side->history.clear();
+    side->link.on_write_callback(write_side, side);
+    side->link.begin(side->id, side->position, side->history, 0);
+    while (!stop->load()) {
+        const uint64_t now = timing_us();
+        if (side->paint_pending) {
+            // the board showed the move on the pass after it was made
+            side->paint_pending = false;
+            side->link.painted(now);
+        }
+        pollfd fd = {side->fd, POLLIN, 0};
+        if (poll(&fd, 1, 5) > 0) {
+            uint8_t buf[512];
+            const ssize_t got = read(side->fd, buf, sizeof(buf));
+            if (got > 0) {
+                side->link.feed(buf, (size_t)got, timing_us());
+            }
+        }
+        side->link.update(timing_us());
+        chess_link::event event;
+        while (side->link.poll(&event)) {
+            switch (event.type) {
+                case chess_link::event_connected:
+                    fprintf(stderr, "%s: connected, moving %s\n", side->name,
+                            side->link.local_team() == first_team ? "first" : "second");
+                    break;
+                case chess_link::event_disconnected:
+                    fprintf(stderr, "%s: disconnected at ply %u\n", side->name, (unsigned)event.ply);
+                    break;
+                case chess_link::event_move:
+                    if (!play(side, event.from, event.to)) {
+                        side->link.reset(side->position, side->history, side->ply, true);
+                    } else {
+                        side->paint_pending = true;
+                    }
+                    break;
+                case chess_link::event_synced:
+                    side->position = side->link.current_position();
+                    side->history = side->link.game_history();
+                    side->ply = side->link.ply();
+                    fprintf(stderr, "%s: took the peer's game at ply %u\n", side->name, (unsigned)event.ply);
+                    break;
+                case chess_link::event_latency:
+                    side->latencies.push_back(event);
+                    break;
+            }
+        }
+        if (!side->link.connected() || !side->link.idle()) {
+            continue;
+        }
+        chess_value_t from, to;
+        if (side->ply >= side->plies || !pick_random(side, &from, &to)) {
+            // done, but still answering until the other side is
+            side->finished.store(side->link.current_position().key() == side->position.key());
+            continue;
+        }
+        side->finished.store(false);
+        if ((side->position.turn() & 1) != side->link.local_team()) {
+            continue;
+        }
+        int desync = side->ply;
+        if (side->desync_ply != nullptr && side->desync_ply->compare_exchange_strong(desync, -1)) {
+            // played here and nowhere else, as if the frame never went out
+            play(side, from, to);
+            side->link.reset(side->position, side->history, side->ply, false);
+            fprintf(stderr, "%s: played ply %d without telling the peer\n", side->name, desync);
+            continue;
+        }
+        play(side, from, to);
+        side->link.move(from, to, timing_us());
+    }
+}
+static void print_side(const link_side& side) {
+    const chess_link::statistics stats = side.link.traffic();
+    printf("%s: ply %u, %u frames and %u bytes out, %u frames and %u bytes in\n", side.name, (unsigned)side.ply,
+           (unsigned)stats.frames_out, (unsigned)stats.bytes_out, (unsigned)stats.frames_in, (unsigned)stats.bytes_in);
+    printf("%s: %u corrupted, %u CRC errors, %u retransmits, %u resyncs\n", side.name, (unsigned)side.corrupted,
+           (unsigned)stats.crc_errors, (unsigned)stats.retransmits, (unsigned)stats.resyncs);
+    if (side.latencies.empty()) {
+        return;
+    }
+    uint64_t total = 0, wire = 0, paint = 0;
+    uint32_t worst = 0;
+    for (const chess_link::event& event : side.latencies) {
+        total += event.total_us;
+        wire += event.wire_us;
+        paint += event.paint_us;
+        worst = event.total_us > worst ? event.total_us : worst;
+    }
+    const size_t count = side.latencies.size();
+    printf("%s: %u moves shown after %.2fms on average (%.2fms on the wire, %.2fms painting), %.2fms at worst\n",
+           side.name, (unsigned)count, total / 1000.0 / count, wire / 1000.0 / count, paint / 1000.0 / count,
+           worst / 1000.0);
+}
+
+// the ply -x asked for, if the game ended first or it was the peer's to play
+static void warn_desync(int ply) {
+    if (ply >= 0) {
+        fprintf(stderr, "ply %d never came up to be played here, so the games never differed\n", ply);
+    }
+}
+
+int link_main(int argc, char** argv) {
+    int plies = 200, errors = 0, desync_ply = -1, baud = 115200;
+    unsigned seed = 1;
+    bool serve = false;
+    const char* device = nullptr;
+    for (int i = 0; i < argc; ++i) {
+        if (0 == strcmp(argv[i], "-P")) {
+            serve = true;
+        } else if (i + 1 >= argc) {
+            fprintf(stderr, "unrecognized option %s\n", argv[i]);
+            return 1;
+        } else if (0 == strcmp(argv[i], "-g")) {
+            plies = atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-e")) {
+            errors = atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-x")) {
+            desync_ply = atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-b")) {
+            baud = atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-s")) {
+            seed = (unsigned)atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-t")) {
+            device = argv[++i];
+        } else {
+            fprintf(stderr, "unrecognized option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (baud <= 0) {
+        baud = 115200;
+    }
+    // too big for the stack
+    static link_side sides[2];
+    for (int i = 0; i < 2; ++i) {
+        sides[i].name = i ? "second" : "first";
+        sides[i].baud = baud;
+        sides[i].errors = errors;
+        sides[i].plies = plies;
+        sides[i].random.seed(seed * 2 + i);
+    }
+    std::atomic<int> desync(desync_ply);
+    sides[0].desync_ply = &desync;
+    sides[1].desync_ply = &desync;
+    std::atomic<bool> stop(false);
+    if (device != nullptr || serve) {
+        // one side here, the other elsewhere
+        link_side& side = sides[0];
+        side.name = device != nullptr ? device : "pty";
+        side.id = (uint32_t)getpid() * 2654435761u ^ seed;
+        if (device != nullptr) {
+            side.fd = open(device, O_RDWR | O_NOCTTY);
+        } else {
+            side.fd = posix_openpt(O_RDWR | O_NOCTTY);
+            if (side.fd >= 0 && (0 != grantpt(side.fd) || 0 != unlockpt(side.fd))) {
+                close(side.fd);
+                side.fd = -1;
+            }
+        }
+        if (side.fd < 0) {
+            fprintf(stderr, "unable to open %s\n", device != nullptr ? device : "a pseudo terminal");
+            return 1;
+        }
+        make_raw(side.fd, baud);
+        if (serve) {
+            printf("%s\n", ptsname(side.fd));
+            fflush(stdout);
+        }
+        std::thread thread(run_side, &side, &stop);
+        // however long the other side takes to turn up
+        while (!side.finished.load()) {
+            usleep(50 * 1000);
+        }
+        // answering a little longer, in case the last ack went astray
+        usleep((useconds_t)chess_link::retransmit_us * 3);
+        stop.store(true);
+        thread.join();
+        close(side.fd);
+        print_side(side);
+        warn_desync(desync.load());
+        return 0;
+    }
+    const int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || 0 != grantpt(master) || 0 != unlockpt(master)) {
+        fprintf(stderr, "unable to open a pseudo terminal\n");
+        return 1;
+    }
+    const int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (slave < 0) {
+        fprintf(stderr, "unable to open %s\n", ptsname(master));
+        close(master);
+        return 1;
+    }
+    make_raw(master, baud);
+    make_raw(slave, baud);
+    sides[0].fd = master;
+    sides[1].fd = slave;
+    sides[0].id = 1;
+    sides[1].id = 2;
+    const uint64_t start = timing_us();
+    std::thread first(run_side, &sides[0], &stop);
+    std::thread second(run_side, &sides[1], &stop);
+    // both done with the same game, or a minute gone
+    bool agreed = false;
+    while (!agreed && timing_us() - start < 60 * 1000 * 1000) {
+        usleep(50 * 1000);
+        agreed = sides[0].finished.load() && sides[1].finished.load();
+    }
+    // the last ack may still be on its way, so give it a moment
+    usleep((useconds_t)chess_link::retransmit_us);
+    stop.store(true);
+    first.join();
+    second.join();
+    close(slave);
+    close(master);
+    const double seconds = (timing_us() - start) / 1000000.0;
+    print_side(sides[0]);
+    print_side(sides[1]);
+    warn_desync(desync.load());
+    const bool same = sides[0].position.key() == sides[1].position.key() && sides[0].ply == sides[1].ply &&
+                      0 == memcmp(sides[0].position.bitboards().squares, sides[1].position.bitboards().squares, 64);
+    printf("%s at ply %u in %.1fs\n", same ? "both boards agree" : "the boards differ", (unsigned)sides[0].ply,
+           seconds);
+    return agreed && same ? 0 : 1;
+}
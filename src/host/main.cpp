@@ -0,0 +1,163 @@
+// Linux host build entry point
+// usage: core2_chess <tool> [args...]
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "host.hpp"
+
+static const struct {
+    const char* name;
+    int (*entry)(int argc, char** argv);
+    const char* description;
+} host_tools[] = {
+    {"harness", harness_main, "replay touch scripts and report render cost"},
+    {"bench", bench_main, "benchmark search speed and strength"},
+    {"perft", perft_main, "validate and time the move generators"},
+    {"journal", journal_main, "record random games and time resuming them"},
+    {"book", book_main, "build opening books from PGN and probe them"},
+    {"tb", tb_main, "probe Syzygy endgame tablebases"},
+    {"uci", uci_main, "run the UCI endpoint over stdin and stdout"},
+    {"pgn", pgn_main, "replay PGN files through the rules"},
+    {"mirror", mirror_main, "reconstruct the screen from a mirror stream"},
+    {"link", link_main, "play two link endpoints against each other over a pty"},
+};
+
+int host_square_index(const char* name) {
+    for (int i = 0; i < 64; ++i) {
+        char buf[3];
+        chess_index_name(i, buf);
+        if (buf[0] == name[0] && buf[1] == name[1]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool host_play(chess_position* position, const char* moves) {
+    while (*moves) {
+        while (isspace((unsigned char)*moves)) ++moves;
+        if (!*moves) break;
+        const int from = host_square_index(moves);
+        const int to = from < 0 ? -1 : host_square_index(moves + 2);
+        if (to < 0 || -2 == position->move(from, to)) {
+            return false;
+        }
+        moves += 4;
+        while (*moves && !isspace((unsigned char)*moves)) ++moves;
+    }
+    return true;
+}
+
+size_t host_move_number(const char* token, size_t length) {
+    size_t digits = 0;
+    while (digits < length && isdigit((unsigned char)token[digits])) ++digits;
+    size_t dots = digits;
+    while (dots < length && token[dots] == '.') ++dots;
+    // digits without dots are a move, such as 0-0
+    return dots == length || dots > digits ? dots : 0;
+}
+
+bool host_san_move(const chess_position& position, const char* san, size_t length, chess_value_t* out_from, chess_value_t* out_to) {
+    // drop check marks and annotations
+    while (length && strchr("+#!?", san[length - 1])) --length;
+    if (length < 2) {
+        return false;
+    }
+    int type = CHESS_PAWN;
+    int castle_file = -1;
+    if (san[0] == 'O' || san[0] == '0') {
+        type = CHESS_KING;
+        castle_file = length >= 5 ? 'c' : 'g';
+    } else if (san[0] && strchr("NBRQK", san[0])) {
+        static const int piece_types[] = {CHESS_KNIGHT, CHESS_BISHOP, CHESS_ROOK, CHESS_QUEEN, CHESS_KING};
+        type = piece_types[strchr("NBRQK", san[0]) - "NBRQK"];
+        ++san;
+        --length;
+    }
+    // promotion
+    const char* equals = (const char*)memchr(san, '=', length);
+    if (equals != nullptr) {
+        if (equals + 1 < san + length && equals[1] != 'Q') {
+            // chess.h always promotes to a queen
+            return false;
+        }
+        length = equals - san;
+    } else if (type == CHESS_PAWN && length && strchr("NBR", san[length - 1])) {
+        return false;
+    } else if (type == CHESS_PAWN && length && san[length - 1] == 'Q') {
+        --length;
+    }
+    // what's left is [file][rank][x]square
+    char from_file = 0, from_rank = 0;
+    int to = -1;
+    if (castle_file < 0) {
+        if (length < 2) {
+            return false;
+        }
+        to = host_square_index(san + length - 2);
+        for (size_t i = 0; i + 2 < length; ++i) {
+            if (san[i] >= 'a' && san[i] <= 'h') {
+                from_file = san[i];
+            } else if (san[i] >= '1' && san[i] <= '8') {
+                from_rank = san[i];
+            }
+        }
+        if (to < 0) {
+            return false;
+        }
+    }
+    uint64_t destinations[64];
+    uint64_t origins = position.legal_moves(destinations);
+    int found = 0;
+    while (origins) {
+        const int from = chess_pop_square(&origins);
+        const chess_value_t id = position.bitboards().squares[from];
+        if (CHESS_TYPE(id) != type) {
+            continue;
+        }
+        char name[3];
+        chess_index_name(from, name);
+        if ((from_file && name[0] != from_file) || (from_rank && name[1] != from_rank)) {
+            continue;
+        }
+        uint64_t dests = destinations[from];
+        while (dests) {
+            const int dest = chess_pop_square(&dests);
+            if (castle_file >= 0) {
+                char dest_name[3];
+                chess_index_name(dest, dest_name);
+                if ((dest - from != 2 && from - dest != 2) || dest_name[0] != castle_file) {
+                    continue;
+                }
+            } else if (dest != to) {
+                continue;
+            }
+            *out_from = from;
+            *out_to = dest;
+            ++found;
+        }
+    }
+    return found == 1;
+}
+
+static void usage(const char* exe) {
+    printf("usage: %s <tool> [args...]\n", exe);
+    for (const auto& tool : host_tools) {
+        printf("  %-10s %s\n", tool.name, tool.description);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        // no tool given: run the render harness with its default script
+        return harness_main(0, nullptr);
+    }
+    for (const auto& tool : host_tools) {
+        if (0 == strcmp(argv[1], tool.name)) {
+            return tool.entry(argc - 2, argv + 2);
+        }
+    }
+    usage(argv[0]);
+    return 1;
+}
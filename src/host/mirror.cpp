@@ -0,0 +1,286 @@
+// Reconstructs the screen from the stream chess_mirror sends, and reports
+// what it cost per move.
+//
+// usage: mirror [-o screen.ppm] [-b baud] [-l] [-q] input
+// the input is a file, - for stdin, or a serial port, which is set to raw
+// mode at the given baud (default 115200). The frames are picked out of
+// whatever else arrives, so the mirror can share the serial monitor's port;
+// -l passes the rest through to stdout. After each move it prints
+//   ply <n>: <bytes> bytes in <frames> frames, <flushed> flushed (<ratio>:1)
+// and rewrites the PPM if given, so it can be watched live. At the end of the
+// input it prints the totals and the checksum of the screen, which matches
+// the harness's for the same frames.
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "chess_mirror.hpp"
+#include "host.hpp"
+
+namespace {
+struct mirror_view {
+    uint16_t width = 0;
+    uint16_t height = 0;
+    std::vector<uint16_t> pixels;
+    // since the last move
+    uint32_t move_bytes = 0;
+    uint32_t move_frames = 0;
+    // the totals
+    uint64_t bytes = 0;
+    uint64_t frames = 0;
+    // up to the last move
+    uint64_t flush_bytes = 0;
+    uint64_t move_total_bytes = 0;
+    uint32_t moves = 0;
+    uint32_t crc_errors = 0;
+    uint32_t bad_frames = 0;
+    uint64_t other_bytes = 0;
+};
+}  // namespace
+
+static speed_t baud_constant(int baud) {
+    switch (baud) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return B115200;
+    }
+}
+static bool write_ppm(const mirror_view& view, const char* path) {
+    // written aside and swapped in, so a viewer never loads half a file
+    char temp_path[1024];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE* file = fopen(temp_path, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", view.width, view.height);
+    for (size_t i = 0; i < view.pixels.size(); ++i) {
+        // the pixels are stored big endian, as they go over the wire
+        const uint8_t* p = (const uint8_t*)&view.pixels[i];
+        const uint16_t v = (p[0] << 8) | p[1];
+        const uint8_t rgb[3] = {(uint8_t)(((v >> 11) & 31) * 255 / 31),
+                                (uint8_t)(((v >> 5) & 63) * 255 / 63),
+                                (uint8_t)((v & 31) * 255 / 31)};
+        fwrite(rgb, 1, 3, file);
+    }
+    fclose(file);
+    return 0 == rename(temp_path, path);
+}
+static uint16_t read16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+// paints a rectangle's tokens over the screen
+static bool apply_rect(mirror_view* view, const uint8_t* payload, size_t size) {
+    if (size < 8 || view->pixels.empty()) {
+        return false;
+    }
+    const uint16_t x1 = read16(payload), y1 = read16(payload + 2);
+    const uint16_t x2 = read16(payload + 4), y2 = read16(payload + 6);
+    if (x2 < x1 || y2 < y1 || x2 >= view->width || y2 >= view->height) {
+        return false;
+    }
+    const size_t w = x2 - x1 + 1, count = w * (y2 - y1 + 1);
+    size_t i = 0, at = 8;
+    while (at < size) {
+        const uint8_t token = payload[at++];
+        if (token < 0x80) {
+            i += token + 1;
+            continue;
+        }
+        const size_t n = (token & 0x3F) + 1;
+        if (i + n > count || at + (token < 0xC0 ? 2 : n * 2) > size) {
+            return false;
+        }
+        for (size_t j = 0; j < n; ++j, ++i) {
+            uint16_t pixel;
+            memcpy(&pixel, payload + at + (token < 0xC0 ? 0 : j * 2), 2);
+            view->pixels[(y1 + i / w) * view->width + x1 + i % w] = pixel;
+        }
+        at += token < 0xC0 ? 2 : n * 2;
+    }
+    return i <= count;
+}
+// handles one whole frame, returning false if it doesn't make sense
+static bool apply_frame(mirror_view* view, uint8_t type, const uint8_t* payload, size_t size, const char* ppm_path, bool quiet) {
+    switch (type) {
+        case chess_mirror::frame_screen:
+            if (size < 5 || payload[4] != 16) {
+                return false;
+            }
+            view->width = read16(payload);
+            view->height = read16(payload + 2);
+            view->pixels.assign((size_t)view->width * view->height, 0);
+            return true;
+        case chess_mirror::frame_rect:
+            return apply_rect(view, payload, size);
+        case chess_mirror::frame_move: {
+            if (size < 6) {
+                return false;
+            }
+            const uint32_t flushed = read16(payload + 2) | ((uint32_t)read16(payload + 4) << 16);
+            view->flush_bytes += flushed;
+            view->move_total_bytes += view->move_bytes;
+            ++view->moves;
+            if (!quiet) {
+                // the move frame itself counts towards the move
+                const uint32_t ratio_x10 = view->move_bytes ? (uint32_t)((uint64_t)flushed * 10 / view->move_bytes) : 0;
+                printf("ply %u: %u bytes in %u frames, %u flushed (%u.%u:1)\n", (unsigned)read16(payload),
+                       (unsigned)view->move_bytes, (unsigned)view->move_frames, (unsigned)flushed,
+                       (unsigned)(ratio_x10 / 10), (unsigned)(ratio_x10 % 10));
+                fflush(stdout);
+            }
+            view->move_bytes = view->move_frames = 0;
+            if (ppm_path != nullptr && !view->pixels.empty() && !write_ppm(*view, ppm_path)) {
+                fprintf(stderr, "Unable to write %s\n", ppm_path);
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+// takes the frames from the start of the buffer, returning how much was used
+static size_t parse(mirror_view* view, const uint8_t* data, size_t size, const char* ppm_path, bool pass_through, bool quiet) {
+    size_t at = 0;
+    while (at < size) {
+        if (data[at] != chess_mirror::sync[0] || (at + 1 < size && data[at + 1] != chess_mirror::sync[1])) {
+            // console output, or noise
+            if (pass_through) {
+                fputc(data[at], stdout);
+            }
+            ++view->other_bytes;
+            ++at;
+            continue;
+        }
+        if (size - at < chess_mirror::frame_overhead) {
+            break;
+        }
+        const size_t payload_size = read16(data + at + 3);
+        if (payload_size > chess_mirror::max_payload) {
+            ++view->bad_frames;
+            ++at;
+            continue;
+        }
+        const size_t frame_size = payload_size + chess_mirror::frame_overhead;
+        if (size - at < frame_size) {
+            break;
+        }
+        const uint16_t crc = read16(data + at + 5 + payload_size);
+        if (crc != chess_mirror::crc16(data + at + 2, payload_size + 3)) {
+            // resynchronize from the next byte
+            ++view->crc_errors;
+            ++at;
+            continue;
+        }
+        view->bytes += frame_size;
+        ++view->frames;
+        view->move_bytes += (uint32_t)frame_size;
+        ++view->move_frames;
+        if (!apply_frame(view, data[at + 2], data + at + 5, payload_size, ppm_path, quiet)) {
+            ++view->bad_frames;
+        }
+        at += frame_size;
+    }
+    return at;
+}
+
+int mirror_main(int argc, char** argv) {
+    const char* ppm_path = nullptr;
+    const char* input = nullptr;
+    int baud = 115200;
+    bool pass_through = false, quiet = false;
+    for (int i = 0; i < argc; ++i) {
+        if (i + 1 < argc && 0 == strcmp(argv[i], "-o")) {
+            ppm_path = argv[++i];
+        } else if (i + 1 < argc && 0 == strcmp(argv[i], "-b")) {
+            baud = atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-l")) {
+            pass_through = true;
+        } else if (0 == strcmp(argv[i], "-q")) {
+            quiet = true;
+        } else if (0 == strcmp(argv[i], "-") || argv[i][0] != '-') {
+            input = argv[i];
+        } else {
+            fprintf(stderr, "unrecognized option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (input == nullptr) {
+        fprintf(stderr, "no input\n");
+        return 1;
+    }
+    const int fd = 0 == strcmp(input, "-") ? 0 : open(input, O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+        fprintf(stderr, "unable to open %s\n", input);
+        return 1;
+    }
+    if (fd != 0 && isatty(fd)) {
+        struct termios options;
+        if (0 == tcgetattr(fd, &options)) {
+            cfmakeraw(&options);
+            cfsetispeed(&options, baud_constant(baud));
+            cfsetospeed(&options, baud_constant(baud));
+            options.c_cc[VMIN] = 1;
+            options.c_cc[VTIME] = 0;
+            tcsetattr(fd, TCSANOW, &options);
+        }
+    }
+    mirror_view view;
+    // room for the largest frame and a read behind it
+    std::vector<uint8_t> buffer(chess_mirror::max_payload * 4);
+    size_t used = 0;
+    while (true) {
+        const ssize_t got = read(fd, buffer.data() + used, buffer.size() - used);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            break;
+        }
+        used += (size_t)got;
+        const size_t taken = parse(&view, buffer.data(), used, ppm_path, pass_through, quiet);
+        memmove(buffer.data(), buffer.data() + taken, used - taken);
+        used -= taken;
+    }
+    if (fd != 0) {
+        close(fd);
+    }
+    // whatever was left never made a frame
+    view.other_bytes += used;
+    printf("%llu frames, %llu bytes, %u moves, %llu bytes per move\n", (unsigned long long)view.frames,
+           (unsigned long long)view.bytes, (unsigned)view.moves,
+           (unsigned long long)(view.moves ? view.move_total_bytes / view.moves : 0));
+    const uint64_t ratio_x10 = view.move_total_bytes ? view.flush_bytes * 10 / view.move_total_bytes : 0;
+    printf("%llu bytes flushed to the screen for %llu sent, %llu.%llu:1\n", (unsigned long long)view.flush_bytes,
+           (unsigned long long)view.move_total_bytes, (unsigned long long)(ratio_x10 / 10),
+           (unsigned long long)(ratio_x10 % 10));
+    printf("%u CRC errors, %u bad frames, %llu other bytes\n", (unsigned)view.crc_errors, (unsigned)view.bad_frames,
+           (unsigned long long)view.other_bytes);
+    if (view.pixels.empty()) {
+        fprintf(stderr, "no screen in the input\n");
+        return 1;
+    }
+    // FNV-1a, as the harness prints it
+    uint32_t checksum = 2166136261u;
+    const uint8_t* p = (const uint8_t*)view.pixels.data();
+    for (size_t i = 0; i < view.pixels.size() * 2; ++i) {
+        checksum = (checksum ^ p[i]) * 16777619u;
+    }
+    printf("frame checksum: %08x\n", (unsigned)checksum);
+    if (ppm_path != nullptr && !write_ppm(view, ppm_path)) {
+        fprintf(stderr, "Unable to write %s\n", ppm_path);
+        return 1;
+    }
+    return view.crc_errors || view.bad_frames ? 1 : 0;
+}
@@ -0,0 +1,60 @@
+// Validates and times the move generators on the host.
+//
+// usage: perft [-d depth] [-l library_depth] [-f fen]
+// runs the reference positions to the given depth (default 4) and compares
+// the counts against the known values. -l also walks the tree with
+// chess_compute_moves()/chess_move() from the initial position, checking
+// each position against the bitboards. -f counts the moves below each root
+// move of a single position instead, for narrowing down a failure.
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chess_perft.hpp"
+#include "host.hpp"
+#include "timing.hpp"
+
+static void print_divide(chess_value_t from, chess_value_t to, chess_value_t promotion, uint64_t nodes, void* state) {
+    (void)state;
+    char from_name[3], to_name[3];
+    chess_index_name(from, from_name);
+    chess_index_name(to, to_name);
+    static const char promotion_chars[] = "pnbrqk";
+    if (promotion > -1) {
+        printf("%s%s%c: %" PRIu64 "\n", from_name, to_name, promotion_chars[chess_bitboard::index_of(CHESS_TYPE(promotion))], nodes);
+    } else {
+        printf("%s%s: %" PRIu64 "\n", from_name, to_name, nodes);
+    }
+}
+
+int perft_main(int argc, char** argv) {
+    int depth = 4;
+    int library_depth = 0;
+    const char* fen = nullptr;
+    for (int i = 0; i + 1 < argc; i += 2) {
+        if (0 == strcmp(argv[i], "-d")) {
+            depth = atoi(argv[i + 1]);
+        } else if (0 == strcmp(argv[i], "-l")) {
+            library_depth = atoi(argv[i + 1]);
+        } else if (0 == strcmp(argv[i], "-f")) {
+            fen = argv[i + 1];
+        } else {
+            fprintf(stderr, "unrecognized option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (fen == nullptr) {
+        return chess_perft::run_suite(depth, library_depth) ? 1 : 0;
+    }
+    chess_perft perft;
+    if (!perft.load(fen) || depth < 1) {
+        fprintf(stderr, "invalid FEN or depth\n");
+        return 1;
+    }
+    const uint64_t start = timing_us();
+    const uint64_t nodes = perft.divide(depth, print_divide, nullptr);
+    const uint64_t elapsed = timing_us() - start;
+    printf("total: %" PRIu64 " nodes in %" PRIu64 "ms\n", nodes, elapsed / 1000);
+    return 0;
+}
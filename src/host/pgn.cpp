@@ -0,0 +1,320 @@
+// Replays PGN files through the rules, to regression check rule changes
+// against large collections of real games.
+//
+// usage: pgn [-j threads] [-q] games.pgn...
+//        pgn -c
+// each file is memory mapped and split into games, and the games are spread
+// across the threads (default: one per core). Every move is played with
+// chess_move() on a chess_game_t, as the library plays it, and on the
+// chess_position the board plays, and after each one the two must agree on
+// the pieces and on chess_status(). Prints one line per game, or with -q
+// only the games that weren't ok:
+//   <game> <result tag> <plies played> <final status> <verdict>
+// where the verdict is ok, or why the game stopped being played after that
+// many plies, then the totals with the games/s and moves/s. Exits with 1 if
+// the two disagreed anywhere or a move couldn't be played.
+// -c replays a few built in games that write their moves in the ways
+// exports do, and exits with 1 unless each plays through.
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "host.hpp"
+#include "timing.hpp"
+
+namespace {
+enum pgn_verdict : uint8_t {
+    PGN_OK = 0,
+    // the move isn't legal, or names no single move
+    PGN_ILLEGAL,
+    // chess.h always promotes to a queen
+    PGN_UNDERPROMOTION,
+    // the game starts from a FEN, which chess_game_t can't be set up with
+    PGN_SETUP,
+    // the library and chess_position disagree
+    PGN_MISMATCH
+};
+struct pgn_game_result {
+    std::string_view result;
+    uint16_t plies;
+    chess_status_t status;
+    pgn_verdict verdict;
+};
+struct pgn_file {
+    const char* data;
+    size_t size;
+};
+}  // namespace
+
+static const char* verdict_name(pgn_verdict verdict) {
+    static const char* names[] = {"ok", "illegal", "underpromotion", "setup", "mismatch"};
+    return names[verdict];
+}
+static const char* status_name(chess_status_t status) {
+    static const char* names[] = {"normal", "check", "checkmate", "stalemate"};
+    return names[status];
+}
+static bool token_is(std::string_view token, const char* text) {
+    return token == std::string_view(text);
+}
+static bool map_file(const char* path, pgn_file* out_file) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "unable to open %s\n", path);
+        return false;
+    }
+    struct stat info;
+    if (0 != fstat(fd, &info)) {
+        close(fd);
+        return false;
+    }
+    out_file->size = (size_t)info.st_size;
+    out_file->data = nullptr;
+    if (out_file->size) {
+        void* data = mmap(nullptr, out_file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            fprintf(stderr, "unable to map %s\n", path);
+            close(fd);
+            return false;
+        }
+        madvise(data, out_file->size, MADV_SEQUENTIAL);
+        out_file->data = (const char*)data;
+    }
+    // the mapping stays valid
+    close(fd);
+    return true;
+}
+// a game starts at the first tag line after movetext
+static void split_games(std::string_view text, std::vector<std::string_view>* games) {
+    size_t start = 0, line = 0;
+    bool movetext = false;
+    while (line < text.size()) {
+        size_t end = text.find('\n', line);
+        if (end == std::string_view::npos) {
+            end = text.size();
+        }
+        if (text[line] == '[') {
+            if (movetext) {
+                games->push_back(text.substr(start, line - start));
+                start = line;
+                movetext = false;
+            }
+        } else if (!movetext) {
+            for (size_t i = line; i < end; ++i) {
+                if (!isspace((unsigned char)text[i])) {
+                    movetext = true;
+                    break;
+                }
+            }
+        }
+        line = end + 1;
+    }
+    if (movetext) {
+        games->push_back(text.substr(start));
+    }
+}
+// the pieces and the status of the side to move must match
+static bool same_position(const chess_game_t& game, const chess_position& position) {
+    const chess_bitboard& boards = position.bitboards();
+    for (int sq = 0; sq < 64; ++sq) {
+        if (chess_index_to_id(&game, sq) != boards.squares[sq]) {
+            return false;
+        }
+    }
+    uint64_t destinations[64];
+    const bool moves = 0 != position.legal_moves(destinations);
+    const chess_status_t status = chess_status(&game, chess_turn(&game));
+    const chess_status_t expected = moves ? (position.in_check() ? CHESS_CHECK : CHESS_NORMAL)
+                                          : (position.in_check() ? CHESS_CHECKMATE : CHESS_STALEMATE);
+    return status == expected;
+}
+static void play_game(std::string_view text, pgn_game_result* out_result) {
+    out_result->result = std::string_view("*");
+    out_result->plies = 0;
+    out_result->verdict = PGN_OK;
+    chess_game_t game;
+    chess_init(&game);
+    chess_position position;
+    position.init();
+    size_t i = 0;
+    while (i < text.size()) {
+        const char ch = text[i];
+        if (isspace((unsigned char)ch)) {
+            ++i;
+        } else if (ch == '[') {
+            const size_t end = text.find('\n', i);
+            const std::string_view tag = text.substr(i, end == std::string_view::npos ? std::string_view::npos : end - i);
+            if (tag.substr(0, 8) == "[Result ") {
+                const size_t open = tag.find('"'), close = tag.rfind('"');
+                if (open != std::string_view::npos && close > open) {
+                    out_result->result = tag.substr(open + 1, close - open - 1);
+                }
+            } else if (tag.substr(0, 5) == "[FEN ") {
+                out_result->verdict = PGN_SETUP;
+            }
+            i = end == std::string_view::npos ? text.size() : end;
+        } else if (ch == '{') {
+            const size_t end = text.find('}', i);
+            i = end == std::string_view::npos ? text.size() : end + 1;
+        } else if (ch == ';' || ch == '%') {
+            const size_t end = text.find('\n', i);
+            i = end == std::string_view::npos ? text.size() : end;
+        } else if (ch == '(') {
+            // variations, which may nest
+            int depth = 0;
+            do {
+                if (text[i] == '(') ++depth;
+                if (text[i] == ')') --depth;
+                ++i;
+            } while (i < text.size() && depth > 0);
+        } else {
+            const size_t start = i;
+            while (i < text.size() && !isspace((unsigned char)text[i]) && !strchr("{(;", text[i])) ++i;
+            std::string_view token = text.substr(start, i - start);
+            if (token_is(token, "1-0") || token_is(token, "0-1") || token_is(token, "1/2-1/2") || token_is(token, "*")) {
+                break;
+            }
+            // move numbers can be glued to the move, as in 1.e4 or 12...Nf6
+            token.remove_prefix(host_move_number(token.data(), token.size()));
+            if (token.empty() || token[0] == '$' || out_result->verdict != PGN_OK) {
+                // move numbers, annotations, and the rest of a game that stopped
+                continue;
+            }
+            const size_t equals = token.find('=');
+            if (equals != std::string_view::npos && equals + 1 < token.size() && strchr("NBR", token[equals + 1])) {
+                out_result->verdict = PGN_UNDERPROMOTION;
+                continue;
+            }
+            chess_value_t from, to;
+            if (!host_san_move(position, token.data(), token.size(), &from, &to)) {
+                out_result->verdict = PGN_ILLEGAL;
+                continue;
+            }
+            const chess_value_t library = chess_move(&game, from, to);
+            if (library == -2 || -2 == position.move(from, to) || !same_position(game, position)) {
+                out_result->verdict = PGN_MISMATCH;
+                continue;
+            }
+            ++out_result->plies;
+        }
+    }
+    out_result->status = chess_status(&game, chess_turn(&game));
+}
+
+// games that must play through, and their plies
+static const struct {
+    const char* text;
+    uint16_t plies;
+} pgn_check_games[] = {
+    {"[Result \"1-0\"]\n\n1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Ba4 Nf6 1-0\n", 8},
+    // move numbers glued to the moves, as TWIC and ChessBase write them
+    {"[Result \"1-0\"]\n\n1.e4 e5 2.Nf3 Nc6 3.Bb5 a6 4.Ba4 Nf6 1-0\n", 8},
+    // black's move numbers after a comment, glued and spaced
+    {"[Result \"*\"]\n\n1.e4 {king's pawn} 1...e5 2.Nf3 {} 2... Nc6 3.Bc4 Bc5 *\n", 6},
+};
+static int pgn_check() {
+    int failures = 0;
+    const int count = (int)(sizeof(pgn_check_games) / sizeof(pgn_check_games[0]));
+    for (int g = 0; g < count; ++g) {
+        pgn_game_result result;
+        play_game(std::string_view(pgn_check_games[g].text), &result);
+        const bool ok = result.verdict == PGN_OK && result.plies == pgn_check_games[g].plies;
+        failures += !ok;
+        printf("%d %u plies %s%s\n", g + 1, (unsigned)result.plies, verdict_name(result.verdict), ok ? "" : " FAILED");
+    }
+    printf("%d of %d games played through\n", count - failures, count);
+    return failures ? 1 : 0;
+}
+
+int pgn_main(int argc, char** argv) {
+    size_t threads = std::thread::hardware_concurrency();
+    bool quiet = false;
+    std::vector<const char*> inputs;
+    for (int i = 0; i < argc; ++i) {
+        if (i + 1 < argc && 0 == strcmp(argv[i], "-j")) {
+            threads = (size_t)atoi(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-q")) {
+            quiet = true;
+        } else if (0 == strcmp(argv[i], "-c")) {
+            return pgn_check();
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "unrecognized option %s\n", argv[i]);
+            return 1;
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+    if (inputs.empty()) {
+        fprintf(stderr, "no input files\n");
+        return 1;
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+    const uint64_t start = timing_us();
+    std::vector<pgn_file> files;
+    std::vector<std::string_view> games;
+    for (const char* input : inputs) {
+        pgn_file file;
+        if (!map_file(input, &file)) {
+            return 1;
+        }
+        files.push_back(file);
+        split_games(std::string_view(file.data, file.size), &games);
+    }
+    const uint64_t split_us = timing_us() - start;
+    std::vector<pgn_game_result> results(games.size());
+    // workers take games in batches, so the counter isn't contended
+    static constexpr const size_t batch = 64;
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t) {
+        pool.emplace_back([&]() {
+            size_t first;
+            while ((first = next.fetch_add(batch)) < games.size()) {
+                const size_t last = first + batch < games.size() ? first + batch : games.size();
+                for (size_t g = first; g < last; ++g) {
+                    play_game(games[g], &results[g]);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+    const uint64_t elapsed_us = timing_us() - start;
+    uint64_t plies = 0;
+    size_t counts[5] = {0};
+    for (size_t g = 0; g < results.size(); ++g) {
+        const pgn_game_result& result = results[g];
+        plies += result.plies;
+        ++counts[result.verdict];
+        if (!quiet || result.verdict != PGN_OK) {
+            printf("%zu %.*s %u %s %s\n", g + 1, (int)result.result.size(), result.result.data(),
+                   (unsigned)result.plies, status_name(result.status), verdict_name(result.verdict));
+        }
+    }
+    for (const pgn_file& file : files) {
+        if (file.size) {
+            munmap((void*)file.data, file.size);
+        }
+    }
+    printf("%zu games, %llu moves in %llums (%llums splitting) on %zu threads\n", games.size(),
+           (unsigned long long)plies, (unsigned long long)(elapsed_us / 1000), (unsigned long long)(split_us / 1000), threads);
+    printf("%llu games/s, %llu moves/s\n",
+           (unsigned long long)(elapsed_us ? (uint64_t)games.size() * 1000000 / elapsed_us : 0),
+           (unsigned long long)(elapsed_us ? plies * 1000000 / elapsed_us : 0));
+    printf("%zu ok, %zu illegal, %zu underpromotion, %zu setup, %zu mismatch\n", counts[PGN_OK],
+           counts[PGN_ILLEGAL], counts[PGN_UNDERPROMOTION], counts[PGN_SETUP], counts[PGN_MISMATCH]);
+    return counts[PGN_ILLEGAL] || counts[PGN_MISMATCH] ? 1 : 0;
+}
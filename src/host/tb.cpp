@@ -0,0 +1,112 @@
+// Probes Syzygy tablebases on the host, through the same block cache the
+// device reads the SD card with.
+//
+// usage: tb -d directory [-b block_size] [-n blocks] [-f fen]...
+// prints the win/draw/loss result, the distance to zeroing and the best move
+// for each position, then the cache hits and misses and the time spent
+// reading. The halfmove clock is taken from the FEN when present.
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "chess_block_cache.hpp"
+#include "chess_perft.hpp"
+#include "chess_tablebase.hpp"
+#include "host.hpp"
+#include "timing.hpp"
+
+static const char* wdl_name(int wdl) {
+    static const char* names[] = {"loss", "blessed loss", "draw", "cursed win", "win"};
+    return names[wdl + 2];
+}
+// the fifth FEN field
+static uint8_t fen_halfmove(const char* fen) {
+    int field = 0;
+    for (const char* p = fen; *p; ++p) {
+        if (*p == ' ' && p[1] != ' ' && ++field == 4) {
+            return (uint8_t)atoi(p + 1);
+        }
+    }
+    return 0;
+}
+
+int tb_main(int argc, char** argv) {
+    const char* directory = nullptr;
+    size_t block_size = 2048, blocks = 512;
+    std::vector<const char*> fens;
+    for (int i = 0; i + 1 < argc; i += 2) {
+        if (0 == strcmp(argv[i], "-d")) {
+            directory = argv[i + 1];
+        } else if (0 == strcmp(argv[i], "-b")) {
+            block_size = (size_t)atoi(argv[i + 1]);
+        } else if (0 == strcmp(argv[i], "-n")) {
+            blocks = (size_t)atoi(argv[i + 1]);
+        } else if (0 == strcmp(argv[i], "-f")) {
+            fens.push_back(argv[i + 1]);
+        } else {
+            fprintf(stderr, "unrecognized option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (directory == nullptr) {
+        fprintf(stderr, "usage: tb -d directory [-b block_size] [-n blocks] [-f fen]...\n");
+        return 1;
+    }
+    static chess_block_cache cache;
+    if (!cache.allocate(block_size, blocks)) {
+        fprintf(stderr, "unable to allocate the cache\n");
+        return 1;
+    }
+    static chess_tablebase tablebase;
+    uint64_t start = timing_us();
+    if (!tablebase.open(directory, &cache)) {
+        fprintf(stderr, "no tables in %s\n", directory);
+        return 1;
+    }
+    printf("%zu tables, up to %d pieces, found in %" PRIu64 "us\n", tablebase.size(), tablebase.max_pieces(), timing_us() - start);
+    int failures = 0;
+    for (const char* fen : fens) {
+        chess_perft perft;
+        if (!perft.load(fen)) {
+            fprintf(stderr, "invalid FEN \"%s\"\n", fen);
+            return 1;
+        }
+        chess_tb_position position;
+        position.boards = perft.bitboards();
+        position.turn = perft.team_to_move();
+        position.castling = perft.castling_rights();
+        position.en_passant = perft.en_passant_square();
+        position.halfmove = fen_halfmove(fen);
+        printf("%s\n", fen);
+        start = timing_us();
+        int wdl, dtz;
+        if (!tablebase.probe_wdl(position, &wdl)) {
+            printf("  not in the tables\n");
+            ++failures;
+            continue;
+        }
+        const uint64_t wdl_us = timing_us() - start;
+        printf("  wdl: %s (%" PRIu64 "us)\n", wdl_name(wdl), wdl_us);
+        start = timing_us();
+        if (tablebase.probe_dtz(position, &dtz)) {
+            printf("  dtz: %d (%" PRIu64 "us)\n", dtz, timing_us() - start);
+        } else {
+            printf("  dtz: unavailable\n");
+        }
+        chess_value_t from, to;
+        start = timing_us();
+        if (tablebase.probe_root(position, &from, &to, &wdl)) {
+            char from_name[3], to_name[3];
+            chess_index_name(from, from_name);
+            chess_index_name(to, to_name);
+            printf("  best: %s%s, %s (%" PRIu64 "us)\n", from_name, to_name, wdl_name(wdl), timing_us() - start);
+        } else {
+            printf("  best: unavailable\n");
+        }
+    }
+    printf("cache: %u hits, %u misses, %" PRIu64 "us reading\n", (unsigned)cache.hits(), (unsigned)cache.misses(), cache.storage_us());
+    return failures ? 1 : 0;
+}
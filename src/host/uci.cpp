@@ -0,0 +1,130 @@
+// Runs the UCI endpoint over stdin and stdout, exactly as the device runs it
+// over its spare UART, so GUIs and match runners can be pointed at it without
+// hardware.
+//
+// usage: uci [-h table_mb] [-j threads] [-c runs]
+// reads commands until quit or the end of input, waiting for a search in
+// progress to finish first. The traffic and the time taken go to stderr,
+// so piping a script through it measures the protocol's throughput.
+// -c instead checks the given number of times that a stop arriving in the
+// same read as go infinite still ends the search with a bestmove, and exits
+// with 1 if one didn't within a second.
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chess_engine.hpp"
+#include "chess_tt.hpp"
+#include "chess_uci.hpp"
+#include "host.hpp"
+#include "timing.hpp"
+
+static void write_stdout(const char* data, size_t size, void* state) {
+    (void)state;
+    fwrite(data, 1, size, stdout);
+    fflush(stdout);
+}
+// counts the bestmove lines, for -c
+static void count_bestmoves(const char* data, size_t size, void* state) {
+    if (size >= 9 && 0 == strncmp(data, "bestmove ", 9)) {
+        ++*(int*)state;
+    }
+}
+static int check_stop(chess_uci& uci, int runs) {
+    static int bestmoves = 0;
+    uci.on_write_callback(count_bestmoves, &bestmoves);
+    static const char setup[] = "uci\nisready\n";
+    uci.feed(setup, sizeof(setup) - 1);
+    int failures = 0;
+    for (int i = 0; i < runs; ++i) {
+        // all in one read, so the stop lands before the engine task has picked up the search
+        static const char script[] = "position startpos\ngo infinite\nstop\n";
+        const int expected = bestmoves + 1;
+        uci.feed(script, sizeof(script) - 1);
+        const uint64_t start = timing_us();
+        while (bestmoves < expected && timing_us() - start < 1000 * 1000) {
+            usleep(1000);
+            uci.update();
+        }
+        if (bestmoves < expected) {
+            fprintf(stderr, "run %d: no bestmove a second after stop\n", i + 1);
+            ++failures;
+            // end it, so the next run starts clean
+            static const char stop[] = "stop\n";
+            uci.feed(stop, sizeof(stop) - 1);
+            while (uci.busy()) {
+                usleep(1000);
+                uci.update();
+            }
+            bestmoves = expected;
+        }
+    }
+    printf("stop after go infinite: %d of %d runs ended the search\n", runs - failures, runs);
+    return failures ? 1 : 0;
+}
+
+int uci_main(int argc, char** argv) {
+    size_t table_mb = 16, threads = 1;
+    int check_runs = 0;
+    for (int i = 0; i + 1 < argc; i += 2) {
+        if (0 == strcmp(argv[i], "-h")) {
+            table_mb = (size_t)atoi(argv[i + 1]);
+        } else if (0 == strcmp(argv[i], "-j")) {
+            threads = (size_t)atoi(argv[i + 1]);
+        } else if (0 == strcmp(argv[i], "-c")) {
+            check_runs = atoi(argv[i + 1]);
+        } else {
+            fprintf(stderr, "unrecognized option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    static chess_tt table;
+    static chess_engine engine;
+    chess_tt* used_table = nullptr;
+    if (table_mb && table.allocate(table_mb * 1024 * 1024)) {
+        engine.table(&table);
+        used_table = &table;
+    }
+    if (!engine.threads(threads) || !engine.start()) {
+        fprintf(stderr, "unable to start the engine\n");
+        return 1;
+    }
+    // too big for the stack
+    static chess_uci uci(engine, used_table);
+    if (check_runs > 0) {
+        const int result = check_stop(uci, check_runs);
+        engine.stop();
+        return result;
+    }
+    uci.on_write_callback(write_stdout);
+    const uint64_t start = timing_us();
+    bool input = true;
+    while (!uci.quit_requested() && (input || uci.busy())) {
+        if (input) {
+            // wake up for input, or every 10ms to collect the search
+            pollfd fd = {0, POLLIN, 0};
+            if (poll(&fd, 1, 10) > 0) {
+                char buf[4096];
+                const ssize_t read_size = read(0, buf, sizeof(buf));
+                if (read_size > 0) {
+                    uci.feed(buf, (size_t)read_size);
+                } else {
+                    input = false;
+                }
+            }
+        } else {
+            usleep(10 * 1000);
+        }
+        uci.update();
+    }
+    engine.stop();
+    const chess_uci::statistics traffic = uci.traffic();
+    const uint64_t elapsed_us = timing_us() - start;
+    fprintf(stderr, "uci: %u commands, %u bytes in, %u bytes out, %u searches in %ums (%u commands/s)\n",
+            (unsigned)traffic.commands, (unsigned)traffic.bytes_in, (unsigned)traffic.bytes_out,
+            (unsigned)traffic.searches, (unsigned)(elapsed_us / 1000),
+            (unsigned)(elapsed_us ? (uint64_t)traffic.commands * 1000000 / elapsed_us : 0));
+    return 0;
+}
@@ -12,8 +12,16 @@
 // screen dimensions
 #define LCD_WIDTH 320
 #define LCD_HEIGHT 240
-// indicates how much of the screen gets updated at once
+// indicates how much of the screen gets updated at once.
+// if not defined, the transfer buffers are sized from
+// the free DMA capable heap at boot
 // #define LCD_DIVISOR 2 // optional
+// the DMA capable heap to leave for everything else
+// when sizing the transfer buffers
+#define LCD_DMA_RESERVE (64 * 1024)  // optional
+// times full screen repaints at boot and keeps the
+// buffer size that draws fastest
+// #define LCD_CALIBRATE // optional
 // screen connections
 #define LCD_PORT SPI3_HOST
 #define LCD_DC 15
@@ -31,6 +39,105 @@
 #define LCD_BGR 1                     // optional
 #define LCD_BIT_DEPTH 16              // optional
 #define LCD_SPEED (40 * 1000 * 1000)  // optional
+// the touch panel's interrupt line. the UI sleeps until
+// it fires instead of polling the panel over I2C
+#define TOUCH_INT 39  // optional
+// how often the touch panel is read while a finger is down
+#define TOUCH_POLL_MS 10  // optional
+// the frame period while something is animating
+#define UI_FRAME_MS 16  // optional
+// how long a moved piece takes to slide to its square
+#define UI_ANIMATION_MS 200  // optional
+// prints the frame rate and bytes sent per frame after each animation
+#define UI_REPORT_ANIMATION  // optional
+// prints the time from each touch interrupt to the first flush it causes
+#define UI_REPORT_LATENCY  // optional
+// the touch strip below the screen takes moves back and replays them:
+// tap the left third to undo, the right third to redo,
+// or drag along it to scrub through the game
+#define HISTORY_STRIP  // optional
+// how far a drag moves before it steps one move
+#define HISTORY_SCRUB_PX 24  // optional
+// shows the side to move, and check, checkmate or stalemate,
+// at the top of the strip left of the board
+#define STATUS_BAR  // optional
+// shows the evaluation as a bar in the strip right of the board
+#define EVAL_BAR  // optional
+// chess clocks in the strip left of the board, started by the first move.
+// the computer budgets its moves from its clock instead of ENGINE_TIME_MS
+#define CLOCK_ENABLED  // optional
+#define CLOCK_MINUTES 10  // optional
+// added to the mover's time after each move, or with CLOCK_DELAY,
+// spent each move before the mover's time starts counting down
+#define CLOCK_BONUS_MS 5000  // optional
+// #define CLOCK_DELAY // optional
+// timestamps the frame pipeline and periodically prints
+// histograms of where the time goes
+// #define FRAME_TRACE // optional
+#define FRAME_TRACE_INTERVAL_MS 5000  // optional
+// the computer plays the team that moves second
+// comment this out for two players
+#define ENGINE_ENABLED
+// the search budget per computer move
+#define ENGINE_TIME_MS 5000  // optional
+// #define ENGINE_NODES 200000 // optional
+// #define ENGINE_DEPTH 8 // optional
+// the transposition table size, allocated in PSRAM
+#define ENGINE_TT_SIZE (2 * 1024 * 1024)  // optional
+// searches the expected reply while the player thinks
+#define ENGINE_PONDER  // optional
+// the number of search threads. a second thread runs on
+// the UI core, below the UI's priority, while the engine thinks
+#define ENGINE_THREADS 2  // optional
+// searches the initial position to this depth at boot with
+// 1 and 2 threads, printing the nodes/s and time to depth
+// #define ENGINE_SCALING_DEPTH 6 // optional
+// keeps the game in SPIFFS and resumes it at boot
+#define JOURNAL_ENABLED  // optional
+// how long moves are batched before they're written
+#define JOURNAL_SYNC_MS 1000  // optional
+// the moves between whole position snapshots
+#define JOURNAL_SNAPSHOT_PLIES 16  // optional
+
+// plays from the opening book in the "book" partition while it has a move
+#define BOOK_ENABLED  // optional
+#define BOOK_PARTITION "book"  // optional
+
+// probes Syzygy endgame tablebases (.rtbw and .rtbz files)
+// on the SD card once few enough pieces are left
+#define TB_ENABLED  // optional
+#define TB_PATH "/sdcard/syzygy"  // optional
+// the SD card read cache, allocated in PSRAM
+#define TB_CACHE_BLOCK_SIZE 4096  // optional
+#define TB_CACHE_BLOCKS 256  // optional
+
+// a UCI endpoint on the spare UART, on config.h's control_serial_pins,
+// so desktop GUIs and match runners can drive the engine. the computer
+// stops playing on the board while a GUI is connected
+#define UCI_ENABLED  // optional
+#define UCI_UART UART_NUM_2  // optional
+
+// mirrors the screen to MIRROR_UART for the host's mirror tool. each flush
+// is copied to PSRAM and a low priority task sends what changed, compressed.
+// UART_NUM_0 is the USB serial port, which the log shares
+// #define MIRROR_ENABLED // optional
+#define MIRROR_UART UART_NUM_0  // optional
+// the USB serial port can run much faster than the log needs
+// #define MIRROR_BAUD 921600 // optional
+// how often the whole screen is sent, for a viewer that joins late
+#define MIRROR_REFRESH_MS 60000  // optional
+
+// plays another board over LINK_UART, on config.h's slave_serial_pins
+// (Port C). each side plays the team the other doesn't, and the computer
+// stops playing while they're connected
+// #define LINK_ENABLED // optional
+#define LINK_UART UART_NUM_1  // optional
+
+// validates and times the move generator at boot,
+// printing the results to the serial monitor
+// #define PERFT_DEPTH 4 // optional
+// also checks chess.h against the move generator to this depth
+// #define PERFT_LIBRARY_DEPTH 3 // optional
 
 #if __has_include(<Arduino.h>)
 #include <Arduino.h>
@@ -45,15 +152,44 @@
 #include "driver/gpio.h"
 #include "driver/spi_master.h"
 #include "driver/uart.h"
+#include "esp_timer.h"
 #include "esp_lcd_panel_ili9342.h"
 #include "esp_lcd_panel_io.h"
 #include "esp_lcd_panel_ops.h"
 #include "esp_lcd_panel_vendor.h"
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+#include "esp_mac.h"
+#else
+#include "esp_system.h"
+#endif
+#include "esp_random.h"
 #include "esp_spiffs.h"
 #include "esp_vfs_fat.h"
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+#include "driver/uart_vfs.h"
+#else
+#include "esp_vfs_dev.h"
+#endif
+#include "freertos/queue.h"
+#include <atomic>
 #define CB24_IMPLEMENTATION
 #include "assets/cb24.hpp"
-#include "chess.h"
+#include "chess_board.hpp"
+#include "chess_book.hpp"
+#include "chess_clock.hpp"
+#include "chess_clock_face.hpp"
+#include "chess_engine.hpp"
+#include "chess_eval_bar.hpp"
+#include "chess_journal.hpp"
+#include "chess_link.hpp"
+#include "chess_mirror.hpp"
+#include "chess_perft.hpp"
+#include "chess_status_bar.hpp"
+#include "chess_tablebase.hpp"
+#include "chess_uci.hpp"
+#include "config.h"
+#include "frame_trace.hpp"
+#include "timing.hpp"
 // namespace imports
 #ifdef ARDUINO
 using namespace arduino;  // devices
@@ -71,6 +207,87 @@ using surface_t = screen_t::control_surface_type;
 
 static uix::display lcd;
 
+// the UI task sleeps on this queue until there is something to do
+enum ui_event : uint8_t {
+    ui_event_touch = 0,    // the touch panel interrupt fired
+    ui_event_flushed = 1,  // a transfer buffer became free
+    ui_event_engine = 2,   // the engine has a move
+    ui_event_clock = 3,    // a clock's display is due to change
+    ui_event_link = 4      // the other board sent something, or the link is due an update
+};
+static QueueHandle_t ui_events = nullptr;
+// transfers handed to the LCD that haven't completed
+static std::atomic<int> lcd_in_flight(0);
+static uint32_t lcd_flushes = 0;
+static uint32_t lcd_flush_bytes = 0;
+// set when the touch panel has new data to read over I2C
+static volatile bool touch_pending = true;
+// whether a finger was down at the last read
+static bool touch_active = false;
+// when the last touch interrupt fired, or 0 once it has been accounted for
+static volatile int64_t touch_event_us = 0;
+static uint32_t touch_latency_us = 0;
+// set while something on screen moves. the UI then wakes every
+// UI_FRAME_MS on top of the events
+static bool ui_animating = false;
+#ifdef UI_REPORT_ANIMATION
+// the frames drawn and bytes sent since the animation started
+static uint32_t animation_frames = 0;
+static uint32_t animation_bytes = 0;
+static uint32_t animation_start_ms = 0;
+#endif
+#ifdef MIRROR_ENABLED
+#if defined(LCD_BIT_DEPTH) && LCD_BIT_DEPTH != 16
+#error "The mirror only sends 16-bit pixels"
+#endif
+// fed by the flush callback
+static chess_mirror mirror;
+#endif
+#ifdef LINK_ENABLED
+// the game as the other board knows it. not "link", which unistd.h has
+static chess_link game_link;
+#endif
+#ifdef HISTORY_STRIP
+// moves to take back (negative) or replay (positive), gathered from the touch strip
+static int history_steps = 0;
+// where the finger went down in the strip and was last stepped from, or -1
+static int history_touch_x = -1;
+static int history_step_x = 0;
+static bool history_scrubbed = false;
+#endif
+
+static void ui_post(ui_event event) {
+    if (ui_events != nullptr) {
+        xQueueSend(ui_events, &event, 0);
+    }
+}
+#ifdef TOUCH_INT
+static void IRAM_ATTR touch_isr(void* arg) {
+    touch_pending = true;
+    if (touch_event_us == 0) {
+        touch_event_us = esp_timer_get_time();
+    }
+    const ui_event event = ui_event_touch;
+    BaseType_t woken = pdFALSE;
+    xQueueSendFromISR(ui_events, &event, &woken);
+    if (woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+static void touch_int_init() {
+    // the FT6336 holds the line low while the panel is touched
+    gpio_config_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.pin_bit_mask = 1ull << TOUCH_INT;
+    cfg.mode = GPIO_MODE_INPUT;
+    cfg.intr_type = GPIO_INTR_ANYEDGE;
+    gpio_config(&cfg);
+    // may already be installed by the framework
+    gpio_install_isr_service(0);
+    gpio_isr_handler_add((gpio_num_t)TOUCH_INT, touch_isr, nullptr);
+}
+#endif
+
 static void power_init() {
     // for AXP192 power management
     static m5core2_power power(esp_i2c<1, 21, 22>::instance);
@@ -79,6 +296,80 @@ static void power_init() {
     power.lcd_voltage(3.0);
 }
 
+#ifdef LCD_BIT_DEPTH
+static constexpr const size_t lcd_pixel_size = (LCD_BIT_DEPTH + 7) / 8;
+#else
+static constexpr const size_t lcd_pixel_size = 2;
+#endif
+static constexpr const size_t lcd_row_size = LCD_WIDTH * lcd_pixel_size;
+// the smallest buffer worth having, in rows
+static constexpr const size_t lcd_min_rows = LCD_HEIGHT / 40;
+#ifdef LCD_TWO_BUFFERS
+static constexpr const size_t lcd_buffer_count = 2;
+#else
+static constexpr const size_t lcd_buffer_count = 1;
+#endif
+// the size of our transfer buffer(s), decided at boot
+static size_t lcd_transfer_buffer_size = 0;
+static uint8_t* lcd_transfer_buffer1 = nullptr;
+static uint8_t* lcd_transfer_buffer2 = nullptr;
+
+static void lcd_buffers_free() {
+    if (lcd_transfer_buffer1 != nullptr) {
+        heap_caps_free(lcd_transfer_buffer1);
+        lcd_transfer_buffer1 = nullptr;
+    }
+    if (lcd_transfer_buffer2 != nullptr) {
+        heap_caps_free(lcd_transfer_buffer2);
+        lcd_transfer_buffer2 = nullptr;
+    }
+}
+static void lcd_buffers_init() {
+    const size_t free_dma = heap_caps_get_free_size(MALLOC_CAP_DMA);
+#ifdef LCD_DIVISOR
+    size_t rows = LCD_HEIGHT / LCD_DIVISOR;
+#else
+#ifdef LCD_DMA_RESERVE
+    static constexpr const size_t reserve = LCD_DMA_RESERVE;
+#else
+    static constexpr const size_t reserve = 64 * 1024;
+#endif
+    size_t budget = free_dma > reserve ? (free_dma - reserve) / lcd_buffer_count : 0;
+    const size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_DMA);
+    if (budget > largest) {
+        budget = largest;
+    }
+    size_t rows = budget / lcd_row_size;
+    if (rows > LCD_HEIGHT) {
+        rows = LCD_HEIGHT;
+    }
+#endif
+    if (rows < lcd_min_rows) {
+        rows = lcd_min_rows;
+    }
+    // back off until they fit
+    while (true) {
+        lcd_transfer_buffer_size = rows * lcd_row_size;
+        lcd_transfer_buffer1 = (uint8_t*)heap_caps_malloc(lcd_transfer_buffer_size, MALLOC_CAP_DMA);
+#ifdef LCD_TWO_BUFFERS
+        lcd_transfer_buffer2 = (uint8_t*)heap_caps_malloc(lcd_transfer_buffer_size, MALLOC_CAP_DMA);
+#endif
+        if (lcd_transfer_buffer1 != nullptr && (lcd_buffer_count == 1 || lcd_transfer_buffer2 != nullptr)) {
+            break;
+        }
+        lcd_buffers_free();
+        if (rows == lcd_min_rows) {
+            puts("Out of memory allocating transfer buffers");
+            while (1) vTaskDelay(5);
+        }
+        rows = rows / 2 > lcd_min_rows ? rows / 2 : lcd_min_rows;
+    }
+    printf("LCD transfer buffers: %u x %uKB (%u rows, divisor %u) of %uKB free DMA heap\n",
+           (unsigned)lcd_buffer_count, (unsigned)(lcd_transfer_buffer_size / 1024),
+           (unsigned)rows, (unsigned)((LCD_HEIGHT + rows - 1) / rows),
+           (unsigned)(free_dma / 1024));
+}
+
 static void spi_init() {
     spi_bus_config_t buscfg;
     memset(&buscfg, 0, sizeof(buscfg));
@@ -87,20 +378,7 @@ static void spi_init() {
     buscfg.miso_io_num = SPI_MISO;
     buscfg.quadwp_io_num = -1;
     buscfg.quadhd_io_num = -1;
-#ifdef LCD_DIVISOR
-    static constexpr const size_t lcd_divisor = LCD_DIVISOR;
-#else
-    static constexpr const size_t lcd_divisor = 10;
-#endif
-#ifdef LCD_BIT_DEPTH
-    static constexpr const size_t lcd_pixel_size = (LCD_BIT_DEPTH + 7) / 8;
-#else
-    static constexpr const size_t lcd_pixel_size = 2;
-#endif
-    // the size of our transfer buffer(s)
-    static const constexpr size_t lcd_transfer_buffer_size =
-        LCD_WIDTH * LCD_HEIGHT * lcd_pixel_size / lcd_divisor;
-
+    // the largest transfer the buffers will ever need
     buscfg.max_transfer_sz =
         (lcd_transfer_buffer_size > 512 ? lcd_transfer_buffer_size : 512) + 8;
     // Initialize the SPI bus on VSPI (SPI3)
@@ -113,28 +391,6 @@ static void lcd_init() {
     using touch_t = ft6336<320, 280, 16>;
     static touch_t touch(esp_i2c<1, 21, 22>::instance);
 
-#ifdef LCD_DIVISOR
-    static constexpr const size_t lcd_divisor = LCD_DIVISOR;
-#else
-    static constexpr const size_t lcd_divisor = 10;
-#endif
-#ifdef LCD_BIT_DEPTH
-    static constexpr const size_t lcd_pixel_size = (LCD_BIT_DEPTH + 7) / 8;
-#else
-    static constexpr const size_t lcd_pixel_size = 2;
-#endif
-    // the size of our transfer buffer(s)
-    static const constexpr size_t lcd_transfer_buffer_size =
-        LCD_WIDTH * LCD_HEIGHT * lcd_pixel_size / lcd_divisor;
-
-    uint8_t* lcd_transfer_buffer1 =
-        (uint8_t*)heap_caps_malloc(lcd_transfer_buffer_size, MALLOC_CAP_DMA);
-    uint8_t* lcd_transfer_buffer2 =
-        (uint8_t*)heap_caps_malloc(lcd_transfer_buffer_size, MALLOC_CAP_DMA);
-    if (lcd_transfer_buffer1 == nullptr || lcd_transfer_buffer2 == nullptr) {
-        puts("Out of memory allocating transfer buffers");
-        while (1) vTaskDelay(5);
-    }
 #if defined(LCD_BL) && LCD_BL > 1
 #ifdef LCD_BL_LOW
     static constexpr const int bl_on = !(LCD_BL_LOW);
@@ -162,7 +418,15 @@ static void lcd_init() {
                                        esp_lcd_panel_io_event_data_t* edata,
                                        void* user_ctx) {
         lcd.flush_complete();
-        return true;
+        --lcd_in_flight;
+#ifdef FRAME_TRACE
+        frame_trace::record(frame_trace_event::transfer_done);
+#endif
+        // wake the UI in case it is waiting for a free buffer
+        const ui_event event = ui_event_flushed;
+        BaseType_t woken = pdFALSE;
+        xQueueSendFromISR(ui_events, &event, &woken);
+        return woken == pdTRUE;
     };
     // Attach the LCD to the SPI bus
     esp_lcd_new_panel_io_spi((esp_lcd_spi_bus_handle_t)LCD_PORT, &io_config,
@@ -243,24 +507,88 @@ static void lcd_init() {
 #endif
     lcd.buffer_size(lcd_transfer_buffer_size);
     lcd.buffer1(lcd_transfer_buffer1);
+#ifdef LCD_TWO_BUFFERS
     lcd.buffer2(lcd_transfer_buffer2);
+#endif
     lcd.on_flush_callback(
         [](const rect16& bounds, const void* bmp, void* state) {
             int x1 = bounds.x1, y1 = bounds.y1, x2 = bounds.x2 + 1,
                 y2 = bounds.y2 + 1;
+            if (touch_event_us != 0) {
+                touch_latency_us = (uint32_t)(esp_timer_get_time() - touch_event_us);
+                touch_event_us = 0;
+            }
+            ++lcd_flushes;
+            lcd_flush_bytes += (uint32_t)((x2 - x1) * (y2 - y1) * ((LCD_BIT_DEPTH + 7) / 8));
+            ++lcd_in_flight;
+#ifdef FRAME_TRACE
+            frame_trace::record(frame_trace_event::flush,
+                                (uint32_t)((x2 - x1) * (y2 - y1) * ((LCD_BIT_DEPTH + 7) / 8)));
+#endif
+#ifdef MIRROR_ENABLED
+            // a copy and a queued rectangle. the link is the mirror task's problem
+            mirror.capture(bounds.x1, bounds.y1, bounds.x2, bounds.y2, bmp);
+#endif
             esp_lcd_panel_draw_bitmap((esp_lcd_panel_handle_t)state, x1, y1, x2,
                                       y2, (void*)bmp);
         },
         lcd_handle);
     lcd.on_touch_callback(
         [](point16* out_locations, size_t* in_out_locations_size, void* state) {
+            *in_out_locations_size = 0;
+#ifdef TOUCH_INT
+            // nothing changed since the panel was last read with no finger down
+            if (!touch_pending && !touch_active) {
+                return;
+            }
+#endif
+            touch_pending = false;
             touch.update();
             // UIX supports multiple touch points.
             // so does the FT6336 so we potentially have
             // two values
-            *in_out_locations_size = 0;
             uint16_t x, y;
+#ifdef HISTORY_STRIP
+            if (touch.xy(&x, &y) && (y >= LCD_HEIGHT || history_touch_x > -1)) {
+                // the strip below the screen. the finger stays on it
+                // until it lifts, wherever it drags
+#ifdef HISTORY_SCRUB_PX
+                static constexpr const int scrub_px = HISTORY_SCRUB_PX;
+#else
+                static constexpr const int scrub_px = 24;
+#endif
+                if (history_touch_x < 0) {
+                    history_touch_x = history_step_x = x;
+                    history_scrubbed = false;
+                }
+                while (x >= history_step_x + scrub_px) {
+                    history_step_x += scrub_px;
+                    history_scrubbed = true;
+                    ++history_steps;
+                }
+                while (x + scrub_px <= history_step_x) {
+                    history_step_x -= scrub_px;
+                    history_scrubbed = true;
+                    --history_steps;
+                }
+                touch_active = true;
+                return;
+            }
+            if (history_touch_x > -1) {
+                // lifted. a tap steps once
+                if (!history_scrubbed) {
+                    if (history_touch_x < LCD_WIDTH / 3) {
+                        --history_steps;
+                    } else if (history_touch_x >= LCD_WIDTH - LCD_WIDTH / 3) {
+                        ++history_steps;
+                    }
+                }
+                history_touch_x = -1;
+            }
             if (touch.xy(&x, &y)) {
+#else
+            if (touch.xy(&x, &y)) {
+#endif
                 out_locations[0] = point16(x, y);
                 ++*in_out_locations_size;
                 if (touch.xy2(&x, &y)) {
@@ -268,6 +596,7 @@ static void lcd_init() {
                     ++*in_out_locations_size;
                 }
             }
+            touch_active = *in_out_locations_size > 0;
         });
     touch.initialize();
     touch.rotation(0);
@@ -314,221 +643,790 @@ static void spiffs_init() {
 
 static screen_t main_screen;
 
-template <typename ControlSurfaceType>
-class chess_board : public control<ControlSurfaceType> {
-    using base_type = control<ControlSurfaceType>;
-    chess_game_t game;
-    chess_value_t moves[64];
-    chess_value_t moves_size;
-    chess_value_t touched;
-    spoint16 last_touch;
-    
-    int move_count;
-    void init_board() {
-        chess_init(&game);
-        moves_size = 0;
-        touched = -1;
-    }
-
-    int point_to_square(spoint16 point) {
-        const int16_t extent = this->dimensions().aspect_ratio() >= 1 ? this->dimensions().height : this->dimensions().width;
-        const int x = point.x / (extent / 8);
-        const int y = point.y / (extent / 8);
-        return y * 8 + x;
-    }
-    void square_coords(int index, srect16* out_rect) {
-        const int16_t extent = this->dimensions().aspect_ratio() >= 1 ? this->dimensions().height : this->dimensions().width;
-        const ssize16 square_size(extent / 8, extent / 8);
-        const int x = index % 8;
-        const int y = index / 8;
-        const spoint16 origin(x * (extent / 8), y * (extent / 8));
-        *out_rect = srect16(origin, square_size);
-    }
-    static const const_bitmap<alpha_pixel<4>>& chess_icon(int id) {
-        const int type = CHESS_TYPE(id);
-        switch (type) {
-            case CHESS_PAWN:
-                return cb24_chess_pawn;
-            case CHESS_KNIGHT:
-                return cb24_chess_knight;
-            case CHESS_BISHOP:
-                return cb24_chess_bishop;
-            case CHESS_ROOK:
-                return cb24_chess_rook;
-            case CHESS_QUEEN:
-                return cb24_chess_queen;
-            case CHESS_KING:
-                return cb24_chess_king;
+#ifdef LCD_CALIBRATE
+// repaints the whole screen and waits for the last transfer
+static uint32_t lcd_repaint_us(size_t buffer_size) {
+    lcd.buffer_size(buffer_size);
+    main_screen.invalidate();
+    const uint64_t start = timing_us();
+    while (true) {
+        const uint32_t flushes = lcd_flushes;
+        lcd.update();
+        if (lcd_flushes == flushes) {
+            if (lcd_in_flight == 0) {
+                break;
+            }
+            taskYIELD();
+        }
+    }
+    return (uint32_t)(timing_us() - start);
+}
+static void lcd_calibrate() {
+    // smallest first, so more memory has to earn its keep
+    static const uint8_t divisors[] = {40, 30, 24, 20, 15, 12, 10, 8, 6, 5, 4, 3, 2, 1};
+    size_t best_size = lcd_transfer_buffer_size;
+    uint32_t best_us = UINT32_MAX;
+    for (const uint8_t divisor : divisors) {
+        const size_t size = (LCD_HEIGHT / divisor) * lcd_row_size;
+        if (size > lcd_transfer_buffer_size) {
+            continue;
+        }
+        // the best of two, so a stray interrupt doesn't decide it
+        uint32_t us = lcd_repaint_us(size);
+        const uint32_t again = lcd_repaint_us(size);
+        if (again < us) us = again;
+        printf("LCD divisor %u: %uus per full repaint\n", (unsigned)divisor, (unsigned)us);
+        // a bigger buffer has to be at least 5% faster
+        if (best_us == UINT32_MAX || us * 20 < best_us * 19) {
+            best_us = us;
+            best_size = size;
         }
-        assert(false);  // invalid piece
-        return cb24_chess_pawn;
     }
+    // give back what the winner doesn't use
+    if (best_size < lcd_transfer_buffer_size) {
+        lcd_transfer_buffer_size = best_size;
+        lcd_transfer_buffer1 = (uint8_t*)heap_caps_realloc(lcd_transfer_buffer1, best_size, MALLOC_CAP_DMA);
+        lcd.buffer1(lcd_transfer_buffer1);
+#ifdef LCD_TWO_BUFFERS
+        lcd_transfer_buffer2 = (uint8_t*)heap_caps_realloc(lcd_transfer_buffer2, best_size, MALLOC_CAP_DMA);
+        lcd.buffer2(lcd_transfer_buffer2);
+#endif
+    }
+    lcd.buffer_size(lcd_transfer_buffer_size);
+    printf("LCD calibrated: %u x %uKB (%u rows), %uus per full repaint\n",
+           (unsigned)lcd_buffer_count, (unsigned)(lcd_transfer_buffer_size / 1024),
+           (unsigned)(lcd_transfer_buffer_size / lcd_row_size), (unsigned)best_us);
+    // the transfers posted events nobody needs
+    xQueueReset(ui_events);
+}
+#endif
 
+// the board fills the screen's height, leaving a strip either side.
+// fixed at compile time so the square geometry is too
+static constexpr const int16_t board_extent = LCD_HEIGHT;
+#ifdef FRAME_TRACE
+// the board, with its paint routine traced
+class chess_board_t : public chess_board<surface_t, board_extent> {
    public:
-    using control_surface_type = ControlSurfaceType;
-    using pixel_type = typename ControlSurfaceType::pixel_type;
-    using palette_type = typename ControlSurfaceType::palette_type;
-    /// @brief Moves a chess_board control
-    /// @param rhs The control to move
-    chess_board(chess_board&& rhs) {
-        do_move_control(rhs);
-    }
-    /// @brief Moves a chess_board control
-    /// @param rhs The control to move
-    /// @return this
-    chess_board& operator=(chess_board&& rhs) {
-        do_move_control(rhs);
-        return *this;
-    }
-    /// @brief Copies a chess_board control
-    /// @param rhs The control to copy
-    chess_board(const chess_board& rhs) {
-        do_copy_control(rhs);
-    }
-    /// @brief Copies a chess_board control
-    /// @param rhs The control to copy
-    /// @return this
-    chess_board& operator=(const chess_board& rhs) {
-        do_copy_control(rhs);
-        return *this;
-    }
-    /// @brief Constructs a chess_board from a given parent with an optional palette
-    /// @param parent The parent the control is bound to - usually the screen
-    /// @param palette The palette associated with the control. This is usually the screen's palette.
-    chess_board(invalidation_tracker& parent, const palette_type* palette = nullptr) : base_type(parent, palette) {
-        init_board();
-    }
-    /// @brief Constructs a chess_board from a given parent with an optional palette
-    chess_board() : base_type() {
-        init_board();
-    }
+    using chess_board<surface_t, board_extent>::chess_board;
 
    protected:
-    void do_move_control(chess_board& rhs) {
-        do_copy_control(rhs);
+    void on_paint(surface_t& destination, const srect16& clip) override {
+        frame_trace::record(frame_trace_event::paint_begin);
+        chess_board<surface_t, board_extent>::on_paint(destination, clip);
+        frame_trace::record(frame_trace_event::paint_end);
+    }
+};
+#else
+using chess_board_t = chess_board<surface_t, board_extent>;
+#endif
+
+chess_board_t board;
+#ifdef STATUS_BAR
+static chess_status_bar<surface_t> status_bar;
+
+static void status_update() {
+    const chess_status_t status = board.status();
+    if (status != status_bar.status()) {
+        static const char* names[] = {"normal", "check", "checkmate", "stalemate"};
+        printf("status: %s\n", names[status]);
+    }
+    status_bar.status(status, board.current_position().turn());
+}
+#endif
+#ifdef EVAL_BAR
+static chess_eval_bar<surface_t> eval_bar;
+
+static void eval_update() {
+    // the board draws team 1 in white. the position keeps the score up to date,
+    // so this is only a read
+    eval_bar.score(board.current_position().score(1));
+}
+#endif
+
+#ifdef CLOCK_ENABLED
+static chess_clock game_clock;
+static chess_clock_face<surface_t> clock_faces[2];
+// fires when the running clock next shows a different time
+static esp_timer_handle_t clock_timer = nullptr;
+static uint64_t clock_due_us = 0;
+// the ply the clock last saw, to tell moves from moves taken back
+static size_t clock_ply = 0;
+
+static void clock_init() {
+#ifdef CLOCK_MINUTES
+    const uint32_t initial_ms = CLOCK_MINUTES * 60 * 1000;
+#else
+    const uint32_t initial_ms = 10 * 60 * 1000;
+#endif
+#ifdef CLOCK_BONUS_MS
+    const uint32_t bonus_ms = CLOCK_BONUS_MS;
+#else
+    const uint32_t bonus_ms = 0;
+#endif
+#ifdef CLOCK_DELAY
+    game_clock.reset(initial_ms, bonus_ms, chess_clock::bonus_delay);
+#else
+    game_clock.reset(initial_ms, bonus_ms, chess_clock::bonus_increment);
+#endif
+    clock_ply = board.ply();
+    esp_timer_create_args_t args;
+    memset(&args, 0, sizeof(args));
+    args.callback = [](void* arg) { ui_post(ui_event_clock); };
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "clock";
+    if (ESP_OK != esp_timer_create(&args, &clock_timer)) {
+        puts("Unable to create the clock timer");
+    }
+}
+static void clock_update() {
+    const uint64_t now = timing_us();
+    const size_t ply = board.ply();
+    if (board.game_over()) {
+        game_clock.stop(now);
+    } else if (ply != clock_ply) {
+        // the first move starts it. a move taken back earns no increment
+        game_clock.press(board.current_position().turn() & 1, now, ply > clock_ply);
+    }
+    clock_ply = ply;
+    const int running = game_clock.running();
+    if (game_clock.check_flag(now)) {
+        printf("clock: team %d is out of time\n", running);
     }
-    void do_copy_control(chess_board& rhs) {
-        memcpy(&game, &rhs.game, sizeof(game));
-        if (rhs.moves_size) {
-            memcpy(moves, rhs.moves, rhs.moves_size * sizeof(int));
+    for (int team = 0; team < 2; ++team) {
+        clock_faces[team].show(game_clock.display_seconds(team, now), game_clock.running() == team, game_clock.flagged(team));
+    }
+    if (clock_timer == nullptr) {
+        return;
+    }
+    // the time is worked out from timestamps, so the timer only says when to look.
+    // that moment only moves when the clock is pressed, stopped or has just changed
+    const uint64_t next = game_clock.next_change_us(now);
+    const uint64_t due = next ? now + next : 0;
+    if (due != clock_due_us) {
+        esp_timer_stop(clock_timer);
+        if (due != 0) {
+            esp_timer_start_once(clock_timer, next);
         }
-        moves_size = rhs.moves_size;
-        move_count = rhs.move_count;
-        last_touch = rhs.last_touch;
-    }
-    void on_paint(control_surface_type& destination, const srect16& clip) override {
-        const int16_t extent = destination.dimensions().aspect_ratio() >= 1 ? destination.dimensions().height : destination.dimensions().width;
-        const ssize16 square_size(extent / 8, extent / 8);
-        bool toggle = false;
-        int idx = 0;
-        for (int y = 0; y < extent; y += square_size.height) {
-            int i = toggle;
-            for (int x = 0; x < extent; x += square_size.width) {
-                const srect16 square(spoint16(x, y), square_size);
-                if (square.intersects(clip)) {
-                    const chess_value_t id = chess_index_to_id(&game,idx);
-                    pixel_type px_bg = (i & 1) ? color_t::brown : color_t::dark_khaki;
-                    pixel_type px_bd = (i & 1) ? color_t::gold : color_t::black;
-                    if (id > -1 && CHESS_TYPE(id) == CHESS_KING && chess_status(&game,CHESS_TEAM(id)) == CHESS_CHECK) {
-                        px_bd = color_t::red;
-                    }
-                    if (touched == idx || chess_contains_move(moves, moves_size, idx)) {
-                        px_bg = color_t::light_blue;
-                        px_bd = color_t::cornflower_blue;
-                    }
-                    draw::filled_rectangle(destination, square, px_bg);
-                    draw::rectangle(destination, square.inflate(-2, -2), px_bd);
-                    if (CHESS_NONE != id) {
-                        auto ico = chess_icon(id);
-                        const srect16 bounds = ((srect16)ico.bounds()).center(square_size.bounds()).offset(x, y);
-                        pixel_type px_piece = CHESS_TEAM(id) ? color_t::white : color_t::black;
-                        draw::icon(destination, bounds.location(), ico, px_piece);
-                    }
-                }
-                ++i;
-                ++idx;
-            }
-            toggle = !toggle;
+        clock_due_us = due;
+    }
+}
+#endif
+
+#ifdef ENGINE_ENABLED
+static chess_engine engine;
+static chess_tt engine_table;
+static bool engine_done = false;
+// the position the engine was given. a result for any other is stale
+static uint64_t engine_key = 0;
+#ifdef BOOK_ENABLED
+static chess_book book;
+#endif
+#ifdef TB_ENABLED
+static chess_block_cache tb_cache;
+static chess_tablebase tablebase;
+
+// the SD card shares the SPI bus with the LCD. let the transfers
+// in flight finish first so a block read doesn't hold up a frame
+static void tb_gate(void* state) {
+    for (int i = 0; i < 2 && lcd_in_flight > 0; ++i) {
+        vTaskDelay(1);
+    }
+}
+static void tb_init() {
+    if (!sd_init()) {
+        puts("No SD card");
+        return;
+    }
+#ifdef TB_CACHE_BLOCK_SIZE
+    const size_t block_size = TB_CACHE_BLOCK_SIZE;
+#else
+    const size_t block_size = 4096;
+#endif
+#ifdef TB_CACHE_BLOCKS
+    const size_t blocks = TB_CACHE_BLOCKS;
+#else
+    const size_t blocks = 256;
+#endif
+#ifdef TB_PATH
+    const char* path = TB_PATH;
+#else
+    const char* path = "/sdcard/syzygy";
+#endif
+    if (!tb_cache.allocate(block_size, blocks)) {
+        puts("Unable to allocate the tablebase cache");
+        return;
+    }
+    tb_cache.on_gate_callback(tb_gate);
+    const uint64_t start = timing_us();
+    if (tablebase.open(path, &tb_cache)) {
+        printf("Tablebases: %u tables, up to %d pieces, %uKB cache, found in %ums\n",
+               (unsigned)tablebase.size(), tablebase.max_pieces(),
+               (unsigned)(block_size * blocks / 1024),
+               (unsigned)((timing_us() - start) / 1000));
+        engine.tablebase(&tablebase);
+    } else {
+        printf("No tablebases in %s\n", path);
+        tb_cache.deallocate();
+    }
+}
+#endif
+
+#ifdef ENGINE_SCALING_DEPTH
+static void engine_scaling_task(void* arg) {
+    chess_search* searcher = new chess_search();
+    searcher->table(&engine_table);
+    searcher->threads(1, 1 - xPortGetCoreID(), 4);
+    chess_position position;
+    position.init();
+    chess_search_limits limits;
+    limits.depth = ENGINE_SCALING_DEPTH;
+    limits.time_ms = 0;
+    limits.nodes = 0;
+    chess_search::run_scaling(*searcher, &position, 1, limits, 2);
+    delete searcher;
+    engine_table.clear();
+    engine_table.reset_statistics();
+    xTaskNotifyGive((TaskHandle_t)arg);
+    vTaskDelete(nullptr);
+}
+static void engine_scaling_run() {
+    // the search recursion needs more stack than the main task has
+    if (pdPASS != xTaskCreatePinnedToCore(engine_scaling_task, "scaling", 16 * 1024,
+                                          xTaskGetCurrentTaskHandle(), 5, nullptr, 0)) {
+        puts("Unable to start the scaling run");
+        return;
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+#endif
+
+static chess_search_limits engine_limits() {
+    chess_search_limits limits;
+#ifdef ENGINE_DEPTH
+    limits.depth = ENGINE_DEPTH;
+#else
+    limits.depth = 0;
+#endif
+#ifdef ENGINE_TIME_MS
+    limits.time_ms = ENGINE_TIME_MS;
+#else
+    limits.time_ms = 0;
+#endif
+#ifdef ENGINE_NODES
+    limits.nodes = ENGINE_NODES;
+#else
+    limits.nodes = 0;
+#endif
+#ifdef CLOCK_ENABLED
+    // a share of what's left on the computer's clock
+    const uint32_t clock_ms = game_clock.budget_ms(board.computer_team(), timing_us());
+    if (clock_ms != 0) {
+        limits.time_ms = clock_ms;
+    }
+#endif
+    return limits;
+}
+#ifdef ENGINE_PONDER
+// the key of the position the engine is pondering
+static uint64_t ponder_key = 0;
+static uint64_t ponder_history[chess_engine::max_history + 1];
+
+static void engine_ponder(chess_value_t from, chess_value_t to) {
+    chess_position position = board.current_position();
+    if (position.move(from, to) == -2) {
+        return;
+    }
+    // the current position becomes history once the reply is played
+    size_t size = board.position_history_size();
+    const uint64_t* history = board.position_history();
+    if (size > chess_engine::max_history) {
+        history += size - chess_engine::max_history;
+        size = chess_engine::max_history;
+    }
+    memcpy(ponder_history, history, size * sizeof(uint64_t));
+    ponder_history[size++] = board.current_position().key();
+    if (engine.ponder(position, engine_limits(), ponder_history, size)) {
+        ponder_key = engine_key = position.key();
+    }
+}
+#endif
+
+#ifdef UCI_ENABLED
+#ifdef UCI_UART
+static constexpr const uart_port_t uci_port = UCI_UART;
+#else
+static constexpr const uart_port_t uci_port = UART_NUM_2;
+#endif
+static chess_uci uci(engine, &engine_table);
+
+static void uci_write(const char* data, size_t size, void* state) {
+    uart_write_bytes(uci_port, data, size);
+}
+static void uci_task(void* arg) {
+    static char buffer[256];
+    while (1) {
+        // the driver buffers input in its ring buffer. wake up for
+        // whatever has arrived, or every 10ms to collect the search
+        const int size = uart_read_bytes(uci_port, buffer, sizeof(buffer), pdMS_TO_TICKS(10));
+        if (size > 0) {
+            uci.feed(buffer, (size_t)size);
         }
+        uci.update();
+    }
+}
+static void uci_init(int core) {
+    uart_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.baud_rate = (int)serial_baud_rate;
+    config.data_bits = UART_DATA_8_BITS;
+    config.parity = UART_PARITY_DISABLE;
+    config.stop_bits = UART_STOP_BITS_1;
+    config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+    config.source_clk = UART_SCLK_DEFAULT;
+    if (ESP_OK != uart_driver_install(uci_port, 2048, 2048, 0, nullptr, 0) ||
+        ESP_OK != uart_param_config(uci_port, &config) ||
+        ESP_OK != uart_set_pin(uci_port, control_serial_pins.tx, control_serial_pins.rx,
+                               UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE)) {
+        puts("Unable to open the UCI port");
+        return;
     }
-    bool on_touch(size_t locations_size, const spoint16* locations) {
-        if (touched > -1) {
-            if (locations_size) last_touch = locations[0];
-            return true;
+    uci.on_write_callback(uci_write);
+    // below the UI
+    if (pdPASS != xTaskCreatePinnedToCore(uci_task, "uci", 4096, nullptr, 3, nullptr, core)) {
+        puts("Unable to start UCI");
+    }
+}
+#endif
+
+static void engine_update() {
+#ifdef UCI_ENABLED
+    if (uci.active()) {
+        // the GUI has the engine
+        return;
+    }
+#endif
+#ifdef LINK_ENABLED
+    if (game_link.connected()) {
+        // the other board plays its team
+        return;
+    }
+#endif
+    chess_search_result result;
+    if (engine.poll(&result)) {
+        if (board.current_position().key() != engine_key) {
+            // the moves were taken back or replayed while it searched
+            puts("engine: stale result");
+            return;
         }
-        if (locations_size) {
-            const int16_t extent = this->dimensions().aspect_ratio() >= 1 ? this->dimensions().height : this->dimensions().width;
-            const srect16 square(spoint16::zero(), ssize16(extent / 8, extent / 8));
-            int sq = point_to_square(*locations);
-            if (sq > -1) {
-                const chess_value_t id = chess_index_to_id(&game,sq);
-                if (id > -1) {
-                    const chess_value_t team = CHESS_TEAM(id);
-                    if (chess_turn(&game) == team) {
-                        touched = sq;
-                        moves_size = chess_compute_moves(&game,sq,moves);
-                        srect16 sq_bnds;
-                        square_coords(sq, &sq_bnds);
-                        this->invalidate(sq_bnds);
-                    }
-                }
-                if (moves_size > 0) {
-                    for (size_t i = 0; i < moves_size; ++i) {
-                        srect16 sq_bnds;
-                        square_coords(moves[i], &sq_bnds);
-                        this->invalidate(sq_bnds);
-                    }
-                    return true;
-                }
+        if (result.from < 0 || !board.make_move(result.from, result.to)) {
+            puts("engine: no move");
+            engine_done = true;
+            return;
+        }
+        printf("engine: depth %d, score %d, %u nodes in %ums (%u nps)\n",
+               result.depth, result.score, (unsigned)result.nodes,
+               (unsigned)result.elapsed_ms, (unsigned)result.nps());
+        const uint32_t first_cutoffs = result.first_move_cutoff_permille();
+        printf("ordering: %u.%u%% first move cutoffs, branching %u.%02u\n",
+               (unsigned)(first_cutoffs / 10), (unsigned)(first_cutoffs % 10),
+               (unsigned)(result.branching_x100 / 100), (unsigned)(result.branching_x100 % 100));
+        const uint32_t hit_rate = engine_table.hit_rate_permille();
+        printf("tt: %u probes, %u.%u%% hits, %u overwrites, %u collisions\n",
+               (unsigned)engine_table.probe_count(), (unsigned)(hit_rate / 10),
+               (unsigned)(hit_rate % 10), (unsigned)engine_table.overwrite_count(),
+               (unsigned)engine_table.collision_count());
+        engine_table.reset_statistics();
+#ifdef TB_ENABLED
+        if (result.tablebase_hits != 0) {
+            printf("tb: %u hits, cache %u hits, %u misses, %ums reading\n",
+                   (unsigned)result.tablebase_hits, (unsigned)tb_cache.hits(),
+                   (unsigned)tb_cache.misses(),
+                   (unsigned)(tb_cache.storage_us() / 1000));
+            tb_cache.reset_statistics();
+        }
+#endif
+#ifdef ENGINE_PONDER
+        if (result.ponder_from > -1) {
+            engine_ponder(result.ponder_from, result.ponder_to);
+        }
+    } else if (engine.pondering()) {
+        if (board.current_position().turn() == board.computer_team()) {
+            if (board.current_position().key() == ponder_key && engine.ponder_hit()) {
+                puts("engine: ponder hit");
+            } else {
+                // search again, from what the pondering left in the table
+                puts("engine: ponder miss");
+                engine.cancel();
             }
         }
-        return false;
+#endif
+    } else if (!engine_done && !engine.thinking() && !board.game_over() &&
+               board.current_position().turn() == board.computer_team()) {
+#ifdef BOOK_ENABLED
+        chess_value_t from, to;
+        const uint64_t book_start = timing_us();
+        if (book.pick(board.current_position(), esp_random(), &from, &to)) {
+            const uint32_t book_us = (uint32_t)(timing_us() - book_start);
+            if (board.make_move(from, to)) {
+                printf("book: move found in %uus\n", (unsigned)book_us);
+                return;
+            }
+        }
+#endif
+        engine_key = board.current_position().key();
+        engine.think(board.current_position(), engine_limits(),
+                     board.position_history(), board.position_history_size());
     }
-    void on_release() override {
-        if (touched > -1) {
-            const signed char id = chess_index_to_id(&game,touched);
-            const bool is_king = (CHESS_TYPE(id) == CHESS_KING);
-            const chess_value_t team = CHESS_TEAM(id);
-            const int16_t extent = this->dimensions().aspect_ratio() >= 1 ? this->dimensions().height : this->dimensions().width;
-            const srect16 square(spoint16::zero(), ssize16(extent / 8, extent / 8));
-            const int x = touched % 8 * (extent / 8), y = touched / 8 * (extent / 8);
-            this->invalidate(square.offset(x, y));
-            if (moves_size > 0) {
-                for (size_t i = 0; i < moves_size; ++i) {
-                    srect16 sq_bnds;
-                    square_coords(moves[i], &sq_bnds);
-                    this->invalidate(sq_bnds);
-                }
-                const int release_idx = point_to_square(last_touch);
-                if (release_idx != -1) {
-                    chess_value_t mv = chess_move(&game,touched,release_idx);
-                    if(mv!=-2) {
-                        char buf[3];
-                        chess_index_name(touched,buf);
-                        fputs("move: ",stdout);
-                        fputs(buf,stdout);
-                        fputs(" to ",stdout);
-                        chess_index_name(release_idx,buf);
-                        puts(buf);
-                        srect16 sq_bnds;
-                        square_coords(release_idx, &sq_bnds);
-                        this->invalidate(sq_bnds);
-                        if(mv!=-1 && mv!=release_idx) { // en passant
-                            square_coords(mv,&sq_bnds);
-                            this->invalidate(sq_bnds);
-                        }
-                    }
+}
+#endif
+
+#ifdef JOURNAL_ENABLED
+static chess_journal journal;
+
+static void journal_init() {
+#ifdef JOURNAL_SNAPSHOT_PLIES
+    journal.open("/spiffs", JOURNAL_SNAPSHOT_PLIES);
+#else
+    journal.open("/spiffs");
+#endif
+    // too big for the stack
+    static chess_position position;
+    static chess_history history;
+    chess_journal::resume_result result;
+    const uint64_t start = timing_us();
+    uint64_t destinations[64];
+    if (journal.resume(&position, &history, &result) && result.plies > 0 &&
+        position.legal_moves(destinations) != 0) {
+        board.restore(position, history);
+        printf("journal: resumed game %u at ply %u, replayed %u moves in %uus\n",
+               (unsigned)result.game, (unsigned)result.plies,
+               (unsigned)result.replayed, (unsigned)(timing_us() - start));
+    } else {
+        // nothing to resume, or the game was over
+        journal.new_game();
+    }
+#ifdef JOURNAL_SYNC_MS
+    const uint32_t sync_ms = JOURNAL_SYNC_MS;
+#else
+    const uint32_t sync_ms = 1000;
+#endif
+    // below the UI and the engine
+    if (!journal.start(sync_ms, 2)) {
+        puts("Unable to start the journal");
+    }
+}
+#endif
+
+#ifdef MIRROR_ENABLED
+#ifdef MIRROR_UART
+static constexpr const uart_port_t mirror_port = MIRROR_UART;
+#else
+static constexpr const uart_port_t mirror_port = UART_NUM_0;
+#endif
+// the driver's ring buffer, and what's kept free in it for the log
+static constexpr const size_t mirror_tx_buffer = 8 * 1024;
+static constexpr const size_t mirror_headroom = 1024;
+// the ply and traffic at the last move, for the cost of each.
+// the first update only takes note, once the journal has resumed the game
+static size_t mirror_ply = SIZE_MAX;
+static chess_mirror::statistics mirror_traffic;
+
+static void mirror_write(const uint8_t* data, size_t size, void* state) {
+    // only copy a frame into the driver's ring once it all fits with room to
+    // spare, so a log line never waits behind it or lands in the middle of it
+    while (uart_get_tx_buffer_free_size(mirror_port) < size + mirror_headroom) {
+        vTaskDelay(1);
+    }
+    uart_write_bytes(mirror_port, (const char*)data, size);
+}
+static void mirror_init() {
+    if (!mirror.allocate(LCD_WIDTH, LCD_HEIGHT)) {
+        puts("Unable to allocate the mirror");
+        return;
+    }
+    if (!uart_is_driver_installed(mirror_port)) {
+        uart_config_t config;
+        memset(&config, 0, sizeof(config));
+        config.baud_rate = (int)serial_baud_rate;
+        config.data_bits = UART_DATA_8_BITS;
+        config.parity = UART_PARITY_DISABLE;
+        config.stop_bits = UART_STOP_BITS_1;
+        config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+        config.source_clk = UART_SCLK_DEFAULT;
+        if (ESP_OK != uart_driver_install(mirror_port, 256, mirror_tx_buffer, 0, nullptr, 0) ||
+            ESP_OK != uart_param_config(mirror_port, &config)) {
+            puts("Unable to open the mirror port");
+            mirror.deallocate();
+            return;
+        }
+    }
+#ifdef MIRROR_BAUD
+    uart_set_baudrate(mirror_port, MIRROR_BAUD);
+#endif
+    if (mirror_port == CONFIG_ESP_CONSOLE_UART_NUM) {
+        // the log goes through the driver too, so the two take turns whole
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+        uart_vfs_dev_use_driver(mirror_port);
+#else
+        esp_vfs_dev_uart_use_driver(mirror_port);
+#endif
+    }
+    mirror.on_write_callback(mirror_write);
+#ifdef MIRROR_REFRESH_MS
+    static constexpr const uint32_t refresh_ms = MIRROR_REFRESH_MS;
+#else
+    static constexpr const uint32_t refresh_ms = 0;
+#endif
+    // below everything else, so it only takes what's left
+    if (!mirror.start(1, refresh_ms)) {
+        puts("Unable to start the mirror");
+    }
+}
+static void mirror_update() {
+    const size_t ply = board.ply();
+    if (ply == mirror_ply) {
+        return;
+    }
+    if (mirror_ply == SIZE_MAX) {
+        mirror_ply = ply;
+        mirror_traffic = mirror.traffic();
+        return;
+    }
+    mirror_ply = ply;
+    mirror.move((uint32_t)ply);
+    // what the last move cost, including whatever the clock drew meanwhile
+    const chess_mirror::statistics traffic = mirror.traffic();
+    const uint32_t sent = traffic.bytes - mirror_traffic.bytes;
+    const uint32_t flushed = traffic.flush_bytes - mirror_traffic.flush_bytes;
+    const uint32_t ratio_x10 = sent ? (uint32_t)((uint64_t)flushed * 10 / sent) : 0;
+    printf("mirror: %u bytes sent for %u flushed (%u.%u:1), %u frames\n", (unsigned)sent, (unsigned)flushed,
+           (unsigned)(ratio_x10 / 10), (unsigned)(ratio_x10 % 10), (unsigned)(traffic.frames - mirror_traffic.frames));
+    mirror_traffic = traffic;
+}
+#endif
+
+#ifdef LINK_ENABLED
+#ifdef LINK_UART
+static constexpr const uart_port_t link_port = LINK_UART;
+#else
+static constexpr const uart_port_t link_port = UART_NUM_1;
+#endif
+static QueueHandle_t link_uart_events = nullptr;
+// set while the peer's move is made on the board, so it isn't sent back
+static bool link_applying = false;
+// the flushes when the peer's move was made, to tell when it has shown
+static bool link_paint_pending = false;
+static uint32_t link_paint_flushes = 0;
+
+static void link_write(const uint8_t* data, size_t size, void* state) {
+    uart_write_bytes(link_port, (const char*)data, size);
+}
+static void link_task(void* arg) {
+    while (1) {
+        // wake the UI when data arrives, and often enough for the resends
+        uart_event_t event;
+        xQueueReceive(link_uart_events, &event, pdMS_TO_TICKS(100));
+        ui_post(ui_event_link);
+    }
+}
+static void link_init() {
+    uart_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.baud_rate = (int)serial_baud_rate;
+    config.data_bits = UART_DATA_8_BITS;
+    config.parity = UART_PARITY_DISABLE;
+    config.stop_bits = UART_STOP_BITS_1;
+    config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+    config.source_clk = UART_SCLK_DEFAULT;
+    // room for a whole game's resync each way
+    if (ESP_OK != uart_driver_install(link_port, 2048, 2048, 16, &link_uart_events, 0) ||
+        ESP_OK != uart_param_config(link_port, &config) ||
+        ESP_OK != uart_set_pin(link_port, slave_serial_pins.tx, slave_serial_pins.rx,
+                               UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE)) {
+        puts("Unable to open the link port");
+        return;
+    }
+    // the MAC address tells the boards apart, and decides who moves first
+    uint8_t mac[6];
+    esp_efuse_mac_get_default(mac);
+    const uint32_t id = ((uint32_t)mac[2] << 24) | ((uint32_t)mac[3] << 16) | ((uint32_t)mac[4] << 8) | mac[5];
+#ifdef JOURNAL_ENABLED
+    const uint16_t plies = (uint16_t)journal.game_plies();
+#else
+    const uint16_t plies = 0;
+#endif
+    game_link.on_write_callback(link_write);
+    game_link.begin(id, board.current_position(), board.game_history(), plies);
+    // below the UI
+    if (pdPASS != xTaskCreate(link_task, "link", 2048, nullptr, 3, nullptr)) {
+        puts("Unable to start the link");
+    }
+}
+// records a move made on the board, sending it if it was this side's
+static void link_moved(chess_value_t from, chess_value_t to) {
+    if (link_applying) {
+        return;
+    }
+    if (!game_link.move(from, to, timing_us())) {
+        // the link's copy went astray, so this board's game is the one
+        game_link.reset(board.current_position(), board.game_history(), (uint16_t)(game_link.ply() + 1));
+    }
+}
+static void link_update() {
+    uint8_t buffer[256];
+    size_t available = 0;
+    while (ESP_OK == uart_get_buffered_data_len(link_port, &available) && available > 0) {
+        const int size = uart_read_bytes(link_port, buffer, available < sizeof(buffer) ? available : sizeof(buffer), 0);
+        if (size <= 0) {
+            break;
+        }
+        game_link.feed(buffer, (size_t)size, timing_us());
+    }
+    game_link.update(timing_us());
+    chess_link::event event;
+    while (game_link.poll(&event)) {
+        switch (event.type) {
+            case chess_link::event_connected:
+                printf("link: connected at ply %u, playing team %d\n", (unsigned)event.ply, (int)game_link.local_team());
+                // the other board plays the computer's part
+                board.computer_team(!game_link.local_team());
+#ifdef ENGINE_ENABLED
+#ifdef UCI_ENABLED
+                if (!uci.active())
+#endif
+                    engine.cancel();
+                engine_done = false;
+#endif
+                break;
+            case chess_link::event_disconnected:
+                printf("link: disconnected at ply %u\n", (unsigned)event.ply);
+#ifdef ENGINE_ENABLED
+                // the computer takes over the other board's team
+                engine_done = false;
+#else
+                board.computer_team(-1);
+#endif
+                break;
+            case chess_link::event_move:
+                link_applying = true;
+                if (board.make_move(event.from, event.to)) {
+                    link_paint_pending = true;
+                    link_paint_flushes = lcd_flushes;
+                } else {
+                    // the link's copy is ahead of the board, so send the board's
+                    game_link.reset(board.current_position(), board.game_history(), (uint16_t)(event.ply - 1));
                 }
-                moves_size = 0;
-            }
+                link_applying = false;
+                break;
+            case chess_link::event_synced:
+                printf("link: took the other board's game at ply %u\n", (unsigned)event.ply);
+                board.restore(game_link.current_position(), game_link.game_history());
+                link_paint_pending = false;
+#ifdef JOURNAL_ENABLED
+                journal.rewrite(game_link.current_position(), game_link.game_history(), event.ply);
+#endif
+                break;
+            case chess_link::event_latency:
+                printf("link: ply %u shown on the other board in %uus (%uus each way, %uus painting)\n",
+                       (unsigned)event.ply, (unsigned)event.total_us, (unsigned)event.wire_us, (unsigned)event.paint_us);
+                break;
         }
-        touched = -1;
     }
-};
+    // shown once the animation has finished and its last frame is out
+    if (link_paint_pending && !board.animating() && lcd_flushes != link_paint_flushes && lcd_in_flight == 0) {
+        link_paint_pending = false;
+        game_link.painted(timing_us());
+    }
+}
+#endif
 
-using chess_board_t = chess_board<surface_t>;
+#if defined(JOURNAL_ENABLED) || defined(LINK_ENABLED)
+// after each move on the board, from touch, the computer or the other board
+static void board_moved(chess_value_t from, chess_value_t to, void* state) {
+#ifdef JOURNAL_ENABLED
+    journal.append(from, to, board.current_position(), board.game_history());
+#endif
+#ifdef LINK_ENABLED
+    link_moved(from, to);
+#endif
+}
+#endif
 
-chess_board_t board;
+#ifdef HISTORY_STRIP
+static void history_update() {
+    if (history_steps == 0) {
+        return;
+    }
+    const int steps = history_steps;
+    history_steps = 0;
+    const size_t ply = board.ply();
+#ifdef ENGINE_ENABLED
+    // whatever it's searching no longer applies
+#ifdef UCI_ENABLED
+    if (!uci.active())
+#endif
+        engine.cancel();
+    engine_done = false;
+#endif
+    for (int i = 0; i < steps; ++i) {
+        if (!board.redo()) {
+            break;
+        }
+#ifdef ENGINE_ENABLED
+        // replay the computer's reply along with the move
+        if (board.current_position().turn() == board.computer_team() && board.redo_count() > 0) {
+            board.redo();
+        }
+#endif
+    }
+    for (int i = 0; i > steps; --i) {
+        if (!board.undo()) {
+            break;
+        }
+#ifdef ENGINE_ENABLED
+        // back to the player's move
+        if (board.current_position().turn() == board.computer_team() && board.ply() > 0) {
+            board.undo();
+        }
+#endif
+    }
+    if (board.ply() == ply) {
+        return;
+    }
+    printf("history: ply %u of %u\n", (unsigned)board.ply(), (unsigned)(board.ply() + board.redo_count()));
+#ifdef JOURNAL_ENABLED
+    journal.rewrite(board.current_position(), board.game_history(),
+                    (uint32_t)(journal.game_plies() + board.ply() - ply));
+#endif
+#ifdef LINK_ENABLED
+    // the other board takes back the same moves
+    game_link.reset(board.current_position(), board.game_history(),
+                    (uint16_t)(game_link.ply() + board.ply() - ply));
+#endif
+}
+#endif
+
+#ifdef PERFT_DEPTH
+static void perft_task(void* arg) {
+#ifdef PERFT_LIBRARY_DEPTH
+    chess_perft::run_suite(PERFT_DEPTH, PERFT_LIBRARY_DEPTH);
+#else
+    chess_perft::run_suite(PERFT_DEPTH, 0);
+#endif
+    xTaskNotifyGive((TaskHandle_t)arg);
+    vTaskDelete(nullptr);
+}
+static void perft_run() {
+    // the move tree recursion needs more stack than the main task has
+    if (pdPASS != xTaskCreate(perft_task, "perft", 16 * 1024,
+                              xTaskGetCurrentTaskHandle(), 5, nullptr)) {
+        puts("Unable to start perft");
+        return;
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+#endif
 
 #ifdef ARDUINO
 void setup() {
@@ -537,39 +1435,261 @@ void setup() {
            ESP_ARDUINO_VERSION_MINOR, ESP_ARDUINO_VERSION_PATCH);
     printf("ESP-IDF version: %d.%d.%d\n", ESP_IDF_VERSION_MAJOR,
            ESP_IDF_VERSION_MINOR, ESP_IDF_VERSION_PATCH);
+    // setup() runs on the same core as loop()
+    const int ui_core = xPortGetCoreID();
 #else
 void loop();
 static void loop_task(void* arg) {
-    uint32_t ts = pdTICKS_TO_MS(xTaskGetTickCount());
+    // loop() blocks until there is something to do
     while (1) {
         loop();
-        uint32_t ms = pdTICKS_TO_MS(xTaskGetTickCount());
-        if (ms > ts + 200) {
-            ms = pdTICKS_TO_MS(xTaskGetTickCount());
-            vTaskDelay(5);
-        }
     }
 }
 extern "C" void app_main() {
     printf("ESP-IDF version: %d.%d.%d\n", ESP_IDF_VERSION_MAJOR,
            ESP_IDF_VERSION_MINOR, ESP_IDF_VERSION_PATCH);
+    // the UI gets one core, the engine the other
+    const int ui_core = 1;
 #endif
     power_init();  // do this first
+    ui_events = xQueueCreate(16, sizeof(ui_event));
+#ifdef FRAME_TRACE
+    if (!frame_trace::begin()) {
+        puts("Unable to start the frame trace");
+    }
+#endif
+#ifdef PERFT_DEPTH
+    perft_run();
+#endif
+    lcd_buffers_init();  // before spi_init() which needs their size
     spi_init();    // used by the LCD and SD reader
     // initialize the display
     lcd_init();
     spiffs_init();
+#ifdef MIRROR_ENABLED
+    // before anything is drawn, so the first whole screen has it all
+    mirror_init();
+#endif
     main_screen.dimensions({LCD_WIDTH, LCD_HEIGHT});
     main_screen.background_color(color_t::black);
-    board.bounds(srect16(0, 0, 239, 239).center(main_screen.bounds()));
+    board.bounds(srect16(0, 0, board_extent - 1, board_extent - 1).center(main_screen.bounds()));
+#ifdef UI_ANIMATION_MS
+    board.animation_ms(UI_ANIMATION_MS);
+#endif
     main_screen.register_control(board);
+#ifdef STATUS_BAR
+    status_bar.bounds(srect16(0, 0, board.bounds().x1 - 1, board.bounds().x1 - 1));
+    main_screen.register_control(status_bar);
+#endif
+#ifdef EVAL_BAR
+    // a narrow bar centered in the strip, clear of the board
+    eval_bar.bounds(srect16(board.bounds().x2 + 13, 8, LCD_WIDTH - 14, LCD_HEIGHT - 9));
+    main_screen.register_control(eval_bar);
+#endif
+#ifdef CLOCK_ENABLED
+    {
+        // each team's clock on its own side of the board, below the status bar.
+        // a team whose pawns advance up the square indices starts at the top
+        const int top = chess_bitboard::pawn_push(0) > 0 ? 0 : 1;
+        const int16_t right = board.bounds().x1 - 1;
+        clock_faces[top].bounds(srect16(0, 48, right, 103));
+        clock_faces[!top].bounds(srect16(0, LCD_HEIGHT - 56, right, LCD_HEIGHT - 1));
+        main_screen.register_control(clock_faces[0]);
+        main_screen.register_control(clock_faces[1]);
+    }
+#endif
     // set the display to our main screen
     lcd.active_screen(main_screen);
+#ifdef LCD_CALIBRATE
+    lcd_calibrate();
+#endif
+#ifdef TOUCH_INT
+    touch_int_init();
+#endif
+#ifdef ENGINE_ENABLED
+    engine.on_result_callback([](void* state) { ui_post(ui_event_engine); });
+    board.computer_team(!board.current_position().turn());
+#ifdef ENGINE_TT_SIZE
+    if (engine_table.allocate(ENGINE_TT_SIZE)) {
+        printf("Transposition table: %uKB in %s\n",
+               (unsigned)(engine_table.size() / 1024),
+               engine_table.in_psram() ? "PSRAM" : "internal RAM");
+        engine.table(&engine_table);
+    } else {
+        puts("Unable to allocate the transposition table");
+    }
+#endif
+#ifdef BOOK_ENABLED
+#ifdef BOOK_PARTITION
+    const char* book_partition = BOOK_PARTITION;
+#else
+    const char* book_partition = "book";
+#endif
+    if (book.open(book_partition)) {
+        printf("Opening book: %u entries\n", (unsigned)book.size());
+    } else {
+        puts("No opening book");
+    }
+#endif
+#ifdef TB_ENABLED
+    tb_init();
+#endif
+#ifdef ENGINE_SCALING_DEPTH
+    engine_scaling_run();
+#endif
+#ifdef ENGINE_THREADS
+    // below the engine so a helper never holds up the UI's core
+    if (!engine.threads(ENGINE_THREADS, ui_core, 4)) {
+        puts("Unable to allocate the search threads");
+    }
+#endif
+    if (!engine.start(1 - ui_core, 5)) {
+        puts("Unable to start the engine");
+    }
+#ifdef UCI_ENABLED
+    uci_init(ui_core);
+#endif
+#endif
+#ifdef JOURNAL_ENABLED
+    // after the computer's team is chosen from the initial position
+    journal_init();
+#endif
+#ifdef LINK_ENABLED
+    // after the journal has resumed the game, so the other board can compare
+    link_init();
+#endif
+#if defined(JOURNAL_ENABLED) || defined(LINK_ENABLED)
+    board.on_move_callback(board_moved);
+#endif
+#ifdef CLOCK_ENABLED
+    // after the journal has resumed the game
+    clock_init();
+#endif
 #ifndef ARDUINO
     TaskHandle_t loop_handle;
-    xTaskCreate(loop_task, "loop_task", 4096, nullptr, 10, &loop_handle);
+    xTaskCreatePinnedToCore(loop_task, "loop_task", 4096, nullptr, 10,
+                            &loop_handle, ui_core);
 #endif
 }
 void loop() {
+    const uint32_t flushes = lcd_flushes;
+    // a move invalidates the board, and whatever shows its status, after the screen may have been drawn
+    const uint64_t key = board.current_position().key();
+#ifdef UI_REPORT_ANIMATION
+    const uint32_t flush_bytes = lcd_flush_bytes;
+#endif
+    // time based, so a slow frame moves the piece further rather than slowing it down
+    board.animate();
+#ifdef FRAME_TRACE
+    frame_trace::record(frame_trace_event::update_begin);
+    lcd.update();
+    frame_trace::record(frame_trace_event::update_end);
+#else
     lcd.update();
+#endif
+#ifdef HISTORY_STRIP
+    history_update();
+#endif
+#ifdef LINK_ENABLED
+    link_update();
+#endif
+#ifdef ENGINE_ENABLED
+    engine_update();
+#endif
+#ifdef STATUS_BAR
+    status_update();
+#endif
+#ifdef EVAL_BAR
+    eval_update();
+#endif
+#ifdef CLOCK_ENABLED
+    clock_update();
+#endif
+#ifdef MIRROR_ENABLED
+    mirror_update();
+#endif
+#ifdef UI_REPORT_ANIMATION
+    if (ui_animating) {
+        if (lcd_flushes != flushes) {
+            ++animation_frames;
+            animation_bytes += lcd_flush_bytes - flush_bytes;
+        }
+        if (!board.animating()) {
+            const uint32_t ms = timing_ms() - animation_start_ms;
+            printf("animation: %u frames in %ums (%u fps), %u bytes per frame\n",
+                   (unsigned)animation_frames, (unsigned)ms,
+                   (unsigned)(ms ? animation_frames * 1000 / ms : 0),
+                   (unsigned)(animation_frames ? animation_bytes / animation_frames : 0));
+        }
+    } else if (board.animating()) {
+        animation_frames = 0;
+        animation_bytes = 0;
+        animation_start_ms = timing_ms();
+    }
+#endif
+    ui_animating = board.animating();
+#ifdef UI_REPORT_LATENCY
+    if (touch_latency_us != 0) {
+        printf("touch: %uus to first flush\n", (unsigned)touch_latency_us);
+        touch_latency_us = 0;
+    }
+#endif
+    TickType_t wait = portMAX_DELAY;
+#ifdef FRAME_TRACE
+#ifdef FRAME_TRACE_INTERVAL_MS
+    static constexpr const uint32_t trace_interval = FRAME_TRACE_INTERVAL_MS;
+#else
+    static constexpr const uint32_t trace_interval = 5000;
+#endif
+    static uint32_t trace_ts = 0;
+    const uint32_t trace_ms = timing_ms();
+    if (trace_ms - trace_ts >= trace_interval) {
+        trace_ts = trace_ms;
+        frame_trace::report();
+    }
+    // wake up to report even when idle
+    wait = pdMS_TO_TICKS(trace_interval);
+#endif
+    if (lcd_flushes != flushes || board.current_position().key() != key) {
+        // there may be more to draw
+        wait = 0;
+    } else if (lcd_in_flight == 0) {
+        // settled. a touch that didn't draw anything has no latency to report
+        touch_event_us = 0;
+    }
+    // otherwise the transfer done interrupt wakes us
+#ifdef TOUCH_POLL_MS
+    static constexpr const TickType_t touch_poll = pdMS_TO_TICKS(TOUCH_POLL_MS);
+#else
+    static constexpr const TickType_t touch_poll = pdMS_TO_TICKS(10);
+#endif
+#ifdef TOUCH_INT
+    // follow the finger until it lifts
+    if (touch_active && wait > touch_poll) {
+        wait = touch_poll;
+    }
+#else
+    if (wait > touch_poll) {
+        wait = touch_poll;
+    }
+#endif
+    if (ui_animating) {
+#ifdef UI_FRAME_MS
+        static constexpr const TickType_t frame_period = pdMS_TO_TICKS(UI_FRAME_MS);
+#else
+        static constexpr const TickType_t frame_period = pdMS_TO_TICKS(16);
+#endif
+        static TickType_t next_frame = 0;
+        const TickType_t now = xTaskGetTickCount();
+        if ((int32_t)(next_frame - now) <= 0 || (int32_t)(next_frame - now) > (int32_t)frame_period) {
+            next_frame = now + frame_period;
+        }
+        if (wait > next_frame - now) {
+            wait = next_frame - now;
+        }
+    }
+    if (wait != 0) {
+        ui_event event;
+        xQueueReceive(ui_events, &event, wait);
+    }
 }